@@ -44,6 +44,7 @@
 #include <glib/gi18n.h>
 
 #include "plugin.h"
+#include "../proctop.h"
 
 #define BORDER_SIZE 2
 
@@ -75,6 +76,9 @@ typedef struct {
     guint pixmap_height;			/* Height of drawing area pixmap; does not include border size */
     struct cpu_stat previous_cpu_stat;		/* Previous value of cpu_stat */
     gboolean show_percentage;				/* Display usage as a percentage */
+    gboolean show_top;				/* Display top processes in tooltip */
+    ProcTop * top;				/* Top processes scanner, NULL if disabled */
+    LXPanel * panel;
     config_setting_t *settings;
 } CPUPlugin;
 
@@ -171,11 +175,64 @@ static void redraw_pixmap(CPUPlugin * c)
     g_object_unref (pixbuf);
 }
 
+/* Update tooltip with the latest sample and top processes if enabled. */
+static void cpu_tooltip_update(CPUPlugin * c)
+{
+    char * text, * top;
+    float val;
+
+    if (c->stats_cpu == NULL)
+        return;
+    val = 100 * c->stats_cpu[c->ring_cursor ? c->ring_cursor - 1 : c->pixmap_width - 1];
+    top = c->top ? proc_top_format(c->top, PROC_TOP_BY_CPU) : NULL;
+    if (top != NULL)
+        text = g_strdup_printf(_("CPU usage: %.2f%%\n%s"), val, top);
+    else
+        text = g_strdup_printf(_("CPU usage: %.2f%%"), val);
+    gtk_widget_set_tooltip_text(c->da, text);
+    g_free(text);
+    g_free(top);
+}
+
+/* Callback when new list of top processes is ready. */
+static void cpu_top_ready(ProcTop * pt, gpointer user_data)
+{
+    cpu_tooltip_update(user_data);
+}
+
+/* Handler for query-tooltip on drawing area.
+ * Top processes are scanned only while the tooltip is shown; it is queried
+ * again each time its text is updated. */
+static gboolean cpu_query_tooltip(GtkWidget * widget, gint x, gint y, gboolean keyboard_mode,
+                                  GtkTooltip * tooltip, CPUPlugin * c)
+{
+    if (c->top != NULL)
+        proc_top_touch(c->top);
+    return FALSE;
+}
+
+static void cpu_set_show_top(CPUPlugin * c)
+{
+    if (c->show_top && c->top == NULL)
+        c->top = proc_top_new(5, cpu_top_ready, c);
+    else if (!c->show_top && c->top != NULL)
+    {
+        proc_top_free(c->top);
+        c->top = NULL;
+    }
+}
+
 /* Periodic timer callback. */
 static gboolean cpu_update(CPUPlugin * c)
 {
     if (g_source_is_destroyed(g_main_current_source()))
         return FALSE;
+    /* nobody sees the panel, restarted when it is unparked */
+    if (panel_is_parked(c->panel))
+    {
+        c->timer = 0;
+        return FALSE;
+    }
     if ((c->stats_cpu != NULL) && (c->pixmap != NULL))
     {
         /* Open statistics file and scan out CPU usage. */
@@ -209,11 +266,18 @@ static gboolean cpu_update(CPUPlugin * c)
 
             /* Redraw with the new sample. */
             redraw_pixmap(c);
+            cpu_tooltip_update(c);
         }
     }
     return TRUE;
 }
 
+static void cpu_panel_parked_changed(LXPanel * panel, CPUPlugin * c)
+{
+    if (!panel_is_parked(panel) && c->timer == 0)
+        c->timer = g_timeout_add(1500, (GSourceFunc) cpu_update, (gpointer) c);
+}
+
 /* Handler for configure_event on drawing area. */
 static void cpu_configuration_changed (LXPanel *panel, GtkWidget *p)
 {
@@ -316,8 +380,12 @@ static GtkWidget *cpu_constructor(LXPanel *panel, config_setting_t *settings)
     const char *str;
 
 	c->settings = settings;
+    c->panel = panel;
     if (config_setting_lookup_int(settings, "ShowPercent", &tmp_int))
         c->show_percentage = tmp_int != 0;
+    c->show_top = TRUE;
+    if (config_setting_lookup_int(settings, "ShowTopProcesses", &tmp_int))
+        c->show_top = tmp_int != 0;
 
 #if GTK_CHECK_VERSION(3, 0, 0)
     if (config_setting_lookup_string(settings, "Foreground", &str))
@@ -362,11 +430,14 @@ static GtkWidget *cpu_constructor(LXPanel *panel, config_setting_t *settings)
 #else
     g_signal_connect(G_OBJECT(c->da), "draw", G_CALLBACK(draw), (gpointer) c);
 #endif
+    g_signal_connect(G_OBJECT(c->da), "query-tooltip", G_CALLBACK(cpu_query_tooltip), (gpointer) c);
+    cpu_set_show_top(c);
 
     /* Show the widget.  Connect a timer to refresh the statistics. */
     gtk_widget_show(c->da);
     cpu_configuration_changed (panel,p);
     c->timer = g_timeout_add(1500, (GSourceFunc) cpu_update, (gpointer) c);
+    g_signal_connect(panel, "parked-changed", G_CALLBACK(cpu_panel_parked_changed), c);
     return p;
 }
 
@@ -376,9 +447,13 @@ static void cpu_destructor(gpointer user_data)
     CPUPlugin * c = (CPUPlugin *)user_data;
 
     /* Disconnect the timer. */
-    g_source_remove(c->timer);
+    g_signal_handlers_disconnect_by_func(c->panel, cpu_panel_parked_changed, c);
+    if (c->timer != 0)
+        g_source_remove(c->timer);
 
     /* Deallocate memory. */
+    if (c->top != NULL)
+        proc_top_free(c->top);
     cairo_surface_destroy(c->pixmap);
     g_free(c->stats_cpu);
     g_free(c);
@@ -390,6 +465,8 @@ static gboolean cpu_apply_configuration (gpointer user_data)
     GtkWidget * p = user_data;
     CPUPlugin * c = lxpanel_plugin_get_data(p);
     config_group_set_int (c->settings, "ShowPercent", c->show_percentage);
+    config_group_set_int (c->settings, "ShowTopProcesses", c->show_top);
+    cpu_set_show_top(c);
 #if GTK_CHECK_VERSION(3, 0, 0)
     sprintf (colbuf, "%s", gdk_rgba_to_string (&c->foreground_color));
 #else
@@ -412,6 +489,7 @@ static GtkWidget *cpu_configure(LXPanel *panel, GtkWidget *p)
     return lxpanel_generic_config_dlg(_("CPU Usage"), panel,
         cpu_apply_configuration, p,
         _("Show usage as percentage"), &dc->show_percentage, CONF_TYPE_BOOL,
+        _("Show top processes in tooltip"), &dc->show_top, CONF_TYPE_BOOL,
         _("Foreground colour"), &dc->foreground_color, CONF_TYPE_COLOR,
         _("Background colour"), &dc->background_color, CONF_TYPE_COLOR,
         NULL);
@@ -26,6 +26,8 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 
@@ -45,17 +47,45 @@
 #define SCALING_SETFREQ     "scaling_setspeed"
 #define SCALING_MAX         "scaling_max_freq"
 #define SCALING_MIN         "scaling_min_freq"
+#define CPUINFO_MAX         "cpuinfo_max_freq"
+#define CPUINFO_MIN         "cpuinfo_min_freq"
+#define RELATED_CPUS        "related_cpus"
+#define TIME_IN_STATE       "stats/time_in_state"
 
+#define HEATMAP_COLUMN      6   /* Width of the column per policy, pixels */
+#define HEATMAP_GAP         1   /* Space between columns, pixels */
+
+/* One cpufreq policy, i.e. a group of CPUs which share the clock, such as
+ * a cluster of big.LITTLE system. The sysfs files which change are kept open
+ * and reread with pread() on each update. */
+typedef struct {
+    char *path;                     /* Directory of the policy in sysfs */
+    char *cpus;                     /* CPUs of the policy, as "0-3" */
+    int cur_fd;                     /* scaling_cur_freq, -1 if unavailable */
+    int gov_fd;                     /* scaling_governor, -1 if unavailable */
+    int stats_fd;                   /* stats/time_in_state, -1 if unavailable */
+    int min_freq;                   /* Hardware limits, kHz */
+    int max_freq;
+    int cur_freq;                   /* Current frequency, kHz */
+    char *governor;                 /* Current governor */
+    int n_states;                   /* Number of rows in time_in_state */
+    int *state_freq;                /* Frequency of each state, kHz */
+    int *state_rank;                /* Position of the state sorted by frequency */
+    guint64 *state_time;            /* Cumulative time in the state, 10ms units */
+    float *state_share;             /* Share of the last interval spent in the state */
+    gboolean stats_valid;           /* state_share is computed from two samples */
+} cpufreq_policy;
 
 typedef struct {
     GtkWidget *main;
+    GtkWidget *icon;                /* Plugin icon */
+    GtkWidget *heatmap;             /* Drawing area with a column per policy */
     LXPanel *panel;                 /* Back pointer to panel */
     config_setting_t *settings;
     GList *governors;
-    GList *cpus;
+    GPtrArray *policies;            /* Array of cpufreq_policy */
     int has_cpufreq;
-    char* cur_governor;
-    int   cur_freq;
+    gboolean show_heatmap;          /* Show per-policy frequency heatmap */
     unsigned int timer;
     //gboolean remember;
 } cpufreq;
@@ -67,41 +97,198 @@ typedef struct {
 
 static void cpufreq_destructor(gpointer user_data);
 
-static void
-get_cur_governor(cpufreq *cf){
-    FILE *fp;
-    char buf[ 100 ], sstmp [ 256 ];
+/* Reads whole sysfs file from the beginning, returns length or -1 */
+static int
+read_fd(int fd, char *buf, size_t size)
+{
+    ssize_t len;
+
+    if (fd < 0)
+        return -1;
+    len = pread(fd, buf, size - 1, 0);
+    if (len < 0)
+        return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+static int
+read_int_file(const char *dir, const char *name)
+{
+    char *path = g_build_filename(dir, name, NULL);
+    char *contents;
+    int value = 0;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL))
+    {
+        value = atoi(contents);
+        g_free(contents);
+    }
+    g_free(path);
+    return value;
+}
 
-    snprintf(sstmp, sizeof(sstmp), "%s/%s", (char*)cf->cpus->data, SCALING_GOV);
-    if ((fp = fopen( sstmp, "r")) != NULL) {
-        if(cf->cur_governor)
+static int
+open_policy_file(const char *dir, const char *name)
+{
+    char *path = g_build_filename(dir, name, NULL);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    g_free(path);
+    return fd;
+}
+
+/* Converts list of CPUs such as "0 1 2 3" into "0-3" */
+static char *
+compress_cpu_list(const char *list)
+{
+    GString *str = g_string_new(NULL);
+    char *end;
+    long cpu, first = -1, last = -1;
+
+    while (TRUE)
+    {
+        cpu = strtol(list, &end, 10);
+        if (end == list)
+            cpu = -1;
+        if (first >= 0 && cpu != last + 1)
         {
-          g_free(cf->cur_governor);
-          cf->cur_governor = NULL;
+            if (str->len > 0)
+                g_string_append_c(str, ',');
+            if (last > first)
+                g_string_append_printf(str, "%ld-%ld", first, last);
+            else
+                g_string_append_printf(str, "%ld", first);
+            first = -1;
         }
-        if (fgets(buf, 100, fp))
+        if (cpu < 0)
+            break;
+        if (first < 0)
+            first = cpu;
+        last = cpu;
+        list = end;
+    }
+    return g_string_free(str, FALSE);
+}
+
+static cpufreq_policy *
+policy_new(const char *path)
+{
+    cpufreq_policy *policy = g_slice_new0(cpufreq_policy);
+    char *file, *contents;
+
+    policy->path = g_strdup(path);
+    policy->cur_fd = open_policy_file(path, SCALING_CUR_FREQ);
+    policy->gov_fd = open_policy_file(path, SCALING_GOV);
+    policy->stats_fd = open_policy_file(path, TIME_IN_STATE);
+    policy->min_freq = read_int_file(path, CPUINFO_MIN);
+    policy->max_freq = read_int_file(path, CPUINFO_MAX);
+    file = g_build_filename(path, RELATED_CPUS, NULL);
+    if (g_file_get_contents(file, &contents, NULL, NULL))
+    {
+        policy->cpus = compress_cpu_list(contents);
+        g_free(contents);
+    }
+    else
+        policy->cpus = g_strdup("?");
+    g_free(file);
+    return policy;
+}
+
+static void
+policy_free(gpointer data)
+{
+    cpufreq_policy *policy = data;
+
+    if (policy->cur_fd >= 0)
+        close(policy->cur_fd);
+    if (policy->gov_fd >= 0)
+        close(policy->gov_fd);
+    if (policy->stats_fd >= 0)
+        close(policy->stats_fd);
+    g_free(policy->path);
+    g_free(policy->cpus);
+    g_free(policy->governor);
+    g_free(policy->state_freq);
+    g_free(policy->state_rank);
+    g_free(policy->state_time);
+    g_free(policy->state_share);
+    g_slice_free(cpufreq_policy, policy);
+}
+
+/* Updates share of time spent in each state since the previous update */
+static void
+policy_update_stats(cpufreq_policy *policy)
+{
+    char buf[4096], *p, *end;
+    int freq[256];
+    guint64 time[256], delta, total = 0;
+    int i, j, n = 0;
+
+    if (read_fd(policy->stats_fd, buf, sizeof(buf)) <= 0)
+        return;
+    for (p = buf; n < (int)G_N_ELEMENTS(freq); p = end)
+    {
+        freq[n] = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        p = end;
+        time[n] = g_ascii_strtoull(p, &end, 10);
+        if (end == p)
+            break;
+        n++;
+    }
+
+    if (n != policy->n_states)
+    {
+        /* first time or the table has changed, make a new baseline */
+        policy->n_states = n;
+        policy->state_freq = g_renew(int, policy->state_freq, n);
+        policy->state_rank = g_renew(int, policy->state_rank, n);
+        policy->state_time = g_renew(guint64, policy->state_time, n);
+        policy->state_share = g_renew(float, policy->state_share, n);
+        memcpy(policy->state_freq, freq, n * sizeof(int));
+        memcpy(policy->state_time, time, n * sizeof(guint64));
+        /* tables may be in any order, so rank states for drawing */
+        for (i = 0; i < n; i++)
         {
-            buf[strlen(buf)-1] = '\0';
-            cf->cur_governor = strdup(buf);
+            policy->state_rank[i] = 0;
+            for (j = 0; j < n; j++)
+                if (freq[j] < freq[i])
+                    policy->state_rank[i]++;
         }
-        fclose(fp);
+        policy->stats_valid = FALSE;
+        return;
     }
+
+    for (i = 0; i < n; i++)
+        total += time[i] - policy->state_time[i];
+    for (i = 0; i < n; i++)
+    {
+        delta = time[i] - policy->state_time[i];
+        policy->state_share[i] = total > 0 ? (float)delta / total : 0.0;
+        policy->state_time[i] = time[i];
+    }
+    policy->stats_valid = (total > 0);
 }
 
 static void
-get_cur_freq(cpufreq *cf){
-    FILE *fp;
-    char buf[ 100 ], sstmp [ 256 ];
+policy_update(cpufreq_policy *policy)
+{
+    char buf[100];
 
-    snprintf(sstmp, sizeof(sstmp), "%s/%s", (char*)cf->cpus->data, SCALING_CUR_FREQ);
-    if ((fp = fopen( sstmp, "r")) != NULL) {
-        if (fgets(buf, 100, fp))
+    if (read_fd(policy->cur_fd, buf, sizeof(buf)) > 0)
+        policy->cur_freq = atoi(buf);
+    if (read_fd(policy->gov_fd, buf, sizeof(buf)) > 0)
+    {
+        g_strchomp(buf);
+        if (g_strcmp0(buf, policy->governor) != 0)
         {
-            buf[strlen(buf)-1] = '\0';
-            cf->cur_freq = atoi(buf);
+            g_free(policy->governor);
+            policy->governor = g_strdup(buf);
         }
-        fclose(fp);
     }
+    policy_update_stats(policy);
 }
 
 /*static void
@@ -196,41 +383,76 @@ frequency_menu(cpufreq *cf){
     return GTK_WIDGET(menu);
 }*/
 
-static void
-get_cpus(cpufreq *cf)
+static gint
+compare_policy_names(gconstpointer a, gconstpointer b)
 {
+    const char *name_a = *(const char **)a, *name_b = *(const char **)b;
 
-    const char *cpu;
-    char cpu_path[100];
+    /* "policy<n>" and "cpu<n>" are sorted by the number */
+    while (*name_a && !g_ascii_isdigit(*name_a)) name_a++;
+    while (*name_b && !g_ascii_isdigit(*name_b)) name_b++;
+    return atoi(name_a) - atoi(name_b);
+}
 
-    GDir * cpuDirectory = g_dir_open(SYSFS_CPU_DIRECTORY, 0, NULL);
-    if (cpuDirectory == NULL)
+/* Finds cpufreq policies once. Kernels since 4.3 have the policy directories,
+ * older ones have cpufreq directory per CPU, where CPUs of the same policy
+ * have links to the same directory. */
+static void
+get_policies(cpufreq *cf)
+{
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    GHashTable *seen = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    const char *name;
+    char *path, *real;
+    GDir *dir;
+    guint i;
+
+    cf->policies = g_ptr_array_new_with_free_func(policy_free);
+    dir = g_dir_open(SYSFS_CPU_DIRECTORY "/cpufreq", 0, NULL);
+    if (dir != NULL)
     {
-        cf->cpus = NULL;
-        printf("cpufreq: no cpu found\n");
-        return;
+        while ((name = g_dir_read_name(dir)))
+            if (strncmp(name, "policy", 6) == 0 && g_ascii_isdigit(name[6]))
+                g_ptr_array_add(paths, g_strdup(name));
+        g_dir_close(dir);
+        g_ptr_array_sort(paths, compare_policy_names);
+        for (i = 0; i < paths->len; i++)
+        {
+            path = g_build_filename(SYSFS_CPU_DIRECTORY, "cpufreq", paths->pdata[i], NULL);
+            g_ptr_array_add(cf->policies, policy_new(path));
+            g_free(path);
+        }
     }
 
-    while ((cpu = g_dir_read_name(cpuDirectory)))
+    if (cf->policies->len == 0 && (dir = g_dir_open(SYSFS_CPU_DIRECTORY, 0, NULL)) != NULL)
     {
-        /* Look for directories of the form "cpu<n>", where "<n>" is a decimal integer. */
-        if ((strncmp(cpu, "cpu", 3) == 0) && (cpu[3] >= '0') && (cpu[3] <= '9'))
+        g_ptr_array_set_size(paths, 0);
+        while ((name = g_dir_read_name(dir)))
+            /* Look for directories of the form "cpu<n>", where "<n>" is a decimal integer. */
+            if (strncmp(name, "cpu", 3) == 0 && g_ascii_isdigit(name[3]))
+                g_ptr_array_add(paths, g_strdup(name));
+        g_dir_close(dir);
+        g_ptr_array_sort(paths, compare_policy_names);
+        for (i = 0; i < paths->len; i++)
         {
-            snprintf(cpu_path, sizeof(cpu_path), "%s/%s/cpufreq", SYSFS_CPU_DIRECTORY, cpu);
-
-            GDir * cpufreqDir = g_dir_open(SYSFS_CPU_DIRECTORY, 0, NULL);
-            if (cpufreqDir == NULL)
+            path = g_build_filename(SYSFS_CPU_DIRECTORY, paths->pdata[i], "cpufreq", NULL);
+            real = realpath(path, NULL);
+            if (real != NULL && g_hash_table_lookup(seen, real) == NULL)
             {
-                cf->cpus = NULL;
-                cf->has_cpufreq = 0;
-                break;
+                g_hash_table_insert(seen, real, real);
+                g_ptr_array_add(cf->policies, policy_new(path));
             }
-
-            cf->has_cpufreq = 1;
-            cf->cpus = g_list_append(cf->cpus, strdup(cpu_path));
+            else
+                free(real);
+            g_free(path);
         }
     }
-    g_dir_close(cpuDirectory);
+
+    if (cf->policies->len == 0)
+        g_message("cpufreq: no cpufreq policy found");
+    cf->has_cpufreq = (cf->policies->len > 0);
+    g_hash_table_destroy(seen);
+    g_ptr_array_free(paths, TRUE);
 }
 
 /*static void
@@ -317,20 +539,149 @@ clicked(GtkWidget *widget, GdkEventButton *evt, LXPanel *panel)
     RET(FALSE);
 }
 
+/* Heat colour for the share of time: dark at 0, then red, then yellow */
+static void
+set_heat_color(cairo_t *cr, float share)
+{
+    share = CLAMP(share, 0.0, 1.0);
+    cairo_set_source_rgb(cr, 0.2 + 0.8 * MIN(share * 2, 1.0),
+                         0.2 + 0.8 * MAX(share * 2 - 1, 0.0), 0.2 * (1.0 - share));
+}
+
+/* Draws a column per policy. If time_in_state is available, each state is a
+ * cell coloured by share of time spent in it during the last interval, the
+ * fastest state on top. Current frequency is marked by a white line. */
+static void
+draw_heatmap(cpufreq *cf, cairo_t *cr, int height)
+{
+    cpufreq_policy *policy;
+    double x, y, cell, level;
+    guint i;
+    int j;
+
+    for (i = 0; i < cf->policies->len; i++)
+    {
+        policy = cf->policies->pdata[i];
+        x = i * (HEATMAP_COLUMN + HEATMAP_GAP);
+        cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
+        cairo_rectangle(cr, x, 0, HEATMAP_COLUMN, height);
+        cairo_fill(cr);
+
+        level = 0.0;
+        if (policy->max_freq > policy->min_freq)
+            level = (double)(policy->cur_freq - policy->min_freq)
+                    / (policy->max_freq - policy->min_freq);
+        level = CLAMP(level, 0.0, 1.0);
+
+        if (policy->stats_valid)
+        {
+            cell = (double)height / policy->n_states;
+            for (j = 0; j < policy->n_states; j++)
+            {
+                set_heat_color(cr, policy->state_share[j]);
+                cairo_rectangle(cr, x, height - (policy->state_rank[j] + 1) * cell,
+                                HEATMAP_COLUMN, cell);
+                cairo_fill(cr);
+            }
+        }
+        else
+        {
+            /* no statistics, show the current frequency as a bar */
+            set_heat_color(cr, level);
+            cairo_rectangle(cr, x, height * (1.0 - level), HEATMAP_COLUMN, height * level);
+            cairo_fill(cr);
+        }
+
+        y = MIN(height * (1.0 - level), height - 1) + 0.5;
+        cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+        cairo_set_line_width(cr, 1.0);
+        cairo_move_to(cr, x, y);
+        cairo_line_to(cr, x + HEATMAP_COLUMN, y);
+        cairo_stroke(cr);
+    }
+}
+
+#if !GTK_CHECK_VERSION(3, 0, 0)
 static gboolean
-_update_tooltip(cpufreq *cf)
+heatmap_expose_event(GtkWidget *widget, GdkEventExpose *event, cpufreq *cf)
+#else
+static gboolean
+heatmap_draw(GtkWidget *widget, cairo_t *cr, cpufreq *cf)
+#endif
 {
-    char *tooltip;
+    GtkAllocation allocation;
+
+    gtk_widget_get_allocation(widget, &allocation);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
+    gdk_cairo_region(cr, event->region);
+    cairo_clip(cr);
+    /* no-window widget, draw relative to its allocation */
+    cairo_translate(cr, allocation.x, allocation.y);
+#endif
+    draw_heatmap(cf, cr, allocation.height);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    cairo_destroy(cr);
+#endif
+    return FALSE;
+}
 
-    get_cur_freq(cf);
-    get_cur_governor(cf);
+static void
+heatmap_set_size(cpufreq *cf)
+{
+    int n = cf->policies->len;
+
+    gtk_widget_set_size_request(cf->heatmap,
+                                n * (HEATMAP_COLUMN + HEATMAP_GAP) - HEATMAP_GAP,
+                                panel_get_icon_size(cf->panel));
+    gtk_widget_set_visible(cf->heatmap, cf->show_heatmap && n > 0);
+}
+
+static gboolean
+_update_tooltip(cpufreq *cf)
+{
+    cpufreq_policy *policy;
+    GString *tooltip;
+    const char *governor;
+    guint i;
+    int j, max_state;
 
     ENTER;
 
-    tooltip = g_strdup_printf(_("Frequency: %d MHz\nGovernor: %s"),
-                              cf->cur_freq / 1000, cf->cur_governor);
-    gtk_widget_set_tooltip_text(cf->main, tooltip);
-    g_free(tooltip);
+    if (!cf->has_cpufreq)
+    {
+        gtk_widget_set_tooltip_text(cf->main, _("CPUFreq not supported"));
+        RET(TRUE);
+    }
+
+    tooltip = g_string_new(NULL);
+    for (i = 0; i < cf->policies->len; i++)
+    {
+        policy = cf->policies->pdata[i];
+        policy_update(policy);
+        governor = policy->governor ? policy->governor : _("unknown");
+        if (cf->policies->len == 1)
+            g_string_append_printf(tooltip, _("Frequency: %d MHz\nGovernor: %s"),
+                                   policy->cur_freq / 1000, governor);
+        else
+            g_string_append_printf(tooltip, _("%sCPU %s: %d MHz, %s"),
+                                   i > 0 ? "\n" : "", policy->cpus,
+                                   policy->cur_freq / 1000, governor);
+        if (policy->stats_valid)
+        {
+            /* running below the top state under load is a sign of throttling */
+            max_state = 0;
+            for (j = 1; j < policy->n_states; j++)
+                if (policy->state_freq[j] > policy->state_freq[max_state])
+                    max_state = j;
+            g_string_append_printf(tooltip, _(" (%.0f%% at max)"),
+                                   policy->state_share[max_state] * 100);
+        }
+    }
+    gtk_widget_set_tooltip_text(cf->main, tooltip->str);
+    g_string_free(tooltip, TRUE);
+    if (cf->show_heatmap)
+        gtk_widget_queue_draw(cf->heatmap);
     RET(TRUE);
 }
 
@@ -344,22 +695,50 @@ static gboolean update_tooltip(gpointer user_data)
 static GtkWidget *cpufreq_constructor(LXPanel *panel, config_setting_t *settings)
 {
     cpufreq *cf;
-    //GtkWidget *button;
+    GtkWidget *box;
+    int tmp_int;
 
     ENTER;
     cf = g_new0(cpufreq, 1);
     g_return_val_if_fail(cf != NULL, NULL);
     cf->governors = NULL;
-    cf->cpus = NULL;
     cf->settings = settings;
     cf->panel = panel;
+    cf->show_heatmap = TRUE;
+    if (config_setting_lookup_int(settings, "ShowHeatmap", &tmp_int))
+        cf->show_heatmap = tmp_int != 0;
 
     cf->main = lxpanel_button_new_for_icon(panel, PROC_ICON, NULL, NULL);
     lxpanel_plugin_set_data(cf->main, cf, cpufreq_destructor);
 
+    /* Put the heatmap next to the icon */
+    cf->icon = gtk_button_get_image(GTK_BUTTON(cf->main));
+    g_object_ref(cf->icon);
+    gtk_button_set_image(GTK_BUTTON(cf->main), NULL);
+#if GTK_CHECK_VERSION(3, 0, 0)
+    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+#else
+    box = gtk_hbox_new(FALSE, 2);
+#endif
+    gtk_box_pack_start(GTK_BOX(box), cf->icon, FALSE, FALSE, 0);
+    g_object_unref(cf->icon);
+    cf->heatmap = gtk_drawing_area_new();
+    gtk_widget_set_has_window(cf->heatmap, FALSE);
+    gtk_box_pack_start(GTK_BOX(box), cf->heatmap, FALSE, FALSE, 0);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    g_signal_connect(G_OBJECT(cf->heatmap), "expose-event",
+                     G_CALLBACK(heatmap_expose_event), cf);
+#else
+    g_signal_connect(G_OBJECT(cf->heatmap), "draw", G_CALLBACK(heatmap_draw), cf);
+#endif
+    gtk_widget_show(cf->icon);
+    gtk_widget_show(box);
+    gtk_button_set_image(GTK_BUTTON(cf->main), box);
+
     cf->has_cpufreq = 0;
 
-    get_cpus(cf);
+    get_policies(cf);
+    heatmap_set_size(cf);
 
     //if (config_setting_lookup_int(settings, "Remember", &tmp_int)) cf->remember = tmp_int != 0;
     //if (config_setting_lookup_int(settings, "Governor", &tmp_str)) cf->cur_governor = g_strdup(tmp_str);
@@ -371,29 +750,28 @@ static GtkWidget *cpufreq_constructor(LXPanel *panel, config_setting_t *settings
     RET(cf->main);
 }
 
-/*
 static gboolean applyConfig(gpointer user_data)
 {
     cpufreq *cf = lxpanel_plugin_get_data(user_data);
 
-    config_group_set_int(cf->settings, "Remember", cf->remember);
+    config_group_set_int(cf->settings, "ShowHeatmap", cf->show_heatmap);
+    heatmap_set_size(cf);
     return FALSE;
 }
 
-static GtkWidget *config(LXPanel *panel, GtkWidget *p, GtkWindow *parent)
+static GtkWidget *config(LXPanel *panel, GtkWidget *p)
 {
     cpufreq *cf = lxpanel_plugin_get_data(p);
     return lxpanel_generic_config_dlg(_("CPUFreq frontend"), panel, applyConfig, p,
-            _("Remember governor and frequency"), &cf->remember, CONF_TYPE_BOOL,
+            _("Show frequency of each CPU cluster"), &cf->show_heatmap, CONF_TYPE_BOOL,
             NULL);
 }
-*/
 
 static void
 cpufreq_destructor(gpointer user_data)
 {
     cpufreq *cf = (cpufreq *)user_data;
-    g_list_free ( cf->cpus );
+    g_ptr_array_free ( cf->policies, TRUE );
     g_list_free ( cf->governors );
     g_source_remove(cf->timer);
     g_free(cf);
@@ -405,7 +783,8 @@ static void cpufreq_reconfig (LXPanel *panel, GtkWidget *widget)
 {
     cpufreq *cf = lxpanel_plugin_get_data (widget);
 
-    lxpanel_plugin_set_taskbar_icon (cf->panel, gtk_button_get_image (GTK_BUTTON (widget)), PROC_ICON);
+    lxpanel_plugin_set_taskbar_icon (cf->panel, cf->icon, PROC_ICON);
+    heatmap_set_size (cf);
 }
 
 FM_DEFINE_MODULE(lxpanel_gtk, cpufreq)
@@ -416,7 +795,7 @@ LXPanelPluginInit fm_module_init_lxpanel_gtk = {
     .description = N_("Display CPU frequency and allow one to change governors and frequency"),
 
     .new_instance = cpufreq_constructor,
-    //.config      = config,
+    .config = config,
     .button_press_event = clicked,
     .reconfigure = cpufreq_reconfig
 };
@@ -291,6 +291,13 @@ static void dclock_timer_set(DClockPlugin * dc, struct timeval *current_time)
     dc->timer = g_timeout_add(milliseconds, (GSourceFunc) dclock_update_display, (gpointer) dc);
 }
 
+static void dclock_panel_parked_changed(LXPanel * panel, DClockPlugin * dc)
+{
+    /* show the current time at once */
+    if (!panel_is_parked(panel) && dc->timer == 0)
+        dc->timer = g_idle_add((GSourceFunc)dclock_update_display, dc);
+}
+
 /* Compare length and content of two strings to see how much they have in common */
 static int strdiff (char *str1, char *str2)
 {
@@ -316,6 +323,12 @@ static gboolean dclock_update_display(DClockPlugin * dc)
 
     if (g_source_is_destroyed(g_main_current_source()))
         return FALSE;
+    /* nobody sees the panel, restarted when it is unparked */
+    if (panel_is_parked(dc->panel))
+    {
+        dc->timer = 0;
+        return FALSE;
+    }
 
     dclock_timer_set(dc, &now);
     current_time = localtime(&now.tv_sec);
@@ -498,6 +511,7 @@ static GtkWidget *dclock_constructor(LXPanel *panel, config_setting_t *settings)
 
     /* Show the widget and return. */
     dc->timer = g_idle_add((GSourceFunc)dclock_update_display, dc);
+    g_signal_connect(panel, "parked-changed", G_CALLBACK(dclock_panel_parked_changed), dc);
     return p;
 }
 
@@ -507,6 +521,7 @@ static void dclock_destructor(gpointer user_data)
     DClockPlugin * dc = user_data;
 
     /* Remove the timer. */
+    g_signal_handlers_disconnect_by_func(dc->panel, dclock_panel_parked_changed, dc);
     if (dc->timer != 0)
         g_source_remove(dc->timer);
 
@@ -58,7 +58,7 @@ static void deskno_destructor(gpointer user_data);
 static gboolean deskno_name_update(GtkWidget * widget, DesknoPlugin * dc)
 {
     /* Compute and redraw the desktop number. */
-    int desktop_number = get_net_current_desktop();
+    int desktop_number = fb_ev_current_desktop(fbev);
     if (desktop_number < dc->number_of_desktops)
         lxpanel_draw_label_text(dc->panel, dc->label, dc->desktop_labels[desktop_number], dc->bold, 1, TRUE);
     return TRUE;
@@ -69,10 +69,10 @@ static gboolean deskno_name_update(GtkWidget * widget, DesknoPlugin * dc)
 static void deskno_redraw(GtkWidget * widget, DesknoPlugin * dc)
 {
     /* Get the NET_DESKTOP_NAMES property. */
-    dc->number_of_desktops = get_net_number_of_desktops();
+    dc->number_of_desktops = fb_ev_number_of_desktops(fbev);
     int number_of_desktop_names;
     char * * desktop_names;
-    desktop_names = get_utf8_property_list(GDK_ROOT_WINDOW(), a_NET_DESKTOP_NAMES, &number_of_desktop_names);
+    desktop_names = fb_ev_desktop_names(fbev, &number_of_desktop_names);
 
     /* Reallocate the vector of labels. */
     if (dc->desktop_labels != NULL)
@@ -88,10 +88,6 @@ static void deskno_redraw(GtkWidget * widget, DesknoPlugin * dc)
     for ( ; i < dc->number_of_desktops; i++)
         dc->desktop_labels[i] = g_strdup_printf("%d", i + 1);
 
-    /* Free the property. */
-    if (desktop_names != NULL)
-        g_strfreev(desktop_names);
-
     /* Redraw the label. */
     deskno_name_update(widget, dc);
 }
@@ -100,8 +96,8 @@ static void deskno_redraw(GtkWidget * widget, DesknoPlugin * dc)
 static gboolean deskno_button_press_event(GtkWidget * widget, GdkEventButton * event, LXPanel * p)
 {
     /* Right-click goes to next desktop, wrapping around to first. */
-    int desknum = get_net_current_desktop();
-    int desks = get_net_number_of_desktops();
+    int desknum = fb_ev_current_desktop(fbev);
+    int desks = fb_ev_number_of_desktops(fbev);
     int newdesk = desknum + 1;
     Screen *xscreen = GDK_SCREEN_XSCREEN(gtk_widget_get_screen(widget));
     if (newdesk >= desks)
@@ -115,8 +111,8 @@ static gboolean deskno_button_press_event(GtkWidget * widget, GdkEventButton * e
 /* Handler for scroll events on the plugin */
 static gboolean deskno_scrolled(GtkWidget * p, GdkEventScroll * ev, DesknoPlugin * dc)
 {
-    int desknum = get_net_current_desktop();
-    int desks = get_net_number_of_desktops();
+    int desknum = fb_ev_current_desktop(fbev);
+    int desks = fb_ev_number_of_desktops(fbev);
     Screen *xscreen = GDK_SCREEN_XSCREEN(gtk_widget_get_screen(p));
 
     switch (ev->direction) {
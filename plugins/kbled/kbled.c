@@ -62,6 +62,7 @@ typedef struct {
     GtkWidget *indicator_image[3];		/* Image for each indicator */
     unsigned int current_state;			/* Current LED state, bit encoded */
     gboolean visible[3];			/* True if control is visible (per user configuration) */
+    guint xkb_event_handler;			/* Subscription to Xkb events */
 } KeyboardLEDPlugin;
 
 static void kbled_update_image(KeyboardLEDPlugin * kl, int i, unsigned int state);
@@ -94,16 +95,13 @@ static void kbled_update_display(KeyboardLEDPlugin * kl, unsigned int new_state)
 }
 
 /* GDK event filter. */
-static GdkFilterReturn kbled_event_filter(GdkXEvent * gdkxevent, GdkEvent * event, KeyboardLEDPlugin * kl)
+static GdkFilterReturn kbled_event_filter(XEvent * xev, gpointer user_data)
 {
     /* Look for XkbIndicatorStateNotify events and update the display. */
-    XEvent * xev = (XEvent *) gdkxevent;
-    if (xev->xany.type == xkb_event_base + XkbEventCode)
-    {
-        XkbEvent * xkbev = (XkbEvent *) xev;
-        if (xkbev->any.xkb_type == XkbIndicatorStateNotify)
-            kbled_update_display(kl, xkbev->indicators.state);
-    }
+    KeyboardLEDPlugin * kl = user_data;
+    XkbEvent * xkbev = (XkbEvent *) xev;
+    if (xkbev->any.xkb_type == XkbIndicatorStateNotify)
+        kbled_update_display(kl, xkbev->indicators.state);
     return GDK_FILTER_CONTINUE;
 }
 
@@ -157,8 +155,9 @@ static GtkWidget *kbled_constructor(LXPanel *panel, config_setting_t *settings)
             return 0;
     }
 
-    /* Add GDK event filter and enable XkbIndicatorStateNotify events. */
-    gdk_window_add_filter(NULL, (GdkFilterFunc) kbled_event_filter, kl);
+    /* Subscribe to Xkb events and enable XkbIndicatorStateNotify events. */
+    kl->xkb_event_handler = lxpanel_x_event_connect(xkb_event_base + XkbEventCode, None, None,
+                                                    kbled_event_filter, kl);
     if ( ! XkbSelectEvents(xdisplay, XkbUseCoreKbd, XkbIndicatorStateNotifyMask, XkbIndicatorStateNotifyMask))
         return 0;
 
@@ -177,8 +176,8 @@ static void kbled_destructor(gpointer user_data)
 {
     KeyboardLEDPlugin * kl = (KeyboardLEDPlugin *) user_data;
 
-    /* Remove GDK event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) kbled_event_filter, kl);
+    /* Remove Xkb events subscription. */
+    lxpanel_x_event_disconnect(kl->xkb_event_handler);
     g_free(kl);
 }
 
@@ -35,15 +35,85 @@ struct _LaunchButton
     LXPanel * panel;                    /* Back pointer to panel (grandparent widget) */
     GtkWidget * plugin;                 /* Back pointer to the plugin */
     FmJob * job;                        /* Async job to retrieve file info */
+    FmPath * path;                      /* Path waiting for batch to resolve */
     FmFileInfo * fi;                    /* Launcher application descriptor */
     config_setting_t * settings;        /* Button settings */
 };
 
+/* Launchers of the batch are resolved by at most two jobs: one file info job
+   for all paths and one search in the menu for all desktop ids. Results are
+   applied all at once when both jobs are finished, so the launchbar is laid
+   out only once. Until then the name and icon cached in settings are shown. */
+typedef struct {
+    GList * buttons;                    /* LaunchButton refs waiting for results */
+    GList * infos;                      /* FmFileInfo found by jobs */
+    int running;                        /* Number of jobs not finished yet */
+} LaunchButtonBatch;
 
-static void launch_button_job_finished(FmJob *job, LaunchButton *self)
+static gboolean launch_button_start_job(LaunchButton *self, FmPath *id);
+
+static gboolean launch_button_path_is_search(FmPath *id)
+{
+    return (!fm_path_is_native(id) &&
+            strncmp(fm_path_get_basename(fm_path_get_scheme_path(id)), "search:", 7) == 0);
+}
+
+/* Keeps name and icon in settings so next time button can be shown before
+   the file info is retrieved. Returns TRUE if settings were changed. */
+static gboolean launch_button_cache_info(LaunchButton *self)
+{
+    const char *name = fm_file_info_get_disp_name(self->fi);
+    FmIcon *icon = fm_file_info_get_icon(self->fi);
+    char *icon_str = icon ? g_icon_to_string(fm_icon_get_gicon(icon)) : NULL;
+    const char *str;
+    gboolean changed = FALSE;
+
+    if (self->settings == NULL)
+        goto out;
+    if (name && (!config_setting_lookup_string(self->settings, "name", &str) ||
+                 strcmp(str, name) != 0))
+    {
+        config_group_set_string(self->settings, "name", name);
+        changed = TRUE;
+    }
+    if (icon_str && (!config_setting_lookup_string(self->settings, "icon", &str) ||
+                     strcmp(str, icon_str) != 0))
+    {
+        config_group_set_string(self->settings, "icon", icon_str);
+        changed = TRUE;
+    }
+out:
+    g_free(icon_str);
+    return changed;
+}
+
+/* Sets image and tooltip from retrieved file info. */
+static gboolean launch_button_apply_info(LaunchButton *self)
 {
+    GDesktopAppInfo *app;
     GtkWidget *image;
 
+    if (self->fi == NULL)
+    {
+        g_warning("launchbar: desktop entry does not exist");
+        return FALSE;
+    }
+    app = g_desktop_app_info_new (fm_file_info_get_name (self->fi));
+    if (app == NULL)
+    {
+        g_warning("launchbar: application in desktop entry is not valid");
+        return FALSE;
+    }
+    g_object_unref(app);
+    image = lxpanel_image_new_for_fm_icon(self->panel, fm_file_info_get_icon(self->fi),
+                                          -1, NULL);
+    lxpanel_button_compose(GTK_WIDGET(self), image, NULL, NULL);
+    gtk_widget_set_tooltip_text(GTK_WIDGET(self), fm_file_info_get_disp_name(self->fi));
+    return launch_button_cache_info(self);
+}
+
+static void launch_button_job_finished(FmJob *job, LaunchButton *self)
+{
     if (self->job == NULL)
         return; // duplicate call? seems a bug in libfm
 
@@ -59,20 +129,88 @@ static void launch_button_job_finished(FmJob *job, LaunchButton *self)
     }
     self->job = NULL;
     g_object_unref(job);
-    if (self->fi == NULL)
+    if (launch_button_apply_info(self))
+        lxpanel_config_save(self->panel);
+}
+
+/* Returns desktop id if button may be resolved by batched search. */
+static const char *launch_button_get_search_id(LaunchButton *self)
+{
+    const char *id;
+
+    if (!launch_button_path_is_search(self->path) || self->settings == NULL ||
+        !config_setting_lookup_string(self->settings, "id", &id) ||
+        strchr(id, '/') != NULL || strchr(id, ',') != NULL)
+        return NULL;
+    return id;
+}
+
+static void launch_button_batch_apply(LaunchButtonBatch *batch)
+{
+    LXPanel *panel = NULL;
+    GList *l, *li;
+
+    for (l = batch->buttons; l; l = l->next)
     {
-        g_warning("launchbar: desktop entry does not exist");
-        return;
+        LaunchButton *btn = l->data;
+        const char *id;
+        FmPath *path = btn->path;
+
+        if (path == NULL) /* button was destroyed */
+            continue;
+        id = launch_button_get_search_id(btn);
+        for (li = batch->infos; li; li = li->next)
+        {
+            if (id ? strcmp(fm_file_info_get_name(li->data), id) == 0
+                   : fm_path_equal(fm_file_info_get_path(li->data), path))
+                break;
+        }
+        btn->path = NULL;
+        if (li != NULL)
+        {
+            btn->fi = fm_file_info_ref(li->data);
+            if (launch_button_apply_info(btn))
+                panel = btn->panel;
+        }
+        else if (!launch_button_start_job(btn, path)) /* try it alone */
+            g_warning("launchbar: problem running file search job");
+        fm_path_unref(path);
     }
-    if (g_desktop_app_info_new (fm_file_info_get_name (self->fi)) == NULL)
+    if (panel != NULL) /* save updated cache */
+        lxpanel_config_save(panel);
+    g_list_free_full(batch->buttons, g_object_unref);
+    g_list_free_full(batch->infos, (GDestroyNotify)fm_file_info_unref);
+    g_slice_free(LaunchButtonBatch, batch);
+}
+
+static void launch_button_batch_finished(FmJob *job, LaunchButtonBatch *batch)
+{
+    FmFileInfoList *list;
+    GList *l;
+
+    g_signal_handlers_disconnect_by_func(job, launch_button_batch_finished, batch);
+    if (FM_IS_FILE_INFO_JOB(job))
+        list = FM_FILE_INFO_JOB(job)->file_infos;
+    else
+        list = FM_DIR_LIST_JOB(job)->files;
+    if (list) for (l = fm_file_info_list_peek_head_link(list); l; l = l->next)
+        batch->infos = g_list_prepend(batch->infos, fm_file_info_ref(l->data));
+    g_object_unref(job);
+    if (--batch->running == 0)
+        launch_button_batch_apply(batch);
+}
+
+static void launch_button_batch_run(LaunchButtonBatch *batch, FmJob *job)
+{
+    batch->running++;
+    g_signal_connect(job, "finished", G_CALLBACK(launch_button_batch_finished), batch);
+    if (!fm_job_run_async(job))
     {
-        g_warning("launchbar: application in desktop entry is not valid");
-        return;
+        /* buttons will be tried alone */
+        g_signal_handlers_disconnect_by_func(job, launch_button_batch_finished, batch);
+        g_object_unref(job);
+        batch->running--;
     }
-    image = lxpanel_image_new_for_fm_icon(self->panel, fm_file_info_get_icon(self->fi),
-                                          -1, NULL);
-    lxpanel_button_compose(GTK_WIDGET(self), image, NULL, NULL);
-    gtk_widget_set_tooltip_text(GTK_WIDGET(self), fm_file_info_get_disp_name(self->fi));
 }
 
 
@@ -94,6 +232,12 @@ static void launch_button_dispose(GObject *object)
         self->job = NULL;
     }
 
+    if (self->path) /* batch will skip it */
+    {
+        fm_path_unref(self->path);
+        self->path = NULL;
+    }
+
     if (self->fi)
     {
         fm_file_info_unref(self->fi);
@@ -109,7 +253,7 @@ static gboolean launch_button_release_event(GtkWidget *widget, GdkEventButton *e
 
     if (event->button == 1) /* left button */
     {
-        if (btn->job) /* The job is still running */
+        if (btn->job || btn->path) /* The job is still running */
             ;
         else if (btn->fi == NULL)  /* The bootstrap button */
             lxpanel_plugin_show_config_dialog(btn->plugin);
@@ -146,6 +290,36 @@ static void launch_button_class_init(LaunchButtonClass *klass)
  * Interface functions
  */
 
+static gboolean launch_button_start_job(LaunchButton *self, FmPath *id)
+{
+    /* g_debug("LaunchButton: trying file %s in scheme %s", fm_path_get_basename(id),
+            fm_path_get_basename(fm_path_get_scheme_path(id))); */
+    if (!launch_button_path_is_search(id))
+    {
+        FmFileInfoJob *job = fm_file_info_job_new(NULL, FM_FILE_INFO_JOB_NONE);
+
+        fm_file_info_job_add(job, id);
+        self->job = FM_JOB(job);
+    }
+    else /* it is a search job */
+    {
+        FmDirListJob *job = fm_dir_list_job_new2(id, FM_DIR_LIST_JOB_FAST);
+
+        self->job = FM_JOB(job);
+    }
+    g_signal_connect(self->job, "finished",
+                     G_CALLBACK(launch_button_job_finished), self);
+    if (!fm_job_run_async(self->job))
+    {
+        g_signal_handlers_disconnect_by_func(self->job,
+                                             launch_button_job_finished, self);
+        g_object_unref(self->job);
+        self->job = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
 /* creates new button */
 LaunchButton *launch_button_new(LXPanel *panel, GtkWidget *plugin, FmPath *id,
                                 config_setting_t *settings)
@@ -162,36 +336,110 @@ LaunchButton *launch_button_new(LXPanel *panel, GtkWidget *plugin, FmPath *id,
         image = lxpanel_image_new_for_icon(panel, "gtk-add", -1, NULL);
         lxpanel_button_compose(GTK_WIDGET(self), image, NULL, NULL);
     }
-    else
+    else if (!launch_button_start_job(self, id))
     {
-        /* g_debug("LaunchButton: trying file %s in scheme %s", fm_path_get_basename(id),
-                fm_path_get_basename(fm_path_get_scheme_path(id))); */
-        if (fm_path_is_native(id) ||
-            strncmp(fm_path_get_basename(fm_path_get_scheme_path(id)), "search:", 7) != 0)
+        gtk_widget_destroy(GTK_WIDGET(self));
+        g_warning("launchbar: problem running file search job");
+        return NULL;
+    }
+    return self;
+}
+
+/**
+ * launch_button_new_deferred
+ * @panel: panel instance
+ * @plugin: plugin instance
+ * @id: path to the desktop entry
+ * @settings: (allow-none): button settings
+ *
+ * Creates new button which shows name and icon cached in @settings until
+ * it is resolved by launch_button_load_batch().
+ *
+ * Returns: (transfer full): new button.
+ */
+LaunchButton *launch_button_new_deferred(LXPanel *panel, GtkWidget *plugin,
+                                         FmPath *id, config_setting_t *settings)
+{
+    LaunchButton *self = g_object_new(PANEL_TYPE_LAUNCH_BUTTON, NULL);
+    GtkWidget *image = NULL;
+    const char *str;
+
+    self->panel = panel;
+    self->plugin = plugin;
+    self->settings = settings;
+    self->path = fm_path_ref(id);
+    if (settings && config_setting_lookup_string(settings, "icon", &str))
+    {
+        GIcon *gicon = g_icon_new_for_string(str, NULL);
+
+        if (gicon)
         {
-            FmFileInfoJob *job = fm_file_info_job_new(NULL, FM_FILE_INFO_JOB_NONE);
+            FmIcon *icon = fm_icon_from_gicon(gicon);
 
-            fm_file_info_job_add(job, id);
-            self->job = FM_JOB(job);
+            image = lxpanel_image_new_for_fm_icon(panel, icon, -1, NULL);
+            g_object_unref(icon);
+            g_object_unref(gicon);
         }
-        else /* it is a search job */
-        {
-            FmDirListJob *job = fm_dir_list_job_new2(id, FM_DIR_LIST_JOB_FAST);
+    }
+    if (image == NULL)
+        image = lxpanel_image_new_for_icon(panel, "application-x-executable", -1, NULL);
+    lxpanel_button_compose(GTK_WIDGET(self), image, NULL, NULL);
+    if (settings && config_setting_lookup_string(settings, "name", &str))
+        gtk_widget_set_tooltip_text(GTK_WIDGET(self), str);
+    return self;
+}
 
-            self->job = FM_JOB(job);
+/**
+ * launch_button_load_batch
+ * @buttons: (element-type LaunchButton): buttons created by launch_button_new_deferred()
+ *
+ * Starts retrieving file info for all @buttons at once. Buttons which
+ * cannot be resolved this way are then tried one by one.
+ */
+void launch_button_load_batch(GList *buttons)
+{
+    LaunchButtonBatch *batch = g_slice_new0(LaunchButtonBatch);
+    FmFileInfoJob *info_job = NULL;
+    GString *names = NULL;
+    const char *id;
+
+    for (; buttons; buttons = buttons->next)
+    {
+        LaunchButton *btn = buttons->data;
+
+        if (!PANEL_IS_LAUNCH_BUTTON(btn) || btn->path == NULL)
+            continue;
+        batch->buttons = g_list_prepend(batch->buttons, g_object_ref(btn));
+        if ((id = launch_button_get_search_id(btn)) != NULL)
+        {
+            /* search supports comma separated list of names */
+            if (names == NULL)
+                names = g_string_new("search://menu://applications/?recursive=1&show_hidden=1&name=");
+            else
+                g_string_append_c(names, ',');
+            g_string_append(names, id);
         }
-        g_signal_connect(self->job, "finished",
-                         G_CALLBACK(launch_button_job_finished), self);
-        if (!fm_job_run_async(self->job))
+        else if (!launch_button_path_is_search(btn->path))
         {
-            g_object_unref(self->job);
-            self->job = NULL;
-            gtk_widget_destroy(GTK_WIDGET(self));
-            g_warning("launchbar: problem running file search job");
-            return NULL;
+            if (info_job == NULL)
+                info_job = fm_file_info_job_new(NULL, FM_FILE_INFO_JOB_NONE);
+            fm_file_info_job_add(info_job, btn->path);
         }
+        /* else it will be tried alone */
     }
-    return self;
+    batch->running = 1; /* hold it until all jobs are started */
+    if (info_job)
+        launch_button_batch_run(batch, FM_JOB(info_job));
+    if (names)
+    {
+        FmPath *path = fm_path_new_for_uri(names->str);
+
+        launch_button_batch_run(batch, FM_JOB(fm_dir_list_job_new2(path, FM_DIR_LIST_JOB_FAST)));
+        fm_path_unref(path);
+        g_string_free(names, TRUE);
+    }
+    if (--batch->running == 0)
+        launch_button_batch_apply(batch);
 }
 
 FmFileInfo *launch_button_get_file_info(LaunchButton *btn)
@@ -242,11 +490,24 @@ void launch_button_set_settings(LaunchButton *btn, config_setting_t *settings)
  */
 gboolean launch_button_wait_load(LaunchButton *btn)
 {
+    if (PANEL_IS_LAUNCH_BUTTON(btn) && btn->path != NULL)
+    {
+        /* don't wait for the batch */
+        FmPath *path = btn->path;
+        gboolean ok;
+
+        btn->path = NULL;
+        ok = launch_button_start_job(btn, path);
+        fm_path_unref(path);
+        if (!ok)
+            goto failed;
+    }
     if (!PANEL_IS_LAUNCH_BUTTON(btn) || btn->job == NULL)
         return TRUE;
     if (fm_job_run_sync(btn->job))
         return TRUE;
 
+failed:
     if (btn->settings)
         config_setting_destroy(btn->settings);
     gtk_widget_destroy(GTK_WIDGET(btn));
@@ -47,6 +47,8 @@ struct _LaunchButtonClass
 
 /* creates new button */
 LaunchButton *launch_button_new(LXPanel *panel, GtkWidget *plugin, FmPath *path, config_setting_t *settings);
+LaunchButton *launch_button_new_deferred(LXPanel *panel, GtkWidget *plugin, FmPath *path, config_setting_t *settings);
+void launch_button_load_batch(GList *buttons);
 FmFileInfo *launch_button_get_file_info(LaunchButton *btn);
 const char *launch_button_get_disp_name(LaunchButton *btn);
 FmIcon *launch_button_get_icon(LaunchButton *btn);
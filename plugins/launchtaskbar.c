@@ -102,6 +102,9 @@ typedef enum {
 } LtbMode;
 
 typedef struct LaunchTaskBarPlugin LaunchTaskBarPlugin;
+#ifndef DISABLE_MENU
+typedef struct TaskResolveJob TaskResolveJob;
+#endif
 
 /* Private context for taskbar plugin. */
 struct LaunchTaskBarPlugin {
@@ -116,6 +119,10 @@ struct LaunchTaskBarPlugin {
     int drag_start_x, drag_start_y; /* Drag start coordinates */
     /* TASKBAR */
     GtkWidget * tb_icon_grid;      /* Manager for taskbar buttons */
+    GHashTable *x_windows;         /* Window -> TaskXEvents for NET_CLIENT_LIST */
+    guint x_windows_stamp;         /* Stamp of last NET_CLIENT_LIST update */
+    GArray *configure_queue;       /* Windows having ConfigureNotify to process */
+    guint configure_timer;         /* Timer to process configure_queue */
     int number_of_desktops;        /* Number of desktops, from NET_WM_NUMBER_OF_DESKTOPS */
     int current_desktop;           /* Current desktop, from NET_WM_CURRENT_DESKTOP */
     guint dnd_delay_timer;         /* Timer for drag and drop delay */
@@ -128,6 +135,10 @@ struct LaunchTaskBarPlugin {
     int spacing;                   /* Spacing between taskbar buttons */
     guint flash_timeout;        /* Timer for urgency notification */
     gboolean flash_state;       /* One-bit counter to flash taskbar */
+    gboolean overflow_menu;        /* User preference: buttons which don't fit are reached from a menu */
+    GtkWidget *overflow_button;    /* Button to show menu of buttons which don't fit */
+    guint overflow_idle;           /* Idle source to update overflow_button */
+    guint overflow_windows;        /* Number of windows shown on overflow_button */
     /* COMMON */
 #ifndef DISABLE_MENU
     FmPath * path;              /* Current menu item path */
@@ -135,6 +146,9 @@ struct LaunchTaskBarPlugin {
     GtkWidget       *p_menuitem_unlock_tbp;
     GtkWidget       *p_menuitem_new_instance;
     GtkWidget       *p_menuitem_separator;
+    GArray          *resolve_queue;     /* Windows waiting for launcher resolution */
+    guint            resolve_idle;      /* Idle source to start resolution batch */
+    TaskResolveJob  *resolve_job;       /* Batch being resolved in worker thread */
 #endif
     GtkWidget * plugin;                 /* Back pointer to Plugin */
     LXPanel * panel;                    /* Back pointer to panel */
@@ -169,6 +183,7 @@ static gchar *launchtaskbar_rc = "style 'launchtaskbar-style' = 'theme-panel'\n"
 #define ALL_WORKSPACES       -1
 #define ICON_ONLY_EXTRA      6      /* Amount needed to have button lay out symmetrically */
 #define ICON_BUTTON_TRIM 4      /* Amount needed to have button remain on panel */
+#define CONFIGURE_INTERVAL   16     /* Process window moves once per frame */
 
 static void launchtaskbar_destructor(gpointer user_data);
 
@@ -180,22 +195,101 @@ static void taskbar_net_client_list(GtkWidget * widget, LaunchTaskBarPlugin * tb
 static void taskbar_net_current_desktop(GtkWidget * widget, LaunchTaskBarPlugin * tb);
 static void taskbar_net_number_of_desktops(GtkWidget * widget, LaunchTaskBarPlugin * tb);
 static void taskbar_net_active_window(GtkWidget * widget, LaunchTaskBarPlugin * tb);
-static GdkFilterReturn taskbar_event_filter(XEvent * xev, GdkEvent * event, LaunchTaskBarPlugin * tb);
+static GdkFilterReturn taskbar_property_notify_event(XEvent *ev, gpointer user_data);
+static GdkFilterReturn taskbar_configure_notify_event(XEvent *ev, gpointer user_data);
 static void taskbar_window_manager_changed(GdkScreen * screen, LaunchTaskBarPlugin * tb);
 static void taskbar_apply_configuration(LaunchTaskBarPlugin * ltbp);
 static void taskbar_add_task_button(LaunchTaskBarPlugin * tb, TaskButton * task);
+static TaskButton *task_lookup(LaunchTaskBarPlugin * tb, Window win);
+static void taskbar_update_overflow(LaunchTaskBarPlugin * tb);
 
 #define taskbar_reset_menu(tb) if (tb->tb_built) task_button_reset_menu(tb->tb_icon_grid)
 
+/* X events subscriptions for a window in NET_CLIENT_LIST. */
+typedef struct {
+    guint property_handler;         /* PropertyNotify subscription */
+    guint configure_handler;        /* ConfigureNotify subscription */
+    guint stamp;                    /* Last NET_CLIENT_LIST update having it */
+    GdkRectangle geometry;          /* Last position sent by window manager */
+    gboolean has_geometry;          /* TRUE if geometry is actual */
+    gboolean configure_pending;     /* TRUE if window is in configure_queue */
+} TaskXEvents;
+
+static void task_x_events_free(gpointer data)
+{
+    TaskXEvents *tx = data;
+
+    lxpanel_x_event_disconnect(tx->property_handler);
+    lxpanel_x_event_disconnect(tx->configure_handler);
+    g_slice_free(TaskXEvents, tx);
+}
+
+static gboolean task_x_events_is_stale(gpointer key, gpointer value, gpointer stamp)
+{
+    return ((TaskXEvents *)value)->stamp != GPOINTER_TO_UINT(stamp);
+}
+
+/* Subscribe to events on windows in the list and drop subscriptions for
+   windows that are gone, so we get events only about our clients. */
+static void taskbar_update_x_events(LaunchTaskBarPlugin *tb, Window *client_list,
+                                    int client_count)
+{
+    TaskXEvents *tx;
+    int i;
+
+    tb->x_windows_stamp++;
+    for (i = 0; i < client_count; i++)
+    {
+        tx = g_hash_table_lookup(tb->x_windows, GINT_TO_POINTER(client_list[i]));
+        if (tx == NULL)
+        {
+            tx = g_slice_new0(TaskXEvents);
+            tx->property_handler = lxpanel_x_event_connect(PropertyNotify, client_list[i], None,
+                                                           taskbar_property_notify_event, tb);
+            tx->configure_handler = lxpanel_x_event_connect(ConfigureNotify, client_list[i], None,
+                                                            taskbar_configure_notify_event, tb);
+            g_hash_table_insert(tb->x_windows, GINT_TO_POINTER(client_list[i]), tx);
+        }
+        tx->stamp = tb->x_windows_stamp;
+    }
+    g_hash_table_foreach_remove(tb->x_windows, task_x_events_is_stale,
+                                GUINT_TO_POINTER(tb->x_windows_stamp));
+}
+
 
 #ifndef DISABLE_MENU
-static char *task_get_cmdline(Window win, LaunchTaskBarPlugin *ltbp)
+/* Launcher data resolved for a window, kept in its TaskDetails while it lives. */
+typedef struct {
+    char *exec_bin;                 /* Command line, special cases applied */
+    char *desktop_id;               /* Id of matched desktop entry */
+    FmPath *path;                   /* Path of matched launcher, or NULL */
+    gboolean searched;              /* TRUE if menu cache was searched already */
+} TaskLauncher;
+
+/* Window queued for launcher resolution. */
+typedef struct {
+    Window win;
+    GPid pid;
+    char *cmdline;                  /* Filled by the worker thread */
+    gboolean from_comm;             /* TRUE if cmdline was taken from comm */
+} TaskResolveItem;
+
+/* Batch of windows being resolved in the worker thread. */
+struct TaskResolveJob {
+    LaunchTaskBarPlugin *ltbp;      /* NULL if plugin was destroyed meanwhile */
+    GArray *items;                  /* Array of TaskResolveItem */
+};
+
+/* Reads process command line, it is safe to call it from any thread. */
+static char *task_read_cmdline(GPid pid, gboolean *from_comm)
 {
-    GPid pid = get_net_wm_pid(win);
     char proc_path[64];
     gchar *cmdline = NULL;
     gchar *p_char = NULL;
 
+    *from_comm = FALSE;
+    if (pid == 0)
+        return NULL;
     snprintf(proc_path, sizeof(proc_path),
              G_DIR_SEPARATOR_S "proc" G_DIR_SEPARATOR_S "%lu" G_DIR_SEPARATOR_S "cmdline",
              (gulong)pid);
@@ -220,36 +314,61 @@ static char *task_get_cmdline(Window win, LaunchTaskBarPlugin *ltbp)
                 p_char = strchr(cmdline, '\n');
                 if(p_char != NULL) *p_char = '\0';
             }
+            *from_comm = TRUE;
         }
-        else
+    }
+    return cmdline;
+}
+
+/* Creates launcher data from command line, takes ownership of cmdline. */
+static TaskLauncher *task_launcher_new(LaunchTaskBarPlugin *ltbp, char *cmdline,
+                                       gboolean from_comm)
+{
+    TaskLauncher *tl = g_slice_new0(TaskLauncher);
+    const char *short_exec;
+    char *special;
+
+    if (cmdline && !from_comm)
+    {
+        short_exec = strrchr(cmdline, G_DIR_SEPARATOR);
+        if (short_exec != NULL) short_exec++;
+        else short_exec = cmdline;
+        special = g_key_file_get_string(ltbp->p_key_file_special_cases,
+                                        "special_cases", short_exec, NULL);
+        if (special != NULL) /* found this key */
         {
-            p_char = g_key_file_get_string(ltbp->p_key_file_special_cases,
-                                           "special_cases", p_char, NULL);
-            if (p_char != NULL) /* found this key */
-            {
-                g_free(cmdline);
-                cmdline = p_char;
-            }
+            g_free(cmdline);
+            cmdline = special;
         }
     }
-    return cmdline;
+    tl->exec_bin = cmdline;
+    return tl;
 }
 
-static FmPath *f_find_menu_launchbutton_recursive(Window win, LaunchTaskBarPlugin *ltbp)
+static void task_launcher_free(TaskLauncher *tl)
 {
-    MenuCache *mc;
-    guint32 flags;
-    GSList *apps, *l;
+    g_free(tl->exec_bin);
+    g_free(tl->desktop_id);
+    if (tl->path)
+        fm_path_unref(tl->path);
+    g_slice_free(TaskLauncher, tl);
+}
+
+/* Searches list of applications for the launcher of command line. */
+static void task_launcher_match(TaskLauncher *tl, GSList *apps)
+{
+    GSList *l;
     size_t len;
-    char *exec_bin = task_get_cmdline(win, ltbp);
+    const char *exec_bin = tl->exec_bin;
     const char *exec, *short_exec;
     char *str_path;
-    FmPath *path = NULL;
 
-    /* FIXME: cache it in Task object */
-    mc = panel_menu_cache_new(&flags);
-    /* FIXME: if menu plugin wasn't loaded yet we'll get NULL list here */
-    apps = menu_cache_list_all_apps(mc);
+    /* if menu plugin wasn't loaded yet we'll get NULL list here, retry later */
+    if (apps == NULL)
+        return;
+    tl->searched = TRUE;
+    if (exec_bin == NULL)
+        return;
     short_exec = strrchr(exec_bin, '/');
     if (short_exec != NULL)
         short_exec++;
@@ -291,15 +410,165 @@ static FmPath *f_find_menu_launchbutton_recursive(Window win, LaunchTaskBarPlugi
     if (l)
     {
         str_path = menu_cache_dir_make_path(MENU_CACHE_DIR(l->data));
-        path = fm_path_new_relative(fm_path_get_apps_menu(), str_path+13); /* skip /Applications */
+        tl->path = fm_path_new_relative(fm_path_get_apps_menu(), str_path+13); /* skip /Applications */
         g_free(str_path);
+        tl->desktop_id = g_strdup(menu_cache_item_get_id(MENU_CACHE_ITEM(l->data)));
     }
+    g_debug("task_launcher_match: search '%s' found=%d", exec_bin, (tl->path != NULL));
+}
+
+static GSList *task_list_all_apps(MenuCache **mc)
+{
+    *mc = panel_menu_cache_new(NULL);
+    return menu_cache_list_all_apps(*mc);
+}
+
+static void task_free_all_apps(MenuCache *mc, GSList *apps)
+{
     g_slist_foreach(apps, (GFunc)menu_cache_item_unref, NULL);
     g_slist_free(apps);
     menu_cache_unref(mc);
-    g_debug("f_find_menu_launchbutton_recursive: search '%s' found=%d", exec_bin, (path != NULL));
-    g_free(exec_bin);
-    return path;
+}
+
+/* Returns launcher data for the window, resolving it now if still not done. */
+static TaskLauncher *task_get_launcher(LaunchTaskBarPlugin *ltbp, TaskButton *task,
+                                       Window win)
+{
+    TaskLauncher *tl = task_button_get_window_data(task, win);
+    MenuCache *mc;
+    GSList *apps;
+    char *cmdline;
+    gboolean from_comm;
+
+    if (tl != NULL && tl->searched)
+        return tl;
+    if (tl == NULL)
+    {
+        /* not resolved in background yet, do it right now */
+        cmdline = task_read_cmdline(get_net_wm_pid(win), &from_comm);
+        tl = task_launcher_new(ltbp, cmdline, from_comm);
+        if (!task_button_set_window_data(task, win, tl, (GDestroyNotify)task_launcher_free))
+        {
+            task_launcher_free(tl);
+            return NULL;
+        }
+    }
+    apps = task_list_all_apps(&mc);
+    task_launcher_match(tl, apps);
+    task_free_all_apps(mc, apps);
+    return tl;
+}
+
+static gboolean task_resolve_start(gpointer user_data);
+
+static void task_resolve_job_free(TaskResolveJob *job)
+{
+    guint i;
+
+    for (i = 0; i < job->items->len; i++)
+        g_free(g_array_index(job->items, TaskResolveItem, i).cmdline);
+    g_array_free(job->items, TRUE);
+    g_slice_free(TaskResolveJob, job);
+}
+
+/* Applies results of the batch in the main thread. */
+static gboolean task_resolve_finished(gpointer user_data)
+{
+    TaskResolveJob *job = user_data;
+    LaunchTaskBarPlugin *ltbp = job->ltbp;
+    TaskResolveItem *item;
+    TaskButton *task;
+    TaskLauncher *tl;
+    MenuCache *mc;
+    GSList *apps;
+    guint i;
+
+    if (ltbp != NULL) /* else plugin was destroyed, just drop results */
+    {
+        ltbp->resolve_job = NULL;
+        /* fetch applications list once for the whole batch */
+        apps = task_list_all_apps(&mc);
+        for (i = 0; i < job->items->len; i++)
+        {
+            item = &g_array_index(job->items, TaskResolveItem, i);
+            task = task_lookup(ltbp, item->win);
+            if (task == NULL || task_button_get_window_data(task, item->win) != NULL)
+                continue; /* window is gone or resolved on demand already */
+            tl = task_launcher_new(ltbp, item->cmdline, item->from_comm);
+            item->cmdline = NULL;
+            task_launcher_match(tl, apps);
+            task_button_set_window_data(task, item->win, tl,
+                                        (GDestroyNotify)task_launcher_free);
+        }
+        task_free_all_apps(mc, apps);
+        /* process windows which were mapped while we were busy */
+        if (ltbp->resolve_queue->len > 0 && ltbp->resolve_idle == 0)
+            ltbp->resolve_idle = g_idle_add_full(G_PRIORITY_LOW, task_resolve_start,
+                                                 ltbp, NULL);
+    }
+    task_resolve_job_free(job);
+    return FALSE;
+}
+
+static gpointer task_resolve_thread(gpointer user_data)
+{
+    TaskResolveJob *job = user_data;
+    TaskResolveItem *item;
+    guint i;
+
+    for (i = 0; i < job->items->len; i++)
+    {
+        item = &g_array_index(job->items, TaskResolveItem, i);
+        item->cmdline = task_read_cmdline(item->pid, &item->from_comm);
+    }
+    g_idle_add(task_resolve_finished, job);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_unref(g_thread_self());
+#endif
+    return NULL;
+}
+
+/* Starts resolution of all queued windows in a worker thread. */
+static gboolean task_resolve_start(gpointer user_data)
+{
+    LaunchTaskBarPlugin *ltbp = user_data;
+    TaskResolveJob *job;
+    XErrorHandler previous_error_handler;
+    guint i;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    ltbp->resolve_idle = 0;
+    if (ltbp->resolve_job != NULL || ltbp->resolve_queue->len == 0)
+        return FALSE; /* it will be restarted when current batch is finished */
+    job = g_slice_new(TaskResolveJob);
+    job->ltbp = ltbp;
+    job->items = ltbp->resolve_queue;
+    ltbp->resolve_queue = g_array_new(FALSE, FALSE, sizeof(TaskResolveItem));
+    /* X calls should be done in the main thread; windows may be already gone */
+    previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+    for (i = 0; i < job->items->len; i++)
+        g_array_index(job->items, TaskResolveItem, i).pid =
+            get_net_wm_pid(g_array_index(job->items, TaskResolveItem, i).win);
+    XSetErrorHandler(previous_error_handler);
+    ltbp->resolve_job = job;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_new("taskbar-resolve", task_resolve_thread, job);
+#else
+    g_thread_create(task_resolve_thread, job, FALSE, NULL);
+#endif
+    return FALSE;
+}
+
+/* Queues a newly mapped window for launcher resolution. */
+static void task_resolve_queue(LaunchTaskBarPlugin *ltbp, Window win)
+{
+    TaskResolveItem item = { win, 0, NULL, FALSE };
+
+    g_array_append_val(ltbp->resolve_queue, item);
+    if (ltbp->resolve_idle == 0 && ltbp->resolve_job == NULL)
+        ltbp->resolve_idle = g_idle_add_full(G_PRIORITY_LOW, task_resolve_start,
+                                             ltbp, NULL);
 }
 #endif
 
@@ -769,8 +1038,10 @@ static LaunchButton *launchbar_exec_bin_exists(LaunchTaskBarPlugin *lb, FmPath *
     return ret_val;
 }
 
-/* Read the configuration file entry for a launchtaskbar button and create it. */
-static gboolean launchbutton_constructor(LaunchTaskBarPlugin * lb, config_setting_t * s)
+/* Read the configuration file entry for a launchtaskbar button and create it.
+ * If batch isn't NULL then the button is added there to be loaded later. */
+static gboolean launchbutton_constructor(LaunchTaskBarPlugin * lb, config_setting_t * s,
+                                         GList ** batch)
 {
     LaunchButton *btn = NULL;
     const char *str;
@@ -797,7 +1068,13 @@ static gboolean launchbutton_constructor(LaunchTaskBarPlugin * lb, config_settin
         str_path = g_strdup_printf("search://menu://applications/?recursive=1&show_hidden=1&name=%s", str);
         path = fm_path_new_for_uri(str_path);
     }
-    btn = launch_button_new(lb->panel, lb->plugin, path, s);
+    if (batch)
+    {
+        btn = launch_button_new_deferred(lb->panel, lb->plugin, path, s);
+        *batch = g_list_prepend(*batch, btn);
+    }
+    else
+        btn = launch_button_new(lb->panel, lb->plugin, path, s);
     g_free(str_path);
     fm_path_unref(path);
     if (btn)
@@ -857,7 +1134,7 @@ static gboolean _launchbutton_create_id(LaunchTaskBarPlugin * lb, config_setting
     }
     g_free(dirname);
     if (ret) /* we created it, let use it */
-        return launchbutton_constructor(lb, s);
+        return launchbutton_constructor(lb, s, NULL);
     return FALSE;
 }
 
@@ -869,6 +1146,7 @@ static void launchtaskbar_constructor_add_default_special_case(LaunchTaskBarPlug
 static void launchtaskbar_constructor_launch(LaunchTaskBarPlugin *ltbp)
 {
     config_setting_t *settings;
+    GList *batch = NULL;
     guint i = 0;
 
     if(!ltbp->lb_built)
@@ -887,7 +1165,7 @@ static void launchtaskbar_constructor_launch(LaunchTaskBarPlugin *ltbp)
                     g_warning("launchtaskbar: illegal token %s\n", config_setting_get_name(s));
                     config_setting_destroy(s);
                 }
-                else if (!launchbutton_constructor(ltbp, s) &&
+                else if (!launchbutton_constructor(ltbp, s, &batch) &&
                          /* try to create desktop id from old-style manual setup */
                          !_launchbutton_create_id(ltbp, s))
                 {
@@ -899,6 +1177,10 @@ static void launchtaskbar_constructor_launch(LaunchTaskBarPlugin *ltbp)
                     i++;
             }
         }
+        /* resolve all buttons at once */
+        batch = g_list_reverse(batch);
+        launch_button_load_batch(batch);
+        g_list_free(batch);
         if (i == 0)
         {
             /* build bootstrap button */
@@ -1000,6 +1282,106 @@ static gboolean init_flash_timer (gpointer user_data)
     return FALSE;
 }
 
+/* Buttons which don't fit into the icon grid are left unmapped by it and
+   are reachable from a menu instead, so panel is not relaid out and redrawn
+   for hundreds of buttons a few pixels wide. */
+static guint taskbar_count_overflow_windows(LaunchTaskBarPlugin * tb)
+{
+    GList *children, *l;
+    guint n = 0;
+
+    if (!tb->overflow_menu || !gtk_widget_get_visible(tb->tb_icon_grid)
+        || panel_icon_grid_get_n_overflow(PANEL_ICON_GRID(tb->tb_icon_grid)) == 0)
+        return 0;
+    /* the icon grid leaves buttons which don't fit not child-visible, count
+       windows in them since the menu lists windows, not buttons */
+    children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid));
+    for (l = children; l; l = l->next)
+        if (gtk_widget_get_visible(l->data) && !gtk_widget_get_child_visible(l->data))
+            n += task_button_get_n_windows(l->data);
+    g_list_free(children);
+    return n;
+}
+
+static void taskbar_update_overflow(LaunchTaskBarPlugin * tb)
+{
+    guint n = taskbar_count_overflow_windows(tb);
+    char text[16];
+
+    tb->overflow_windows = n;
+    if (n == 0)
+    {
+        gtk_widget_hide(tb->overflow_button);
+        return;
+    }
+    snprintf(text, sizeof(text), "+%u", n);
+    lxpanel_draw_label_text(tb->panel, gtk_bin_get_child(GTK_BIN(tb->overflow_button)),
+                            text, FALSE, 1, tb->flags.flat_button);
+    gtk_button_set_relief(GTK_BUTTON(tb->overflow_button),
+                          tb->flags.flat_button ? GTK_RELIEF_NONE : GTK_RELIEF_NORMAL);
+    gtk_widget_show(tb->overflow_button);
+}
+
+static gboolean taskbar_update_overflow_idle(gpointer user_data)
+{
+    LaunchTaskBarPlugin *tb;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    tb = user_data;
+    tb->overflow_idle = 0;
+    /* updating the label resizes the panel, do it only if needed */
+    if (taskbar_count_overflow_windows(tb) != tb->overflow_windows)
+        taskbar_update_overflow(tb);
+    return FALSE;
+}
+
+static void on_tb_icon_grid_size_allocate(GtkWidget *grid, GtkAllocation *alloc,
+                                          LaunchTaskBarPlugin *tb)
+{
+    /* buttons which don't fit and windows in them are changed on allocation,
+       don't resize the panel right inside it */
+    if (tb->overflow_idle == 0)
+        tb->overflow_idle = g_idle_add(taskbar_update_overflow_idle, tb);
+}
+
+#if !GTK_CHECK_VERSION(3, 0, 0)
+static void taskbar_overflow_set_position(GtkMenu *menu, gint *px, gint *py,
+                                          gboolean *push_in, gpointer data)
+{
+    LaunchTaskBarPlugin *tb = data;
+
+    lxpanel_plugin_popup_set_position_helper(tb->panel, tb->overflow_button,
+                                             GTK_WIDGET(menu), px, py);
+    *push_in = TRUE;
+}
+#endif
+
+static void on_overflow_button_clicked(GtkButton *button, LaunchTaskBarPlugin *tb)
+{
+    GtkWidget *menu = gtk_menu_new();
+    GList *children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid));
+    GList *l;
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gtk_menu_set_reserve_toggle_size(GTK_MENU(menu), FALSE);
+#endif
+    for (l = children; l; l = l->next)
+        if (gtk_widget_get_visible(l->data) && !gtk_widget_get_child_visible(l->data))
+            task_button_add_menu_items(l->data, GTK_MENU_SHELL(menu));
+    g_list_free(children);
+    g_signal_connect(menu, "selection-done", G_CALLBACK(gtk_widget_destroy), NULL);
+    gtk_widget_show_all(menu);
+    gtk_menu_attach_to_widget(GTK_MENU(menu), GTK_WIDGET(button), NULL);
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gtk_menu_popup_at_widget(GTK_MENU(menu), GTK_WIDGET(button),
+                             GDK_GRAVITY_NORTH_WEST, GDK_GRAVITY_NORTH_WEST, NULL);
+#else
+    gtk_menu_popup(GTK_MENU(menu), NULL, NULL, taskbar_overflow_set_position, tb,
+                   0, gtk_get_current_event_time());
+#endif
+}
+
 static void launchtaskbar_constructor_task(LaunchTaskBarPlugin *ltbp)
 {
     if(!ltbp->tb_built)
@@ -1032,6 +1414,8 @@ static void launchtaskbar_constructor_task(LaunchTaskBarPlugin *ltbp)
             ltbp->grouped_tasks = (tmp_int != 0);
         if (config_setting_lookup_int(s, "UseSmallerIcons", &tmp_int))
             ltbp->flags.use_smaller_icons = (tmp_int != 0);
+        if (config_setting_lookup_int(s, "OverflowMenu", &tmp_int))
+            ltbp->overflow_menu = (tmp_int != 0);
 
         /* Make container for task buttons as a child of top level widget. */
         ltbp->tb_icon_grid = panel_icon_grid_new(panel_get_orientation(ltbp->panel),
@@ -1040,15 +1424,30 @@ static void launchtaskbar_constructor_task(LaunchTaskBarPlugin *ltbp)
                                                  ltbp->spacing, 0,
                                                  panel_get_height(ltbp->panel));
         panel_icon_grid_set_constrain_width(PANEL_ICON_GRID(ltbp->tb_icon_grid), TRUE);
+        panel_icon_grid_set_overflow(PANEL_ICON_GRID(ltbp->tb_icon_grid), ltbp->overflow_menu);
         gtk_box_pack_start(GTK_BOX(ltbp->plugin), ltbp->tb_icon_grid, TRUE, TRUE, 0);
+        g_signal_connect_after(ltbp->tb_icon_grid, "size-allocate",
+                               G_CALLBACK(on_tb_icon_grid_size_allocate), ltbp);
+        ltbp->overflow_button = gtk_button_new();
+        gtk_container_add(GTK_CONTAINER(ltbp->overflow_button), gtk_label_new(NULL));
+        gtk_widget_show(gtk_bin_get_child(GTK_BIN(ltbp->overflow_button)));
+        g_signal_connect(ltbp->overflow_button, "clicked",
+                         G_CALLBACK(on_overflow_button_clicked), ltbp);
+        gtk_box_pack_start(GTK_BOX(ltbp->plugin), ltbp->overflow_button, FALSE, TRUE, 0);
         /* taskbar_update_style(ltbp); */
 
-        /* Add GDK event filter. */
-        gdk_window_add_filter(NULL, (GdkFilterFunc) taskbar_event_filter, ltbp);
+#ifndef DISABLE_MENU
+        ltbp->resolve_queue = g_array_new(FALSE, FALSE, sizeof(TaskResolveItem));
+#endif
+
+        /* Windows which we receive X events about. */
+        ltbp->x_windows = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                                NULL, task_x_events_free);
+        ltbp->configure_queue = g_array_new(FALSE, FALSE, sizeof(Window));
 
         /* Connect signals to receive root window events and initialize root window properties. */
-        ltbp->number_of_desktops = get_net_number_of_desktops();
-        ltbp->current_desktop = get_net_current_desktop();
+        ltbp->number_of_desktops = fb_ev_number_of_desktops(fbev);
+        ltbp->current_desktop = fb_ev_current_desktop(fbev);
         g_signal_connect(G_OBJECT(fbev), "current-desktop", G_CALLBACK(taskbar_net_current_desktop), (gpointer) ltbp);
         g_signal_connect(G_OBJECT(fbev), "active-window", G_CALLBACK(taskbar_net_active_window), (gpointer) ltbp);
         g_signal_connect(G_OBJECT(fbev), "number-of-desktops", G_CALLBACK(taskbar_net_number_of_desktops), (gpointer) ltbp);
@@ -1067,6 +1466,7 @@ static void launchtaskbar_constructor_task(LaunchTaskBarPlugin *ltbp)
         taskbar_net_active_window(NULL, ltbp);
     }
     gtk_widget_set_visible(ltbp->tb_icon_grid, TRUE);
+    taskbar_update_overflow(ltbp);
 }
 
 /* Override GtkBox bug - it does not always propagate allocation to children */
@@ -1199,8 +1599,11 @@ static void launchtaskbar_destructor_launch(LaunchTaskBarPlugin *ltbp)
 
 static void launchtaskbar_destructor_task(LaunchTaskBarPlugin *ltbp)
 {
-    /* Remove GDK event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) taskbar_event_filter, ltbp);
+    /* Remove X events subscriptions. */
+    if (ltbp->configure_timer != 0)
+        g_source_remove(ltbp->configure_timer);
+    g_array_free(ltbp->configure_queue, TRUE);
+    g_hash_table_destroy(ltbp->x_windows);
 
     /* Remove root window signal handlers. */
     g_signal_handlers_disconnect_by_func(fbev, taskbar_net_current_desktop, ltbp);
@@ -1213,9 +1616,19 @@ static void launchtaskbar_destructor_task(LaunchTaskBarPlugin *ltbp)
 
     /* Stop blinking timeout */
     reset_timer_on_task(ltbp);
+
+    if (ltbp->overflow_idle != 0)
+        g_source_remove(ltbp->overflow_idle);
 #ifndef DISABLE_MENU
     if (ltbp->path)
         fm_path_unref(ltbp->path);
+
+    /* Launcher resolution: running batch will be freed on completion */
+    if (ltbp->resolve_idle != 0)
+        g_source_remove(ltbp->resolve_idle);
+    if (ltbp->resolve_job != NULL)
+        ltbp->resolve_job->ltbp = NULL;
+    g_array_free(ltbp->resolve_queue, TRUE);
 #endif
 
     /* DND delay handler */
@@ -1481,7 +1894,10 @@ static void on_combobox_mode_changed(GtkComboBox *p_combobox, gpointer p_data)
     switch (ltbp->mode) {
     case LAUNCHBAR:
         if (ltbp->tb_icon_grid)
+        {
             gtk_widget_set_visible(ltbp->tb_icon_grid, FALSE);
+            taskbar_update_overflow(ltbp);
+        }
         launchtaskbar_constructor_launch(ltbp);
         plugin_set_expand_status(ltbp, FALSE);
         gtk_widget_set_name(ltbp->plugin, "launchbar");
@@ -1523,6 +1939,15 @@ static void on_checkbutton_icons_only_toggled(GtkToggleButton *p_togglebutton, g
     taskbar_apply_configuration(ltbp);
 }
 
+static void on_checkbutton_overflow_menu_toggled(GtkToggleButton *p_togglebutton, gpointer p_data)
+{
+    LaunchTaskBarPlugin *ltbp = (LaunchTaskBarPlugin *)p_data;
+    ltbp->overflow_menu = gtk_toggle_button_get_active(p_togglebutton);
+    config_group_set_int(ltbp->settings, "OverflowMenu", ltbp->overflow_menu);
+    panel_icon_grid_set_overflow(PANEL_ICON_GRID(ltbp->tb_icon_grid), ltbp->overflow_menu);
+    taskbar_update_overflow(ltbp);
+}
+
 static void on_checkbutton_flat_buttons_toggled(GtkToggleButton *p_togglebutton, gpointer p_data)
 {
     LaunchTaskBarPlugin *ltbp = (LaunchTaskBarPlugin *)p_data;
@@ -1816,6 +2241,12 @@ static GtkWidget *launchtaskbar_configure(LXPanel *panel, GtkWidget *p)
             gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(object), ltbp->flags.use_smaller_icons);
             g_signal_connect(object, "toggled", G_CALLBACK(on_checkbutton_use_smaller_icons_toggled), ltbp);
         }
+        object = gtk_builder_get_object(builder, "checkbutton_overflow_menu");
+        if (object)
+        {
+            gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(object), ltbp->overflow_menu);
+            g_signal_connect(object, "toggled", G_CALLBACK(on_checkbutton_overflow_menu_toggled), ltbp);
+        }
 
 #define SETUP_SPIN_BUTTON(button,member) \
         object = gtk_builder_get_object(builder, #button); \
@@ -1909,7 +2340,7 @@ static gboolean launchtaskbar_control(GtkWidget *p, const char *cmd)
 
             s = config_group_add_subgroup(ltbp->settings, "Button");
             config_group_set_string(s, "id", &cmd[4]);
-            if (launchbutton_constructor(ltbp, s))
+            if (launchbutton_constructor(ltbp, s, NULL))
             {
                 launchbar_remove_bootstrap(ltbp);
                 lxpanel_config_save(ltbp->panel);
@@ -1949,6 +2380,7 @@ static void taskbar_redraw(LaunchTaskBarPlugin * tb)
         task_button_update(l->data, tb->current_desktop, tb->number_of_desktops,
                            mon, icon_size, tb->flags);
     g_list_free(children);
+    taskbar_update_overflow(tb);
 }
 
 /* Determine if a task should be visible given its NET_WM_STATE. */
@@ -2047,13 +2479,13 @@ static void on_task_menu_target_set(TaskButton *btn, gulong win, LaunchTaskBarPl
 #ifndef DISABLE_MENU
             if(ltbp->mode == LAUNCHTASKBAR)
             {
-                FmPath *path = f_find_menu_launchbutton_recursive(win, ltbp);
-                LaunchButton *btn = launchbar_exec_bin_exists(ltbp, path);
-                /* FIXME: shouldn't we make file info at task button creation? */
+                TaskLauncher *tl = task_get_launcher(ltbp, btn, win);
+                FmPath *path = (tl && tl->path) ? fm_path_ref(tl->path) : NULL;
+                LaunchButton *lbtn = launchbar_exec_bin_exists(ltbp, path);
 #ifdef DEBUG
-                g_print("\nTB '%s' right-click, in LB: %c\n", tk->exec_bin, btn != NULL ? 'Y':'N');
+                g_print("\nTB '%s' right-click, in LB: %c\n", tl ? tl->exec_bin : NULL, lbtn != NULL ? 'Y':'N');
 #endif
-                if(btn != NULL)
+                if(lbtn != NULL)
                 {
                     gtk_widget_set_visible(ltbp->p_menuitem_lock_tbp, FALSE);
                     gtk_widget_set_visible(ltbp->p_menuitem_unlock_tbp, TRUE);
@@ -2225,12 +2657,17 @@ static void taskbar_add_new_window(LaunchTaskBarPlugin * tb, Window win, GList *
     else for (; list; list = list->next)
         if (task_button_add_window(list->data, win, res_class))
             break;
-    if (list != NULL)
-        return; /* some button accepted it, done */
-
-    task = task_button_new(win, tb->current_desktop, tb->number_of_desktops,
-                           tb->panel, res_class, tb->flags);
-    taskbar_add_task_button(tb, task);
+    if (list == NULL) /* no button accepted it, make a new one */
+    {
+        task = task_button_new(win, tb->current_desktop, tb->number_of_desktops,
+                               tb->panel, res_class, tb->flags);
+        taskbar_add_task_button(tb, task);
+    }
+#ifndef DISABLE_MENU
+    /* each window has own launcher data, even in a group */
+    if (tb->mode == LAUNCHTASKBAR)
+        task_resolve_queue(tb, win);
+#endif
 }
 
 /*****************************************************
@@ -2245,7 +2682,8 @@ static void taskbar_net_client_list(GtkWidget * widget, LaunchTaskBarPlugin * tb
 
     /* Get the NET_CLIENT_LIST property. */
     int client_count;
-    Window * client_list = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_CLIENT_LIST, XA_WINDOW, &client_count);
+    Window * client_list = fb_ev_client_list(fbev, &client_count);
+    taskbar_update_x_events(tb, client_list, client_count);
     if (client_list != NULL)
     {
         GList *children = gtk_container_get_children(GTK_CONTAINER(tb->tb_icon_grid)), *l;
@@ -2284,7 +2722,6 @@ static void taskbar_net_client_list(GtkWidget * widget, LaunchTaskBarPlugin * tb
             }
         }
         g_list_free(children);
-        XFree(client_list);
     }
 
     else /* clear taskbar */
@@ -2299,7 +2736,7 @@ static void taskbar_net_current_desktop(GtkWidget * widget, LaunchTaskBarPlugin
     if(ltbp->mode == LAUNCHBAR) return;
 
     /* Store the local copy of current desktops.  Redisplay the taskbar. */
-    tb->current_desktop = get_net_current_desktop();
+    tb->current_desktop = fb_ev_current_desktop(fbev);
     taskbar_redraw(tb);
 }
 
@@ -2310,7 +2747,7 @@ static void taskbar_net_number_of_desktops(GtkWidget * widget, LaunchTaskBarPlug
     if(ltbp->mode == LAUNCHBAR) return;
 
     /* Store the local copy of number of desktops.  Recompute the popup menu and redisplay the taskbar. */
-    tb->number_of_desktops = get_net_number_of_desktops();
+    tb->number_of_desktops = fb_ev_number_of_desktops(fbev);
     taskbar_reset_menu(tb);
     taskbar_redraw(tb);
 }
@@ -2322,19 +2759,22 @@ static void taskbar_net_active_window(GtkWidget * widget, LaunchTaskBarPlugin *
     if(ltbp->mode == LAUNCHBAR) return;
 
     /* Get the window that has focus. */
-    Window * f = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_ACTIVE_WINDOW, XA_WINDOW, 0);
+    Window * f = fb_ev_active_window(fbev);
 
     gtk_container_foreach(GTK_CONTAINER(tb->tb_icon_grid),
                           (GtkCallback)task_button_window_focus_changed, f);
-    if (f != NULL)
-        XFree(f);
 }
 
 /* Handle PropertyNotify event.
  * http://tronche.com/gui/x/icccm/
  * http://standards.freedesktop.org/wm-spec/wm-spec-1.4.html */
-static void taskbar_property_notify_event(LaunchTaskBarPlugin *tb, XEvent *ev)
+static GdkFilterReturn taskbar_property_notify_event(XEvent *ev, gpointer user_data)
 {
+    LaunchTaskBarPlugin *tb = user_data;
+
+    if (tb->mode == LAUNCHBAR)
+        return GDK_FILTER_CONTINUE;
+
     /* State may be PropertyNewValue, PropertyDeleted. */
     if (((XPropertyEvent*) ev)->state == PropertyNewValue)
     {
@@ -2388,42 +2828,84 @@ static void taskbar_property_notify_event(LaunchTaskBarPlugin *tb, XEvent *ev)
             }
         }
     }
+    return GDK_FILTER_CONTINUE;
 }
 
-/* Handle ConfigureNotify events */
-static void taskbar_configure_notify_event(LaunchTaskBarPlugin * tb, XConfigureEvent * ev)
+/* Process windows that were moved or resized since last frame */
+static gboolean taskbar_configure_flush(gpointer user_data)
 {
-    /* If the same_monitor_only option is set and the window is on a different
-       monitor than before, redraw the taskbar */
+    LaunchTaskBarPlugin *tb = user_data;
+    XErrorHandler previous_error_handler;
+    TaskXEvents *tx;
     TaskButton *task;
+    Window win;
+    guint i;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    tb->configure_timer = 0;
 
-    if (ev->window != GDK_ROOT_WINDOW())
+    /* Deleted windows seem to get ConfigureNotify events too. */
+    previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
+    for (i = 0; i < tb->configure_queue->len; i++)
     {
-        task = task_lookup(tb, ev->window);
+        win = g_array_index(tb->configure_queue, Window, i);
+        tx = g_hash_table_lookup(tb->x_windows, GINT_TO_POINTER(win));
+        if (tx == NULL || !tx->configure_pending) /* left NET_CLIENT_LIST */
+            continue;
+        tx->configure_pending = FALSE;
+        task = task_lookup(tb, win);
+        /* Monitor might be changed so button might need update */
         if (task)
-        {
-            /* Deleted windows seem to get ConfigureNotify events too. */
-            XErrorHandler previous_error_handler = XSetErrorHandler(panel_handle_x_error_swallow_BadWindow_BadDrawable);
-
-            /* Monitor might be changed so button might need update */
-            task_button_window_reconfigured(task, ev->window);
-
-            XSetErrorHandler(previous_error_handler);
-        }
+            task_button_window_reconfigured(task, win,
+                                            tx->has_geometry ? &tx->geometry : NULL);
     }
+    XSetErrorHandler(previous_error_handler);
+    g_array_set_size(tb->configure_queue, 0);
+    return FALSE;
 }
 
-/* GDK event filter. */
-static GdkFilterReturn taskbar_event_filter(XEvent * xev, GdkEvent * event, LaunchTaskBarPlugin * tb)
+/* Handle ConfigureNotify events */
+static GdkFilterReturn taskbar_configure_notify_event(XEvent *xev, gpointer user_data)
 {
+    /* If the same_monitor_only option is set and the window is on a different
+       monitor than before, redraw the taskbar */
+    LaunchTaskBarPlugin *tb = user_data;
+    XConfigureEvent *ev = &xev->xconfigure;
+    TaskXEvents *tx;
+
     if (tb->mode == LAUNCHBAR)
         return GDK_FILTER_CONTINUE;
 
-    if (xev->type == PropertyNotify)
-        taskbar_property_notify_event(tb, xev);
-    else if (xev->type == ConfigureNotify)
-        taskbar_configure_notify_event(tb, &xev->xconfigure);
+    tx = g_hash_table_lookup(tb->x_windows, GINT_TO_POINTER(ev->window));
+    if (tx == NULL)
+        return GDK_FILTER_CONTINUE;
 
+    /* Window drag or resize generates lots of events, remember only the last
+       one and process it on next frame. Only synthetic events sent by window
+       manager are in root coordinates, otherwise position will be queried. */
+    if (ev->send_event)
+    {
+        if (tx->has_geometry && !tx->configure_pending
+            && tx->geometry.x == ev->x && tx->geometry.y == ev->y
+            && tx->geometry.width == ev->width && tx->geometry.height == ev->height)
+            return GDK_FILTER_CONTINUE; /* not moved */
+        tx->geometry.x = ev->x;
+        tx->geometry.y = ev->y;
+        tx->geometry.width = ev->width;
+        tx->geometry.height = ev->height;
+        tx->has_geometry = TRUE;
+    }
+    else
+        tx->has_geometry = FALSE;
+
+    if (!tx->configure_pending)
+    {
+        tx->configure_pending = TRUE;
+        g_array_append_val(tb->configure_queue, ev->window);
+    }
+    if (tb->configure_timer == 0)
+        tb->configure_timer = g_timeout_add(CONFIGURE_INTERVAL, taskbar_configure_flush, tb);
     return GDK_FILTER_CONTINUE;
 }
 
@@ -88,8 +88,26 @@ typedef struct {
     guint visibility_flags;
     gpointer reload_notify;
     FmDndSrc *ds;
+
+    GHashTable *icon_pending;   /* FmIcon being loaded by prefetch jobs */
+    guint icon_generation;      /* bumped each time the icon theme is changed */
+    GSList *icon_jobs;          /* running icons prefetch jobs */
 } menup;
 
+typedef struct {
+    FmIcon *icon;               /* referenced icon */
+    char *filename;             /* file to decode, resolved in main thread */
+    GdkPixbuf *pixbuf;          /* result, set by the worker */
+} MenuIconLoad;
+
+typedef struct {
+    menup *m;                   /* NULL if plugin was destroyed */
+    GtkWidget *menu;            /* weak pointer to menu which requested icons */
+    guint generation;           /* m->icon_generation at start */
+    int size;                   /* requested icons size */
+    GArray *icons;              /* array of MenuIconLoad */
+} MenuIconJob;
+
 static guint idle_loader = 0;
 
 GQuark SYS_MENU_ITEM_ID = 0;
@@ -107,6 +125,193 @@ static void on_data_get(FmDndSrc *ds, GtkWidget *mi)
     fm_dnd_src_set_file(ds, fi);
 }
 
+#define MENU_ICON_FALLBACK "application-x-executable"
+
+/* returns TRUE if icon is being loaded by prefetch job right now */
+static gboolean menu_icon_is_pending(menup *m, FmIcon *icon)
+{
+    return g_hash_table_lookup_extended(m->icon_pending, icon, NULL, NULL);
+}
+
+static void menu_icon_job_cancel(gpointer job, gpointer unused)
+{
+    ((MenuIconJob *)job)->m = NULL;
+}
+
+static void menu_icon_job_free(MenuIconJob *job)
+{
+    guint i;
+
+    for (i = 0; i < job->icons->len; i++)
+    {
+        MenuIconLoad *load = &g_array_index(job->icons, MenuIconLoad, i);
+
+        g_object_unref(load->icon);
+        g_free(load->filename);
+        if (load->pixbuf)
+            g_object_unref(load->pixbuf);
+    }
+    g_array_free(job->icons, TRUE);
+    if (job->menu)
+        g_object_remove_weak_pointer(G_OBJECT(job->menu), (gpointer *)&job->menu);
+    g_slice_free(MenuIconJob, job);
+}
+
+static void on_menu_item_map(GtkWidget *mi, menup *m);
+
+/* runs in main thread: put decoded icons into cache and set them on items
+   which were mapped while the job was running */
+static gboolean menu_icon_job_finished(gpointer user_data)
+{
+    MenuIconJob *job = user_data;
+    menup *m = job->m;
+    GList *children, *child;
+    guint i;
+
+    if (m == NULL) /* plugin was destroyed */
+        goto _done;
+    m->icon_jobs = g_slist_remove(m->icon_jobs, job);
+    /* if theme was changed meanwhile then results are obsolete and pending
+       icons were already forgotten so there is nothing to do */
+    if (job->generation != m->icon_generation)
+        goto _done;
+    for (i = 0; i < job->icons->len; i++)
+    {
+        MenuIconLoad *load = &g_array_index(job->icons, MenuIconLoad, i);
+
+        /* if not loaded then let on_menu_item_map() try it with fallback */
+        if (load->pixbuf && job->size == m->iconsize)
+            lxpanel_icon_cache_add(load->icon, job->size, 1, MENU_ICON_FALLBACK,
+                                   load->pixbuf);
+        g_hash_table_remove(m->icon_pending, load->icon);
+    }
+    if (job->menu && gtk_widget_get_mapped(job->menu))
+    {
+        children = gtk_container_get_children(GTK_CONTAINER(job->menu));
+        for (child = children; child; child = child->next)
+            if (gtk_widget_get_mapped(child->data) &&
+                g_signal_handler_find(child->data, G_SIGNAL_MATCH_FUNC, 0, 0,
+                                      NULL, on_menu_item_map, NULL))
+                on_menu_item_map(child->data, m);
+        g_list_free(children);
+    }
+
+_done:
+    menu_icon_job_free(job);
+    return FALSE;
+}
+
+static gpointer menu_icon_job_thread(gpointer user_data)
+{
+    MenuIconJob *job = user_data;
+    guint i;
+
+    for (i = 0; i < job->icons->len; i++)
+    {
+        MenuIconLoad *load = &g_array_index(job->icons, MenuIconLoad, i);
+
+        load->pixbuf = gdk_pixbuf_new_from_file_at_size(load->filename, job->size,
+                                                        job->size, NULL);
+    }
+    g_idle_add(menu_icon_job_finished, job);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_unref(g_thread_self());
+#endif
+    return NULL;
+}
+
+static GtkImage *menu_item_get_image(GtkWidget *mi)
+{
+#if GTK_CHECK_VERSION(3, 0, 0)
+    GtkWidget *box = gtk_bin_get_child(GTK_BIN(mi));
+    GtkImage *img = NULL;
+    GList *children;
+
+    if (!GTK_IS_BOX(box))
+        return NULL;
+    children = gtk_container_get_children(GTK_CONTAINER(box));
+    if (children && GTK_IS_IMAGE(children->data))
+        img = children->data; /* this should always be the image... */
+    g_list_free(children);
+    return img;
+#else
+    if (!GTK_IS_IMAGE_MENU_ITEM(mi))
+        return NULL;
+    return GTK_IMAGE(gtk_image_menu_item_get_image(GTK_IMAGE_MENU_ITEM(mi)));
+#endif
+}
+
+/* Decode icons of items in the menu which is about to be shown in a worker
+   thread. Icon theme lookup isn't thread-safe so files are resolved here and
+   only the decoding is done by the worker. */
+static void menu_prefetch_icons(menup *m, GtkWidget *menu)
+{
+    GtkIconTheme *theme = gtk_icon_theme_get_default();
+    GList *children, *child;
+    MenuIconJob *job = NULL;
+    GtkIconInfo *info;
+    GdkPixbuf *pixbuf;
+    GtkImage *img;
+    FmFileInfo *fi;
+    FmIcon *icon;
+
+    children = gtk_container_get_children(GTK_CONTAINER(menu));
+    for (child = children; child; child = child->next)
+    {
+        fi = g_object_get_qdata(G_OBJECT(child->data), SYS_MENU_ITEM_ID);
+        if (fi == NULL || fi == (gpointer)1 /* placeholder or separator */)
+            continue;
+        icon = fm_file_info_get_icon(fi);
+        if (icon == NULL || menu_icon_is_pending(m, icon))
+            continue;
+        pixbuf = lxpanel_icon_cache_lookup(icon, m->iconsize, 1, MENU_ICON_FALLBACK);
+        if (pixbuf != NULL)
+        {
+            g_object_unref(pixbuf);
+            continue;
+        }
+        img = menu_item_get_image(child->data);
+        if (img == NULL || gtk_image_get_storage_type(img) != GTK_IMAGE_EMPTY)
+            continue;
+        info = gtk_icon_theme_lookup_by_gicon(theme, fm_icon_get_gicon(icon),
+                                              m->iconsize, GTK_ICON_LOOKUP_FORCE_SIZE);
+        if (info == NULL) /* will be handled with fallback when mapped */
+            continue;
+        if (gtk_icon_info_get_filename(info) != NULL)
+        {
+            MenuIconLoad load;
+
+            if (job == NULL)
+            {
+                job = g_slice_new0(MenuIconJob);
+                job->m = m;
+                job->generation = m->icon_generation;
+                job->size = m->iconsize;
+                job->icons = g_array_new(FALSE, FALSE, sizeof(MenuIconLoad));
+            }
+            load.icon = g_object_ref(icon);
+            load.filename = g_strdup(gtk_icon_info_get_filename(info));
+            load.pixbuf = NULL;
+            g_array_append_val(job->icons, load);
+            /* mark it as being loaded */
+            g_hash_table_insert(m->icon_pending, g_object_ref(icon), NULL);
+        }
+        gtk_icon_info_free(info);
+    }
+    g_list_free(children);
+
+    if (job == NULL)
+        return;
+    job->menu = menu;
+    g_object_add_weak_pointer(G_OBJECT(menu), (gpointer *)&job->menu);
+    m->icon_jobs = g_slist_prepend(m->icon_jobs, job);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_new("menu-icons", menu_icon_job_thread, job);
+#else
+    g_thread_create(menu_icon_job_thread, job, FALSE, NULL);
+#endif
+}
+
 static void
 menu_destructor(gpointer user_data)
 {
@@ -121,6 +326,10 @@ menu_destructor(gpointer user_data)
     if (m->show_system_menu_idle)
         g_source_remove(m->show_system_menu_idle);
 
+    /* let running prefetch jobs know they should just free themselves */
+    g_slist_foreach(m->icon_jobs, menu_icon_job_cancel, NULL);
+    g_slist_free(m->icon_jobs);
+
     g_signal_handlers_disconnect_matched(m->ds, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
                                          on_data_get, NULL);
     g_object_unref(G_OBJECT(m->ds));
@@ -132,6 +341,7 @@ menu_destructor(gpointer user_data)
         menu_cache_unref( m->menu_cache );
     }
 
+    g_hash_table_destroy(m->icon_pending);
     g_free(m->fname);
     g_free(m->caption);
     g_free(m);
@@ -179,13 +389,7 @@ static void on_menu_item( GtkMenuItem* mi, menup* m )
 /* load icon when mapping the menu item to speed up */
 static void on_menu_item_map(GtkWidget *mi, menup *m)
 {
-#if GTK_CHECK_VERSION(3, 0, 0)
-  GList *children = gtk_container_get_children (GTK_CONTAINER (gtk_bin_get_child (GTK_BIN (mi))));
-  GtkImage *img = children->data;  // this should always be the image...
-  g_list_free (children);
-#else
-  GtkImage* img = GTK_IMAGE(gtk_image_menu_item_get_image(GTK_IMAGE_MENU_ITEM(mi)));
-#endif
+    GtkImage* img = menu_item_get_image(mi);
     if( img )
     {
         FmFileInfo *fi;
@@ -198,16 +402,18 @@ static void on_menu_item_map(GtkWidget *mi, menup *m)
             GdkPixbuf *icon = NULL;
 
             if (fm_icon == NULL)
-                fm_icon = _fm_icon = fm_icon_from_name("application-x-executable");
-            icon = fm_pixbuf_from_icon_with_fallback(fm_icon, m->iconsize,
-                                                         "application-x-executable");
-            if (_fm_icon)
-                g_object_unref(_fm_icon);
+                fm_icon = _fm_icon = fm_icon_from_name(MENU_ICON_FALLBACK);
+            /* if icon is still being loaded it will be set when ready */
+            if (!menu_icon_is_pending(m, fm_icon))
+                icon = lxpanel_icon_cache_get(fm_icon, m->iconsize, 1,
+                                              MENU_ICON_FALLBACK);
             if (icon)
             {
                 gtk_image_set_from_pixbuf(img, icon);
                 g_object_unref(icon);
             }
+            if (_fm_icon)
+                g_object_unref(_fm_icon);
         }
     }
 }
@@ -402,6 +608,42 @@ static gboolean on_menu_button_press(GtkWidget* mi, GdkEventButton* evt, menup*
     return FALSE;
 }
 
+/* create FmFileInfo for the item, it will be used in callbacks */
+static FmFileInfo *menu_item_file_info_new(MenuCacheItem *item)
+{
+    char *mpath = menu_cache_dir_make_path(MENU_CACHE_DIR(item));
+    FmPath *path = fm_path_new_relative(fm_path_get_apps_menu(), mpath+13);
+                                                /* skip "/Applications" */
+    FmFileInfo *fi = fm_file_info_new_from_menu_cache_item(path, item);
+
+    g_free(mpath);
+    fm_path_unref(path);
+    return fi;
+}
+
+gboolean check_close (GtkWidget *widget, GdkEventKey *event, gpointer userdata);
+static int load_menu(menup* m, MenuCacheDir* dir, GtkWidget* menu, int pos );
+
+/* fill submenu only when it's about to be shown first time */
+static void on_menu_dir_select(GtkMenuItem *mi, menup *m)
+{
+    GtkWidget *sub = g_object_get_data(G_OBJECT(mi), "PanelMenuDirSubmenu");
+
+    if (sub == NULL || g_object_get_data(G_OBJECT(sub), "PanelMenuLoaded"))
+        return;
+    load_menu(m, g_object_get_data(G_OBJECT(sub), "PanelMenuCacheDir"), sub, -1);
+    g_object_set_data(G_OBJECT(sub), "PanelMenuLoaded", GINT_TO_POINTER(1));
+    menu_prefetch_icons(m, sub);
+}
+
+/* set directory for submenu, it will be used to fill it on demand */
+static void menu_dir_set_cache_dir(GtkWidget *sub, MenuCacheItem *item)
+{
+    g_object_set_data_full(G_OBJECT(sub), "PanelMenuCacheDir",
+                           menu_cache_item_ref(item),
+                           (GDestroyNotify)menu_cache_item_unref);
+}
+
 static GtkWidget* create_item(MenuCacheItem *item, menup *m)
 {
     GtkWidget* mi;
@@ -413,14 +655,7 @@ static GtkWidget* create_item(MenuCacheItem *item, menup *m)
     else
     {
         GtkWidget* img;
-        /* create FmFileInfo for the item, it will be used in callbacks */
-        char *mpath = menu_cache_dir_make_path(MENU_CACHE_DIR(item));
-        FmPath *path = fm_path_new_relative(fm_path_get_apps_menu(), mpath+13);
-                                                    /* skip "/Applications" */
-        FmFileInfo *fi = fm_file_info_new_from_menu_cache_item(path, item);
-
-        g_free(mpath);
-        fm_path_unref(path);
+        FmFileInfo *fi = menu_item_file_info_new(item);
 #if GTK_CHECK_VERSION(3, 0, 0)
         GtkWidget *box, *label;
         mi = gtk_menu_item_new ();
@@ -449,6 +684,23 @@ static GtkWidget* create_item(MenuCacheItem *item, menup *m)
                 gtk_widget_set_tooltip_text(mi, comment);
             g_signal_connect(mi, "activate", G_CALLBACK(on_menu_item), m);
         }
+        else if (menu_cache_item_get_type(item) == MENU_CACHE_TYPE_DIR)
+        {
+            /* submenu is created empty and filled on first selection */
+            GtkWidget* sub = gtk_menu_new();
+#if GTK_CHECK_VERSION(3, 0, 0)
+            gtk_menu_set_reserve_toggle_size (GTK_MENU (sub), FALSE);
+#endif
+            g_signal_connect(sub, "key-press-event", G_CALLBACK(check_close), m->menu);
+            menu_dir_set_cache_dir(sub, item);
+            gtk_widget_set_name (mi, "sysmenu");
+            gtk_menu_item_set_submenu( GTK_MENU_ITEM(mi), sub );
+            /* keep pointer since submenu may be replaced by context menu */
+            g_object_set_data(G_OBJECT(mi), "PanelMenuDirSubmenu", sub);
+            g_signal_connect(mi, "select", G_CALLBACK(on_menu_dir_select), m);
+        }
+        g_object_set_data_full(G_OBJECT(mi), "PanelMenuItemId",
+                               g_strdup(menu_cache_item_get_id(item)), g_free);
         g_signal_connect(mi, "map", G_CALLBACK(on_menu_item_map), m);
         g_signal_connect(mi, "style-set", G_CALLBACK(on_menu_item_style_set), m);
         g_signal_connect(mi, "button-press-event", G_CALLBACK(on_menu_button_press), m);
@@ -470,85 +722,99 @@ gboolean check_close (GtkWidget *widget, GdkEventKey *event, gpointer userdata)
     return FALSE;
 }
 
-static int load_menu(menup* m, MenuCacheDir* dir, GtkWidget* menu, int pos )
+static gboolean menu_dir_is_visible(MenuCacheDir* dir)
 {
-    GSList * l;
-    /* number of visible entries */
-    gint count = 0;
-#if MENU_CACHE_CHECK_VERSION(0, 4, 0)
-    GSList *children;
-# if MENU_CACHE_CHECK_VERSION(0, 5, 0)
-#  if !MENU_CACHE_CHECK_VERSION(1, 0, 0)
+    gboolean visible = TRUE;
+#if MENU_CACHE_CHECK_VERSION(0, 5, 0)
+# if !MENU_CACHE_CHECK_VERSION(1, 0, 0)
     char *kfpath;
     GKeyFile *kf;
-#  endif
-    if (!menu_cache_dir_is_visible(dir)) /* directory is hidden, ignore children */
-        return 0;
-#  if !MENU_CACHE_CHECK_VERSION(1, 0, 0)
+# endif
+    if (!menu_cache_dir_is_visible(dir)) /* directory is hidden */
+        return FALSE;
+# if !MENU_CACHE_CHECK_VERSION(1, 0, 0)
     /* version 1.0.0 has NoDisplay checked internally */
     kfpath = menu_cache_item_get_file_path(MENU_CACHE_ITEM(dir));
     kf = g_key_file_new();
     /* for version 0.5.0 we enable hidden so should test NoDisplay flag */
     if (kfpath && g_key_file_load_from_file(kf, kfpath, 0, NULL) &&
         g_key_file_get_boolean(kf, "Desktop Entry", "NoDisplay", NULL))
-        count = -1;
+        visible = FALSE;
     g_free(kfpath);
     g_key_file_free(kf);
-    if (count < 0) /* directory is hidden, ignore children */
-        return 0;
-#  endif /* < 1.0.0 */
-# endif /* < 0.5.0 */
+# endif /* < 1.0.0 */
+#endif /* < 0.5.0 */
+    return visible;
+}
+
+/*
+ * Get list of children of dir which should be shown in the menu, each
+ * item in the list is referenced. Empty submenus are not included.
+ * If first_only is TRUE then stops after first visible child is found.
+ */
+static GSList *menu_dir_list_visible(menup* m, MenuCacheDir* dir, gboolean first_only)
+{
+    GSList *l, *children, *visible = NULL;
+
+    if (!menu_dir_is_visible(dir)) /* ignore children of hidden directory */
+        return NULL;
+#if MENU_CACHE_CHECK_VERSION(0, 4, 0)
     children = menu_cache_dir_list_children(dir);
-    for (l = children; l; l = l->next)
 #else /* < 0.4.0 */
-    for( l = menu_cache_dir_get_children(dir); l; l = l->next )
+    children = menu_cache_dir_get_children(dir);
 #endif
+    for (l = children; l; l = l->next)
     {
         MenuCacheItem* item = MENU_CACHE_ITEM(l->data);
+        GSList *sub;
 
-        gboolean is_visible = ((menu_cache_item_get_type(item) != MENU_CACHE_TYPE_APP) ||
-			       (panel_menu_item_evaluate_visibility(item, m->visibility_flags)));
-
-	if (is_visible)
-	{
-            GtkWidget * mi = create_item(item, m);
-	    count++;
-            if (mi != NULL)
-                gtk_menu_shell_insert( (GtkMenuShell*)menu, mi, pos );
-            if( pos >= 0 )
-                ++pos;
-	    /* process subentries */
-	    if (menu_cache_item_get_type(item) == MENU_CACHE_TYPE_DIR)
-	    {
-                GtkWidget* sub = gtk_menu_new();
-#if GTK_CHECK_VERSION(3, 0, 0)
-                gtk_menu_set_reserve_toggle_size (GTK_MENU (sub), FALSE);
-#endif
-            g_signal_connect(sub, "key-press-event", G_CALLBACK(check_close), m->menu);
-		/*  always pass -1 for position */
-		gint s_count = load_menu( m, MENU_CACHE_DIR(item), sub, -1 );
-                if (s_count) gtk_widget_set_name (mi, "sysmenu");
-                if (s_count)
-		    gtk_menu_item_set_submenu( GTK_MENU_ITEM(mi), sub );
-		else
-		{
-		    /* don't keep empty submenus */
-		    gtk_widget_destroy( sub );
-		    gtk_widget_destroy( mi );
-		    if (pos > 0)
-			pos--;
-		}
-	    }
-	}
+        switch (menu_cache_item_get_type(item))
+        {
+        case MENU_CACHE_TYPE_APP:
+            if (!panel_menu_item_evaluate_visibility(item, m->visibility_flags))
+                continue;
+            break;
+        case MENU_CACHE_TYPE_DIR:
+            /* don't keep empty submenus */
+            sub = menu_dir_list_visible(m, MENU_CACHE_DIR(item), TRUE);
+            if (sub == NULL)
+                continue;
+            g_slist_foreach(sub, (GFunc)menu_cache_item_unref, NULL);
+            g_slist_free(sub);
+            break;
+        default: ;
+        }
+        visible = g_slist_prepend(visible, menu_cache_item_ref(item));
+        if (first_only)
+            break;
     }
 #if MENU_CACHE_CHECK_VERSION(0, 4, 0)
     g_slist_foreach(children, (GFunc)menu_cache_item_unref, NULL);
     g_slist_free(children);
 #endif
-    return count;
+    return g_slist_reverse(visible);
 }
 
+/* creates items for one level only, submenus are filled when selected */
+static int load_menu(menup* m, MenuCacheDir* dir, GtkWidget* menu, int pos )
+{
+    GSList *children, *l;
+    /* number of visible entries */
+    gint count = 0;
 
+    children = menu_dir_list_visible(m, dir, FALSE);
+    for (l = children; l; l = l->next)
+    {
+        GtkWidget * mi = create_item(MENU_CACHE_ITEM(l->data), m);
+        count++;
+        gtk_menu_shell_insert( (GtkMenuShell*)menu, mi, pos );
+        if( pos >= 0 )
+            ++pos;
+    }
+    g_slist_foreach(children, (GFunc)menu_cache_item_unref, NULL);
+    g_slist_free(children);
+    return count;
+}
 
 static gboolean sys_menu_item_has_data( GtkMenuItem* item )
 {
@@ -567,37 +833,20 @@ static void _unload_old_icons(GtkMenu* menu, GtkIconTheme* theme, menup* m)
         item = GTK_MENU_ITEM( child->data );
         if( sys_menu_item_has_data( item ) )
         {
-            GtkImage* img;
-            item = GTK_MENU_ITEM( child->data );
-#if GTK_CHECK_VERSION(3, 0, 0)
-            if (GTK_IS_MENU_ITEM (item))
+            GtkImage* img = menu_item_get_image(GTK_WIDGET(item));
+            if (img)
             {
-                GtkWidget *box = gtk_bin_get_child (GTK_BIN (item));
-                if (GTK_IS_BOX (box))
-                {
-                    GList *bchildren = gtk_container_get_children (GTK_CONTAINER (box));
-                    if (GTK_IS_IMAGE (bchildren->data))
-                    {
-                        img = GTK_IMAGE (bchildren->data);
-                        gtk_image_clear(img);
-                        if (gtk_widget_get_mapped (GTK_WIDGET(img))) on_menu_item_map(GTK_WIDGET(item), m);
-                    }
-                    g_list_free (bchildren);
-                }
-            }
-#else
-            if( GTK_IS_IMAGE_MENU_ITEM(item) )
-            {
-	        img = GTK_IMAGE(gtk_image_menu_item_get_image(GTK_IMAGE_MENU_ITEM(item)));
                 gtk_image_clear(img);
                 if (gtk_widget_get_mapped(GTK_WIDGET(img)))
-		    on_menu_item_map(GTK_WIDGET(item), m);
+                    on_menu_item_map(GTK_WIDGET(item), m);
             }
-#endif
+            /* loaded system submenus have icons too */
+            if ((sub_menu = g_object_get_data(G_OBJECT(item), "PanelMenuDirSubmenu")))
+                _unload_old_icons(GTK_MENU(sub_menu), theme, m);
         }
         else if( ( sub_menu = gtk_menu_item_get_submenu( item ) ) )
         {
-	    _unload_old_icons(GTK_MENU(sub_menu), theme, m);
+            _unload_old_icons(GTK_MENU(sub_menu), theme, m);
         }
     }
     g_list_free( children );
@@ -605,6 +854,9 @@ static void _unload_old_icons(GtkMenu* menu, GtkIconTheme* theme, menup* m)
 
 static void unload_old_icons(GtkIconTheme* theme, menup* m)
 {
+    /* shared cache is already cleared, running jobs will discard results */
+    m->icon_generation++;
+    g_hash_table_remove_all(m->icon_pending);
     _unload_old_icons(GTK_MENU(m->menu), theme, m);
 }
 
@@ -653,40 +905,155 @@ static void sys_menu_insert_items( menup* m, GtkMenu* menu, int position )
 }
 
 
+static int sys_menu_merge(menup* m, MenuCacheDir* dir, GtkWidget* menu,
+                          int pos, GList* old_items);
+
+/*
+ * Update existing menu item to reflect changed menu cache item.
+ * Returns FALSE if item cannot be reused and should be recreated.
+ */
+static gboolean sys_menu_item_update(menup* m, GtkWidget* mi, MenuCacheItem* item)
+{
+    FmFileInfo *old_fi = g_object_get_qdata(G_OBJECT(mi), SYS_MENU_ITEM_ID);
+    GtkWidget *sub = g_object_get_data(G_OBJECT(mi), "PanelMenuDirSubmenu");
+    FmFileInfo *fi;
+
+    if (old_fi == NULL || old_fi == (gpointer)1 ||
+        (sub != NULL) != (menu_cache_item_get_type(item) == MENU_CACHE_TYPE_DIR))
+        return FALSE;
+    fi = menu_item_file_info_new(item);
+    /* icons are cached by libfm so the same icon is the same object */
+    if (g_strcmp0(fm_file_info_get_disp_name(fi), fm_file_info_get_disp_name(old_fi)) != 0 ||
+        fm_file_info_get_icon(fi) != fm_file_info_get_icon(old_fi))
+    {
+        fm_file_info_unref(fi);
+        return FALSE;
+    }
+    g_object_set_qdata_full(G_OBJECT(mi), SYS_MENU_ITEM_ID, fi,
+                            (GDestroyNotify)fm_file_info_unref);
+    if (sub == NULL)
+        gtk_widget_set_tooltip_text(mi, menu_cache_item_get_comment(item));
+    else
+    {
+        menu_dir_set_cache_dir(sub, item);
+        /* update loaded submenu in place, unloaded one will use new dir */
+        if (g_object_get_data(G_OBJECT(sub), "PanelMenuLoaded"))
+        {
+            GList *children = gtk_container_get_children(GTK_CONTAINER(sub));
+
+            sys_menu_merge(m, MENU_CACHE_DIR(item), sub, 0, children);
+            g_list_free(children);
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Merge children of dir into menu starting at pos, reusing unchanged items
+ * from old_items list instead of recreating them. Items from old_items that
+ * were not reused are destroyed. Returns number of items in merged block.
+ */
+static int sys_menu_merge(menup* m, MenuCacheDir* dir, GtkWidget* menu,
+                          int pos, GList* old_items)
+{
+    GHashTable *by_id = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTable *reused = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GSList *children, *l;
+    GList *ol;
+    int count = 0;
+
+    for (ol = old_items; ol; ol = ol->next)
+    {
+        const char *id = g_object_get_data(G_OBJECT(ol->data), "PanelMenuItemId");
+
+        if (id != NULL && g_hash_table_lookup(by_id, id) == NULL)
+            g_hash_table_insert(by_id, (gpointer)id, ol->data);
+    }
+    children = menu_dir_list_visible(m, dir, FALSE);
+    for (l = children; l; l = l->next, pos++, count++)
+    {
+        MenuCacheItem *item = MENU_CACHE_ITEM(l->data);
+        const char *id = menu_cache_item_get_id(item);
+        GtkWidget *mi = id ? g_hash_table_lookup(by_id, id) : NULL;
+
+        if (mi != NULL && menu_cache_item_get_type(item) != MENU_CACHE_TYPE_SEP &&
+            sys_menu_item_update(m, mi, item))
+        {
+            g_hash_table_remove(by_id, id);
+            g_hash_table_insert(reused, mi, mi);
+            gtk_menu_reorder_child(GTK_MENU(menu), mi, pos);
+        }
+        else
+            gtk_menu_shell_insert(GTK_MENU_SHELL(menu), create_item(item, m), pos);
+    }
+    for (ol = old_items; ol; ol = ol->next)
+        if (g_hash_table_lookup(reused, ol->data) == NULL)
+            gtk_widget_destroy(ol->data);
+    g_slist_foreach(children, (GFunc)menu_cache_item_unref, NULL);
+    g_slist_free(children);
+    g_hash_table_destroy(reused);
+    g_hash_table_destroy(by_id);
+    return count;
+}
+
 static void
 reload_system_menu( menup* m, GtkMenu* menu )
 {
-    GList *children, *child;
+    GList *children, *child, *block;
     GtkMenuItem* item;
     GtkWidget* sub_menu;
+    MenuCacheDir* dir;
     gint idx;
 
     children = gtk_container_get_children( GTK_CONTAINER(menu) );
-    for( child = children, idx = 0; child; child = child->next, ++idx )
+    for( child = children, idx = 0; child; )
     {
         item = GTK_MENU_ITEM( child->data );
         if( sys_menu_item_has_data( item ) )
         {
+            /* collect consecutive system items and merge new content */
+            block = NULL;
             do
             {
-                item = GTK_MENU_ITEM( child->data );
+                block = g_list_prepend(block, child->data);
                 child = child->next;
-                gtk_widget_destroy( GTK_WIDGET(item) );
             }while( child && sys_menu_item_has_data( child->data ) );
-            sys_menu_insert_items( m, menu, idx );
-            if( ! child )
-                break;
+            block = g_list_reverse(block);
+#if MENU_CACHE_CHECK_VERSION(0, 4, 0)
+            dir = menu_cache_dup_root_dir(m->menu_cache);
+#else
+            dir = menu_cache_get_root_dir( m->menu_cache );
+#endif
+            if (dir)
+            {
+                idx += sys_menu_merge(m, dir, GTK_WIDGET(menu), idx, block);
+#if MENU_CACHE_CHECK_VERSION(0, 4, 0)
+                menu_cache_item_unref(MENU_CACHE_ITEM(dir));
+#endif
+            }
+            else /* menu content is empty, add a place holder */
+            {
+                GtkWidget* mi = gtk_menu_item_new();
+                g_object_set_qdata( G_OBJECT(mi), SYS_MENU_ITEM_ID, GINT_TO_POINTER(1) );
+                gtk_menu_shell_insert(GTK_MENU_SHELL(menu), mi, idx++);
+                g_list_foreach(block, (GFunc)gtk_widget_destroy, NULL);
+            }
+            g_list_free(block);
+            continue;
         }
         else if( ( sub_menu = gtk_menu_item_get_submenu( item ) ) )
         {
             reload_system_menu( m, GTK_MENU(sub_menu) );
         }
+        child = child->next;
+        ++idx;
     }
     g_list_free( children );
 }
 
 static void show_menu( GtkWidget* widget, menup* m, int btn, guint32 time )
 {
+    menu_prefetch_icons(m, m->menu);
 #if GTK_CHECK_VERSION(3, 0, 0)
     gtk_menu_popup_at_widget (GTK_MENU(m->menu), widget, GDK_GRAVITY_NORTH_WEST, GDK_GRAVITY_NORTH_WEST, NULL);
 #else
@@ -1077,6 +1444,8 @@ menu_constructor(LXPanel *panel, config_setting_t *settings)
     g_return_val_if_fail(m != NULL, 0);
 
     m->iconsize = panel_get_safe_icon_size (panel);
+    m->icon_pending = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                            g_object_unref, NULL);
 
     m->box = gtk_button_new();
     gtk_button_set_relief (GTK_BUTTON (m->box), GTK_RELIEF_NONE);
@@ -1138,6 +1507,9 @@ static gboolean apply_config(gpointer user_data)
         menu_cache_unref( m->menu_cache );
     }
     m->menu_cache = NULL;
+    /* icon size might be changed, results of running jobs are useless */
+    m->icon_generation++;
+    g_hash_table_remove_all(m->icon_pending);
     m->menu = read_submenu(m, m->settings, 2);
     return FALSE;
 }
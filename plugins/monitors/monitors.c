@@ -46,24 +46,13 @@
  *     - the default color of your plugin ("default_colors" table)
  *     - the update function ("update_functions" table)
  *     - the tooltip update function ("tooltip_update" table)
+ *     - the name used in the config file ("config_names" table), options
+ *       "DisplayFOO" and "FOOColor" are then loaded and saved automatically.
+ *    The monitor_push_sample() adds a sample to the graph. Samples should be
+ *    fractions of 0..1 unless the monitor sets autoscale.
  * 5) Configuration :
  *     - edit the monitors_config() function so that a "Display FOO usage"
- *     checkbox appears in the prefs dialog.
- *     - edit the monitors_save() function so that a "DisplayFOO" string appears
- *     in the config file ("~/.config/lxpanel/<profile>/config")
- *     - edit the monitors_config() function so that a "FOO color" entry appears
- *       in the prefs dialog.
- *     - edit the monitors_save() function so that a "FOOColor" string appears
- *       in the config file.
- *     - edit the monitors_constructor() function so that options are correctly
- *     aplied. Adding something like :
- *
- *     else if (g_ascii_strcasecmp(s.t[0], "DisplayFOO") == 0)
- *         mp->displayed_monitors[FOO_POSITION] = atoi(s.t[1])
- *     else if (g_ascii_strcasecmp(s.t[0], "FOOColor") == 0)
- *         colors[FOO_POSITION] = g_strndup(s.t[1], COLOR_SIZE-1);
- *
- *     should be enough.
+ *     checkbox and a "FOO color" entry appear in the prefs dialog.
  * 6) Enjoy.
  */
 
@@ -80,9 +69,12 @@
 #include <stdlib.h>
 #include <glib/gi18n.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <libfm/fm-gtk.h>
 
 #include "plugin.h"
+#include "../proctop.h"
 
 #include "dbg.h"
 
@@ -117,6 +109,13 @@ struct Monitor {
     stats_set    *stats;            /* Circular buffer of values              */
     stats_set    total;             /* Maximum possible value, as in mem_total*/
     gint         ring_cursor;       /* Cursor for ring/circular buffer        */
+    gboolean     autoscale;         /* Stats are not fractions, scale to max  */
+    guint64      last_counter[2];   /* Previous values of cumulative counters */
+    gint64       last_time;         /* Time of previous counters, 0 if none   */
+    float        details[3];        /* Extra values for the tooltip           */
+    gboolean     available;         /* Source could be read last time         */
+    ProcTop      *top;              /* Top processes scanner, or NULL         */
+    ProcTopOrder top_order;         /* Which processes to show in the tooltip */
     gchar        *color;            /* Color of the graph                     */
     gboolean     (*update) (struct Monitor *); /* Update function             */
     void         (*update_tooltip) (struct Monitor *);
@@ -133,7 +132,11 @@ typedef void (*tooltip_update_func) (Monitor *);
  */
 #define CPU_POSITION    0
 #define MEM_POSITION    1
-#define N_MONITORS      2
+#define MEM_PSI_POSITION 2
+#define CPU_PSI_POSITION 3
+#define IO_PSI_POSITION 4
+#define SWAP_POSITION   5
+#define N_MONITORS      6
 
 /* Our plugin */
 typedef struct {
@@ -142,6 +145,7 @@ typedef struct {
     Monitor  *monitors[N_MONITORS];          /* Monitors                      */
     int      displayed_monitors[N_MONITORS]; /* Booleans                      */
     char     *action;                        /* What to do on click           */
+    int      show_top;                       /* Show top processes in tooltip */
     guint    timer;                          /* Timer for regular updates     */
 } MonitorsPlugin;
 
@@ -158,6 +162,18 @@ static void     cpu_tooltip_update (Monitor *m);
 static gboolean mem_update(Monitor *);
 static void     mem_tooltip_update (Monitor *m);
 
+/* Pressure stall monitors */
+static gboolean mem_psi_update(Monitor *);
+static gboolean cpu_psi_update(Monitor *);
+static gboolean io_psi_update(Monitor *);
+static void     mem_psi_tooltip_update (Monitor *m);
+static void     cpu_psi_tooltip_update (Monitor *m);
+static void     io_psi_tooltip_update (Monitor *m);
+
+/* Swap activity monitor */
+static gboolean swap_update(Monitor *);
+static void     swap_tooltip_update (Monitor *m);
+
 
 static gboolean configure_event(GtkWidget*, GdkEventConfigure*, gpointer);
 #if !GTK_CHECK_VERSION(3, 0, 0)
@@ -166,6 +182,7 @@ static gboolean expose_event(GtkWidget *, GdkEventExpose *, Monitor *);
 static gboolean draw(GtkWidget *, cairo_t *, Monitor *);
 #endif
 static void redraw_pixmap (Monitor *m);
+static gboolean query_tooltip(GtkWidget *, gint, gint, gboolean, GtkTooltip *, Monitor *);
 
 /* Monitors functions */
 static void monitors_destructor(gpointer);
@@ -197,6 +214,8 @@ monitor_init(MonitorsPlugin *mp, Monitor *m, gchar *color)
     g_signal_connect (G_OBJECT(m->da), "draw",
         G_CALLBACK(draw), (gpointer) m);
 #endif
+    g_signal_connect(G_OBJECT(m->da), "query-tooltip",
+        G_CALLBACK(query_tooltip), (gpointer) m);
 
     return m;
 }
@@ -208,6 +227,8 @@ monitor_free(Monitor *m)
         return;
 
     g_free(m->color);
+    if (m->top)
+        proc_top_free(m->top);
     if (m->pixmap)
         cairo_surface_destroy(m->pixmap);
     if (m->stats)
@@ -228,6 +249,134 @@ monitor_set_foreground_color(MonitorsPlugin *mp, Monitor *m, const gchar *color)
     gdk_color_parse(color, &m->foreground_color);
 #endif
 }
+
+/* New list of top processes is ready, refresh the tooltip with it */
+static void
+monitor_top_ready(ProcTop *pt, gpointer data)
+{
+    Monitor *m = data;
+
+    if (m->update_tooltip)
+        m->update_tooltip(m);
+}
+
+static void
+monitor_set_show_top(Monitor *m, gboolean show, ProcTopOrder order)
+{
+    if (show && !m->top)
+    {
+        m->top = proc_top_new(5, monitor_top_ready, m);
+        m->top_order = order;
+    }
+    else if (!show && m->top)
+    {
+        proc_top_free(m->top);
+        m->top = NULL;
+    }
+}
+
+/* Sets the tooltip, with top processes appended if they are being scanned */
+static void
+monitor_set_tooltip(Monitor *m, const gchar *text)
+{
+    gchar *top = m->top ? proc_top_format(m->top, m->top_order) : NULL;
+
+    if (top)
+    {
+        gchar *tooltip_text = g_strconcat(text, "\n", top, NULL);
+        gtk_widget_set_tooltip_text(m->da, tooltip_text);
+        g_free(tooltip_text);
+        g_free(top);
+    }
+    else
+        gtk_widget_set_tooltip_text(m->da, text);
+}
+
+/* Adds a sample to the ring buffer and redraws the graph */
+static void
+monitor_push_sample(Monitor *m, stats_set value)
+{
+    m->stats[m->ring_cursor] = value;
+    m->ring_cursor++;
+    if (m->ring_cursor >= m->pixmap_width)
+        m->ring_cursor = 0;
+
+    redraw_pixmap(m);
+}
+
+static stats_set
+monitor_last_sample(Monitor *m)
+{
+    gint ring_pos = (m->ring_cursor == 0)
+        ? m->pixmap_width - 1 : m->ring_cursor - 1;
+
+    return m->stats[ring_pos];
+}
+
+/* Reads the /proc file into the buffer as a string, up to the buffer size.
+ * Returns FALSE if it cannot be read. Some /proc files are returned in
+ * pieces so read until EOF. */
+static gboolean
+proc_read_file(const char *path, char *buf, gsize size)
+{
+    gsize len = 0;
+    ssize_t n;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return FALSE;
+    while (len < size - 1)
+    {
+        n = read(fd, buf + len, size - 1 - len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            close(fd);
+            return FALSE;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+    close(fd);
+    buf[len] = '\0';
+    return TRUE;
+}
+
+typedef struct {
+    const char *name;                   /* Field name including ':'           */
+    long int *value;                    /* Where to store the value           */
+} ProcKey;
+
+/* Scans "Name: value" lines in one pass and stores values of the requested
+ * keys. Returns bit mask of keys which were found. */
+static unsigned int
+proc_scan_keys(char *buf, const ProcKey *keys, int n_keys)
+{
+    unsigned int found = 0, all = (1U << n_keys) - 1;
+    char *line, *next;
+    int i;
+
+    for (line = buf; line && *line && found != all; line = next)
+    {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        for (i = 0; i < n_keys; i++)
+        {
+            size_t len = strlen(keys[i].name);
+
+            if (!(found & (1U << i)) && strncmp(line, keys[i].name, len) == 0)
+            {
+                *keys[i].value = strtol(line + len, NULL, 10);
+                found |= 1U << i;
+                break;
+            }
+        }
+    }
+    return found;
+}
 /******************************************************************************
  *                          End of monitor functions                          *
  ******************************************************************************/
@@ -296,7 +445,7 @@ cpu_tooltip_update (Monitor *m)
             ? m->pixmap_width - 1 : m->ring_cursor - 1;
         tooltip_text = g_strdup_printf(_("CPU usage: %.2f%%"),
                 m->stats[ring_pos] * 100);
-        gtk_widget_set_tooltip_text(m->da, tooltip_text);
+        monitor_set_tooltip(m, tooltip_text);
         g_free(tooltip_text);
     }
 }
@@ -313,59 +462,46 @@ mem_update(Monitor * m)
 {
     ENTER;
 
-    FILE *meminfo;
-    char buf[80];
+    char buf[4096];
     long int mem_total = 0;
     long int mem_free  = 0;
     long int mem_buffers = 0;
     long int mem_cached = 0;
     long int mem_sreclaimable = 0;
-    unsigned int readmask = 0x10 | 0x8 | 0x4 | 0x2 | 0x1;
+    long int mem_available = 0;
+    const ProcKey keys[] = {
+        { "MemTotal:", &mem_total },
+        { "MemFree:", &mem_free },
+        { "Buffers:", &mem_buffers },
+        { "Cached:", &mem_cached },
+        { "SReclaimable:", &mem_sreclaimable },
+        { "MemAvailable:", &mem_available }
+    };
+    unsigned int found;
 
     if (!m->stats || !m->pixmap)
         RET(TRUE);
 
-    meminfo = fopen("/proc/meminfo", "r");
-    if (!meminfo) {
+    if (!proc_read_file("/proc/meminfo", buf, sizeof(buf))) {
         g_warning("monitors: Could not open /proc/meminfo: %d, %s",
                   errno, strerror(errno));
         RET(FALSE);
     }
 
-    while (readmask && fgets(buf, sizeof(buf), meminfo)) {
-        if (sscanf(buf, "MemTotal: %ld kB\n", &mem_total) == 1) {
-            readmask ^= 0x1;
-            continue;
-        }
-        if (sscanf(buf, "MemFree: %ld kB\n", &mem_free) == 1) {
-            readmask ^= 0x2;
-            continue;
-        }
-        if (sscanf(buf, "Buffers: %ld kB\n", &mem_buffers) == 1) {
-            readmask ^= 0x4;
-            continue;
-        }
-        if (sscanf(buf, "Cached: %ld kB\n", &mem_cached) == 1) {
-            readmask ^= 0x8;
-            continue;
-        }
-        if (sscanf(buf, "SReclaimable: %ld kB\n", &mem_sreclaimable) == 1) {
-            readmask ^= 0x10;
-            continue;
-        }
-    }
-
-    fclose(meminfo);
+    found = proc_scan_keys(buf, keys, G_N_ELEMENTS(keys));
 
-    if (readmask) {
+    /* MemAvailable is optional, it appeared in Linux 3.14 */
+    if ((found & 0x1f) != 0x1f || mem_total <= 0) {
         g_warning("monitors: Couldn't read all values from /proc/meminfo: "
-                  "readmask %x", readmask);
+                  "found %x", found);
         RET(FALSE);
     }
 
     m->total = mem_total;
 
     /* Adding stats to the buffer:
+     * Kernel estimate of memory available for new applications is used if
+     * it is provided, otherwise it is guessed from the free memory.
      * It is debatable if 'mem_buffers' counts as free or not. I'll go with
      * 'free', because it can be flushed fairly quickly, and generally
      * isn't necessary to keep in memory.
@@ -375,15 +511,11 @@ mem_update(Monitor * m)
      * 'man free' doesn't specify this)
      * 'mem_cached' definitely counts as 'free' because it is immediately
      * released should any application need it. */
-    m->stats[m->ring_cursor] = (mem_total - mem_buffers - mem_free -
-            mem_cached - mem_sreclaimable) / (float)mem_total;
-
-    m->ring_cursor++;
-    if (m->ring_cursor >= m->pixmap_width)
-        m->ring_cursor = 0;
-
-    /* Redraw the pixmap, with the new sample */
-    redraw_pixmap (m);
+    if (found & 0x20)
+        monitor_push_sample(m, (mem_total - mem_available) / (float)mem_total);
+    else
+        monitor_push_sample(m, (mem_total - mem_buffers - mem_free -
+                mem_cached - mem_sreclaimable) / (float)mem_total);
 
     RET(TRUE);
 }
@@ -398,7 +530,7 @@ mem_tooltip_update (Monitor *m)
         tooltip_text = g_strdup_printf(_("RAM usage: %.1fMB (%.2f%%)"),
                 m->stats[ring_pos] * m->total / 1024,
                 m->stats[ring_pos] * 100);
-        gtk_widget_set_tooltip_text(m->da, tooltip_text);
+        monitor_set_tooltip(m, tooltip_text);
         g_free(tooltip_text);
     }
 }
@@ -406,6 +538,195 @@ mem_tooltip_update (Monitor *m)
  *                             End of RAM Monitor                             *
  ******************************************************************************/
 
+/******************************************************************************
+ *                          Pressure stall monitors                           *
+ ******************************************************************************/
+/* The graph shows the share of the last period some tasks were stalled on
+ * the resource, computed from the total stall time, so short stalls are not
+ * smoothed out like in kernel averages. Averages are shown in the tooltip. */
+static gboolean
+psi_update(Monitor *m, const char *path)
+{
+    char buf[256];
+    char *avg10, *avg60, *avg300, *total_str;
+    guint64 total;
+    gint64 now;
+
+    if (!m->stats || !m->pixmap)
+        return TRUE;
+
+    /* the "some" line is always the first one; values are not localized */
+    if (!proc_read_file(path, buf, sizeof(buf)) ||
+        strncmp(buf, "some ", 5) != 0 ||
+        (avg10 = strstr(buf, "avg10=")) == NULL ||
+        (avg60 = strstr(buf, "avg60=")) == NULL ||
+        (avg300 = strstr(buf, "avg300=")) == NULL ||
+        (total_str = strstr(buf, "total=")) == NULL)
+    {
+        /* kernel is built without CONFIG_PSI or it is disabled */
+        m->available = FALSE;
+        m->last_time = 0;
+        monitor_push_sample(m, 0.0);
+        return FALSE;
+    }
+
+    total = g_ascii_strtoull(total_str + 6, NULL, 10);
+    now = g_get_monotonic_time();
+    m->available = TRUE;
+    m->details[0] = g_ascii_strtod(avg10 + 6, NULL);
+    m->details[1] = g_ascii_strtod(avg60 + 6, NULL);
+    m->details[2] = g_ascii_strtod(avg300 + 7, NULL);
+    if (m->last_time != 0 && now > m->last_time && total >= m->last_counter[0])
+        /* total is in microseconds as well */
+        monitor_push_sample(m, MIN((float)(total - m->last_counter[0]) /
+                                   (now - m->last_time), 1.0));
+    else
+        monitor_push_sample(m, m->details[0] / 100);
+    m->last_counter[0] = total;
+    m->last_time = now;
+
+    return TRUE;
+}
+
+static gboolean
+mem_psi_update(Monitor *m)
+{
+    return psi_update(m, "/proc/pressure/memory");
+}
+
+static gboolean
+cpu_psi_update(Monitor *m)
+{
+    return psi_update(m, "/proc/pressure/cpu");
+}
+
+static gboolean
+io_psi_update(Monitor *m)
+{
+    return psi_update(m, "/proc/pressure/io");
+}
+
+static void
+psi_tooltip_update (Monitor *m, const char *resource)
+{
+    if (m && m->stats) {
+        gchar *tooltip_text;
+
+        if (m->available)
+            /* Translators: first %s is "Memory", "CPU" or "IO" */
+            tooltip_text = g_strdup_printf(_("%s pressure: %.2f%%\n"
+                                             "Average for 10 s: %.2f%%, 1 min: %.2f%%, 5 min: %.2f%%"),
+                    resource, monitor_last_sample(m) * 100,
+                    m->details[0], m->details[1], m->details[2]);
+        else
+            tooltip_text = g_strdup_printf(_("%s pressure: not supported by the kernel"),
+                                           resource);
+        gtk_widget_set_tooltip_text(m->da, tooltip_text);
+        g_free(tooltip_text);
+    }
+}
+
+static void
+mem_psi_tooltip_update (Monitor *m)
+{
+    psi_tooltip_update(m, _("Memory"));
+}
+
+static void
+cpu_psi_tooltip_update (Monitor *m)
+{
+    psi_tooltip_update(m, _("CPU"));
+}
+
+static void
+io_psi_tooltip_update (Monitor *m)
+{
+    psi_tooltip_update(m, _("IO"));
+}
+/******************************************************************************
+ *                       End of pressure stall monitors                       *
+ ******************************************************************************/
+
+/******************************************************************************
+ *                           Swap activity monitor                            *
+ ******************************************************************************/
+/* Graph shows pages swapped in and out per second, scaled to the peak of the
+ * visible period; swap usage is shown in the tooltip. */
+static gboolean
+swap_update(Monitor *m)
+{
+    char buf[16384];
+    long int pswpin = 0, pswpout = 0;
+    long int swap_total = 0, swap_free = 0;
+    const ProcKey vmstat_keys[] = {
+        { "pswpin ", &pswpin },
+        { "pswpout ", &pswpout }
+    };
+    const ProcKey meminfo_keys[] = {
+        { "SwapTotal:", &swap_total },
+        { "SwapFree:", &swap_free }
+    };
+    gint64 now;
+
+    if (!m->stats || !m->pixmap)
+        return TRUE;
+
+    if (!proc_read_file("/proc/vmstat", buf, sizeof(buf)) ||
+        proc_scan_keys(buf, vmstat_keys, G_N_ELEMENTS(vmstat_keys)) != 0x3)
+    {
+        m->available = FALSE;
+        m->last_time = 0;
+        monitor_push_sample(m, 0.0);
+        return FALSE;
+    }
+    if (proc_read_file("/proc/meminfo", buf, sizeof(buf)))
+        proc_scan_keys(buf, meminfo_keys, G_N_ELEMENTS(meminfo_keys));
+
+    now = g_get_monotonic_time();
+    m->available = TRUE;
+    m->total = swap_total;
+    m->details[2] = swap_total - swap_free;
+    if (m->last_time != 0 && now > m->last_time &&
+        (guint64)pswpin >= m->last_counter[0] &&
+        (guint64)pswpout >= m->last_counter[1])
+    {
+        float seconds = (now - m->last_time) / (float)G_USEC_PER_SEC;
+
+        m->details[0] = (pswpin - m->last_counter[0]) / seconds;
+        m->details[1] = (pswpout - m->last_counter[1]) / seconds;
+    }
+    else
+        m->details[0] = m->details[1] = 0.0;
+    m->last_counter[0] = pswpin;
+    m->last_counter[1] = pswpout;
+    m->last_time = now;
+
+    monitor_push_sample(m, m->details[0] + m->details[1]);
+
+    return TRUE;
+}
+
+static void
+swap_tooltip_update (Monitor *m)
+{
+    if (m && m->stats) {
+        gchar *tooltip_text;
+
+        if (m->available)
+            tooltip_text = g_strdup_printf(_("Swap in: %.0f pages/s, out: %.0f pages/s\n"
+                                             "Swap usage: %.1fMB of %.1fMB"),
+                    m->details[0], m->details[1],
+                    m->details[2] / 1024, m->total / 1024);
+        else
+            tooltip_text = g_strdup(_("Swap activity is not available"));
+        gtk_widget_set_tooltip_text(m->da, tooltip_text);
+        g_free(tooltip_text);
+    }
+}
+/******************************************************************************
+ *                        End of swap activity monitor                        *
+ ******************************************************************************/
+
 /******************************************************************************
  *                            Basic events handlers                           *
  ******************************************************************************/
@@ -530,6 +851,18 @@ draw(GtkWidget * widget, cairo_t * cr, Monitor *m)
     return FALSE;
 }
 
+/* Top processes are scanned only while the tooltip is queried, and it is
+ * queried each time its text is updated while it is shown. */
+static gboolean
+query_tooltip(GtkWidget *widget, gint x, gint y, gboolean keyboard_mode,
+              GtkTooltip *tooltip, Monitor *m)
+{
+    if (m->top)
+        proc_top_touch(m->top);
+    /* let the default handler show the text */
+    return FALSE;
+}
+
 
 static gboolean monitors_button_press_event(GtkWidget* widget, GdkEventButton* evt, LXPanel *panel)
 {
@@ -554,6 +887,7 @@ static void
 redraw_pixmap (Monitor *m)
 {
     int i;
+    stats_set scale = 1.0;
     cairo_t *cr = cairo_create(m->pixmap);
 #if !GTK_CHECK_VERSION(3, 0, 0)
     GtkStyle *style = gtk_widget_get_style(m->da);
@@ -574,13 +908,21 @@ redraw_pixmap (Monitor *m)
 #else
     gdk_cairo_set_source_color(cr, &m->foreground_color);
 #endif
+    if (m->autoscale)
+    {
+        scale = 0.0;
+        for (i = 0; i < m->pixmap_width; i++)
+            scale = MAX(scale, m->stats[i]);
+        if (scale <= 0.0)
+            scale = 1.0;
+    }
     for (i = 0; i < m->pixmap_width; i++)
     {
         unsigned int drawing_cursor = (m->ring_cursor + i) % m->pixmap_width;
 
         /* Draw one bar of the graph */
         cairo_move_to(cr, i + 0.5, m->pixmap_height);
-        cairo_line_to(cr, i + 0.5, (1.0 - m->stats[drawing_cursor]) * m->pixmap_height);
+        cairo_line_to(cr, i + 0.5, (1.0 - m->stats[drawing_cursor] / scale) * m->pixmap_height);
         cairo_stroke(cr);
     }
 
@@ -593,28 +935,66 @@ redraw_pixmap (Monitor *m)
 
 static update_func update_functions [N_MONITORS] = {
     [CPU_POSITION] = cpu_update,
-    [MEM_POSITION] = mem_update
+    [MEM_POSITION] = mem_update,
+    [MEM_PSI_POSITION] = mem_psi_update,
+    [CPU_PSI_POSITION] = cpu_psi_update,
+    [IO_PSI_POSITION] = io_psi_update,
+    [SWAP_POSITION] = swap_update
 };
 
 static char *default_colors[N_MONITORS] = {
     [CPU_POSITION] = "#0000FF",
-    [MEM_POSITION] = "#FF0000"
+    [MEM_POSITION] = "#FF0000",
+    [MEM_PSI_POSITION] = "#FF8000",
+    [CPU_PSI_POSITION] = "#00A0FF",
+    [IO_PSI_POSITION] = "#A000FF",
+    [SWAP_POSITION] = "#00C000"
+};
+
+/* Names used for DisplayFOO and FOOColor in the config file */
+static const char *config_names[N_MONITORS] = {
+    [CPU_POSITION] = "CPU",
+    [MEM_POSITION] = "RAM",
+    [MEM_PSI_POSITION] = "MemPressure",
+    [CPU_PSI_POSITION] = "CPUPressure",
+    [IO_PSI_POSITION] = "IOPressure",
+    [SWAP_POSITION] = "Swap"
 };
 
 
+/* Monitors which show rates without upper limit */
+static const gboolean monitor_autoscale[N_MONITORS] = {
+    [SWAP_POSITION] = TRUE
+};
+
 static tooltip_update_func tooltip_update[N_MONITORS] = {
     [CPU_POSITION] = cpu_tooltip_update,
-    [MEM_POSITION] = mem_tooltip_update
+    [MEM_POSITION] = mem_tooltip_update,
+    [MEM_PSI_POSITION] = mem_psi_tooltip_update,
+    [CPU_PSI_POSITION] = cpu_psi_tooltip_update,
+    [IO_PSI_POSITION] = io_psi_tooltip_update,
+    [SWAP_POSITION] = swap_tooltip_update
 };
 
 /* Colors currently used. We cannot store them in the "struct Monitor"s where
  * they belong, because we free these when the user removes them. And since we
  * want the colors to stay the same even after removing/adding a widget... */
 static char *colors[N_MONITORS] = {
-    NULL,
     NULL
 };
 
+/* Top processes are shown for the CPU and RAM monitors only */
+static void
+monitors_update_top(MonitorsPlugin *mp)
+{
+    if (mp->monitors[CPU_POSITION])
+        monitor_set_show_top(mp->monitors[CPU_POSITION], mp->show_top,
+                             PROC_TOP_BY_CPU);
+    if (mp->monitors[MEM_POSITION])
+        monitor_set_show_top(mp->monitors[MEM_POSITION], mp->show_top,
+                             PROC_TOP_BY_MEMORY);
+}
+
 /*
  * This function is called every UPDATE_PERIOD seconds. It updates all
  * monitors.
@@ -630,6 +1010,12 @@ monitors_update(gpointer data)
     mp = (MonitorsPlugin *) data;
     if (!mp)
         RET(FALSE);
+    /* nobody sees the panel, restarted when it is unparked */
+    if (panel_is_parked(mp->panel))
+    {
+        mp->timer = 0;
+        return FALSE;
+    }
 
     for (i = 0; i < N_MONITORS; i++)
     {
@@ -646,7 +1032,7 @@ monitors_update(gpointer data)
 
 static Monitor*
 monitors_add_monitor (GtkWidget *p, MonitorsPlugin *mp, update_func update,
-             tooltip_update_func update_tooltip, gchar *color)
+             tooltip_update_func update_tooltip, gboolean autoscale, gchar *color)
 {
     ENTER;
 
@@ -656,12 +1042,21 @@ monitors_add_monitor (GtkWidget *p, MonitorsPlugin *mp, update_func update,
     m = monitor_init(mp, m, color);
     m->update = update;
     m->update_tooltip = update_tooltip;
+    m->autoscale = autoscale;
     gtk_box_pack_start(GTK_BOX(p), m->da, FALSE, FALSE, 0);
     gtk_widget_show(m->da);
 
     RET(m);
 }
 
+static void
+monitors_panel_parked_changed(LXPanel *panel, MonitorsPlugin *mp)
+{
+    if (!panel_is_parked(panel) && mp->timer == 0)
+        mp->timer = g_timeout_add_seconds(UPDATE_PERIOD, (GSourceFunc) monitors_update,
+                                          (gpointer) mp);
+}
+
 static GtkWidget *
 monitors_constructor(LXPanel *panel, config_setting_t *settings)
 {
@@ -685,18 +1080,25 @@ monitors_constructor(LXPanel *panel, config_setting_t *settings)
 
     /* First time we use this plugin : only display CPU usage */
     mp->displayed_monitors[CPU_POSITION] = 1;
+    mp->show_top = 1;
 
     /* Apply options */
-    config_setting_lookup_int(settings, "DisplayCPU",
-                              &mp->displayed_monitors[CPU_POSITION]);
-    config_setting_lookup_int(settings, "DisplayRAM",
-                              &mp->displayed_monitors[MEM_POSITION]);
+    for (i = 0; i < N_MONITORS; i++)
+    {
+        char *key = g_strconcat("Display", config_names[i], NULL);
+        config_setting_lookup_int(settings, key, &mp->displayed_monitors[i]);
+        g_free(key);
+        key = g_strconcat(config_names[i], "Color", NULL);
+        if (config_setting_lookup_string(settings, key, &tmp))
+        {
+            g_free(colors[i]);
+            colors[i] = g_strndup(tmp, COLOR_SIZE-1);
+        }
+        g_free(key);
+    }
     if (config_setting_lookup_string(settings, "Action", &tmp))
         mp->action = g_strdup(tmp);
-    if (config_setting_lookup_string(settings, "CPUColor", &tmp))
-        colors[CPU_POSITION] = g_strndup(tmp, COLOR_SIZE-1);
-    if (config_setting_lookup_string(settings, "RAMColor", &tmp))
-        colors[MEM_POSITION] = g_strndup(tmp, COLOR_SIZE-1);
+    config_setting_lookup_int(settings, "ShowTopProcesses", &mp->show_top);
 
     /* Initializing monitors */
     for (i = 0; i < N_MONITORS; i++)
@@ -709,14 +1111,18 @@ monitors_constructor(LXPanel *panel, config_setting_t *settings)
             mp->monitors[i] = monitors_add_monitor(p, mp,
                                                    update_functions[i],
                                                    tooltip_update[i],
+                                                   monitor_autoscale[i],
                                                    colors[i]);
         }
     }
+    monitors_update_top(mp);
 
     /* Adding a timer : monitors will be updated every UPDATE_PERIOD
      * seconds */
     mp->timer = g_timeout_add_seconds(UPDATE_PERIOD, (GSourceFunc) monitors_update,
                               (gpointer) mp);
+    g_signal_connect(panel, "parked-changed",
+                     G_CALLBACK(monitors_panel_parked_changed), mp);
     RET(p);
 }
 
@@ -730,7 +1136,9 @@ monitors_destructor(gpointer user_data)
     mp = (MonitorsPlugin *) user_data;
 
     /* Removing timer */
-    g_source_remove(mp->timer);
+    g_signal_handlers_disconnect_by_func(mp->panel, monitors_panel_parked_changed, mp);
+    if (mp->timer != 0)
+        g_source_remove(mp->timer);
 
     /* Freeing all monitors */
     for (i = 0; i < N_MONITORS; i++)
@@ -762,6 +1170,15 @@ monitors_config (LXPanel *panel, GtkWidget *p)
         _("CPU color"), &colors[CPU_POSITION], CONF_TYPE_STR,
         _("Display RAM usage"), &mp->displayed_monitors[1], CONF_TYPE_BOOL,
         _("RAM color"), &colors[MEM_POSITION], CONF_TYPE_STR,
+        _("Display memory pressure"), &mp->displayed_monitors[MEM_PSI_POSITION], CONF_TYPE_BOOL,
+        _("Memory pressure color"), &colors[MEM_PSI_POSITION], CONF_TYPE_STR,
+        _("Display CPU pressure"), &mp->displayed_monitors[CPU_PSI_POSITION], CONF_TYPE_BOOL,
+        _("CPU pressure color"), &colors[CPU_PSI_POSITION], CONF_TYPE_STR,
+        _("Display IO pressure"), &mp->displayed_monitors[IO_PSI_POSITION], CONF_TYPE_BOOL,
+        _("IO pressure color"), &colors[IO_PSI_POSITION], CONF_TYPE_STR,
+        _("Display swap activity"), &mp->displayed_monitors[SWAP_POSITION], CONF_TYPE_BOOL,
+        _("Swap color"), &colors[SWAP_POSITION], CONF_TYPE_STR,
+        _("Show top processes in CPU and RAM tooltips"), &mp->show_top, CONF_TYPE_BOOL,
         _("Action when clicked (default: lxtask)"), &mp->action, CONF_TYPE_STR,
         NULL);
 
@@ -795,6 +1212,7 @@ start:
             mp->monitors[i] = monitors_add_monitor(p, mp,
                                                    update_functions[i],
                                                    tooltip_update[i],
+                                                   monitor_autoscale[i],
                                                    colors[i]);
             /*
              * It is probably best for users if their monitors are always
@@ -830,13 +1248,19 @@ start:
         mp->displayed_monitors[0] = 1;
         goto start;
     }
-    config_group_set_int(mp->settings, "DisplayCPU", mp->displayed_monitors[CPU_POSITION]);
-    config_group_set_int(mp->settings, "DisplayRAM", mp->displayed_monitors[MEM_POSITION]);
+    monitors_update_top(mp);
+    for (i = 0; i < N_MONITORS; i++)
+    {
+        char *key = g_strconcat("Display", config_names[i], NULL);
+        config_group_set_int(mp->settings, key, mp->displayed_monitors[i]);
+        g_free(key);
+        key = g_strconcat(config_names[i], "Color", NULL);
+        config_group_set_string(mp->settings, key,
+                                mp->monitors[i] ? colors[i] : NULL);
+        g_free(key);
+    }
     config_group_set_string(mp->settings, "Action", mp->action);
-    config_group_set_string(mp->settings, "CPUColor",
-                            mp->monitors[CPU_POSITION] ? colors[CPU_POSITION] : NULL);
-    config_group_set_string(mp->settings, "RAMColor",
-                            mp->monitors[MEM_POSITION] ? colors[MEM_POSITION] : NULL);
+    config_group_set_int(mp->settings, "ShowTopProcesses", mp->show_top);
 
     RET(FALSE);
 }
@@ -846,7 +1270,7 @@ FM_DEFINE_MODULE(lxpanel_gtk, monitors)
 
 LXPanelPluginInit fm_module_init_lxpanel_gtk = {
     .name = N_("Resource monitors"),
-    .description = N_("Display monitors (CPU, RAM)"),
+    .description = N_("Display monitors (CPU, RAM, pressure, swap)"),
     .new_instance = monitors_constructor,
     .config = monitors_config,
     .button_press_event = monitors_button_press_event
@@ -45,6 +45,11 @@
 /* 1 second */
 #define NETSTAT_IFACE_POLL_DELAY 3000
 
+/* results newer than that are shown without rescanning, in microseconds */
+#define WIRELESS_SCAN_MAX_AGE (5 * G_USEC_PER_SEC)
+/* seconds between scans while the wireless menu is shown */
+#define WIRELESS_RESCAN_INTERVAL 10
+
 static void* actionProcess(void *arg)
 {
     ENTER;
@@ -127,15 +132,68 @@ g_free_weaknotify(void *ptr, GObject *dummy)
     g_free(ptr);
 }
 
-static GtkWidget *
-wireless_menu(netdev_info *ni)
+/* scan results of an interface, kept between menu popups */
+typedef struct {
+    netstat *ns;
+    char *ifname;
+    ap_scan *scan;              /* last results, NULL if none yet */
+    gpointer scan_job;          /* scan in progress */
+    guint rescan_timer;         /* periodic rescan while menu is shown */
+    GtkWidget *menu;            /* menu which is shown now */
+    netdev_info *ni;            /* interface the menu is for */
+} ap_table;
+
+static void wireless_scan_start(ap_table *table);
+static void wireless_menu_destroyed(GtkWidget *menu, ap_table *table);
+
+static void ap_table_free(gpointer data)
+{
+    ap_table *table = data;
+
+    if (table->scan_job != NULL)
+        wireless_scan_cancel(table->scan_job);
+    if (table->rescan_timer != 0)
+        g_source_remove(table->rescan_timer);
+    if (table->menu != NULL)
+        g_signal_handlers_disconnect_by_func(table->menu, wireless_menu_destroyed, table);
+    wireless_scan_unref(table->scan);
+    g_free(table->ifname);
+    g_slice_free(ap_table, table);
+}
+
+static ap_table *ap_table_get(netstat *ns, const char *ifname)
+{
+    ap_table *table = g_hash_table_lookup(ns->ap_tables, ifname);
+
+    if (table == NULL) {
+        table = g_slice_new0(ap_table);
+        table->ns = ns;
+        table->ifname = g_strdup(ifname);
+        g_hash_table_insert(ns->ap_tables, table->ifname, table);
+    }
+    return table;
+}
+
+static void wireless_menu_add_label(GtkWidget *menu, const char *text)
 {
-    APLIST *aplist;
-    APLIST *ptr;
-    GtkWidget *menu;
     GtkWidget *menu_item;
     GtkWidget *wireless_label;
 
+    menu_item = gtk_menu_item_new();
+    wireless_label = gtk_label_new(text);
+    gtk_label_set_justify(GTK_LABEL(wireless_label), GTK_JUSTIFY_LEFT);
+    gtk_widget_set_sensitive(GTK_WIDGET(wireless_label), FALSE);
+    gtk_container_add(GTK_CONTAINER(menu_item), wireless_label);
+    gtk_menu_shell_append(GTK_MENU_SHELL(menu), menu_item);
+}
+
+/* (re)creates menu items from the last results of the table */
+static void wireless_menu_fill(GtkWidget *menu, ap_table *table)
+{
+    netdev_info *ni = table->ni;
+    APLIST *ptr;
+    GtkWidget *menu_item;
+
     /* AP status widget */
     GtkWidget *item_box;
     GtkWidget *essid_label;
@@ -144,16 +202,18 @@ wireless_menu(netdev_info *ni)
     gdouble quality_per;
     ap_setting *aps;
 
-    /* create menu */
-    menu = gtk_menu_new();
-    g_signal_connect(menu, "selection-done", G_CALLBACK(gtk_widget_destroy), NULL);
-
-    /* Scanning AP */
-    aplist = wireless_scanning(ni->ns->fnetd->iwsockfd, ni->netdev_list->info.ifname);
-    if (aplist!=NULL) {
-        /* release AP list after menu */
-        g_object_weak_ref(G_OBJECT(menu), wireless_aplist_free, aplist);
-        ptr = aplist;
+    gtk_container_foreach(GTK_CONTAINER(menu), (GtkCallback)gtk_widget_destroy, NULL);
+    /* items refer to AP info so hold the results while menu exists */
+    if (table->scan != NULL)
+        g_object_set_data_full(G_OBJECT(menu), "ap-scan",
+                               wireless_scan_ref(table->scan),
+                               (GDestroyNotify)wireless_scan_unref);
+
+    if (table->scan == NULL) {
+        /* results will be added when scanning is done */
+        wireless_menu_add_label(menu, _("Scanning for wireless networks..."));
+    } else if (table->scan->aplist!=NULL) {
+        ptr = table->scan->aplist;
         do {
             /* skip hidden AP with Encryption */
             if (ptr->info->haskey&&ptr->info->essid==NULL) {
@@ -225,15 +285,95 @@ wireless_menu(netdev_info *ni)
         } while(ptr!=NULL);
     } else {
         /* we do not found any wireless networks */
-        menu_item = gtk_menu_item_new();
-        wireless_label = gtk_label_new(_("Wireless Networks not found in range"));
-        gtk_label_set_justify(GTK_LABEL(wireless_label), GTK_JUSTIFY_LEFT);
-        gtk_widget_set_sensitive(GTK_WIDGET(wireless_label), FALSE);
-        gtk_container_add(GTK_CONTAINER(menu_item), wireless_label);
-        gtk_menu_shell_append(GTK_MENU_SHELL(menu), menu_item);
+        wireless_menu_add_label(menu, _("Wireless Networks not found in range"));
     }
 
     gtk_widget_show_all(menu);
+}
+
+static gboolean wireless_rescan_timeout(gpointer user_data)
+{
+    ap_table *table = user_data;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    table->rescan_timer = 0;
+    wireless_scan_start(table);
+    return FALSE;
+}
+
+static void wireless_scan_done(ap_scan *scan, gpointer user_data)
+{
+    ap_table *table = user_data;
+
+    gboolean changed = TRUE;
+
+    table->scan_job = NULL;
+    if (scan != NULL) {
+        wireless_scan_unref(table->scan);
+        table->scan = wireless_scan_ref(scan);
+    } else if (table->scan == NULL) {
+        /* scanning failed, show that nothing is found instead of waiting */
+        table->scan = g_slice_new0(ap_scan);
+        table->scan->ref = 1;
+    } else
+        /* keep previous results */
+        changed = FALSE;
+    if (table->menu != NULL) {
+        if (changed) {
+            wireless_menu_fill(table->menu, table);
+            gtk_menu_reposition(GTK_MENU(table->menu));
+        }
+        /* keep results fresh while user is choosing */
+        table->rescan_timer = g_timeout_add_seconds(WIRELESS_RESCAN_INTERVAL,
+                                                    wireless_rescan_timeout, table);
+    }
+}
+
+static void wireless_scan_start(ap_table *table)
+{
+    if (table->scan_job == NULL)
+        table->scan_job = wireless_scan_async(table->ifname, wireless_scan_done, table);
+}
+
+static void wireless_menu_destroyed(GtkWidget *menu, ap_table *table)
+{
+    table->menu = NULL;
+    table->ni = NULL;
+    if (table->rescan_timer != 0) {
+        g_source_remove(table->rescan_timer);
+        table->rescan_timer = 0;
+    }
+}
+
+/* Shows the last known networks immediately and updates them when a scan
+   started in background is finished */
+static GtkWidget *
+wireless_menu(netdev_info *ni)
+{
+    GtkWidget *menu;
+    ap_table *table;
+
+    table = ap_table_get(ni->ns, ni->netdev_list->info.ifname);
+    if (table->menu != NULL)
+        gtk_widget_destroy(table->menu);
+
+    /* create menu */
+    menu = gtk_menu_new();
+    g_signal_connect(menu, "selection-done", G_CALLBACK(gtk_widget_destroy), NULL);
+    g_signal_connect(menu, "destroy", G_CALLBACK(wireless_menu_destroyed), table);
+    table->menu = menu;
+    table->ni = ni;
+
+    wireless_menu_fill(menu, table);
+
+    /* don't rescan on repeated clicks, results are fresh enough */
+    if (table->scan == NULL || table->scan_job != NULL ||
+        g_get_monotonic_time() - table->scan->timestamp > WIRELESS_SCAN_MAX_AGE)
+        wireless_scan_start(table);
+    else
+        table->rescan_timer = g_timeout_add_seconds(WIRELESS_RESCAN_INTERVAL,
+                                                    wireless_rescan_timeout, table);
 
     return menu;
 }
@@ -450,6 +590,7 @@ static void netstat_destructor(gpointer user_data)
 
     ENTER;
     g_source_remove(ns->ttag);
+    g_hash_table_destroy(ns->ap_tables);
     netproc_netdevlist_clear(&ns->fnetd->netdevlist);
     /* The widget is destroyed in plugin_stop().
     gtk_widget_destroy(ns->mainw);
@@ -486,6 +627,7 @@ static GtkWidget *netstat_constructor(LXPanel *panel, config_setting_t *settings
     ns->fnetd->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     ns->fnetd->iwsockfd = iw_sockets_open();
     ns->fnetd->lxnmchannel = lxnm_socket();
+    ns->ap_tables = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, ap_table_free);
 
     /* main */
     ns->mainw = panel_box_new(panel, FALSE, 1);
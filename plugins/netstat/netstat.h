@@ -76,6 +76,7 @@ typedef struct {
     char *fixcmd;
     gint ttag;
     gboolean use_theme;
+    GHashTable *ap_tables; /* ifname -> wireless scan results */
 } netstat;
 
 typedef struct {
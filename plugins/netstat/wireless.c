@@ -23,6 +23,7 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <iwlib.h>
 #include "netstat.h"
 #include "wireless.h"
@@ -317,7 +318,9 @@ gboolean wireless_refresh(int iwsockfd, const char *ifname)
 	return TRUE;
 }
 
-APLIST *wireless_scanning(int iwsockfd, const char *ifname)
+/* Blocks until results are ready so it should be called from a worker thread
+ * with its own socket. Returns FALSE if scanning failed. */
+gboolean wireless_scanning(int iwsockfd, const char *ifname, APLIST **aplist)
 {
 	APLIST *ap = NULL;
 	APLIST *newap;
@@ -331,14 +334,15 @@ APLIST *wireless_scanning(int iwsockfd, const char *ifname)
 	struct timeval tv;		/* select timeout */
 	int timeout = 15000000;		/* 15s */
 
+	*aplist = NULL;
+
 	/* Get range stuff */
 	has_range = (iw_get_range_info(iwsockfd, ifname, &range) >= 0);
 
 	/* Check if the interface could support scanning. */
 	if ((!has_range) || (range.we_version_compiled < 14)) {
-		fprintf(stderr, "%-8.16s  Interface doesn't support scanning.\n\n",
-				ifname);
-		return NULL;
+		g_debug("%s: interface doesn't support scanning", ifname);
+		return FALSE;
 	}
 
 	/* Init timeout value -> 250ms between set and first get */
@@ -352,9 +356,9 @@ APLIST *wireless_scanning(int iwsockfd, const char *ifname)
 	/* Initiate Scanning */
 	if (iw_set_ext(iwsockfd, ifname, SIOCSIWSCAN, &wrq) < 0) {
 		if ((errno != EPERM) || (scanflags != 0)) {
-			fprintf(stderr, "%-8.16s  Interface doesn't support "
-				"scanning : %s\n\n", ifname, strerror(errno));
-			return NULL;
+			g_debug("%s: interface doesn't support scanning: %s",
+				ifname, g_strerror(errno));
+			return FALSE;
 		}
 		tv.tv_usec = 0;
 	}
@@ -362,25 +366,17 @@ APLIST *wireless_scanning(int iwsockfd, const char *ifname)
 
 	/* Forever */
 	while (1) {
-		fd_set rfds;		/* File descriptors for select */
-		int last_fd;	/* Last fd */
 		int ret;
 
-		/* Guess what ? We must re-generate rfds each time */
-		FD_ZERO(&rfds);
-		last_fd = -1;
-
-		/* In here, add the rtnetlink fd in the list */
-
 		/* Wait until something happens */
-		ret = select(last_fd + 1, &rfds, NULL, NULL, &tv);
+		ret = select(0, NULL, NULL, NULL, &tv);
 
 		/* Check if there was an error */
 		if (ret < 0) {
 			if (errno == EAGAIN || errno == EINTR)
 				continue;
-			fprintf(stderr, "Unhandled signal - exiting...\n");
-			return NULL;
+			g_free(buffer);
+			return FALSE;
 		}
 
 		/* Check if there was a timeout */
@@ -389,12 +385,11 @@ APLIST *wireless_scanning(int iwsockfd, const char *ifname)
 
 realloc:
 			/* (Re)allocate the buffer - realloc(NULL, len) == malloc(len) */
-			newbuf = realloc(buffer, buflen);
+			newbuf = g_try_realloc(buffer, buflen);
 			if (newbuf == NULL) {
-				if (buffer)
-					free(buffer);
-				fprintf(stderr, "%s: Allocation failed\n", __FUNCTION__);
-				return NULL;
+				g_free(buffer);
+				g_warning("%s: scan buffer allocation failed", ifname);
+				return FALSE;
 			}
 			buffer = newbuf;
 
@@ -426,19 +421,15 @@ realloc:
 				}
 
 				/* Bad error */
-				free(buffer);
-				fprintf(stderr,
-				"%-8.16s  Failed to read scan data : %s\n\n",
-						ifname, strerror(errno));
-				return NULL;
+				g_free(buffer);
+				g_debug("%s: failed to read scan data: %s",
+					ifname, g_strerror(errno));
+				return FALSE;
 			}
 			else
 				/* We have the results, go to process them */
 				break;
 		}
-
-		/* In here, check if event and event type
-		 * if scan event, read results. All errors bad & no reset timeout */
 	}
 
 	if(wrq.u.data.length) {
@@ -448,22 +439,107 @@ realloc:
 
 		iw_init_event_stream(&stream, (char *) buffer, wrq.u.data.length);
 		do {
-			/* Extract an event and print it */
+			/* Extract an event and parse it */
 			ret = iw_extract_event_stream(&stream, &iwe, range.we_version_compiled);
+			if (ret <= 0)
+				break;
 			if (iwe.cmd==SIOCGIWAP) {
-				newap = malloc(sizeof(APLIST));
+				newap = g_new(APLIST, 1);
 				newap->info = NULL;
 				newap->next = ap;
 				ap = newap;
+			} else if (ap == NULL) {
+				/* events before the first AP address */
+				continue;
 			}
 			ap->info = wireless_parse_scanning_event(&iwe, ap->info);
 		}
 		while (ret > 0);
-		printf("\n");
 	}
-	else
-		printf("%-8.16s  No scan results\n\n", ifname);
 
-	free(buffer);
-	return ap;
+	g_free(buffer);
+	*aplist = ap;
+	return TRUE;
+}
+
+ap_scan *wireless_scan_ref(ap_scan *scan)
+{
+	g_atomic_int_inc(&scan->ref);
+	return scan;
+}
+
+void wireless_scan_unref(ap_scan *scan)
+{
+	if (scan != NULL && g_atomic_int_dec_and_test(&scan->ref)) {
+		wireless_aplist_free(scan->aplist, NULL);
+		g_slice_free(ap_scan, scan);
+	}
+}
+
+typedef struct {
+	char *ifname;
+	wireless_scan_func func;	/* NULL if job was cancelled */
+	gpointer user_data;
+	ap_scan *scan;			/* NULL if scanning failed */
+} wireless_scan_job;
+
+static gboolean wireless_scan_finished(gpointer user_data)
+{
+	wireless_scan_job *job = user_data;
+
+	if (job->func != NULL)
+		job->func(job->scan, job->user_data);
+	wireless_scan_unref(job->scan);
+	g_free(job->ifname);
+	g_slice_free(wireless_scan_job, job);
+	return FALSE;
+}
+
+static gpointer wireless_scan_thread(gpointer user_data)
+{
+	wireless_scan_job *job = user_data;
+	APLIST *aplist;
+	int iwsockfd;
+
+	/* the socket of the plugin is used by the main thread concurrently */
+	iwsockfd = iw_sockets_open();
+	if (iwsockfd >= 0) {
+		if (wireless_scanning(iwsockfd, job->ifname, &aplist)) {
+			job->scan = g_slice_new(ap_scan);
+			job->scan->ref = 1;
+			job->scan->aplist = aplist;
+			job->scan->timestamp = g_get_monotonic_time();
+		}
+		close(iwsockfd);
+	}
+	g_idle_add(wireless_scan_finished, job);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	g_thread_unref(g_thread_self());
+#endif
+	return NULL;
+}
+
+/* Starts scanning in a worker thread. The func is called in the main thread
+ * with the results, or with NULL if scanning failed, unless the job returned
+ * was cancelled by wireless_scan_cancel() before that. */
+gpointer wireless_scan_async(const char *ifname, wireless_scan_func func, gpointer user_data)
+{
+	wireless_scan_job *job = g_slice_new(wireless_scan_job);
+
+	job->ifname = g_strdup(ifname);
+	job->func = func;
+	job->user_data = user_data;
+	job->scan = NULL;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+	g_thread_new("netstat-scan", wireless_scan_thread, job);
+#else
+	g_thread_create(wireless_scan_thread, job, FALSE, NULL);
+#endif
+	return job;
+}
+
+/* The job is freed when the thread is finished, results are dropped. */
+void wireless_scan_cancel(gpointer job)
+{
+	((wireless_scan_job *)job)->func = NULL;
 }
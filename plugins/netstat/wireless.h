@@ -37,8 +37,22 @@ typedef struct ap_info_node {
 	struct ap_info_node *next;
 } APLIST;
 
+/* results of one scan, shared by the cache and open menus */
+typedef struct {
+	int ref;
+	APLIST *aplist;		/* NULL if no networks were found */
+	gint64 timestamp;	/* g_get_monotonic_time() when results were read */
+} ap_scan;
+
+typedef void (*wireless_scan_func)(ap_scan *scan, gpointer user_data);
+
 void wireless_aplist_free(void *aplist, GObject *dummy);
-APLIST *wireless_scanning(int iwsockfd, const char *ifname);
+gboolean wireless_scanning(int iwsockfd, const char *ifname, APLIST **aplist);
+
+ap_scan *wireless_scan_ref(ap_scan *scan);
+void wireless_scan_unref(ap_scan *scan);
+gpointer wireless_scan_async(const char *ifname, wireless_scan_func func, gpointer user_data);
+void wireless_scan_cancel(gpointer job);
 
 gboolean wireless_refresh(int iwsockfd, const char *ifname);
 
@@ -46,6 +46,7 @@ struct _NetstatusIconPrivate
 {
   GtkWidget      *image;
   GtkWidget      *signal_image;
+  GtkWidget      *history_area;
   GtkWidget      *error_dialog;
 
   NetstatusIface *iface;
@@ -69,9 +70,11 @@ struct _NetstatusIconPrivate
   gulong          name_changed_id;
   gulong          wireless_changed_id;
   gulong          signal_changed_id;
+  gulong          history_changed_id;
 
   guint           tooltips_enabled : 1;
   guint           show_signal : 1;
+  guint           show_history : 1;
 };
 
 enum {
@@ -374,11 +377,48 @@ netstatus_icon_update_image (NetstatusIcon *icon)
     gtk_image_set_from_pixbuf (GTK_IMAGE (icon->priv->signal_image), pixbuf);
 }
 
+static char *
+netstatus_icon_format_rate (guint32 rate)
+{
+  char *size;
+  char *retval;
+
+#if GLIB_CHECK_VERSION(2, 30, 0)
+  size = g_format_size (rate);
+#else
+  size = g_format_size_for_display (rate);
+#endif
+  retval = g_strdup_printf (_("%s/s"), size);
+  g_free (size);
+
+  return retval;
+}
+
+static char *
+netstatus_icon_format_history (const NetstatusHistory    *history,
+			       NetstatusHistoryDirection  direction,
+			       const char                *label)
+{
+  char *now, *avg, *max;
+  char *retval;
+
+  now = netstatus_icon_format_rate (netstatus_history_get_sample (history, direction, 0));
+  avg = netstatus_icon_format_rate (netstatus_history_get_average (history, direction));
+  max = netstatus_icon_format_rate (netstatus_history_get_max (history, direction));
+  retval = g_strdup_printf (_("%s %s (average %s, peak %s)"), label, now, avg, max);
+  g_free (now);
+  g_free (avg);
+  g_free (max);
+
+  return retval;
+}
+
 static void
 netstatus_icon_name_changed (NetstatusIface *iface __attribute__((unused)),
 			     GParamSpec     *pspec __attribute__((unused)),
 			     NetstatusIcon  *icon)
 {
+  const NetstatusHistory *history;
   const gchar *iface_name;
   const gchar *tip;
   gchar       *freeme = NULL;
@@ -394,11 +434,136 @@ netstatus_icon_name_changed (NetstatusIface *iface __attribute__((unused)),
       tip = _("Network Connection");
     }
 
+  history = netstatus_iface_get_history (icon->priv->iface);
+  if (icon->priv->show_history && netstatus_history_get_length (history) > 0)
+    {
+      char *rx, *tx;
+
+      rx = netstatus_icon_format_history (history, NETSTATUS_HISTORY_RX, _("Received:"));
+      tx = netstatus_icon_format_history (history, NETSTATUS_HISTORY_TX, _("Sent:"));
+      tip = g_strconcat (tip, "\n", rx, "\n", tx, NULL);
+      g_free (freeme);
+      freeme = (gchar *) tip;
+      g_free (rx);
+      g_free (tx);
+    }
+
   gtk_widget_set_tooltip_text(GTK_WIDGET (icon), tip);
 
   g_free (freeme);
 }
 
+static void
+netstatus_icon_history_changed (NetstatusIface *iface,
+				GParamSpec     *pspec __attribute__((unused)),
+				NetstatusIcon  *icon)
+{
+  if (!icon->priv->show_history)
+    return;
+
+  gtk_widget_queue_draw (icon->priv->history_area);
+  netstatus_icon_name_changed (iface, NULL, icon);
+}
+
+static guint32
+netstatus_icon_history_peak (const NetstatusHistory    *history,
+			     NetstatusHistoryDirection  direction,
+			     guint                      age,
+			     guint                      count)
+{
+  guint   end = MIN (age + count, netstatus_history_get_length (history));
+  guint32 peak = 0;
+
+  for (; age < end; age++)
+    peak = MAX (peak, netstatus_history_get_sample (history, direction, age));
+
+  return peak;
+}
+
+/* Each column shows the peak of the samples it covers, so the whole hour fits
+ * into the area and short bursts are still visible. Received traffic is drawn
+ * filled and sent traffic as a line over it, both in the same scale. */
+#if !GTK_CHECK_VERSION(3, 0, 0)
+static gboolean
+netstatus_icon_history_expose (GtkWidget      *widget,
+			       GdkEventExpose *event,
+			       NetstatusIcon  *icon)
+#else
+static gboolean
+netstatus_icon_history_draw (GtkWidget     *widget,
+			     cairo_t       *cr,
+			     NetstatusIcon *icon)
+#endif
+{
+  const NetstatusHistory *history;
+  GtkAllocation allocation;
+  guint32       scale;
+  guint         length;
+  guint         per_column;
+  int           column;
+
+  if (!icon->priv->iface)
+    return FALSE;
+
+  history = netstatus_iface_get_history (icon->priv->iface);
+  length  = netstatus_history_get_length (history);
+  scale   = MAX (netstatus_history_get_max (history, NETSTATUS_HISTORY_RX),
+		 netstatus_history_get_max (history, NETSTATUS_HISTORY_TX));
+  gtk_widget_get_allocation (widget, &allocation);
+  if (length == 0 || scale == 0 || allocation.width <= 0)
+    return FALSE;
+
+  per_column = (NETSTATUS_HISTORY_LENGTH + allocation.width - 1) / allocation.width;
+
+#if !GTK_CHECK_VERSION(3, 0, 0)
+  cairo_t *cr = gdk_cairo_create (gtk_widget_get_window (widget));
+  gdk_cairo_region (cr, event->region);
+  cairo_clip (cr);
+#endif
+  cairo_set_line_width (cr, 1.0);
+
+  /* newest samples are on the right side */
+  cairo_set_source_rgba (cr, 0.2, 0.6, 0.2, 0.8);
+  for (column = 0; column * per_column < length && column < allocation.width; column++)
+    {
+      guint32 rx = netstatus_icon_history_peak (history, NETSTATUS_HISTORY_RX,
+						column * per_column, per_column);
+      double  x = allocation.width - column - 0.5;
+
+      cairo_move_to (cr, x, allocation.height);
+      cairo_line_to (cr, x, allocation.height - (double) rx * allocation.height / scale);
+    }
+  cairo_stroke (cr);
+
+  cairo_set_source_rgb (cr, 0.8, 0.2, 0.2);
+  for (column = 0; column * per_column < length && column < allocation.width; column++)
+    {
+      guint32 tx = netstatus_icon_history_peak (history, NETSTATUS_HISTORY_TX,
+						column * per_column, per_column);
+
+      cairo_line_to (cr, allocation.width - column - 0.5,
+		     allocation.height - 0.5 - (double) tx * (allocation.height - 1) / scale);
+    }
+  cairo_stroke (cr);
+
+#if !GTK_CHECK_VERSION(3, 0, 0)
+  cairo_destroy (cr);
+#endif
+
+  return FALSE;
+}
+
+static void
+netstatus_icon_resize_history (NetstatusIcon *icon,
+			       int            size)
+{
+  /* wide enough to see the shape of the last hour */
+  if (icon->priv->orientation == GTK_ORIENTATION_HORIZONTAL)
+    gtk_widget_set_size_request (icon->priv->history_area, size * 2, -1);
+  else
+    gtk_widget_set_size_request (icon->priv->history_area, -1, size);
+}
+
 static void
 netstatus_icon_state_changed (NetstatusIface *iface,
 			      GParamSpec     *pspec __attribute__((unused)),
@@ -481,11 +646,14 @@ netstatus_icon_destroy (GtkObject *widget)
 				   icon->priv->wireless_changed_id);
       g_signal_handler_disconnect (icon->priv->iface,
 				   icon->priv->signal_changed_id);
+      g_signal_handler_disconnect (icon->priv->iface,
+				   icon->priv->history_changed_id);
     }
   icon->priv->state_changed_id    = 0;
   icon->priv->name_changed_id     = 0;
   icon->priv->wireless_changed_id = 0;
   icon->priv->signal_changed_id   = 0;
+  icon->priv->history_changed_id  = 0;
 
   icon->priv->image = NULL;
 
@@ -640,6 +808,7 @@ netstatus_icon_size_allocate (GtkWidget     *widget,
       icon->priv->size = size;
 
       netstatus_icon_scale_icons (icon, size);
+      netstatus_icon_resize_history (icon, size);
     }
 
   if (gtk_widget_get_realized(widget))
@@ -925,6 +1094,17 @@ netstatus_icon_instance_init (NetstatusIcon      *icon,
   gtk_container_add (GTK_CONTAINER (icon), icon->priv->signal_image);
   gtk_widget_hide (icon->priv->signal_image);
 
+  icon->priv->history_area = gtk_drawing_area_new ();
+#if !GTK_CHECK_VERSION(3, 0, 0)
+  g_signal_connect (icon->priv->history_area, "expose-event",
+		    G_CALLBACK (netstatus_icon_history_expose), icon);
+#else
+  g_signal_connect (icon->priv->history_area, "draw",
+		    G_CALLBACK (netstatus_icon_history_draw), icon);
+#endif
+  gtk_container_add (GTK_CONTAINER (icon), icon->priv->history_area);
+  gtk_widget_hide (icon->priv->history_area);
+
   gtk_widget_add_events (GTK_WIDGET (icon),
 			 GDK_BUTTON_PRESS_MASK | GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK);
 }
@@ -1036,6 +1216,8 @@ netstatus_icon_set_iface (NetstatusIcon  *icon,
 				       icon->priv->wireless_changed_id);
 	  g_signal_handler_disconnect (icon->priv->iface,
 				       icon->priv->signal_changed_id);
+	  g_signal_handler_disconnect (icon->priv->iface,
+				       icon->priv->history_changed_id);
 	}
 
       if (iface)
@@ -1053,11 +1235,14 @@ netstatus_icon_set_iface (NetstatusIcon  *icon,
 							   G_CALLBACK (netstatus_icon_is_wireless_changed), icon);
       icon->priv->signal_changed_id    = g_signal_connect (icon->priv->iface, "notify::signal-strength",
 							   G_CALLBACK (netstatus_icon_signal_changed), icon);
+      icon->priv->history_changed_id   = g_signal_connect (icon->priv->iface, "notify::history",
+							   G_CALLBACK (netstatus_icon_history_changed), icon);
 
       netstatus_icon_state_changed       (icon->priv->iface, NULL, icon);
       netstatus_icon_name_changed        (icon->priv->iface, NULL, icon);
       netstatus_icon_is_wireless_changed (icon->priv->iface, NULL, icon);
       netstatus_icon_signal_changed      (icon->priv->iface, NULL, icon);
+      netstatus_icon_history_changed     (icon->priv->iface, NULL, icon);
 
       /* g_object_notify (G_OBJECT (icon), "iface"); */
     }
@@ -1082,6 +1267,8 @@ netstatus_icon_set_orientation (NetstatusIcon  *icon,
       icon->priv->orientation = orientation;
 
       netstatus_icon_rotate_signal_icons (icon, orientation);
+      if (icon->priv->size > 0)
+	netstatus_icon_resize_history (icon, icon->priv->size);
       netstatus_icon_update_image (icon);
 
       icon->priv->size = -1;
@@ -1152,3 +1339,33 @@ netstatus_icon_get_show_signal (NetstatusIcon *icon)
 
   return icon->priv->show_signal;
 }
+
+void
+netstatus_icon_set_show_history (NetstatusIcon *icon,
+				 gboolean       show_history)
+{
+  g_return_if_fail (NETSTATUS_IS_ICON (icon));
+
+  show_history = show_history != FALSE;
+
+  if (icon->priv->show_history != show_history)
+    {
+      icon->priv->show_history = show_history;
+
+      if (show_history)
+	gtk_widget_show (icon->priv->history_area);
+      else
+	gtk_widget_hide (icon->priv->history_area);
+
+      if (icon->priv->iface)
+	netstatus_icon_name_changed (icon->priv->iface, NULL, icon);
+    }
+}
+
+gboolean
+netstatus_icon_get_show_history (NetstatusIcon *icon)
+{
+  g_return_val_if_fail (NETSTATUS_ICON (icon), FALSE);
+
+  return icon->priv->show_history;
+}
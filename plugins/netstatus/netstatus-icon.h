@@ -76,6 +76,10 @@ void            netstatus_icon_set_show_signal      (NetstatusIcon  *icon,
 						     gboolean        show_signal);
 gboolean        netstatus_icon_get_show_signal      (NetstatusIcon  *icon);
 
+void            netstatus_icon_set_show_history     (NetstatusIcon  *icon,
+						     gboolean        show_history);
+gboolean        netstatus_icon_get_show_history     (NetstatusIcon  *icon);
+
 G_END_DECLS
 
 #endif /* __NETSTATUS_ICON_H__ */
@@ -63,7 +63,8 @@ enum
   PROP_STATS,
   PROP_WIRELESS,
   PROP_SIGNAL_STRENGTH,
-  PROP_ERROR
+  PROP_ERROR,
+  PROP_HISTORY
 };
 
 struct _NetstatusIfacePrivate
@@ -78,6 +79,12 @@ struct _NetstatusIfacePrivate
   int             sockfd;
   guint           monitor_id;
 
+  NetstatusHistory history;
+  gint64          history_stamp;     /* time the last sample was taken at */
+  gulong          history_in_bytes;  /* counters at that time */
+  gulong          history_out_bytes;
+  guint           history_valid : 1; /* counters above are valid */
+
   guint           error_polling : 1;
   guint           is_wireless : 1;
 };
@@ -192,6 +199,13 @@ netstatus_iface_class_init (NetstatusIfaceClass *klass)
 						       _("The current error condition"),
 						       NETSTATUS_TYPE_G_ERROR,
 						       G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (gobject_class,
+				   PROP_HISTORY,
+				   g_param_spec_pointer ("history",
+							 _("History"),
+							 _("Traffic rates of the interface over the last hour"),
+							 G_PARAM_READABLE));
 }
 
 static void
@@ -269,6 +283,10 @@ netstatus_iface_get_property (GObject    *object,
       break;
     case PROP_ERROR:
       g_value_set_boxed (value, iface->priv->error);
+      break;
+    case PROP_HISTORY:
+      g_value_set_pointer (value, &iface->priv->history);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -334,6 +352,14 @@ netstatus_iface_get_statistics (NetstatusIface *iface,
     *stats  = iface->priv->stats;
 }
 
+const NetstatusHistory *
+netstatus_iface_get_history (NetstatusIface *iface)
+{
+  g_return_val_if_fail (NETSTATUS_IS_IFACE (iface), NULL);
+
+  return &iface->priv->history;
+}
+
 gboolean
 netstatus_iface_get_is_wireless (NetstatusIface *iface)
 {
@@ -479,6 +505,55 @@ netstatus_iface_poll_iface_statistics (NetstatusIface *iface,
   return TRUE;
 }
 
+/* Appends a sample for each second passed since the previous one. Rate over
+ * the whole interval is used for all of them, or zero if the counters were
+ * not available (interface is down) */
+static void
+netstatus_iface_update_history (NetstatusIface *iface,
+				gboolean        valid,
+				gulong          in_bytes,
+				gulong          out_bytes)
+{
+  gint64  now = g_get_monotonic_time ();
+  gint64  elapsed;
+  guint32 rx = 0, tx = 0;
+  guint   n;
+
+  if (iface->priv->history_stamp == 0)
+    {
+      iface->priv->history_stamp     = now;
+      iface->priv->history_in_bytes  = in_bytes;
+      iface->priv->history_out_bytes = out_bytes;
+      iface->priv->history_valid     = valid;
+      return;
+    }
+
+  elapsed = now - iface->priv->history_stamp;
+  if (elapsed < G_USEC_PER_SEC)
+    return;
+
+  /* counters are reset when the interface is re-created */
+  if (valid && iface->priv->history_valid &&
+      in_bytes >= iface->priv->history_in_bytes &&
+      out_bytes >= iface->priv->history_out_bytes)
+    {
+      rx = MIN ((in_bytes - iface->priv->history_in_bytes) * (gdouble) G_USEC_PER_SEC / elapsed, G_MAXUINT32);
+      tx = MIN ((out_bytes - iface->priv->history_out_bytes) * (gdouble) G_USEC_PER_SEC / elapsed, G_MAXUINT32);
+    }
+
+  n = elapsed / G_USEC_PER_SEC;
+  /* keep samples on the one second grid */
+  iface->priv->history_stamp    += (gint64) n * G_USEC_PER_SEC;
+  iface->priv->history_in_bytes  = in_bytes;
+  iface->priv->history_out_bytes = out_bytes;
+  iface->priv->history_valid     = valid;
+
+  for (n = MIN (n, NETSTATUS_HISTORY_LENGTH); n > 0; n--)
+    netstatus_history_append (&iface->priv->history, rx, tx);
+
+  g_object_notify (G_OBJECT (iface), "history");
+}
+
 static NetstatusState
 netstatus_iface_poll_state (NetstatusIface *iface)
 {
@@ -516,6 +591,8 @@ netstatus_iface_poll_state (NetstatusIface *iface)
   if (!netstatus_iface_poll_iface_statistics (iface, &in_packets, &out_packets, &in_bytes, &out_bytes))
     return NETSTATUS_STATE_IDLE;
 
+  netstatus_iface_update_history (iface, TRUE, in_bytes, out_bytes);
+
   dprintf (POLLING, "Packets in: %ld out: %ld. Prev in: %ld out: %ld\n",
 	   in_packets, out_packets,
 	   iface->priv->stats.in_packets, iface->priv->stats.out_packets);
@@ -621,6 +698,8 @@ netstatus_iface_monitor_timeout (NetstatusIface *iface)
     return FALSE;
 
   state = netstatus_iface_poll_state (iface);
+  if (state == NETSTATUS_STATE_DISCONNECTED)
+    netstatus_iface_update_history (iface, FALSE, 0, 0);
 
   if (iface->priv->state != state &&
       iface->priv->state != NETSTATUS_STATE_ERROR)
@@ -657,10 +736,14 @@ netstatus_iface_init_monitor (NetstatusIface *iface)
   iface->priv->signal_strength   = 0;
   iface->priv->is_wireless       = FALSE;
 
+  netstatus_history_reset (&iface->priv->history);
+  iface->priv->history_stamp     = 0;
+
   g_object_freeze_notify (G_OBJECT (iface));
   g_object_notify (G_OBJECT (iface), "state");
   g_object_notify (G_OBJECT (iface), "wireless");
   g_object_notify (G_OBJECT (iface), "signal-strength");
+  g_object_notify (G_OBJECT (iface), "history");
   g_object_thaw_notify (G_OBJECT (iface));
 
   if (iface->priv->monitor_id)
@@ -69,6 +69,7 @@ void                   netstatus_iface_get_statistics        (NetstatusIface  *i
 							      NetstatusStats  *stats);
 gboolean               netstatus_iface_get_is_wireless       (NetstatusIface  *iface);
 int                    netstatus_iface_get_signal_strength   (NetstatusIface  *iface);
+const NetstatusHistory *netstatus_iface_get_history          (NetstatusIface  *iface);
 
 void                   netstatus_iface_set_error             (NetstatusIface  *iface,
 							      const GError    *error);
@@ -32,6 +32,7 @@
 #include <math.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <glib/gi18n.h>
 
@@ -140,97 +141,250 @@ parse_stats_header (char *buf,
     }
 }
 
-static inline FILE *
-get_proc_net_dev_fh (void)
+/* /proc/net/dev is read and parsed once into a table which serves all the
+ * interfaces polled within NETSTATUS_PROC_NET_DEV_MAX_AGE, so several
+ * netstatus instances don't parse the file each on its own timer.
+ */
+#define NETSTATUS_PROC_NET_DEV_MAX_AGE (200 * 1000) /* microseconds */
+
+typedef struct
 {
-  static FILE *retval = NULL;
+  gulong   in_packets;
+  gulong   out_packets;
+  gulong   in_bytes;
+  gulong   out_bytes;
+  guint    serial;      /* snapshot this entry was seen in last time */
+  gboolean valid;       /* statistics were parsed successfully */
+  char    *line;        /* original line if parsing failed */
+} NetstatusProcNetDevEntry;
+
+static struct
+{
+  int         fd;
+  char       *buf;
+  gsize       buf_size;
+  char       *header;     /* columns line the indices were parsed from */
+  int         prx_idx, ptx_idx;
+  int         brx_idx, btx_idx;
+  GHashTable *entries;    /* name -> NetstatusProcNetDevEntry */
+  guint       serial;
+  gint64      stamp;      /* g_get_monotonic_time() of last read */
+  char       *error;      /* error which affects all interfaces */
+} proc_net_dev = { -1 };
+
+static void
+proc_net_dev_entry_free (gpointer data)
+{
+  NetstatusProcNetDevEntry *entry = data;
 
-  if (retval != NULL)
-    return retval;
+  g_free (entry->line);
+  g_slice_free (NetstatusProcNetDevEntry, entry);
+}
+
+/* reads the whole file into the buffer which is reused between reads */
+static gssize
+proc_net_dev_read (void)
+{
+  gsize   len = 0;
+  gssize  n;
+
+  if (proc_net_dev.fd < 0)
+    {
+      proc_net_dev.fd = open ("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+      if (proc_net_dev.fd < 0)
+	return -1;
+    }
+
+  if (proc_net_dev.buf == NULL)
+    {
+      proc_net_dev.buf_size = 4096;
+      proc_net_dev.buf = g_malloc (proc_net_dev.buf_size);
+    }
 
-  return retval = fopen ("/proc/net/dev", "r");
+  do
+    {
+      if (len + 1 >= proc_net_dev.buf_size)
+	{
+	  proc_net_dev.buf_size *= 2;
+	  proc_net_dev.buf = g_realloc (proc_net_dev.buf, proc_net_dev.buf_size);
+	}
+      n = pread (proc_net_dev.fd, proc_net_dev.buf + len,
+		 proc_net_dev.buf_size - len - 1, len);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      len += n;
+    }
+  while (n > 0);
+
+  proc_net_dev.buf [len] = '\0';
+  return len;
 }
 
-char *
-netstatus_sysdeps_read_iface_statistics (const char  *iface,
-					 gulong      *in_packets,
-					 gulong      *out_packets,
-					 gulong      *in_bytes,
-					 gulong      *out_bytes)
+static gboolean
+proc_net_dev_entry_is_stale (gpointer key,
+			     gpointer value,
+			     gpointer serial)
 {
-  FILE *fh;
-  char  buf [512];
-  int   prx_idx, ptx_idx;
-  int   brx_idx, btx_idx;
-  char *error_message = NULL;
+  return ((NetstatusProcNetDevEntry *) value)->serial != GPOINTER_TO_UINT (serial);
+}
 
-  g_return_val_if_fail (iface != NULL, NULL);
-  g_return_val_if_fail (in_packets != NULL, NULL);
-  g_return_val_if_fail (out_packets != NULL, NULL);
-  g_return_val_if_fail (in_bytes != NULL, NULL);
-  g_return_val_if_fail (out_bytes != NULL, NULL);
+static void
+proc_net_dev_update (void)
+{
+  char  *line;
+  char  *next;
+  gint64 now;
 
-  *in_packets  = -1;
-  *out_packets = -1;
-  *in_bytes    = -1;
-  *out_bytes   = -1;
+  now = g_get_monotonic_time ();
+  if (proc_net_dev.stamp != 0 &&
+      now - proc_net_dev.stamp < NETSTATUS_PROC_NET_DEV_MAX_AGE)
+    return;
+  proc_net_dev.stamp = now;
+  proc_net_dev.serial++;
 
-  fh = get_proc_net_dev_fh ();
-  if (!fh)
-    return g_strdup_printf (_("Cannot open /proc/net/dev: %s"),
-			    g_strerror (errno));
+  g_free (proc_net_dev.error);
+  proc_net_dev.error = NULL;
 
-  if (fgets (buf, sizeof (buf), fh) == NULL ||
-      fgets (buf, sizeof (buf), fh) == NULL)
-    return g_strdup (_("Could not parse /proc/net/dev. No data."));
+  if (proc_net_dev_read () < 0)
+    {
+      proc_net_dev.error = g_strdup_printf (_("Cannot open /proc/net/dev: %s"),
+					    g_strerror (errno));
+      return;
+    }
 
-  parse_stats_header (buf, &prx_idx, &ptx_idx, &brx_idx, &btx_idx);
-  if (prx_idx == -1 || ptx_idx == -1 ||
-      brx_idx == -1 || btx_idx == -1)
-    return g_strdup (_("Could not parse /proc/net/dev. Unknown format."));
+  /* skip the first header line */
+  line = strchr (proc_net_dev.buf, '\n');
+  if (line == NULL || (next = strchr (++line, '\n')) == NULL)
+    {
+      proc_net_dev.error = g_strdup (_("Could not parse /proc/net/dev. No data."));
+      return;
+    }
+  *next++ = '\0';
 
-  while (fgets (buf, sizeof (buf), fh))
+  /* columns don't change while kernel is running, parse them only once */
+  if (g_strcmp0 (proc_net_dev.header, line) != 0)
     {
+      g_free (proc_net_dev.header);
+      proc_net_dev.header = g_strdup (line);
+      parse_stats_header (line,
+			  &proc_net_dev.prx_idx, &proc_net_dev.ptx_idx,
+			  &proc_net_dev.brx_idx, &proc_net_dev.btx_idx);
+    }
+  if (proc_net_dev.prx_idx == -1 || proc_net_dev.ptx_idx == -1 ||
+      proc_net_dev.brx_idx == -1 || proc_net_dev.btx_idx == -1)
+    {
+      proc_net_dev.error = g_strdup (_("Could not parse /proc/net/dev. Unknown format."));
+      return;
+    }
+
+  if (proc_net_dev.entries == NULL)
+    proc_net_dev.entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						  proc_net_dev_entry_free);
+
+  for (line = next; line && *line; line = next)
+    {
+      NetstatusProcNetDevEntry *entry;
       char *stats;
       char *name;
+      char  saved [512];
 
-      name = buf;
+      next = strchr (line, '\n');
+      if (next)
+	*next++ = '\0';
+
+      name = line;
       while (g_ascii_isspace (name [0]))
 	name++;
 
       stats = parse_iface_name (name);
       if (!stats)
 	{
-	  if (!error_message)
-	    error_message = g_strdup_printf (_("Could not parse interface name from '%s'"), buf);
+	  if (!proc_net_dev.error)
+	    proc_net_dev.error = g_strdup_printf (_("Could not parse interface name from '%s'"), line);
 	  continue;
 	}
 
-      if (strcmp (name, iface) != 0)
-	continue;
-
-      if (!parse_stats (stats,
-			prx_idx, ptx_idx, in_packets, out_packets,
-			brx_idx, btx_idx, in_bytes, out_bytes))
+      entry = g_hash_table_lookup (proc_net_dev.entries, name);
+      if (entry == NULL)
 	{
-	  if (error_message)
-	    g_free (error_message);
-	  error_message = g_strdup_printf (_("Could not parse interface statistics from '%s'. "
-					     "prx_idx = %d; ptx_idx = %d; brx_idx = %d; btx_idx = %d;"),
-					   buf, prx_idx, ptx_idx, brx_idx, btx_idx);
-	  continue;
+	  entry = g_slice_new0 (NetstatusProcNetDevEntry);
+	  g_hash_table_insert (proc_net_dev.entries, g_strdup (name), entry);
 	}
+      entry->serial = proc_net_dev.serial;
+
+      entry->in_packets  = -1;
+      entry->out_packets = -1;
+      entry->in_bytes    = -1;
+      entry->out_bytes   = -1;
+      /* parse_stats() mangles the buffer, keep it for error message */
+      g_strlcpy (saved, stats, sizeof (saved));
+      entry->valid = parse_stats (stats,
+				  proc_net_dev.prx_idx, proc_net_dev.ptx_idx,
+				  &entry->in_packets, &entry->out_packets,
+				  proc_net_dev.brx_idx, proc_net_dev.btx_idx,
+				  &entry->in_bytes, &entry->out_bytes);
+      g_free (entry->line);
+      entry->line = entry->valid ? NULL : g_strconcat (name, ":", saved, NULL);
+    }
 
-      break;
+  /* forget interfaces which are gone, they may come and go all the time */
+  g_hash_table_foreach_remove (proc_net_dev.entries, proc_net_dev_entry_is_stale,
+			       GUINT_TO_POINTER (proc_net_dev.serial));
+}
+
+char *
+netstatus_sysdeps_read_iface_statistics (const char  *iface,
+					 gulong      *in_packets,
+					 gulong      *out_packets,
+					 gulong      *in_bytes,
+					 gulong      *out_bytes)
+{
+  NetstatusProcNetDevEntry *entry = NULL;
+
+  g_return_val_if_fail (iface != NULL, NULL);
+  g_return_val_if_fail (in_packets != NULL, NULL);
+  g_return_val_if_fail (out_packets != NULL, NULL);
+  g_return_val_if_fail (in_bytes != NULL, NULL);
+  g_return_val_if_fail (out_bytes != NULL, NULL);
+
+  *in_packets  = -1;
+  *out_packets = -1;
+  *in_bytes    = -1;
+  *out_bytes   = -1;
+
+  proc_net_dev_update ();
+
+  if (proc_net_dev.entries != NULL)
+    entry = g_hash_table_lookup (proc_net_dev.entries, iface);
+  if (entry != NULL && entry->serial != proc_net_dev.serial)
+    entry = NULL; /* interface is gone */
+
+  if (entry != NULL && !entry->valid)
+    return g_strdup_printf (_("Could not parse interface statistics from '%s'. "
+			      "prx_idx = %d; ptx_idx = %d; brx_idx = %d; btx_idx = %d;"),
+			    entry->line,
+			    proc_net_dev.prx_idx, proc_net_dev.ptx_idx,
+			    proc_net_dev.brx_idx, proc_net_dev.btx_idx);
+
+  if (entry != NULL)
+    {
+      *in_packets  = entry->in_packets;
+      *out_packets = entry->out_packets;
+      *in_bytes    = entry->in_bytes;
+      *out_bytes   = entry->out_bytes;
     }
 
-  if ((*in_packets == (gulong) -1 || *out_packets == (gulong) -1 || *in_bytes == (gulong) -1 || *out_bytes == (gulong) -1) && !error_message)
-    error_message = g_strdup_printf ("Could not find information on interface '%s' in /proc/net/dev", iface);
+  if (proc_net_dev.error)
+    return g_strdup (proc_net_dev.error);
 
-  rewind (fh);
-  fflush (fh);
+  if (*in_packets == (gulong) -1 || *out_packets == (gulong) -1 || *in_bytes == (gulong) -1 || *out_bytes == (gulong) -1)
+    return g_strdup_printf ("Could not find information on interface '%s' in /proc/net/dev", iface);
 
-  return error_message;
+  return NULL;
 }
 
 static inline gboolean
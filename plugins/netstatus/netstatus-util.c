@@ -188,3 +188,118 @@ netstatus_list_insert_unique (GList *list,
 
   return g_list_prepend (list, str);
 }
+
+void
+netstatus_history_reset (NetstatusHistory *history)
+{
+  memset (history, 0, sizeof (NetstatusHistory));
+}
+
+/* keeps the queue sorted by sample value: new sample drops from the tail all
+ * the samples which can never be an extremum again while it is in the window */
+static void
+history_queue_push (guint32       *queue,
+		    guint         *head,
+		    guint         *len,
+		    const guint32 *samples,
+		    guint32        serial,
+		    guint32        value,
+		    gboolean       keep_max)
+{
+  /* the oldest sample is leaving the window */
+  if (*len > 0 && serial - queue [*head] >= NETSTATUS_HISTORY_LENGTH)
+    {
+      *head = (*head + 1) % NETSTATUS_HISTORY_LENGTH;
+      (*len)--;
+    }
+
+  while (*len > 0)
+    {
+      guint32 tail = samples [queue [(*head + *len - 1) % NETSTATUS_HISTORY_LENGTH] % NETSTATUS_HISTORY_LENGTH];
+
+      if (keep_max ? tail > value : tail < value)
+	break;
+      (*len)--;
+    }
+
+  queue [(*head + *len) % NETSTATUS_HISTORY_LENGTH] = serial;
+  (*len)++;
+}
+
+static void
+history_series_append (NetstatusHistorySeries *series,
+		       guint32                 serial,
+		       guint32                 value)
+{
+  guint slot = serial % NETSTATUS_HISTORY_LENGTH;
+
+  history_queue_push (series->max_queue, &series->max_head, &series->max_len,
+		      series->samples, serial, value, TRUE);
+  history_queue_push (series->min_queue, &series->min_head, &series->min_len,
+		      series->samples, serial, value, FALSE);
+
+  if (serial >= NETSTATUS_HISTORY_LENGTH)
+    series->sum -= series->samples [slot];
+  series->sum += value;
+  series->samples [slot] = value;
+}
+
+void
+netstatus_history_append (NetstatusHistory *history,
+			  guint32           rx,
+			  guint32           tx)
+{
+  history_series_append (&history->series [NETSTATUS_HISTORY_RX], history->serial, rx);
+  history_series_append (&history->series [NETSTATUS_HISTORY_TX], history->serial, tx);
+  history->serial++;
+}
+
+guint
+netstatus_history_get_length (const NetstatusHistory *history)
+{
+  return MIN (history->serial, NETSTATUS_HISTORY_LENGTH);
+}
+
+/* age 0 is the most recent sample */
+guint32
+netstatus_history_get_sample (const NetstatusHistory    *history,
+			      NetstatusHistoryDirection  direction,
+			      guint                      age)
+{
+  g_return_val_if_fail (age < netstatus_history_get_length (history), 0);
+
+  return history->series [direction].samples [(history->serial - 1 - age) % NETSTATUS_HISTORY_LENGTH];
+}
+
+guint32
+netstatus_history_get_min (const NetstatusHistory    *history,
+			   NetstatusHistoryDirection  direction)
+{
+  const NetstatusHistorySeries *series = &history->series [direction];
+
+  if (series->min_len == 0)
+    return 0;
+  return series->samples [series->min_queue [series->min_head] % NETSTATUS_HISTORY_LENGTH];
+}
+
+guint32
+netstatus_history_get_max (const NetstatusHistory    *history,
+			   NetstatusHistoryDirection  direction)
+{
+  const NetstatusHistorySeries *series = &history->series [direction];
+
+  if (series->max_len == 0)
+    return 0;
+  return series->samples [series->max_queue [series->max_head] % NETSTATUS_HISTORY_LENGTH];
+}
+
+guint32
+netstatus_history_get_average (const NetstatusHistory    *history,
+			       NetstatusHistoryDirection  direction)
+{
+  guint length = netstatus_history_get_length (history);
+
+  if (length == 0)
+    return 0;
+  return history->series [direction].sum / length;
+}
@@ -68,6 +68,34 @@ typedef struct
   gulong out_bytes;
 } NetstatusStats;
 
+#define NETSTATUS_HISTORY_LENGTH 3600 /* samples, one per second */
+
+typedef enum {
+  NETSTATUS_HISTORY_RX = 0,
+  NETSTATUS_HISTORY_TX = 1,
+  NETSTATUS_HISTORY_LAST = 2
+} NetstatusHistoryDirection;
+
+/* Fixed-size ring of traffic rates. Minimum and maximum over the window are
+ * tracked with monotonic queues of sample serials so all of them are O(1)
+ * per appended sample and nothing is allocated after creation.
+ */
+typedef struct
+{
+  guint32 samples [NETSTATUS_HISTORY_LENGTH];   /* bytes per second */
+  guint64 sum;                                  /* of samples in the window */
+  guint32 max_queue [NETSTATUS_HISTORY_LENGTH]; /* serials, decreasing samples */
+  guint32 min_queue [NETSTATUS_HISTORY_LENGTH]; /* serials, increasing samples */
+  guint   max_head, max_len;
+  guint   min_head, min_len;
+} NetstatusHistorySeries;
+
+typedef struct
+{
+  NetstatusHistorySeries series [NETSTATUS_HISTORY_LAST];
+  guint32                serial; /* number of samples appended */
+} NetstatusHistory;
+
 GQuark               netstatus_error_quark                (void);
 GType                netstatus_g_error_get_type           (void);
 GType                netstatus_stats_get_type             (void);
@@ -85,6 +113,21 @@ void                 netstatus_connect_signal_while_alive (gpointer        objec
 							   gpointer        func_data,
 							   gpointer        alive_object);
 
+void                 netstatus_history_reset              (NetstatusHistory          *history);
+void                 netstatus_history_append             (NetstatusHistory          *history,
+							   guint32                    rx,
+							   guint32                    tx);
+guint                netstatus_history_get_length         (const NetstatusHistory    *history);
+guint32              netstatus_history_get_sample         (const NetstatusHistory    *history,
+							   NetstatusHistoryDirection  direction,
+							   guint                      age);
+guint32              netstatus_history_get_min            (const NetstatusHistory    *history,
+							   NetstatusHistoryDirection  direction);
+guint32              netstatus_history_get_max            (const NetstatusHistory    *history,
+							   NetstatusHistoryDirection  direction);
+guint32              netstatus_history_get_average        (const NetstatusHistory    *history,
+							   NetstatusHistoryDirection  direction);
+
 #ifdef G_ENABLE_DEBUG
 
 #include <stdio.h>
@@ -40,6 +40,7 @@ typedef struct {
     config_setting_t *settings;
     char *iface;
     char *config_tool;
+    gboolean show_history;
     GtkWidget *dlg;
 } netstatus;
 
@@ -117,6 +118,7 @@ netstatus_constructor(LXPanel *panel, config_setting_t *settings)
     NetstatusIface* iface;
     GtkWidget *p;
     const char *tmp;
+    int tmp_int;
 
     ENTER;
     ns = g_new0(netstatus, 1);
@@ -129,11 +131,15 @@ netstatus_constructor(LXPanel *panel, config_setting_t *settings)
     if (!config_setting_lookup_string(settings, "configtool", &tmp))
         tmp = "nm-connection-editor";
     ns->config_tool = g_strdup(tmp);
+    if (!config_setting_lookup_int(settings, "showhistory", &tmp_int))
+        tmp_int = 1;
+    ns->show_history = !!tmp_int;
 
     iface = netstatus_iface_new(ns->iface);
     p = netstatus_icon_new( iface );
     lxpanel_plugin_set_data(p, ns, netstatus_destructor);
     netstatus_icon_set_show_signal((NetstatusIcon *)p, TRUE);
+    netstatus_icon_set_show_history((NetstatusIcon *)p, ns->show_history);
     g_object_unref( iface );
 
     RET(p);
@@ -145,11 +151,18 @@ static gboolean apply_config(gpointer user_data)
     netstatus *ns = lxpanel_plugin_get_data(p);
     NetstatusIface* iface;
 
-    iface = netstatus_iface_new(ns->iface);
-    netstatus_icon_set_iface((NetstatusIcon *)p, iface);
-    g_object_unref(iface);
+    /* keep collected history unless interface is changed */
+    iface = netstatus_icon_get_iface((NetstatusIcon *)p);
+    if (g_strcmp0(netstatus_iface_get_name(iface), ns->iface) != 0)
+    {
+        iface = netstatus_iface_new(ns->iface);
+        netstatus_icon_set_iface((NetstatusIcon *)p, iface);
+        g_object_unref(iface);
+    }
+    netstatus_icon_set_show_history((NetstatusIcon *)p, ns->show_history);
     config_group_set_string(ns->settings, "iface", ns->iface);
     config_group_set_string(ns->settings, "configtool", ns->config_tool);
+    config_group_set_int(ns->settings, "showhistory", ns->show_history);
     return FALSE;
 }
 
@@ -161,6 +174,7 @@ static GtkWidget *netstatus_config(LXPanel *panel, GtkWidget *p)
                 panel, apply_config, p,
                 _("Interface to monitor"), &ns->iface, CONF_TYPE_STR,
                 _("Config tool"), &ns->config_tool, CONF_TYPE_STR,
+                _("Show traffic history"), &ns->show_history, CONF_TYPE_BOOL,
                 NULL );
     return dlg;
 }
@@ -0,0 +1,432 @@
+/*
+ * Top processes scanner for CPU and memory monitors.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <glib/gi18n.h>
+
+#include "proctop.h"
+
+/* Each scan walks /proc once using a directory fd kept open, and reads each
+   /proc/<pid>/stat with openat() and pread() into a reused buffer. Ticks of
+   every process are kept in the table keyed by pid, so a scan compares them
+   with previous ones. A process whose ticks didn't change has not run since
+   previous scan, so it cannot have renamed itself nor grown its memory, and
+   its name isn't parsed again and it isn't a candidate for top CPU users. */
+
+#define PROC_TOP_INTERVAL   2                   /* seconds between scans */
+#define PROC_TOP_IDLE_TIME  (3 * G_USEC_PER_SEC) /* stop if not touched */
+#define PROC_TOP_MAX_AGE    (2 * PROC_TOP_INTERVAL * G_USEC_PER_SEC) /* older scan is a new baseline */
+#define PROC_TOP_MAX        10                  /* max processes to show */
+
+typedef struct {
+    int pid;
+    char name[16];              /* as /proc/<pid>/comm */
+    float cpu;                  /* percents of all CPUs */
+    guint64 rss;                /* resident memory, in bytes */
+} ProcTopEntry;
+
+typedef struct {
+    guint64 ticks;              /* utime + stime */
+    guint64 start_time;         /* to detect reuse of the pid */
+    guint64 rss;                /* resident pages */
+    guint serial;               /* last scan where it was seen */
+    char name[16];              /* last known name */
+} ProcTopTask;
+
+typedef struct {
+    int proc_fd;                /* directory fd of /proc */
+    GHashTable *tasks;          /* pid -> ProcTopTask */
+    guint serial;               /* number of current scan */
+    gint64 timestamp;           /* monotonic time of last scan, 0 if none */
+    char buffer[1024];          /* for contents of stat file */
+} ProcTopState;
+
+typedef struct {
+    ProcTop *pt;                /* NULL if scanner was freed meanwhile */
+    ProcTopState *state;        /* owned by job while it runs */
+    guint n;                    /* how many entries to collect */
+    ProcTopEntry by_cpu[PROC_TOP_MAX];
+    guint n_cpu;
+    ProcTopEntry by_mem[PROC_TOP_MAX];
+    guint n_mem;
+    gboolean valid;             /* FALSE if scan was just a baseline */
+} ProcTopJob;
+
+struct _ProcTop {
+    guint n;                    /* how many entries to show */
+    ProcTopFunc func;
+    gpointer user_data;
+    ProcTopState *state;        /* NULL while a job runs */
+    ProcTopJob *job;            /* running job */
+    guint timer;                /* periodic scans while touched */
+    gint64 last_touch;          /* monotonic time of last proc_top_touch() */
+    ProcTopEntry by_cpu[PROC_TOP_MAX];
+    guint n_cpu;
+    ProcTopEntry by_mem[PROC_TOP_MAX];
+    guint n_mem;
+};
+
+static void proc_top_task_free(gpointer data)
+{
+    g_slice_free(ProcTopTask, data);
+}
+
+static ProcTopState *proc_top_state_new(void)
+{
+    ProcTopState *state = g_slice_new0(ProcTopState);
+
+    state->proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state->proc_fd < 0)
+        g_warning("proctop: cannot open /proc: %s", g_strerror(errno));
+    state->tasks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                         proc_top_task_free);
+    return state;
+}
+
+static void proc_top_state_free(ProcTopState *state)
+{
+    if (state->proc_fd >= 0)
+        close(state->proc_fd);
+    g_hash_table_destroy(state->tasks);
+    g_slice_free(ProcTopState, state);
+}
+
+/* inserts entry into the array sorted descending by value, keeping n best */
+static void proc_top_insert(ProcTopEntry *list, guint *count, guint n,
+                            const ProcTopEntry *entry, ProcTopOrder order)
+{
+    guint i = *count;
+
+#define PROC_TOP_VALUE(_e) (order == PROC_TOP_BY_CPU ? (double)(_e)->cpu : (double)(_e)->rss)
+    if (i == n)
+    {
+        if (PROC_TOP_VALUE(&list[n - 1]) >= PROC_TOP_VALUE(entry))
+            return;
+        i--;
+    }
+    else
+        (*count)++;
+    while (i > 0 && PROC_TOP_VALUE(&list[i - 1]) < PROC_TOP_VALUE(entry))
+    {
+        list[i] = list[i - 1];
+        i--;
+    }
+    list[i] = *entry;
+#undef PROC_TOP_VALUE
+}
+
+/* parses fields of /proc/<pid>/stat that follow the name */
+static gboolean proc_top_parse_stat(char *p, guint64 *ticks, guint64 *start_time,
+                                    guint64 *rss)
+{
+    guint64 utime = 0, stime = 0;
+    int field;
+
+    /* p points after ')' so the next field is number 3, the state */
+    for (field = 3; field <= 24; field++)
+    {
+        while (*p == ' ')
+            p++;
+        if (*p == '\0')
+            return FALSE;
+        switch (field)
+        {
+        case 14:
+            utime = g_ascii_strtoull(p, NULL, 10);
+            break;
+        case 15:
+            stime = g_ascii_strtoull(p, NULL, 10);
+            break;
+        case 22:
+            *start_time = g_ascii_strtoull(p, NULL, 10);
+            break;
+        case 24:
+            *rss = g_ascii_strtoull(p, NULL, 10);
+            break;
+        }
+        while (*p != ' ' && *p != '\0')
+            p++;
+    }
+    *ticks = utime + stime;
+    return TRUE;
+}
+
+static gboolean proc_top_task_is_stale(gpointer key, gpointer value, gpointer serial)
+{
+    return ((ProcTopTask *)value)->serial != GPOINTER_TO_UINT(serial);
+}
+
+static void proc_top_scan(ProcTopJob *job)
+{
+    ProcTopState *state = job->state;
+    ProcTopTask *task;
+    ProcTopEntry entry;
+    struct dirent *de;
+    DIR *dir;
+    char path[32];
+    char *name, *end;
+    guint64 ticks, start_time, rss;
+    gint64 now;
+    double scale;
+    ssize_t len;
+    long page_size = sysconf(_SC_PAGESIZE);
+    int fd, pid;
+
+    if (state->proc_fd < 0)
+        return;
+    fd = dup(state->proc_fd);
+    if (fd < 0 || (dir = fdopendir(fd)) == NULL)
+    {
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    /* the fd was dup()ed so its offset is shared with previous scans */
+    rewinddir(dir);
+
+    now = g_get_monotonic_time();
+    job->valid = (state->timestamp > 0 && now - state->timestamp < PROC_TOP_MAX_AGE);
+    /* ticks per second of time, in percents of all CPUs */
+    scale = job->valid ? 100.0 * G_USEC_PER_SEC / (now - state->timestamp)
+                         / sysconf(_SC_CLK_TCK) / MAX(sysconf(_SC_NPROCESSORS_ONLN), 1)
+                       : 0.0;
+    state->timestamp = now;
+    state->serial++;
+
+    while ((de = readdir(dir)) != NULL)
+    {
+        if (!isdigit(de->d_name[0]))
+            continue;
+        pid = atoi(de->d_name);
+        g_snprintf(path, sizeof(path), "%s/stat", de->d_name);
+        fd = openat(state->proc_fd, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) /* it's gone already */
+            continue;
+        len = pread(fd, state->buffer, sizeof(state->buffer) - 1, 0);
+        close(fd);
+        if (len <= 0)
+            continue;
+        state->buffer[len] = '\0';
+        /* name may contain anything including spaces and parentheses */
+        name = strchr(state->buffer, '(');
+        end = strrchr(state->buffer, ')');
+        if (name == NULL || end == NULL || end < name)
+            continue;
+        if (!proc_top_parse_stat(end + 1, &ticks, &start_time, &rss))
+            continue;
+
+        task = g_hash_table_lookup(state->tasks, GINT_TO_POINTER(pid));
+        if (task != NULL && task->start_time == start_time && task->ticks == ticks)
+        {
+            /* it didn't run, only resident size could decrease */
+            task->serial = state->serial;
+            task->rss = rss;
+            if (job->valid)
+            {
+                entry.pid = pid;
+                memcpy(entry.name, task->name, sizeof(entry.name));
+                entry.cpu = 0.0;
+                entry.rss = rss * page_size;
+                proc_top_insert(job->by_mem, &job->n_mem, job->n, &entry,
+                                PROC_TOP_BY_MEMORY);
+            }
+            continue;
+        }
+
+        entry.pid = pid;
+        *end = '\0';
+        g_strlcpy(entry.name, name + 1, sizeof(entry.name));
+        entry.rss = rss * page_size;
+        if (task == NULL || task->start_time != start_time)
+        {
+            /* new process, or pid was reused; count it since its start */
+            if (task == NULL)
+            {
+                task = g_slice_new(ProcTopTask);
+                g_hash_table_insert(state->tasks, GINT_TO_POINTER(pid), task);
+            }
+            task->ticks = 0;
+            task->start_time = start_time;
+        }
+        entry.cpu = (ticks - task->ticks) * scale;
+        task->ticks = ticks;
+        task->rss = rss;
+        task->serial = state->serial;
+        memcpy(task->name, entry.name, sizeof(task->name));
+        if (job->valid)
+        {
+            proc_top_insert(job->by_cpu, &job->n_cpu, job->n, &entry, PROC_TOP_BY_CPU);
+            proc_top_insert(job->by_mem, &job->n_mem, job->n, &entry, PROC_TOP_BY_MEMORY);
+        }
+    }
+    closedir(dir);
+
+    /* forget processes which have exited */
+    g_hash_table_foreach_remove(state->tasks, proc_top_task_is_stale,
+                                GUINT_TO_POINTER(state->serial));
+}
+
+static gboolean proc_top_scan_finished(gpointer data)
+{
+    ProcTopJob *job = data;
+    ProcTop *pt = job->pt;
+
+    if (pt == NULL) /* scanner was freed */
+        proc_top_state_free(job->state);
+    else
+    {
+        pt->state = job->state;
+        pt->job = NULL;
+        /* don't show results if tooltip was hidden meanwhile */
+        if (job->valid && pt->timer != 0)
+        {
+            memcpy(pt->by_cpu, job->by_cpu, job->n_cpu * sizeof(ProcTopEntry));
+            pt->n_cpu = job->n_cpu;
+            memcpy(pt->by_mem, job->by_mem, job->n_mem * sizeof(ProcTopEntry));
+            pt->n_mem = job->n_mem;
+            if (pt->func)
+                pt->func(pt, pt->user_data);
+        }
+    }
+    g_slice_free(ProcTopJob, job);
+    return FALSE;
+}
+
+static gpointer proc_top_scan_thread(gpointer data)
+{
+    ProcTopJob *job = data;
+
+    proc_top_scan(job);
+    g_idle_add(proc_top_scan_finished, job);
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_unref(g_thread_self());
+#endif
+    return NULL;
+}
+
+static void proc_top_start_scan(ProcTop *pt)
+{
+    ProcTopJob *job;
+
+    if (pt->job != NULL) /* previous scan is still running */
+        return;
+    job = g_slice_new0(ProcTopJob);
+    job->pt = pt;
+    job->n = pt->n;
+    job->state = pt->state;
+    pt->state = NULL;
+    pt->job = job;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_new("proc-top-scan", proc_top_scan_thread, job);
+#else
+    g_thread_create(proc_top_scan_thread, job, FALSE, NULL);
+#endif
+}
+
+static gboolean proc_top_timeout(gpointer data)
+{
+    ProcTop *pt = data;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    if (g_get_monotonic_time() - pt->last_touch > PROC_TOP_IDLE_TIME)
+    {
+        /* tooltip is hidden, stop scanning until it's shown again */
+        pt->timer = 0;
+        pt->n_cpu = pt->n_mem = 0;
+        return FALSE;
+    }
+    proc_top_start_scan(pt);
+    return TRUE;
+}
+
+ProcTop *proc_top_new(guint n, ProcTopFunc func, gpointer user_data)
+{
+    ProcTop *pt = g_slice_new0(ProcTop);
+
+    pt->n = CLAMP(n, 1, PROC_TOP_MAX);
+    pt->func = func;
+    pt->user_data = user_data;
+    pt->state = proc_top_state_new();
+    return pt;
+}
+
+void proc_top_free(ProcTop *pt)
+{
+    if (pt->timer)
+        g_source_remove(pt->timer);
+    if (pt->job)
+        pt->job->pt = NULL;
+    else
+        proc_top_state_free(pt->state);
+    g_slice_free(ProcTop, pt);
+}
+
+void proc_top_touch(ProcTop *pt)
+{
+    pt->last_touch = g_get_monotonic_time();
+    if (pt->timer != 0)
+        return;
+    /* make a baseline now so first results are ready after an interval */
+    pt->timer = g_timeout_add_seconds(PROC_TOP_INTERVAL, proc_top_timeout, pt);
+    proc_top_start_scan(pt);
+}
+
+char *proc_top_format(ProcTop *pt, ProcTopOrder order)
+{
+    ProcTopEntry *list = (order == PROC_TOP_BY_CPU) ? pt->by_cpu : pt->by_mem;
+    guint n = (order == PROC_TOP_BY_CPU) ? pt->n_cpu : pt->n_mem;
+    GString *str;
+    guint i;
+
+    if (pt->timer == 0)
+        return NULL;
+    if (n == 0)
+        return g_strdup(_("Top processes: measuring..."));
+    if (order == PROC_TOP_BY_CPU && list[0].cpu < 0.05)
+        return g_strdup(_("Top processes: all idle"));
+    str = g_string_new(_("Top processes:"));
+    for (i = 0; i < n; i++)
+    {
+        if (order == PROC_TOP_BY_CPU)
+        {
+            /* idle ones aren't interesting */
+            if (list[i].cpu < 0.05)
+                break;
+            g_string_append_printf(str, "\n%5.1f%%  %s (%d)", list[i].cpu,
+                                   list[i].name, list[i].pid);
+        }
+        else
+            g_string_append_printf(str, "\n%6.1fMB  %s (%d)",
+                                   list[i].rss / 1048576.0,
+                                   list[i].name, list[i].pid);
+    }
+    return g_string_free(str, FALSE);
+}
@@ -0,0 +1,49 @@
+/*
+ * Top processes scanner for CPU and memory monitors.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __PROC_TOP_H__
+#define __PROC_TOP_H__ 1
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* The scanner runs only while somebody is interested in it: call
+   proc_top_touch() each time the tooltip is queried and scanning stops
+   shortly after the tooltip is hidden. Scans are done in a worker thread
+   and callback is called in main loop each time new results are ready. */
+
+typedef struct _ProcTop ProcTop;
+
+typedef enum {
+    PROC_TOP_BY_CPU,            /* CPU time since previous scan */
+    PROC_TOP_BY_MEMORY          /* resident set size */
+} ProcTopOrder;
+
+typedef void (*ProcTopFunc)(ProcTop *pt, gpointer user_data);
+
+G_GNUC_INTERNAL ProcTop *proc_top_new(guint n, ProcTopFunc func, gpointer user_data);
+G_GNUC_INTERNAL void proc_top_free(ProcTop *pt);
+G_GNUC_INTERNAL void proc_top_touch(ProcTop *pt);
+G_GNUC_INTERNAL char *proc_top_format(ProcTop *pt, ProcTopOrder order);
+
+G_END_DECLS
+
+#endif
@@ -72,6 +72,8 @@ typedef struct
     GtkWidget * menu_item;      /* if menu_list exists then it's an item in it */
     Atom name_source;                       /* Atom that is the source of taskbar label */
     Atom image_source;                      /* Atom that is the source of taskbar icon */
+    gpointer user_data;         /* data attached by task_button_set_window_data() */
+    GDestroyNotify user_data_free; /* destroy notify for user_data */
     unsigned int visible :1;    /* TRUE if window is shown in taskbar */
     unsigned int focused                :1; /* True if window has focus */
     unsigned int iconified              :1; /* True if window is iconified, from WM_STATE */
@@ -120,29 +122,121 @@ static void task_update_icon(TaskButton *task, TaskDetails *details, Atom source
  * Internal functions
  */
 
-/* Determine which monitor a given window is associated with */
-static gint get_window_monitor(Window win)
+/* Monitors geometry in X coordinates, dropped when screen layout changes */
+static GArray *monitor_rects = NULL;
+
+static void monitor_rects_invalidate(GdkScreen *screen, gpointer unused)
 {
-    GdkDisplay *display;
-    GdkWindow *gwin;
-    gint m;
+    if (monitor_rects != NULL)
+        g_array_free(monitor_rects, TRUE);
+    monitor_rects = NULL;
+}
 
-    display = gdk_display_get_default();
-    g_assert(display);
-    gwin = gdk_x11_window_foreign_new_for_display(display,win);
-    g_assert(gwin);
+static GArray *get_monitor_rects(void)
+{
+    static gboolean signals_connected = FALSE;
+    GdkScreen *screen = gdk_screen_get_default();
+    GdkRectangle rect;
+    gint i, n;
+
+    if (monitor_rects != NULL)
+        return monitor_rects;
+    if (!signals_connected)
+    {
+        g_signal_connect(screen, "monitors-changed",
+                         G_CALLBACK(monitor_rects_invalidate), NULL);
+        g_signal_connect(screen, "size-changed",
+                         G_CALLBACK(monitor_rects_invalidate), NULL);
+        signals_connected = TRUE;
+    }
+#if GTK_CHECK_VERSION(3, 0, 0)
+    GdkDisplay *display = gdk_screen_get_display(screen);
+    n = gdk_display_get_n_monitors(display);
+#else
+    n = gdk_screen_get_n_monitors(screen);
+#endif
+    monitor_rects = g_array_sized_new(FALSE, FALSE, sizeof(GdkRectangle), n);
+    for (i = 0; i < n; i++)
+    {
 #if GTK_CHECK_VERSION(3, 0, 0)
-    m = -1;
-    GdkMonitor *mon = gdk_display_get_monitor_at_window (gdk_window_get_display (gwin), gwin);
-    for (int i = 0; i < gdk_display_get_n_monitors (gdk_window_get_display (gwin)); i++)
-        if (gdk_display_get_monitor (gdk_window_get_display (gwin), i) == mon) m = i;
+        GdkMonitor *mon = gdk_display_get_monitor(display, i);
+        gint scale = gdk_monitor_get_scale_factor(mon);
+
+        /* GDK gives application pixels, X gives device ones */
+        gdk_monitor_get_geometry(mon, &rect);
+        rect.x *= scale;
+        rect.y *= scale;
+        rect.width *= scale;
+        rect.height *= scale;
 #else
-    m = gdk_screen_get_monitor_at_window(gdk_window_get_screen(gwin),gwin);
+        gdk_screen_get_monitor_geometry(screen, i, &rect);
 #endif
-    g_object_unref(gwin);
+        g_array_append_val(monitor_rects, rect);
+    }
+    return monitor_rects;
+}
+
+/* Determine which monitor given rectangle is on: the one having largest
+   intersection with it, or the nearest one if there is no intersection */
+static gint get_monitor_at_rect(const GdkRectangle *geom)
+{
+    GArray *rects = get_monitor_rects();
+    GdkRectangle inter;
+    gint i, m = -1;
+    gint64 area, best_area = 0, dist, best_dist = G_MAXINT64;
+    gint cx = geom->x + geom->width / 2, cy = geom->y + geom->height / 2;
+
+    for (i = 0; i < (gint)rects->len; i++)
+    {
+        GdkRectangle *r = &g_array_index(rects, GdkRectangle, i);
+
+        if (gdk_rectangle_intersect(geom, r, &inter))
+        {
+            area = (gint64)inter.width * inter.height;
+            if (area > best_area)
+            {
+                best_area = area;
+                m = i;
+            }
+        }
+        else if (best_area == 0)
+        {
+            gint64 dx = MAX(MAX(r->x - cx, cx - (r->x + r->width)), 0);
+            gint64 dy = MAX(MAX(r->y - cy, cy - (r->y + r->height)), 0);
+
+            dist = dx * dx + dy * dy;
+            if (dist < best_dist)
+            {
+                best_dist = dist;
+                m = i;
+            }
+        }
+    }
     return m;
 }
 
+/* Determine which monitor a given window is associated with */
+static gint get_window_monitor(Window win)
+{
+    Display *xdisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+    Window root, child;
+    int x, y;
+    unsigned int w, h, bw, depth;
+    GdkRectangle geom;
+
+    /* nothing to compute on single monitor */
+    if (get_monitor_rects()->len <= 1)
+        return 0;
+    if (!XGetGeometry(xdisplay, win, &root, &x, &y, &w, &h, &bw, &depth)
+        || !XTranslateCoordinates(xdisplay, win, root, 0, 0, &x, &y, &child))
+        return -1;
+    geom.x = x;
+    geom.y = y;
+    geom.width = w;
+    geom.height = h;
+    return get_monitor_at_rect(&geom);
+}
+
 /* Determine if the "urgency" hint is set on a window. */
 static gboolean task_has_urgency(Window win)
 {
@@ -253,6 +347,8 @@ static TaskDetails *task_details_for_window(TaskButton *button, Window win)
 
 static void free_task_details(TaskDetails *details)
 {
+    if (details->user_data_free)
+        details->user_data_free(details->user_data);
     g_free(details->name);
     if (details->icon)
         g_object_unref(details->icon);
@@ -611,6 +707,28 @@ static void menu_task_deselected(GtkMenuItem *item, TaskButton *tb)
     gtk_menu_item_set_submenu(item, NULL);
 }
 
+/* creates a menu item with the name, or the iconified name, and the icon
+ * of the application window */
+static GtkWidget *task_menu_item_new(TaskButton *tb, TaskDetails *task)
+{
+    GtkWidget *item;
+    char *name;
+
+    name = task->iconified ? g_strdup_printf("[%s]", task->name) : NULL;
+#if GTK_CHECK_VERSION(3, 0, 0)
+    item = lxpanel_plugin_new_menu_item(tb->panel, name ? name : task->name, 0, NULL);
+    if (task->icon)
+        lxpanel_plugin_update_menu_icon(item, gtk_image_new_from_pixbuf(task->icon));
+#else
+    item = gtk_image_menu_item_new_with_label(name ? name : task->name);
+    if (task->icon)
+        gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(item),
+                                      gtk_image_new_from_pixbuf(task->icon));
+#endif
+    g_free(name);
+    return item;
+}
+
 /* Handler for "activate" event from "close all windows" menu item */
 static void taskbar_close_all_windows(GtkWidget * widget, TaskButton *tb)
 {
@@ -1310,7 +1428,6 @@ static gboolean task_button_button_release_event(GtkWidget *widget, GdkEventButt
     TaskButton *tb = PANEL_TASK_BUTTON(widget);
     TaskDetails *task;
     GList *l;
-    char *name;
 
     if (!tb->entered_state)
         /* SF bug#731: don't process button release with DND. Also if button was
@@ -1345,26 +1462,7 @@ static gboolean task_button_button_release_event(GtkWidget *widget, GdkEventButt
                 task = l->data;
                 if (task->visible)
                 {
-                    /* The menu item has the name, or the iconified name, and
-                     * the icon of the application window. */
-                    name = task->iconified ? g_strdup_printf("[%s]", task->name) : NULL;
-#if GTK_CHECK_VERSION(3, 0, 0)
-                    task->menu_item = lxpanel_plugin_new_menu_item (tb->panel, name ? name : task->name, 0, NULL);
-                    g_free(name);
-                    if (task->icon)
-                    {
-                        GtkWidget *im = gtk_image_new_from_pixbuf(task->icon);
-                        lxpanel_plugin_update_menu_icon (task->menu_item, im);
-                    }
-#else
-                    task->menu_item = gtk_image_menu_item_new_with_label(name ? name : task->name);
-                    g_free(name);
-                    if (task->icon)
-                    {
-                        GtkWidget *im = gtk_image_new_from_pixbuf(task->icon);
-                        gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(task->menu_item), im);
-                    }
-#endif
+                    task->menu_item = task_menu_item_new(tb, task);
                     g_signal_connect(task->menu_item, "button-press-event",
                                      G_CALLBACK(taskbar_popup_activate_event), tb);
                     g_signal_connect(task->menu_item, "select",
@@ -1761,7 +1859,8 @@ gboolean task_button_window_focus_changed(TaskButton *button, Window *win)
 }
 
 /* update internal data */
-gboolean task_button_window_reconfigured(TaskButton *button, Window win)
+gboolean task_button_window_reconfigured(TaskButton *button, Window win,
+                                         const GdkRectangle *geometry)
 {
     gint old_mon, new_mon;
     TaskDetails *details;
@@ -1775,7 +1874,13 @@ gboolean task_button_window_reconfigured(TaskButton *button, Window win)
     /* If the same_monitor_only option is set and the window is on a different
        monitor than before, redraw the task button */
     old_mon = details->monitor;
-    new_mon = get_window_monitor(details->win);
+    if (geometry != NULL && get_monitor_rects()->len > 1)
+        new_mon = get_monitor_at_rect(geometry);
+    else
+        new_mon = get_window_monitor(details->win);
+    /* window may be already destroyed, or not moved to other monitor */
+    if (new_mon < 0 || new_mon == old_mon)
+        return TRUE;
     details->monitor = new_mon;
 
     if (button->flags.same_monitor_only
@@ -2061,3 +2166,74 @@ void task_button_raise_window(TaskButton *button, guint32 time)
     if (button->details)
         task_raise_window(button, button->details->data, time);
 }
+
+static void menu_overflow_task_activate(GtkMenuItem *item, TaskButton *tb)
+{
+    Window win = GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(item), "task-window"));
+    TaskDetails *task = task_details_lookup(tb, win);
+
+    /* the window might be closed while menu was shown */
+    if (task)
+        task_raise_window(tb, task, gtk_get_current_event_time());
+}
+
+/* appends an item for each shown window of the button into the menu */
+void task_button_add_menu_items(TaskButton *button, GtkMenuShell *menu)
+{
+    GtkWidget *item;
+    TaskDetails *task;
+    GList *l;
+
+    if (!PANEL_IS_TASK_BUTTON(button))
+        return;
+    for (l = button->details; l; l = l->next)
+    {
+        task = l->data;
+        if (!task->visible)
+            continue;
+        item = task_menu_item_new(button, task);
+        /* keep window ID only, the details may be gone before activation */
+        g_object_set_data(G_OBJECT(item), "task-window", GSIZE_TO_POINTER(task->win));
+        g_signal_connect_object(item, "activate",
+                                G_CALLBACK(menu_overflow_task_activate), button, 0);
+        gtk_menu_shell_append(menu, item);
+    }
+}
+
+guint task_button_get_n_windows(TaskButton *button)
+{
+    g_return_val_if_fail(PANEL_IS_TASK_BUTTON(button), 0);
+
+    return button->n_visible;
+}
+
+/* returns data attached to the window or NULL */
+gpointer task_button_get_window_data(TaskButton *button, Window win)
+{
+    TaskDetails *details;
+
+    g_return_val_if_fail(PANEL_IS_TASK_BUTTON(button), NULL);
+
+    details = task_details_lookup(button, win);
+    if (details == NULL)
+        return NULL;
+    return details->user_data;
+}
+
+/* attaches data to the window, it will be freed when window is gone */
+gboolean task_button_set_window_data(TaskButton *button, Window win,
+                                     gpointer data, GDestroyNotify free_func)
+{
+    TaskDetails *details;
+
+    g_return_val_if_fail(PANEL_IS_TASK_BUTTON(button), FALSE);
+
+    details = task_details_lookup(button, win);
+    if (details == NULL)
+        return FALSE;
+    if (details->user_data_free)
+        details->user_data_free(details->user_data);
+    details->user_data = data;
+    details->user_data_free = free_func;
+    return TRUE;
+}
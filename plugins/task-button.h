@@ -71,7 +71,9 @@ void task_button_update_windows_list(TaskButton *button, Window *list, gint n);
 /* returns TRUE if found and updated */
 gboolean task_button_window_xprop_changed(TaskButton *button, Window win, Atom atom);
 gboolean task_button_window_focus_changed(TaskButton *button, Window *win);
-gboolean task_button_window_reconfigured(TaskButton *button, Window win);
+/* geometry is window position in root coordinates, NULL to query it */
+gboolean task_button_window_reconfigured(TaskButton *button, Window win,
+                                         const GdkRectangle *geometry);
 /* updates rendering options */
 void task_button_update(TaskButton *button, gint desk, gint desks,
                         gint mon, guint icon_size, TaskShowFlags flags);
@@ -87,6 +89,15 @@ gboolean task_button_merge(TaskButton *button, TaskButton *sibling);
 void task_button_reset_menu(GtkWidget *parent);
 /* request for a minimized window to raise */
 void task_button_raise_window(TaskButton *button, guint32 time);
+/* appends items to raise each shown window of button, used for buttons
+   which don't fit into the taskbar */
+void task_button_add_menu_items(TaskButton *button, GtkMenuShell *menu);
+/* returns number of windows shown by button */
+guint task_button_get_n_windows(TaskButton *button);
+/* per-window data storage, the data is freed when window leaves the taskbar */
+gpointer task_button_get_window_data(TaskButton *button, Window win);
+gboolean task_button_set_window_data(TaskButton *button, Window win,
+                                     gpointer data, GDestroyNotify free_func);
 
 G_END_DECLS
 
@@ -29,6 +29,8 @@
 #include <sys/types.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <glib/gi18n.h>
 
 #include <string.h>
@@ -48,9 +50,17 @@
 #define SYSFS_THERMAL_TEMPF  "temp"
 #define SYSFS_THERMAL_TRIP  "trip_point_0_temp"
 
+#define SYSFS_CPUFREQ_DIRECTORY "/sys/devices/system/cpu/cpufreq/"
+#define SYSFS_CPUFREQ_FALLBACK "/sys/devices/system/cpu/cpu0/cpufreq/"
+
 #define MAX_NUM_SENSORS 10
+#define MAX_NUM_POLICIES 8
 #define MAX_AUTOMATIC_CRITICAL_TEMP 150 /* in degrees Celsius */
 
+/* History is kept in fixed rings, a sample per update and a pixel per sample */
+#define HISTORY_LENGTH 48
+#define UPDATE_PERIOD 3 /* in seconds */
+
 #if !GLIB_CHECK_VERSION(2, 40, 0)
 # define g_info(...) g_log(G_LOG_DOMAIN, G_LOG_LEVEL_INFO, __VA_ARGS__)
 #endif
@@ -86,6 +96,16 @@ typedef struct thermal {
     GetTempFunc get_critical[MAX_NUM_SENSORS];
     gint temperature[MAX_NUM_SENSORS];
     gint critical[MAX_NUM_SENSORS];
+    GtkWidget *graph;                   /* temperature and frequency history */
+    int show_history;
+    int freq_fd[MAX_NUM_POLICIES];      /* scaling_cur_freq of each policy */
+    int num_freq_fds;
+    gint max_freq;                      /* highest cpuinfo_max_freq, kHz */
+    gint history[MAX_NUM_SENSORS][HISTORY_LENGTH]; /* °C, -1 if not read */
+    gint freq_history[HISTORY_LENGTH];  /* fastest policy, kHz, 0 if unknown */
+    gboolean throttled[HISTORY_LENGTH]; /* frequency dropped while too hot */
+    int ring_cursor;                    /* where next sample goes */
+    int num_samples;                    /* valid samples in the rings */
 } thermal;
 
 
@@ -153,6 +173,20 @@ proc_get_temperature(char const* sensor_path){
     return -1;
 }
 
+/* reads plain integer value, returns -1 on error */
+static gint _get_int_value(const char *path)
+{
+    FILE *state;
+    gint value;
+
+    if (!(state = fopen(path, "r")))
+        return -1;
+    if (fscanf(state, "%d", &value) != 1)
+        value = -1;
+    fclose(state);
+    return value;
+}
+
 static gint _get_reading(const char *path, gboolean quiet)
 {
     FILE *state;
@@ -268,6 +302,218 @@ static gint get_critical(thermal *th)
     return min;
 }
 
+/* Opens scaling_cur_freq of every cpufreq policy once, they are reread on
+ * each update to see if CPU slows down while temperature is high. */
+static void
+open_freq_sources(thermal *th)
+{
+    GDir *dir;
+    const char *name;
+    char path[100];
+    int fd;
+
+    th->num_freq_fds = 0;
+    th->max_freq = 0;
+    dir = g_dir_open(SYSFS_CPUFREQ_DIRECTORY, 0, NULL);
+    while (th->num_freq_fds < MAX_NUM_POLICIES)
+    {
+        if (dir != NULL)
+        {
+            if ((name = g_dir_read_name(dir)) == NULL)
+                break;
+            if (strncmp(name, "policy", 6) != 0)
+                continue;
+            snprintf(path, sizeof(path), "%s%s/", SYSFS_CPUFREQ_DIRECTORY, name);
+        }
+        else /* kernels before 4.3 */
+            snprintf(path, sizeof(path), "%s", SYSFS_CPUFREQ_FALLBACK);
+        strncat(path, "scaling_cur_freq", sizeof(path) - strlen(path) - 1);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            th->freq_fd[th->num_freq_fds++] = fd;
+            strcpy(strrchr(path, '/') + 1, "cpuinfo_max_freq");
+            th->max_freq = MAX(th->max_freq, _get_int_value(path));
+        }
+        if (dir == NULL)
+            break;
+    }
+    if (dir != NULL)
+        g_dir_close(dir);
+}
+
+static void
+close_freq_sources(thermal *th)
+{
+    int i;
+
+    for (i = 0; i < th->num_freq_fds; i++)
+        close(th->freq_fd[i]);
+    th->num_freq_fds = 0;
+}
+
+/* Returns frequency of the fastest policy in kHz, or 0 if unknown */
+static gint
+get_frequency(thermal *th)
+{
+    char buf[32];
+    ssize_t len;
+    gint freq = 0;
+    int i;
+
+    for (i = 0; i < th->num_freq_fds; i++)
+    {
+        len = pread(th->freq_fd[i], buf, sizeof(buf) - 1, 0);
+        if (len <= 0)
+            continue;
+        buf[len] = '\0';
+        freq = MAX(freq, atoi(buf));
+    }
+    return freq;
+}
+
+static void
+add_history_sample(thermal *th, int warn)
+{
+    int i, prev;
+    gint freq = get_frequency(th);
+
+    prev = (th->ring_cursor + HISTORY_LENGTH - 1) % HISTORY_LENGTH;
+    for (i = 0; i < th->numsensors; i++)
+        th->history[i][th->ring_cursor] = th->temperature[i];
+    th->freq_history[th->ring_cursor] = freq;
+    /* the governor slowing down on a cool CPU is not a throttle event */
+    th->throttled[th->ring_cursor] = (th->num_samples > 0 && warn >= 2 &&
+                                      freq > 0 && freq < th->freq_history[prev]);
+    th->ring_cursor = (th->ring_cursor + 1) % HISTORY_LENGTH;
+    if (th->num_samples < HISTORY_LENGTH)
+        th->num_samples++;
+}
+
+/* Draws frequency as a shaded area on its own scale from 0 to maximum, and
+ * temperature of each sensor as a line scaled to the range of the visible
+ * history, with warning2 level as a reference. Throttle events are marked
+ * with ticks on the top edge. */
+static void
+draw_history(thermal *th, cairo_t *cr, int width, int height)
+{
+    gint lo = G_MAXINT, hi = G_MININT, temp;
+    int i, j, k, x;
+    gboolean started;
+
+    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+    cairo_rectangle(cr, 0, 0, width, height);
+    cairo_fill(cr);
+    if (th->num_samples == 0 || height <= 2)
+        return;
+
+    for (j = 0; j < th->numsensors; j++)
+        for (k = 0; k < th->num_samples; k++)
+        {
+            temp = th->history[j][(th->ring_cursor + HISTORY_LENGTH - 1 - k) % HISTORY_LENGTH];
+            if (temp == -1)
+                continue;
+            lo = MIN(lo, temp);
+            hi = MAX(hi, temp);
+        }
+    if (lo > hi) /* no readings at all */
+        lo = hi = th->warning2;
+    /* show warning2 level only if temperature is getting close to it */
+    if (th->warning2 - hi <= 10)
+        hi = MAX(hi, th->warning2);
+    hi++;
+    lo--;
+#define TEMP_Y(_t) ((height - 1) - (double)((_t) - lo) * (height - 2) / (hi - lo))
+
+    /* newest sample is on the right edge */
+    for (k = 0; k < th->num_samples && k < width; k++)
+    {
+        i = (th->ring_cursor + HISTORY_LENGTH - 1 - k) % HISTORY_LENGTH;
+        x = width - 1 - k;
+        if (th->max_freq > 0 && th->freq_history[i] > 0)
+        {
+            double h = (double)th->freq_history[i] * height / th->max_freq;
+            cairo_set_source_rgb(cr, 0.2, 0.3, 0.5);
+            cairo_rectangle(cr, x, height - MIN(h, height), 1, MIN(h, height));
+            cairo_fill(cr);
+        }
+        if (th->throttled[i])
+        {
+#if GTK_CHECK_VERSION(3, 0, 0)
+            gdk_cairo_set_source_rgba(cr, &th->cl_warning2);
+#else
+            gdk_cairo_set_source_color(cr, &th->cl_warning2);
+#endif
+            cairo_rectangle(cr, x, 0, 1, 3);
+            cairo_fill(cr);
+        }
+    }
+
+    cairo_set_line_width(cr, 1.0);
+    if (th->warning2 < hi)
+    {
+#if GTK_CHECK_VERSION(3, 0, 0)
+        gdk_cairo_set_source_rgba(cr, &th->cl_warning2);
+#else
+        gdk_cairo_set_source_color(cr, &th->cl_warning2);
+#endif
+        cairo_move_to(cr, 0, (int)TEMP_Y(th->warning2) + 0.5);
+        cairo_line_to(cr, width, (int)TEMP_Y(th->warning2) + 0.5);
+        cairo_stroke(cr);
+    }
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gdk_cairo_set_source_rgba(cr, &th->cl_normal);
+#else
+    gdk_cairo_set_source_color(cr, &th->cl_normal);
+#endif
+    for (j = 0; j < th->numsensors; j++)
+    {
+        started = FALSE;
+        for (k = 0; k < th->num_samples && k < width; k++)
+        {
+            temp = th->history[j][(th->ring_cursor + HISTORY_LENGTH - 1 - k) % HISTORY_LENGTH];
+            if (temp == -1)
+            {
+                started = FALSE;
+                continue;
+            }
+            if (started)
+                cairo_line_to(cr, width - 0.5 - k, TEMP_Y(temp));
+            else
+                cairo_move_to(cr, width - 0.5 - k, TEMP_Y(temp));
+            started = TRUE;
+        }
+        cairo_stroke(cr);
+    }
+#undef TEMP_Y
+}
+
+#if !GTK_CHECK_VERSION(3, 0, 0)
+static gboolean
+graph_expose_event(GtkWidget *widget, GdkEventExpose *event, thermal *th)
+#else
+static gboolean
+graph_draw(GtkWidget *widget, cairo_t *cr, thermal *th)
+#endif
+{
+    GtkAllocation allocation;
+
+    gtk_widget_get_allocation(widget, &allocation);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    cairo_t *cr = gdk_cairo_create(gtk_widget_get_window(widget));
+    gdk_cairo_region(cr, event->region);
+    cairo_clip(cr);
+    /* no-window widget, draw relative to its allocation */
+    cairo_translate(cr, allocation.x, allocation.y);
+#endif
+    draw_history(th, cr, allocation.width, allocation.height);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    cairo_destroy(cr);
+#endif
+    return FALSE;
+}
+
 static void
 update_display(thermal *th)
 {
@@ -282,6 +528,7 @@ update_display(thermal *th)
     gchar *separator;
 
     temp = get_temperature(th, &i);
+    add_history_sample(th, i);
     if (i >= 2)
         color = th->cl_warning2;
     else if (i >= 1)
@@ -303,7 +550,29 @@ update_display(thermal *th)
         g_string_append_printf(th->tip, "%s%s:\t%2d°C", separator, th->sensor_name[i], th->temperature[i]);
         separator = "\n";
     }
+    if (th->num_freq_fds > 0)
+    {
+        int prev = (th->ring_cursor + HISTORY_LENGTH - 1) % HISTORY_LENGTH;
+        int throttles = 0;
+
+        g_string_append_printf(th->tip, _("%sCPU frequency:\t%d MHz"), separator,
+                               th->freq_history[prev] / 1000);
+        for (i = 0; i < th->num_samples; i++)
+            if (th->throttled[i])
+                throttles++;
+        if (throttles > 0)
+            g_string_append_printf(th->tip,
+                                   ngettext("\nThrottled %d time in the last %d minutes",
+                                            "\nThrottled %d times in the last %d minutes",
+                                            throttles),
+                                   throttles, (th->num_samples * UPDATE_PERIOD + 59) / 60);
+    }
     gtk_widget_set_tooltip_text(th->namew, th->tip->str);
+    if (th->show_history)
+    {
+        gtk_widget_set_tooltip_text(th->graph, th->tip->str);
+        gtk_widget_queue_draw(th->graph);
+    }
 }
 
 static gboolean update_display_timeout(gpointer user_data)
@@ -486,6 +755,11 @@ static gboolean applyConfig(gpointer p)
         th->warning2 = critical - 5;
     }
 
+    /* sensors may be different now so start history again */
+    th->num_samples = 0;
+    th->ring_cursor = 0;
+    gtk_widget_set_visible(th->graph, th->show_history);
+
     config_group_set_string(th->settings, "NormalColor", th->str_cl_normal);
     config_group_set_string(th->settings, "Warning1Color", th->str_cl_warning1);
     config_group_set_string(th->settings, "Warning2Color", th->str_cl_warning2);
@@ -496,6 +770,7 @@ static gboolean applyConfig(gpointer p)
     config_group_set_int(th->settings, "Warning2Temp", th->warning2);
     config_group_set_int(th->settings, "AutomaticSensor", th->auto_sensor);
     config_group_set_string(th->settings, "Sensor", th->sensor);
+    config_group_set_int(th->settings, "ShowHistory", th->show_history);
     RET(FALSE);
 }
 
@@ -506,6 +781,7 @@ thermal_destructor(gpointer user_data)
 
   ENTER;
   remove_all_sensors(th);
+  close_freq_sources(th);
   g_string_free(th->tip, TRUE);
   g_free(th->sensor);
   g_free(th->str_cl_normal);
@@ -520,7 +796,7 @@ static GtkWidget *
 thermal_constructor(LXPanel *panel, config_setting_t *settings)
 {
     thermal *th;
-    GtkWidget *p;
+    GtkWidget *p, *box;
     const char *tmp;
 
     ENTER;
@@ -532,8 +808,27 @@ thermal_constructor(LXPanel *panel, config_setting_t *settings)
     lxpanel_plugin_set_data(p, th, thermal_destructor);
     gtk_widget_set_has_window(p, FALSE);
 
+#if GTK_CHECK_VERSION(3, 0, 0)
+    box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 2);
+#else
+    box = gtk_hbox_new(FALSE, 2);
+#endif
+    gtk_container_add(GTK_CONTAINER(p), box);
+    gtk_widget_show(box);
+
     th->namew = gtk_label_new("ww");
-    gtk_container_add(GTK_CONTAINER(p), th->namew);
+    gtk_box_pack_start(GTK_BOX(box), th->namew, FALSE, FALSE, 0);
+
+    th->graph = gtk_drawing_area_new();
+    gtk_widget_set_has_window(th->graph, FALSE);
+    gtk_widget_set_size_request(th->graph, HISTORY_LENGTH, -1);
+    gtk_box_pack_start(GTK_BOX(box), th->graph, FALSE, FALSE, 0);
+#if !GTK_CHECK_VERSION(3, 0, 0)
+    g_signal_connect(G_OBJECT(th->graph), "expose-event",
+                     G_CALLBACK(graph_expose_event), th);
+#else
+    g_signal_connect(G_OBJECT(th->graph), "draw", G_CALLBACK(graph_draw), th);
+#endif
 
     th->tip = g_string_new(NULL);
 
@@ -556,6 +851,8 @@ thermal_constructor(LXPanel *panel, config_setting_t *settings)
         th->sensor = g_strdup(tmp);
     config_setting_lookup_int(settings, "Warning1Temp", &th->warning1);
     config_setting_lookup_int(settings, "Warning2Temp", &th->warning2);
+    th->show_history = TRUE;
+    config_setting_lookup_int(settings, "ShowHistory", &th->show_history);
 
     if(!th->str_cl_normal)
         th->str_cl_normal = g_strdup("#00ff00");
@@ -564,12 +861,13 @@ thermal_constructor(LXPanel *panel, config_setting_t *settings)
     if(!th->str_cl_warning2)
         th->str_cl_warning2 = g_strdup("#ff0000");
 
+    open_freq_sources(th);
     applyConfig(p);
 
     gtk_widget_show(th->namew);
 
     update_display(th);
-    th->timer = g_timeout_add_seconds(3, (GSourceFunc) update_display_timeout, (gpointer)th);
+    th->timer = g_timeout_add_seconds(UPDATE_PERIOD, (GSourceFunc) update_display_timeout, (gpointer)th);
 
     RET(p);
 }
@@ -590,6 +888,7 @@ static GtkWidget *config(LXPanel *panel, GtkWidget *p)
             _("Automatic temperature levels"), &th->not_custom_levels, CONF_TYPE_BOOL, // FIXME: if off, disable two below
             _("Warning1 temperature"), &th->warning1, CONF_TYPE_INT,
             _("Warning2 temperature"), &th->warning2, CONF_TYPE_INT,
+            _("Show temperature and frequency history"), &th->show_history, CONF_TYPE_BOOL,
             NULL);
 
     RET(dialog);
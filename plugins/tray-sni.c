@@ -0,0 +1,977 @@
+/*
+ * StatusNotifierItem host for the system tray plugin.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Standards reference:
+   https://www.freedesktop.org/wiki/Specifications/StatusNotifierItem/
+   Items send their icons as pixmaps or names over D-Bus, so unlike XEMBED
+   clients they need no X window each: every item is a windowless image in
+   the tray icon grid. Property change signals are coalesced and the menu is
+   requested via com.canonical.dbusmenu only when it is about to be shown. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+
+#include "icon-grid.h"
+#include "tray-sni.h"
+
+#define WATCHER_NAME    "org.kde.StatusNotifierWatcher"
+#define WATCHER_PATH    "/StatusNotifierWatcher"
+#define WATCHER_IFACE   "org.kde.StatusNotifierWatcher"
+#define ITEM_IFACE      "org.kde.StatusNotifierItem"
+#define ITEM_PATH       "/StatusNotifierItem"
+#define DBUSMENU_IFACE  "com.canonical.dbusmenu"
+
+/* Delay before property changes of items are requested, in milliseconds.
+   Applications tend to send several signals in a row on each change. */
+#define BATCH_DELAY     100
+
+/* Upper limit of pixmap dimensions accepted from items. */
+#define MAX_PIXMAP_SIZE 1024
+
+static const gchar watcher_xml[] =
+    "<node>"
+    "  <interface name='" WATCHER_IFACE "'>"
+    "    <method name='RegisterStatusNotifierItem'>"
+    "      <arg name='service' type='s' direction='in'/>"
+    "    </method>"
+    "    <method name='RegisterStatusNotifierHost'>"
+    "      <arg name='service' type='s' direction='in'/>"
+    "    </method>"
+    "    <property name='RegisteredStatusNotifierItems' type='as' access='read'/>"
+    "    <property name='IsStatusNotifierHostRegistered' type='b' access='read'/>"
+    "    <property name='ProtocolVersion' type='i' access='read'/>"
+    "    <signal name='StatusNotifierItemRegistered'>"
+    "      <arg type='s'/>"
+    "    </signal>"
+    "    <signal name='StatusNotifierItemUnregistered'>"
+    "      <arg type='s'/>"
+    "    </signal>"
+    "    <signal name='StatusNotifierHostRegistered'/>"
+    "  </interface>"
+    "</node>";
+
+/* Representative of a status notifier item. */
+typedef struct {
+    TraySni * sni;                      /* Back pointer to host */
+    char * key;                         /* "bus/path" as announced by watcher */
+    char * bus_name;                    /* Name of item owner on the bus */
+    char * path;                        /* Object path of item */
+    guint watch_id;                     /* Watch for item owner to vanish */
+    guint signal_id;                    /* Subscription to item signals */
+    GCancellable * cancellable;         /* Cancels pending property requests */
+    gboolean dirty;                     /* Properties should be requested again */
+    gboolean fetching;                  /* Properties request is in progress */
+    char * id;                          /* Id property */
+    char * status;                      /* Status property */
+    char * tooltip;                     /* Tooltip text */
+    char * menu_path;                   /* Object path of dbusmenu, or NULL */
+    gboolean item_is_menu;              /* Activation should show the menu */
+    GdkPixbuf * pixbuf;                 /* Icon scaled to icon size, or NULL */
+    GtkWidget * widget;                 /* Event box receiving input */
+    GtkWidget * image;                  /* Icon inside the event box */
+} SniItem;
+
+/* Private context for the host. */
+struct _TraySni {
+    LXPanel * panel;
+    GtkWidget * grid;                   /* Tray icon grid items are added to */
+    GtkWidget * menu;                   /* Last shown item menu */
+    gint icon_size;
+    GList * items;                      /* List of SniItem in registration order */
+    guint batch_timer;                  /* Timer to request properties of dirty items */
+    GCancellable * cancellable;         /* Cancels pending requests on destroy */
+    GDBusConnection * bus;              /* Session bus, or NULL until connected */
+    GDBusNodeInfo * watcher_info;       /* Introspection of watcher interface */
+    guint watcher_object_id;            /* Exported watcher object */
+    guint watcher_owner_id;             /* Request for the watcher name */
+    guint host_owner_id;                /* Request for the host name */
+    guint watcher_signal_id;            /* Subscription to an external watcher */
+    gboolean is_watcher;                /* We own the watcher name */
+    char * host_name;                   /* org.kde.StatusNotifierHost-<pid> */
+};
+
+/* Target of dbusmenu events, attached to the root menu. */
+typedef struct {
+    GDBusConnection * bus;
+    char * bus_name;
+    char * menu_path;
+} SniMenuTarget;
+
+/* Pending menu layout request. */
+typedef struct {
+    TraySni * sni;
+    SniMenuTarget * target;
+    GtkWidget * widget;                 /* Item widget the menu is shown for */
+    GdkEvent * event;                   /* Copy of the event which requested the menu */
+} SniMenuRequest;
+
+static void sni_item_fetch(SniItem * item);
+static void sni_remove_item(TraySni * sni, SniItem * item);
+static gboolean sni_button_press_event(GtkWidget * widget, GdkEventButton * event, SniItem * item);
+static gboolean sni_scroll_event(GtkWidget * widget, GdkEventScroll * event, SniItem * item);
+
+/* Items which are not passive and have something to draw. */
+static gboolean sni_item_is_shown(SniItem * item)
+{
+    return (item->pixbuf != NULL && g_strcmp0(item->status, "Passive") != 0);
+}
+
+/* Update the item widget after its properties are changed. */
+static void sni_item_update_widget(SniItem * item)
+{
+    gtk_image_set_from_pixbuf(GTK_IMAGE(item->image), item->pixbuf);
+    gtk_widget_set_tooltip_text(item->widget, item->tooltip);
+    gtk_widget_set_visible(item->widget, sni_item_is_shown(item));
+}
+
+/* Convert the best fitting of the ARGB32 pixmaps in network byte order
+   into a pixbuf of the icon size. */
+static GdkPixbuf * sni_pixbuf_from_pixmaps(GVariant * pixmaps, gint size)
+{
+    GVariantIter iter;
+    GVariant * data, * best = NULL;
+    gint w, h, best_w = 0, best_h = 0;
+    GdkPixbuf * pixbuf, * scaled;
+    const guchar * src;
+    guchar * pixels;
+    gint i;
+
+    if (!g_variant_is_of_type(pixmaps, G_VARIANT_TYPE("a(iiay)")))
+        return NULL;
+    g_variant_iter_init(&iter, pixmaps);
+    while (g_variant_iter_next(&iter, "(ii@ay)", &w, &h, &data))
+    {
+        if (w > 0 && h > 0 && w <= MAX_PIXMAP_SIZE && h <= MAX_PIXMAP_SIZE
+            && g_variant_get_size(data) >= (gsize)w * h * 4
+            /* smallest one not less than size, or else the largest one */
+            && (best == NULL || (best_w < size && w > best_w)
+                || (w >= size && w < best_w)))
+        {
+            if (best != NULL)
+                g_variant_unref(best);
+            best = data;
+            best_w = w;
+            best_h = h;
+        }
+        else
+            g_variant_unref(data);
+    }
+    if (best == NULL)
+        return NULL;
+
+    src = g_variant_get_data(best);
+    pixels = g_malloc(best_w * best_h * 4);
+    for (i = 0; i < best_w * best_h * 4; i += 4)
+    {
+        pixels[i] = src[i + 1];
+        pixels[i + 1] = src[i + 2];
+        pixels[i + 2] = src[i + 3];
+        pixels[i + 3] = src[i];
+    }
+    g_variant_unref(best);
+    pixbuf = gdk_pixbuf_new_from_data(pixels, GDK_COLORSPACE_RGB, TRUE, 8,
+                                      best_w, best_h, best_w * 4,
+                                      (GdkPixbufDestroyNotify)g_free, NULL);
+    if (best_w == size || best_h == size)
+        return pixbuf;
+    if (best_w >= best_h)
+        scaled = gdk_pixbuf_scale_simple(pixbuf, size, MAX(1, best_h * size / best_w),
+                                         GDK_INTERP_BILINEAR);
+    else
+        scaled = gdk_pixbuf_scale_simple(pixbuf, MAX(1, best_w * size / best_h), size,
+                                         GDK_INTERP_BILINEAR);
+    g_object_unref(pixbuf);
+    return scaled;
+}
+
+/* Load icon by name, looking into the theme path supplied by item too. */
+static GdkPixbuf * sni_pixbuf_from_name(const char * name, const char * theme_path, gint size)
+{
+    GdkPixbuf * pixbuf;
+    char * fallback = NULL;
+
+    if (name == NULL || name[0] == '\0')
+        return NULL;
+    if (theme_path != NULL && theme_path[0] == '/' && name[0] != '/')
+        fallback = g_strdup_printf("%s/%s.png", theme_path, name);
+    pixbuf = lxpanel_icon_cache_get_for_name(name, size, 1, fallback);
+    g_free(fallback);
+    return pixbuf;
+}
+
+static char * sni_variant_dup_string(GVariant * value)
+{
+    if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)
+        || g_variant_is_of_type(value, G_VARIANT_TYPE_OBJECT_PATH))
+        return g_variant_dup_string(value, NULL);
+    return NULL;
+}
+
+static void sni_item_props_ready(GObject * source, GAsyncResult * res, gpointer user_data)
+{
+    SniItem * item = user_data;
+    GError * err = NULL;
+    GVariant * ret, * props, * value;
+    GVariant * icon_pixmap = NULL, * attention_pixmap = NULL;
+    char * icon_name = NULL, * attention_name = NULL, * theme_path = NULL, * title = NULL;
+    char * tip_title = NULL, * tip_text = NULL;
+    const char * key;
+    GVariantIter iter;
+    gboolean attention;
+
+    ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if (ret == NULL)
+    {
+        /* item may be already freed if cancelled */
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_debug("tray: cannot get properties of %s: %s", item->key, err->message);
+            item->fetching = FALSE;
+        }
+        g_error_free(err);
+        return;
+    }
+    item->fetching = FALSE;
+
+    g_free(item->id);
+    g_free(item->status);
+    g_free(item->menu_path);
+    item->id = item->status = item->menu_path = NULL;
+    item->item_is_menu = FALSE;
+    props = g_variant_get_child_value(ret, 0);
+    g_variant_iter_init(&iter, props);
+    while (g_variant_iter_next(&iter, "{&sv}", &key, &value))
+    {
+        if (strcmp(key, "Id") == 0)
+            item->id = sni_variant_dup_string(value);
+        else if (strcmp(key, "Title") == 0)
+            title = sni_variant_dup_string(value);
+        else if (strcmp(key, "Status") == 0)
+            item->status = sni_variant_dup_string(value);
+        else if (strcmp(key, "IconName") == 0)
+            icon_name = sni_variant_dup_string(value);
+        else if (strcmp(key, "AttentionIconName") == 0)
+            attention_name = sni_variant_dup_string(value);
+        else if (strcmp(key, "IconThemePath") == 0)
+            theme_path = sni_variant_dup_string(value);
+        else if (strcmp(key, "Menu") == 0)
+            item->menu_path = sni_variant_dup_string(value);
+        else if (strcmp(key, "IconPixmap") == 0)
+            icon_pixmap = g_variant_ref(value);
+        else if (strcmp(key, "AttentionIconPixmap") == 0)
+            attention_pixmap = g_variant_ref(value);
+        else if (strcmp(key, "ItemIsMenu") == 0
+                 && g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN))
+            item->item_is_menu = g_variant_get_boolean(value);
+        else if (strcmp(key, "ToolTip") == 0
+                 && g_variant_is_of_type(value, G_VARIANT_TYPE("(sa(iiay)ss)")))
+            g_variant_get(value, "(&s@a(iiay)ss)", NULL, NULL, &tip_title, &tip_text);
+        g_variant_unref(value);
+    }
+    g_variant_unref(props);
+    g_variant_unref(ret);
+
+    /* "/" means no menu for some implementations */
+    if (item->menu_path != NULL && strcmp(item->menu_path, "/") == 0)
+    {
+        g_free(item->menu_path);
+        item->menu_path = NULL;
+    }
+
+    /* pick the icon: name has priority over pixmap as it scales better */
+    if (item->pixbuf != NULL)
+        g_object_unref(item->pixbuf);
+    attention = (g_strcmp0(item->status, "NeedsAttention") == 0);
+    item->pixbuf = NULL;
+    if (attention)
+    {
+        item->pixbuf = sni_pixbuf_from_name(attention_name, theme_path, item->sni->icon_size);
+        if (item->pixbuf == NULL && attention_pixmap != NULL)
+            item->pixbuf = sni_pixbuf_from_pixmaps(attention_pixmap, item->sni->icon_size);
+    }
+    if (item->pixbuf == NULL)
+        item->pixbuf = sni_pixbuf_from_name(icon_name, theme_path, item->sni->icon_size);
+    if (item->pixbuf == NULL && icon_pixmap != NULL)
+        item->pixbuf = sni_pixbuf_from_pixmaps(icon_pixmap, item->sni->icon_size);
+
+    /* compose tooltip text */
+    g_free(item->tooltip);
+    if (tip_title != NULL && tip_title[0] != '\0')
+    {
+        if (tip_text != NULL && tip_text[0] != '\0')
+            item->tooltip = g_strdup_printf("%s\n%s", tip_title, tip_text);
+        else
+            item->tooltip = g_strdup(tip_title);
+    }
+    else if (title != NULL && title[0] != '\0')
+        item->tooltip = g_strdup(title);
+    else
+        item->tooltip = g_strdup(item->id);
+
+    if (icon_pixmap != NULL)
+        g_variant_unref(icon_pixmap);
+    if (attention_pixmap != NULL)
+        g_variant_unref(attention_pixmap);
+    g_free(icon_name);
+    g_free(attention_name);
+    g_free(theme_path);
+    g_free(title);
+    g_free(tip_title);
+    g_free(tip_text);
+
+    sni_item_update_widget(item);
+
+    /* item changed again while we were waiting for reply */
+    if (item->dirty)
+        sni_item_fetch(item);
+}
+
+static void sni_item_fetch(SniItem * item)
+{
+    item->dirty = FALSE;
+    item->fetching = TRUE;
+    g_dbus_connection_call(item->sni->bus, item->bus_name, item->path,
+                           "org.freedesktop.DBus.Properties", "GetAll",
+                           g_variant_new("(s)", ITEM_IFACE),
+                           G_VARIANT_TYPE("(a{sv})"), G_DBUS_CALL_FLAGS_NONE, -1,
+                           item->cancellable, sni_item_props_ready, item);
+}
+
+static gboolean sni_batch_timeout(gpointer user_data)
+{
+    TraySni * sni = user_data;
+    GList * l;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    sni->batch_timer = 0;
+    for (l = sni->items; l != NULL; l = l->next)
+    {
+        SniItem * item = l->data;
+        if (item->dirty && !item->fetching)
+            sni_item_fetch(item);
+    }
+    return FALSE;
+}
+
+/* Mark item for update; all updates within the delay are done at once. */
+static void sni_item_queue_update(SniItem * item)
+{
+    TraySni * sni = item->sni;
+
+    item->dirty = TRUE;
+    if (sni->batch_timer == 0)
+        sni->batch_timer = g_timeout_add(BATCH_DELAY, sni_batch_timeout, sni);
+}
+
+static void sni_item_signal(GDBusConnection * connection, const gchar * sender_name,
+                            const gchar * object_path, const gchar * interface_name,
+                            const gchar * signal_name, GVariant * parameters,
+                            gpointer user_data)
+{
+    /* NewIcon, NewTitle, NewStatus, etc. - all need the properties */
+    sni_item_queue_update(user_data);
+}
+
+static void sni_item_vanished(GDBusConnection * connection, const gchar * name,
+                              gpointer user_data)
+{
+    SniItem * item = user_data;
+
+    sni_remove_item(item->sni, item);
+}
+
+static void sni_item_free(SniItem * item)
+{
+    g_cancellable_cancel(item->cancellable);
+    g_object_unref(item->cancellable);
+    if (item->watch_id != 0)
+        g_bus_unwatch_name(item->watch_id);
+    if (item->signal_id != 0)
+        g_dbus_connection_signal_unsubscribe(item->sni->bus, item->signal_id);
+    g_signal_handlers_disconnect_by_data(item->widget, item);
+    gtk_widget_destroy(item->widget);
+    g_object_unref(item->widget);
+    if (item->pixbuf != NULL)
+        g_object_unref(item->pixbuf);
+    g_free(item->key);
+    g_free(item->bus_name);
+    g_free(item->path);
+    g_free(item->id);
+    g_free(item->status);
+    g_free(item->tooltip);
+    g_free(item->menu_path);
+    g_slice_free(SniItem, item);
+}
+
+static SniItem * sni_find_item(TraySni * sni, const char * key)
+{
+    GList * l;
+
+    for (l = sni->items; l != NULL; l = l->next)
+        if (strcmp(((SniItem *)l->data)->key, key) == 0)
+            return l->data;
+    return NULL;
+}
+
+static void sni_emit_watcher_signal(TraySni * sni, const char * signal, const char * key)
+{
+    if (!sni->is_watcher)
+        return;
+    g_dbus_connection_emit_signal(sni->bus, NULL, WATCHER_PATH, WATCHER_IFACE, signal,
+                                  key ? g_variant_new("(s)", key) : NULL, NULL);
+}
+
+static void sni_add_item(TraySni * sni, const char * bus_name, const char * path)
+{
+    SniItem * item;
+    char * key;
+
+    if (!g_dbus_is_name(bus_name) || !g_variant_is_object_path(path))
+        return;
+    key = g_strconcat(bus_name, path, NULL);
+    if (sni_find_item(sni, key) != NULL)
+    {
+        g_free(key);
+        return;
+    }
+
+    item = g_slice_new0(SniItem);
+    item->sni = sni;
+    item->key = key;
+    item->bus_name = g_strdup(bus_name);
+    item->path = g_strdup(path);
+    item->cancellable = g_cancellable_new();
+
+    /* Input-only event box with a windowless image inside, so the icon is
+       painted directly over the panel background. It is shown when the
+       icon arrives. */
+    item->widget = gtk_event_box_new();
+    gtk_event_box_set_visible_window(GTK_EVENT_BOX(item->widget), FALSE);
+    gtk_widget_add_events(item->widget, GDK_BUTTON_PRESS_MASK | GDK_SCROLL_MASK);
+    gtk_widget_set_name(item->widget, "tray-sni");
+    gtk_widget_set_no_show_all(item->widget, TRUE);
+    g_signal_connect(item->widget, "button-press-event", G_CALLBACK(sni_button_press_event), item);
+    g_signal_connect(item->widget, "scroll-event", G_CALLBACK(sni_scroll_event), item);
+    item->image = gtk_image_new();
+    gtk_container_add(GTK_CONTAINER(item->widget), item->image);
+    gtk_widget_show(item->image);
+    gtk_container_add(GTK_CONTAINER(sni->grid), item->widget);
+    g_object_ref(item->widget);
+
+    item->signal_id = g_dbus_connection_signal_subscribe(sni->bus, bus_name, ITEM_IFACE,
+                                                         NULL, path, NULL,
+                                                         G_DBUS_SIGNAL_FLAGS_NONE,
+                                                         sni_item_signal, item, NULL);
+    sni->items = g_list_append(sni->items, item);
+    /* keep SNI icons in registration order before the sockets */
+    panel_icon_grid_reorder_child(PANEL_ICON_GRID(sni->grid), item->widget,
+                                  g_list_length(sni->items) - 1);
+    item->watch_id = g_bus_watch_name_on_connection(sni->bus, bus_name,
+                                                    G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                    NULL, sni_item_vanished, item, NULL);
+    sni_emit_watcher_signal(sni, "StatusNotifierItemRegistered", key);
+    sni_item_queue_update(item);
+}
+
+/* Add item announced as "bus/path" by a watcher. */
+static void sni_add_item_from_key(TraySni * sni, const char * key)
+{
+    const char * path = strchr(key, '/');
+    char * bus_name;
+
+    if (path == NULL)
+    {
+        sni_add_item(sni, key, ITEM_PATH);
+        return;
+    }
+    bus_name = g_strndup(key, path - key);
+    sni_add_item(sni, bus_name, path);
+    g_free(bus_name);
+}
+
+static void sni_remove_item(TraySni * sni, SniItem * item)
+{
+    sni->items = g_list_remove(sni->items, item);
+    sni_emit_watcher_signal(sni, "StatusNotifierItemUnregistered", item->key);
+    sni_item_free(item);
+}
+
+/* Watcher interface, used if there is no other watcher on the bus. */
+static void sni_watcher_method_call(GDBusConnection * connection, const gchar * sender,
+                                    const gchar * object_path, const gchar * interface_name,
+                                    const gchar * method_name, GVariant * parameters,
+                                    GDBusMethodInvocation * invocation, gpointer user_data)
+{
+    TraySni * sni = user_data;
+    const char * service;
+
+    g_variant_get(parameters, "(&s)", &service);
+    if (strcmp(method_name, "RegisterStatusNotifierItem") == 0)
+    {
+        /* service is either a bus name or an object path on the sender */
+        if (service[0] == '/')
+            sni_add_item(sni, sender, service);
+        else
+            sni_add_item(sni, service, ITEM_PATH);
+    }
+    else if (strcmp(method_name, "RegisterStatusNotifierHost") == 0)
+        sni_emit_watcher_signal(sni, "StatusNotifierHostRegistered", NULL);
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static GVariant * sni_watcher_get_property(GDBusConnection * connection, const gchar * sender,
+                                           const gchar * object_path, const gchar * interface_name,
+                                           const gchar * property_name, GError ** error,
+                                           gpointer user_data)
+{
+    TraySni * sni = user_data;
+
+    if (strcmp(property_name, "RegisteredStatusNotifierItems") == 0)
+    {
+        GVariantBuilder builder;
+        GList * l;
+
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
+        for (l = sni->items; l != NULL; l = l->next)
+            g_variant_builder_add(&builder, "s", ((SniItem *)l->data)->key);
+        return g_variant_builder_end(&builder);
+    }
+    if (strcmp(property_name, "IsStatusNotifierHostRegistered") == 0)
+        return g_variant_new_boolean(TRUE);
+    if (strcmp(property_name, "ProtocolVersion") == 0)
+        return g_variant_new_int32(0);
+    return NULL;
+}
+
+static const GDBusInterfaceVTable watcher_vtable = {
+    sni_watcher_method_call,
+    sni_watcher_get_property,
+    NULL
+};
+
+/* Signals of an external watcher. */
+static void sni_watcher_signal(GDBusConnection * connection, const gchar * sender_name,
+                               const gchar * object_path, const gchar * interface_name,
+                               const gchar * signal_name, GVariant * parameters,
+                               gpointer user_data)
+{
+    TraySni * sni = user_data;
+    const char * key;
+    SniItem * item;
+
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(s)")))
+        return;
+    g_variant_get(parameters, "(&s)", &key);
+    if (strcmp(signal_name, "StatusNotifierItemRegistered") == 0)
+        sni_add_item_from_key(sni, key);
+    else if (strcmp(signal_name, "StatusNotifierItemUnregistered") == 0
+             && (item = sni_find_item(sni, key)) != NULL)
+        sni_remove_item(sni, item);
+}
+
+static void sni_watcher_items_ready(GObject * source, GAsyncResult * res, gpointer user_data)
+{
+    TraySni * sni = user_data;
+    GError * err = NULL;
+    GVariant * ret, * value;
+    GVariantIter iter;
+    const char * key;
+
+    ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if (ret == NULL)
+    {
+        /* host may be already freed if cancelled */
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_warning("tray: cannot get items from watcher: %s", err->message);
+        g_error_free(err);
+        return;
+    }
+    g_variant_get(ret, "(v)", &value);
+    if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING_ARRAY))
+    {
+        g_variant_iter_init(&iter, value);
+        while (g_variant_iter_next(&iter, "&s", &key))
+            sni_add_item_from_key(sni, key);
+    }
+    g_variant_unref(value);
+    g_variant_unref(ret);
+}
+
+static void sni_watcher_acquired(GDBusConnection * connection, const gchar * name,
+                                 gpointer user_data)
+{
+    TraySni * sni = user_data;
+
+    /* items will register with us from now on */
+    if (sni->watcher_signal_id != 0)
+    {
+        g_dbus_connection_signal_unsubscribe(sni->bus, sni->watcher_signal_id);
+        sni->watcher_signal_id = 0;
+    }
+    sni->is_watcher = TRUE;
+    sni_emit_watcher_signal(sni, "StatusNotifierHostRegistered", NULL);
+}
+
+static void sni_watcher_lost(GDBusConnection * connection, const gchar * name,
+                             gpointer user_data)
+{
+    TraySni * sni = user_data;
+
+    sni->is_watcher = FALSE;
+    if (connection == NULL || sni->watcher_signal_id != 0)
+        return;
+    /* another watcher is running, register there as a host */
+    sni->watcher_signal_id = g_dbus_connection_signal_subscribe(sni->bus, WATCHER_NAME,
+                                                                WATCHER_IFACE, NULL,
+                                                                WATCHER_PATH, NULL,
+                                                                G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                sni_watcher_signal, sni, NULL);
+    g_dbus_connection_call(sni->bus, WATCHER_NAME, WATCHER_PATH, WATCHER_IFACE,
+                           "RegisterStatusNotifierHost", g_variant_new("(s)", sni->host_name),
+                           NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+    g_dbus_connection_call(sni->bus, WATCHER_NAME, WATCHER_PATH,
+                           "org.freedesktop.DBus.Properties", "Get",
+                           g_variant_new("(ss)", WATCHER_IFACE, "RegisteredStatusNotifierItems"),
+                           G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1,
+                           sni->cancellable, sni_watcher_items_ready, sni);
+}
+
+static void sni_bus_ready(GObject * source, GAsyncResult * res, gpointer user_data)
+{
+    TraySni * sni = user_data;
+    GError * err = NULL;
+    GDBusConnection * bus = g_bus_get_finish(res, &err);
+
+    if (bus == NULL)
+    {
+        /* host may be already freed if cancelled */
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_warning("tray: cannot connect to session bus: %s", err->message);
+        g_error_free(err);
+        return;
+    }
+    sni->bus = bus;
+    sni->watcher_object_id = g_dbus_connection_register_object(bus, WATCHER_PATH,
+                                                               sni->watcher_info->interfaces[0],
+                                                               &watcher_vtable, sni, NULL, &err);
+    if (sni->watcher_object_id == 0)
+    {
+        g_warning("tray: cannot export status notifier watcher: %s", err->message);
+        g_error_free(err);
+    }
+    sni->host_owner_id = g_bus_own_name_on_connection(bus, sni->host_name,
+                                                      G_BUS_NAME_OWNER_FLAGS_NONE,
+                                                      NULL, NULL, NULL, NULL);
+    sni->watcher_owner_id = g_bus_own_name_on_connection(bus, WATCHER_NAME,
+                                                         G_BUS_NAME_OWNER_FLAGS_NONE,
+                                                         sni_watcher_acquired,
+                                                         sni_watcher_lost, sni, NULL);
+}
+
+/* Menu handling. */
+static void sni_menu_target_free(gpointer data)
+{
+    SniMenuTarget * target = data;
+
+    g_object_unref(target->bus);
+    g_free(target->bus_name);
+    g_free(target->menu_path);
+    g_slice_free(SniMenuTarget, target);
+}
+
+static void sni_menu_item_activated(GtkMenuItem * mi, SniMenuTarget * target)
+{
+    gint id = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(mi), "sni-id"));
+
+    g_dbus_connection_call(target->bus, target->bus_name, target->menu_path,
+                           DBUSMENU_IFACE, "Event",
+                           g_variant_new("(isvu)", id, "clicked", g_variant_new_int32(0),
+                                         gtk_get_current_event_time()),
+                           NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+}
+
+/* Fill menu from children of dbusmenu layout, of type av. */
+static void sni_menu_fill(GtkWidget * menu, GVariant * children, SniMenuTarget * target)
+{
+    GVariantIter iter;
+    GVariant * layout, * props, * sub;
+    GtkWidget * mi;
+    const char * label, * type, * toggle_type, * display;
+    gboolean flag;
+    gint id, state;
+
+    g_variant_iter_init(&iter, children);
+    while (g_variant_iter_next(&iter, "v", &layout))
+    {
+        if (!g_variant_is_of_type(layout, G_VARIANT_TYPE("(ia{sv}av)")))
+        {
+            g_variant_unref(layout);
+            continue;
+        }
+        g_variant_get(layout, "(i@a{sv}@av)", &id, &props, &sub);
+        if (g_variant_lookup(props, "visible", "b", &flag) && !flag)
+            mi = NULL;
+        else if (g_variant_lookup(props, "type", "&s", &type) && strcmp(type, "separator") == 0)
+            mi = gtk_separator_menu_item_new();
+        else
+        {
+            if (!g_variant_lookup(props, "label", "&s", &label))
+                label = "";
+            if (g_variant_lookup(props, "toggle-type", "&s", &toggle_type)
+                && (strcmp(toggle_type, "checkmark") == 0 || strcmp(toggle_type, "radio") == 0))
+            {
+                mi = gtk_check_menu_item_new_with_mnemonic(label);
+                gtk_check_menu_item_set_draw_as_radio(GTK_CHECK_MENU_ITEM(mi),
+                                                      toggle_type[0] == 'r');
+                if (g_variant_lookup(props, "toggle-state", "i", &state))
+                    gtk_check_menu_item_set_active(GTK_CHECK_MENU_ITEM(mi), state == 1);
+            }
+            else
+                mi = gtk_menu_item_new_with_mnemonic(label);
+            if (g_variant_lookup(props, "enabled", "b", &flag) && !flag)
+                gtk_widget_set_sensitive(mi, FALSE);
+            if ((g_variant_lookup(props, "children-display", "&s", &display)
+                 && strcmp(display, "submenu") == 0) || g_variant_n_children(sub) > 0)
+            {
+                GtkWidget * submenu = gtk_menu_new();
+                sni_menu_fill(submenu, sub, target);
+                gtk_menu_item_set_submenu(GTK_MENU_ITEM(mi), submenu);
+            }
+            else
+            {
+                g_object_set_data(G_OBJECT(mi), "sni-id", GINT_TO_POINTER(id));
+                g_signal_connect(mi, "activate", G_CALLBACK(sni_menu_item_activated), target);
+            }
+        }
+        if (mi != NULL)
+        {
+            gtk_widget_show(mi);
+            gtk_menu_shell_append(GTK_MENU_SHELL(menu), mi);
+        }
+        g_variant_unref(props);
+        g_variant_unref(sub);
+        g_variant_unref(layout);
+    }
+}
+
+static void sni_menu_request_free(SniMenuRequest * req)
+{
+    if (req->target != NULL)
+        sni_menu_target_free(req->target);
+    g_object_unref(req->widget);
+    gdk_event_free(req->event);
+    g_slice_free(SniMenuRequest, req);
+}
+
+static void sni_menu_layout_ready(GObject * source, GAsyncResult * res, gpointer user_data)
+{
+    SniMenuRequest * req = user_data;
+    TraySni * sni = req->sni;
+    GError * err = NULL;
+    GVariant * ret, * layout, * children;
+    GtkWidget * menu;
+
+    ret = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if (ret == NULL)
+    {
+        /* host may be already freed if cancelled */
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_debug("tray: cannot get menu of %s: %s", req->target->bus_name, err->message);
+        g_error_free(err);
+        sni_menu_request_free(req);
+        return;
+    }
+
+    /* item is gone while menu was requested */
+    if (gtk_widget_get_parent(req->widget) == NULL)
+    {
+        g_variant_unref(ret);
+        sni_menu_request_free(req);
+        return;
+    }
+
+    /* the previous menu is no longer needed */
+    if (sni->menu != NULL)
+        gtk_widget_destroy(sni->menu);
+    menu = sni->menu = gtk_menu_new();
+    g_object_set_data_full(G_OBJECT(menu), "sni-target", req->target, sni_menu_target_free);
+    layout = g_variant_get_child_value(ret, 1);
+    children = g_variant_get_child_value(layout, 2);
+    sni_menu_fill(menu, children, req->target);
+    req->target = NULL;
+    g_variant_unref(children);
+    g_variant_unref(layout);
+    g_variant_unref(ret);
+
+    gtk_menu_attach_to_widget(GTK_MENU(menu), req->widget, NULL);
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gtk_menu_popup_at_widget(GTK_MENU(menu), req->widget, GDK_GRAVITY_NORTH_WEST,
+                             GDK_GRAVITY_NORTH_WEST, req->event);
+#else
+    gtk_menu_popup(GTK_MENU(menu), NULL, NULL, NULL, NULL,
+                   req->event->button.button, req->event->button.time);
+#endif
+    sni_menu_request_free(req);
+}
+
+/* Request menu layout and show the menu when it arrives. */
+static gboolean sni_item_show_menu(TraySni * sni, SniItem * item, GdkEventButton * event)
+{
+    SniMenuRequest * req;
+
+    if (item->menu_path == NULL)
+        return FALSE;
+    g_dbus_connection_call(sni->bus, item->bus_name, item->menu_path,
+                           DBUSMENU_IFACE, "AboutToShow", g_variant_new("(i)", 0),
+                           NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+    req = g_slice_new(SniMenuRequest);
+    req->sni = sni;
+    req->widget = g_object_ref(item->widget);
+    req->event = gdk_event_copy((GdkEvent *)event);
+    req->target = g_slice_new(SniMenuTarget);
+    req->target->bus = g_object_ref(sni->bus);
+    req->target->bus_name = g_strdup(item->bus_name);
+    req->target->menu_path = g_strdup(item->menu_path);
+    g_dbus_connection_call(sni->bus, item->bus_name, item->menu_path,
+                           DBUSMENU_IFACE, "GetLayout",
+                           g_variant_new("(ii@as)", 0, -1, g_variant_new_strv(NULL, 0)),
+                           G_VARIANT_TYPE("(u(ia{sv}av))"), G_DBUS_CALL_FLAGS_NONE, -1,
+                           sni->cancellable, sni_menu_layout_ready, req);
+    return TRUE;
+}
+
+static void sni_item_call(TraySni * sni, SniItem * item, const char * method, GVariant * params)
+{
+    g_dbus_connection_call(sni->bus, item->bus_name, item->path, ITEM_IFACE, method,
+                           params, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL, NULL);
+}
+
+static gboolean sni_button_press_event(GtkWidget * widget, GdkEventButton * event, SniItem * item)
+{
+    TraySni * sni = item->sni;
+    gint x = event->x_root, y = event->y_root;
+
+    if (event->type != GDK_BUTTON_PRESS)
+        return FALSE;
+    switch (event->button)
+    {
+    case 1:
+        if (!item->item_is_menu || !sni_item_show_menu(sni, item, event))
+            sni_item_call(sni, item, "Activate", g_variant_new("(ii)", x, y));
+        break;
+    case 2:
+        sni_item_call(sni, item, "SecondaryActivate", g_variant_new("(ii)", x, y));
+        break;
+    case 3:
+        if (!sni_item_show_menu(sni, item, event))
+            sni_item_call(sni, item, "ContextMenu", g_variant_new("(ii)", x, y));
+        break;
+    default:
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean sni_scroll_event(GtkWidget * widget, GdkEventScroll * event, SniItem * item)
+{
+    TraySni * sni = item->sni;
+
+    switch (event->direction)
+    {
+    case GDK_SCROLL_UP:
+        sni_item_call(sni, item, "Scroll", g_variant_new("(is)", -1, "vertical"));
+        break;
+    case GDK_SCROLL_DOWN:
+        sni_item_call(sni, item, "Scroll", g_variant_new("(is)", 1, "vertical"));
+        break;
+    case GDK_SCROLL_LEFT:
+        sni_item_call(sni, item, "Scroll", g_variant_new("(is)", -1, "horizontal"));
+        break;
+    case GDK_SCROLL_RIGHT:
+        sni_item_call(sni, item, "Scroll", g_variant_new("(is)", 1, "horizontal"));
+        break;
+    default:
+        return FALSE;
+    }
+    return TRUE;
+}
+
+TraySni *tray_sni_new(LXPanel *panel, GtkWidget *grid, gint icon_size)
+{
+    TraySni * sni = g_slice_new0(TraySni);
+
+    sni->panel = panel;
+    sni->grid = grid;
+    sni->icon_size = icon_size;
+    sni->host_name = g_strdup_printf("org.kde.StatusNotifierHost-%d", (int)getpid());
+    sni->watcher_info = g_dbus_node_info_new_for_xml(watcher_xml, NULL);
+    sni->cancellable = g_cancellable_new();
+
+    g_bus_get(G_BUS_TYPE_SESSION, sni->cancellable, sni_bus_ready, sni);
+    return sni;
+}
+
+void tray_sni_set_icon_size(TraySni *sni, gint icon_size)
+{
+    GList * l;
+
+    if (icon_size == sni->icon_size)
+        return;
+    sni->icon_size = icon_size;
+    for (l = sni->items; l != NULL; l = l->next)
+        sni_item_queue_update(l->data);
+}
+
+void tray_sni_free(TraySni *sni)
+{
+    g_cancellable_cancel(sni->cancellable);
+    if (sni->batch_timer != 0)
+        g_source_remove(sni->batch_timer);
+    while (sni->items != NULL)
+    {
+        sni_item_free(sni->items->data);
+        sni->items = g_list_delete_link(sni->items, sni->items);
+    }
+    if (sni->watcher_owner_id != 0)
+        g_bus_unown_name(sni->watcher_owner_id);
+    if (sni->host_owner_id != 0)
+        g_bus_unown_name(sni->host_owner_id);
+    if (sni->bus != NULL)
+    {
+        if (sni->watcher_signal_id != 0)
+            g_dbus_connection_signal_unsubscribe(sni->bus, sni->watcher_signal_id);
+        if (sni->watcher_object_id != 0)
+            g_dbus_connection_unregister_object(sni->bus, sni->watcher_object_id);
+        g_object_unref(sni->bus);
+    }
+    if (sni->menu != NULL)
+        gtk_widget_destroy(sni->menu);
+    g_object_unref(sni->cancellable);
+    g_dbus_node_info_unref(sni->watcher_info);
+    g_free(sni->host_name);
+    g_slice_free(TraySni, sni);
+}
@@ -0,0 +1,42 @@
+/*
+ * StatusNotifierItem host for the system tray plugin.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __TRAY_SNI_H__
+#define __TRAY_SNI_H__ 1
+
+#include "plugin.h"
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* Every item is added into the tray icon grid as a separate widget, before
+   the XEMBED sockets. The host works as the StatusNotifierWatcher itself if there is no
+   other one on the session bus, otherwise it registers within that one. */
+
+typedef struct _TraySni TraySni;
+
+G_GNUC_INTERNAL TraySni *tray_sni_new(LXPanel *panel, GtkWidget *grid, gint icon_size);
+G_GNUC_INTERNAL void tray_sni_set_icon_size(TraySni *sni, gint icon_size);
+G_GNUC_INTERNAL void tray_sni_free(TraySni *sni);
+
+G_END_DECLS
+
+#endif
@@ -29,6 +29,10 @@
  * Copyright (C) 2002 Anders Carlsson <andersca@gnu.org>
  * Copyright (C) 2003-2006 Vincent Untz */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -39,11 +43,16 @@
 #include "plugin.h"
 #include "misc.h"
 #include "icon-grid.h"
+#include "tray-sni.h"
 
 #if GTK_CHECK_VERSION(3, 0, 0)
 #include <gtk/gtkx.h>
 #endif
 
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif
+
 /* Standards reference:  http://standards.freedesktop.org/systemtray-spec/ */
 
 /* Protocol constants. */
@@ -75,6 +84,11 @@ typedef struct _tray_client {
     struct _tray_plugin * tr;			/* Back pointer to tray plugin */
     Window window;				/* X window ID */
     GtkWidget * socket;				/* Socket */
+    guint destroy_handler;			/* Subscription to DestroyNotify on window */
+    GtkAllocation allocation;			/* Last allocation of the socket, to detect moves */
+#ifdef HAVE_XDAMAGE
+    Damage damage;				/* Damage object tracking the icon window, or None */
+#endif
 } TrayClient;
 
 /* Private context for system tray plugin. */
@@ -89,7 +103,10 @@ typedef struct _tray_plugin {
     GtkWidget * invisible;			/* Invisible window that holds manager selection */
     Window invisible_window;			/* X window ID of invisible window */
     GdkAtom selection_atom;			/* Atom for _NET_SYSTEM_TRAY_S%d */
-    int redraw_called;				/* Counter for size-allocate events to distinguish between deliberate redraws and events from panel */
+    guint x_event_handlers[4];			/* Subscriptions to X events */
+    config_setting_t * settings;		/* Plugin settings */
+    TraySni * sni;				/* StatusNotifierItem host, or NULL if disabled */
+    int sni_enabled;				/* Show StatusNotifierItem icons */
 } TrayPlugin;
 
 static void balloon_message_display(TrayPlugin * tr, BalloonMessage * msg);
@@ -98,41 +115,79 @@ static void balloon_message_remove(TrayPlugin * tr, Window window, gboolean all_
 static void tray_unmanage_selection(TrayPlugin * tr);
 static void tray_destructor(gpointer user_data);
 
-static gboolean init_redraw (gpointer data)
+static void trap_pop_ignored(void)
 {
-    TrayPlugin *tr = (TrayPlugin *) data;
-    tr->redraw_called = 3;		/* each force_redraw causes 3 size-allocate events */
-    panel_icon_grid_force_redraw (PANEL_ICON_GRID (tr->plugin));
-    return FALSE;
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gdk_error_trap_pop_ignored();
+#else
+    gdk_error_trap_pop();
+#endif
 }
 
-static gboolean do_redraw (gpointer data)
+/*** Repainting of icons ***/
+
+/* Sockets have parent-relative background, so the panel background shows
+ * through them.  When a socket is moved or the background is changed, the
+ * icon window is cleared, which repaints the background under it and sends
+ * Expose to the client, so only that icon is repainted.  With XDamage the
+ * socket is also repainted each time the client draws into its icon. */
+
+/* Clear the icon window and let the client draw it again. */
+static void client_force_redraw(TrayClient * tc)
 {
-    TrayPlugin *tr = (TrayPlugin *) data;
-    if (tr->redraw_called == 0)
-    {
-        tr->redraw_called = 3;		/* each force_redraw causes 3 size-allocate events */
-        panel_icon_grid_force_redraw (PANEL_ICON_GRID (tr->plugin));
-    }
-    return FALSE;
+    if (!gtk_widget_get_mapped(tc->socket) ||
+        gtk_socket_get_plug_window(GTK_SOCKET(tc->socket)) == NULL)
+        return;
+    gdk_error_trap_push();
+    XClearArea(GDK_DISPLAY_XDISPLAY(gtk_widget_get_display(tc->socket)),
+               tc->window, 0, 0, 0, 0, True);
+    trap_pop_ignored();
 }
 
-static void redraw (TrayPlugin *tr)
+/* Handler for "realize" on the socket. */
+static void client_socket_realize(GtkWidget * socket, TrayClient * tc)
 {
-#if GTK_CHECK_VERSION (3, 0, 0)
-    tr->redraw_called = 0;
-    g_idle_add (do_redraw, tr);
+    /* Use parent's background for the socket, GTK won't override it since the socket is app-paintable. */
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gdk_window_set_background_pattern(gtk_widget_get_window(socket), NULL);
+#else
+    gdk_window_set_back_pixmap(gtk_widget_get_window(socket), NULL, TRUE);
 #endif
 }
 
-static void on_size_alloc (GtkWidget *wid, GtkAllocation *alloc, gpointer data)
+/* Handler for "size-allocate" on the socket, after the socket window was moved. */
+static void client_socket_size_allocate(GtkWidget * socket, GtkAllocation * alloc, TrayClient * tc)
 {
-    TrayPlugin *tr = (TrayPlugin *) data;
-    if (tr->redraw_called == 0)
-        redraw (tr);
-    else if (tr->redraw_called > 0)
-        tr->redraw_called--;
+    if (alloc->x == tc->allocation.x && alloc->y == tc->allocation.y &&
+        alloc->width == tc->allocation.width && alloc->height == tc->allocation.height)
+        return;
+    tc->allocation = *alloc;
+    client_force_redraw(tc);
+}
+
+#ifdef HAVE_XDAMAGE
+/* Handler for XDamageNotify on icon windows. */
+static GdkFilterReturn tray_damage_event(XEvent * xev, gpointer user_data)
+{
+    TrayPlugin * tr = user_data;
+    XDamageNotifyEvent * ev = (XDamageNotifyEvent *) xev;
+    TrayClient * tc;
+
+    for (tc = tr->client_list; tc != NULL; tc = tc->client_flink)
+        if (tc->damage == ev->damage)
+            break;
+    if (tc == NULL)
+        return GDK_FILTER_CONTINUE;
+
+    /* With XDamageReportNonEmpty no more events come until the damage is
+     * subtracted, so a burst of drawing by the client costs one repaint. */
+    gdk_error_trap_push();
+    XDamageSubtract(ev->display, ev->damage, None, None);
+    trap_pop_ignored();
+    gtk_widget_queue_draw(tc->socket);
+    return GDK_FILTER_REMOVE;
 }
+#endif
 
 /* Look up a client in the client list. */
 static TrayClient * client_lookup(TrayPlugin * tr, Window window)
@@ -187,6 +242,18 @@ static void client_delete(TrayPlugin * tr, TrayClient * tc, gboolean unlink, gbo
         }
     }
 
+    lxpanel_x_event_disconnect(tc->destroy_handler);
+
+#ifdef HAVE_XDAMAGE
+    /* The damage is already gone if the window was destroyed. */
+    if (tc->damage != None)
+    {
+        gdk_error_trap_push();
+        XDamageDestroy(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), tc->damage);
+        trap_pop_ignored();
+    }
+#endif
+
     /* Clear out any balloon messages. */
     balloon_incomplete_message_remove(tr, tc->window, TRUE, 0);
     balloon_message_remove(tr, tc->window, TRUE, 0);
@@ -197,8 +264,6 @@ static void client_delete(TrayPlugin * tr, TrayClient * tc, gboolean unlink, gbo
 
     /* Deallocate the client structure. */
     g_free(tc);
-
-    redraw (tr);
 }
 
 /*** Balloon message display ***/
@@ -456,6 +521,18 @@ static void balloon_message_data_event(TrayPlugin * tr, XClientMessageEvent * xe
     }
 }
 
+/* Handler for DestroyNotify on tray icon window.
+ * We do it this way rather than with a "plug_removed" event because delivery
+ * of plug_removed events is observed to be unreliable if the client
+ * disconnects within less than 10 ms. */
+static GdkFilterReturn trayclient_destroyed(XEvent * xev, gpointer user_data)
+{
+    TrayClient * tc = user_data;
+
+    client_delete(tc->tr, tc, TRUE, TRUE);
+    return GDK_FILTER_CONTINUE;
+}
+
 /* Handler for request dock message. */
 static void trayclient_request_dock(TrayPlugin * tr, XClientMessageEvent * xevent)
 {
@@ -477,6 +554,9 @@ static void trayclient_request_dock(TrayPlugin * tr, XClientMessageEvent * xeven
 
     /* Allocate a socket.  This is the tray side of the Xembed connection. */
     tc->socket = gtk_socket_new();
+    gtk_widget_set_app_paintable(tc->socket, TRUE);
+    g_signal_connect(tc->socket, "realize", G_CALLBACK(client_socket_realize), tc);
+    g_signal_connect_after(tc->socket, "size-allocate", G_CALLBACK(client_socket_size_allocate), tc);
 
     /* Add the socket to the icon grid. */
     gtk_container_add(GTK_CONTAINER(tr->plugin), tc->socket);
@@ -505,26 +585,26 @@ static void trayclient_request_dock(TrayPlugin * tr, XClientMessageEvent * xeven
         tc->client_flink = tc_pred->client_flink;
         tc_pred->client_flink = tc;
     }
+    tc->destroy_handler = lxpanel_x_event_connect(DestroyNotify, tc->window, None,
+                                                  trayclient_destroyed, tc);
 
-    redraw (tr);
+#ifdef HAVE_XDAMAGE
+    if (tr->x_event_handlers[3] != 0)
+    {
+        gdk_error_trap_push();
+        tc->damage = XDamageCreate(xevent->display, tc->window, XDamageReportNonEmpty);
+        if (gdk_error_trap_pop())
+            tc->damage = None;
+    }
+#endif
 }
 
-/* GDK event filter. */
-static GdkFilterReturn tray_event_filter(XEvent * xev, GdkEvent * event, TrayPlugin * tr)
+/* Handler for X events subscribed by the tray. */
+static GdkFilterReturn tray_event_filter(XEvent * xev, gpointer user_data)
 {
-    if (xev->type == DestroyNotify)
-    {
-        /* Look for DestroyNotify events on tray icon windows and update state.
-         * We do it this way rather than with a "plug_removed" event because delivery
-         * of plug_removed events is observed to be unreliable if the client
-         * disconnects within less than 10 ms. */
-        XDestroyWindowEvent * xev_destroy = (XDestroyWindowEvent *) xev;
-        TrayClient * tc = client_lookup(tr, xev_destroy->window);
-        if (tc != NULL)
-            client_delete(tr, tc, TRUE, TRUE);
-    }
+    TrayPlugin * tr = user_data;
 
-    else if (xev->type == ClientMessage)
+    if (xev->type == ClientMessage)
     {
         if (xev->xclient.message_type == a_NET_SYSTEM_TRAY_OPCODE)
         {
@@ -599,6 +679,21 @@ static void tray_unmanage_selection(TrayPlugin * tr)
     }
 }
 
+/* Create or destroy the StatusNotifierItem host according to settings.
+ * XEMBED clients are still served by the tray either way. */
+static void tray_set_sni(TrayPlugin * tr)
+{
+    if (tr->sni_enabled && tr->sni == NULL)
+    {
+        tr->sni = tray_sni_new(tr->panel, tr->plugin, panel_get_icon_size(tr->panel));
+    }
+    else if (!tr->sni_enabled && tr->sni != NULL)
+    {
+        tray_sni_free(tr->sni);
+        tr->sni = NULL;
+    }
+}
+
 /* Plugin constructor. */
 static GtkWidget *tray_constructor(LXPanel *panel, config_setting_t *settings)
 {
@@ -675,11 +770,23 @@ static GtkWidget *tray_constructor(LXPanel *panel, config_setting_t *settings)
     TrayPlugin * tr = g_new0(TrayPlugin, 1);
     tr->panel = panel;
     tr->selection_atom = gdk_selection_atom;
-    /* Add GDK event filter. */
-    gdk_window_add_filter(NULL, (GdkFilterFunc) tray_event_filter, tr);
     /* Reference the window since it is never added to a container. */
     tr->invisible = invisible;
     tr->invisible_window = GDK_WINDOW_XID(gtk_widget_get_window(invisible));
+    /* Subscribe to tray protocol messages and loss of the selection. */
+    tr->x_event_handlers[0] = lxpanel_x_event_connect(ClientMessage, None, a_NET_SYSTEM_TRAY_OPCODE,
+                                                      tray_event_filter, tr);
+    tr->x_event_handlers[1] = lxpanel_x_event_connect(ClientMessage, None, a_NET_SYSTEM_TRAY_MESSAGE_DATA,
+                                                      tray_event_filter, tr);
+    tr->x_event_handlers[2] = lxpanel_x_event_connect(SelectionClear, tr->invisible_window, None,
+                                                      tray_event_filter, tr);
+#ifdef HAVE_XDAMAGE
+    /* Damage events have no window in the common part, so match them by damage. */
+    int damage_event_base, damage_error_base;
+    if (XDamageQueryExtension(GDK_DISPLAY_XDISPLAY(display), &damage_event_base, &damage_error_base))
+        tr->x_event_handlers[3] = lxpanel_x_event_connect(damage_event_base + XDamageNotify, None, None,
+                                                          tray_damage_event, tr);
+#endif
 
     /* Allocate top level widget and set into Plugin widget pointer. */
     tr->plugin = p = panel_icon_grid_new(panel_get_orientation(panel),
@@ -690,11 +797,13 @@ static GtkWidget *tray_constructor(LXPanel *panel, config_setting_t *settings)
     gtk_widget_set_name(p, "tray");
     panel_icon_grid_set_aspect_width(PANEL_ICON_GRID(p), TRUE);
 
-#if GTK_CHECK_VERSION(3, 0, 0)
-    tr->redraw_called = 0;
-    g_signal_connect (p, "size-allocate", G_CALLBACK (on_size_alloc), tr);
-    g_idle_add (init_redraw, tr);
-#endif
+    /* Serve StatusNotifierItem clients unless disabled. */
+    tr->settings = settings;
+    tr->sni_enabled = 1;
+    int tmp_int;
+    if (config_setting_lookup_int(settings, "StatusNotifier", &tmp_int))
+        tr->sni_enabled = tmp_int != 0;
+    tray_set_sni(tr);
 
     return p;
 }
@@ -703,13 +812,19 @@ static GtkWidget *tray_constructor(LXPanel *panel, config_setting_t *settings)
 static void tray_destructor(gpointer user_data)
 {
     TrayPlugin * tr = user_data;
+    guint i;
 
-    /* Remove GDK event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) tray_event_filter, tr);
+    /* Remove X events subscriptions. */
+    for (i = 0; i < G_N_ELEMENTS(tr->x_event_handlers); i++)
+        lxpanel_x_event_disconnect(tr->x_event_handlers[i]);
 
     /* Make sure we drop the manager selection. */
     tray_unmanage_selection(tr);
 
+    /* Drop StatusNotifierItem host and its D-Bus names. */
+    if (tr->sni != NULL)
+        tray_sni_free(tr->sni);
+
     /* Deallocate incomplete messages. */
     while (tr->incomplete_messages != NULL)
     {
@@ -739,7 +854,34 @@ static void tray_panel_configuration_changed(LXPanel *panel, GtkWidget *p)
                                  panel_get_icon_size(panel),
                                  3, 0, panel_get_height(panel));
 
-    redraw (tr);
+    /* Background may be changed, icons which were moved are repainted on allocation. */
+    TrayClient * tc;
+    for (tc = tr->client_list; tc != NULL; tc = tc->client_flink)
+        client_force_redraw(tc);
+
+    if (tr->sni != NULL)
+        tray_sni_set_icon_size(tr->sni, panel_get_icon_size(panel));
+}
+
+/* Callback when the configuration dialog has recorded a change. */
+static gboolean tray_apply_configuration(gpointer user_data)
+{
+    GtkWidget * p = user_data;
+    TrayPlugin * tr = lxpanel_plugin_get_data(p);
+
+    config_group_set_int(tr->settings, "StatusNotifier", tr->sni_enabled);
+    tray_set_sni(tr);
+    return FALSE;
+}
+
+/* Callback when the configuration dialog is to be shown. */
+static GtkWidget *tray_configure(LXPanel *panel, GtkWidget *p)
+{
+    TrayPlugin * tr = lxpanel_plugin_get_data(p);
+    return lxpanel_generic_config_dlg(_("System Tray"), panel,
+        tray_apply_configuration, p,
+        _("Show StatusNotifierItem icons"), &tr->sni_enabled, CONF_TYPE_BOOL,
+        NULL);
 }
 
 /* Plugin descriptor. */
@@ -751,6 +893,7 @@ LXPanelPluginInit lxpanel_static_plugin_tray = {
     .one_per_system = TRUE,
 
     .new_instance = tray_constructor,
+    .config = tray_configure,
     .reconfigure = tray_panel_configuration_changed
 };
 
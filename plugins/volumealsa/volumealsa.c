@@ -87,6 +87,9 @@
 
 #define MAX_LINEAR_DB_SCALE 24
 
+#define VOLUME_WRITE_INTERVAL 16  /* ms, coalesce writes to one per frame */
+#define ASOUND_RESTART_DELAY 500  /* ms, let device nodes settle after hotplug */
+
 #ifdef DISABLE_ALSA
 typedef union
 {
@@ -112,6 +115,9 @@ typedef struct {
     gboolean show_popup;			/* Toggle to show and hide the popup on left click */
     guint volume_scale_handler;			/* Handler for vscale widget */
     guint mute_check_handler;			/* Handler for mute_check widget */
+    int pending_volume;				/* Volume to write to mixer, -1 if none */
+    guint set_volume_timer;			/* Timer to coalesce volume writes */
+    int tooltip_level;				/* Level shown in tooltip, -1 if none */
 
 #ifdef DISABLE_ALSA
     int mixer_fd;				/* The mixer FD */
@@ -122,14 +128,10 @@ typedef struct {
     /* ALSA interface. */
     snd_mixer_t * mixer;			/* The mixer */
     snd_mixer_elem_t * master_element;		/* The Master element */
-    guint mixer_evt_idle;			/* Timer to handle restarting poll */
+    GSource * mixer_source;			/* Source polling mixer descriptors */
     guint restart_idle;
     gint alsamixer_mapping;
-
-    /* unloading and error handling */
-    GIOChannel **channels;                      /* Channels that we listen to */
-    guint *watches;                             /* Watcher IDs for channels */
-    guint num_channels;                         /* Number of channels */
+    GFileMonitor * hotplug_monitor;		/* Watches /dev/snd for cards changes */
 
     gint used_device;
     char *master_channel;
@@ -160,6 +162,9 @@ static gboolean asound_restart(gpointer vol_gpointer);
 #endif
 static gboolean asound_initialize(VolumeALSAPlugin * vol);
 static void asound_deinitialize(VolumeALSAPlugin * vol);
+static gboolean asound_is_muted(VolumeALSAPlugin * vol);
+static int asound_get_volume(VolumeALSAPlugin * vol);
+static void volumealsa_update_current_icon(VolumeALSAPlugin * vol, gboolean mute, int level);
 static void volumealsa_update_display(VolumeALSAPlugin * vol);
 static void volumealsa_destructor(gpointer user_data);
 
@@ -187,36 +192,76 @@ static gboolean asound_find_element(VolumeALSAPlugin * vol, const char ** ename,
     return FALSE;
 }
 
-/* NOTE by PCMan:
- * This is magic! Since ALSA uses its own machanism to handle this part.
- * After polling of mixer fds, it requires that we should call
- * snd_mixer_handle_events to clear all pending mixer events.
- * However, when using the glib IO channels approach, we don't have
- * poll() and snd_mixer_poll_descriptors_revents(). Due to the design of
- * glib, on_mixer_event() will be called for every fd whose status was
- * changed. So, after each poll(), it's called for several times,
- * not just once. Therefore, we cannot call snd_mixer_handle_events()
- * directly in the event handler. Otherwise, it will get called for
- * several times, which might clear unprocessed pending events in the queue.
- * So, here we call it once in the event callback for the first fd.
- * Then, we don't call it for the following fds. After all fds with changed
- * status are handled, we remove this restriction in an idle handler.
- * The next time the event callback is involked for the first fs, we can
- * call snd_mixer_handle_events() again. Racing shouldn't happen here
- * because the idle handler has the same priority as the io channel callback.
- * So, io callbacks for future pending events should be in the next gmain
- * iteration, and won't be affected.
- */
+/* Mixer may use several descriptors but snd_mixer_handle_events() should be
+ * called only once after each poll() so all descriptors are attached to one
+ * source and ALSA gets them all at once in snd_mixer_poll_descriptors_revents()
+ * to find out what happened. */
+typedef struct {
+    GSource source;
+    snd_mixer_t * mixer;
+    struct pollfd * fds;			/* Descriptors as returned by ALSA */
+    GPollFD * pfds;				/* The same descriptors polled by GLib */
+    int n_fds;
+} AsoundMixerSource;
+
+typedef gboolean (*AsoundMixerFunc)(unsigned short revents, gpointer user_data);
 
-static gboolean asound_reset_mixer_evt_idle(VolumeALSAPlugin * vol)
+static gboolean asound_source_prepare(GSource * source, gint * timeout)
 {
-    if (!g_source_is_destroyed(g_main_current_source()))
-        vol->mixer_evt_idle = 0;
+    *timeout = -1;
+    return FALSE;
+}
+
+static gboolean asound_source_check(GSource * source)
+{
+    AsoundMixerSource * ms = (AsoundMixerSource *) source;
+    int i;
+
+    for (i = 0; i < ms->n_fds; i++)
+        if (ms->pfds[i].revents != 0)
+            return TRUE;
     return FALSE;
 }
 
-/* Handler for I/O event on ALSA channel. */
-static gboolean asound_mixer_event(GIOChannel * channel, GIOCondition cond, gpointer vol_gpointer)
+static gboolean asound_source_dispatch(GSource * source, GSourceFunc callback, gpointer user_data)
+{
+    AsoundMixerSource * ms = (AsoundMixerSource *) source;
+    unsigned short revents = 0;
+    int i;
+
+    for (i = 0; i < ms->n_fds; i++)
+    {
+        ms->fds[i].revents = ms->pfds[i].revents;
+        ms->pfds[i].revents = 0;
+    }
+    if (snd_mixer_poll_descriptors_revents(ms->mixer, ms->fds, ms->n_fds, &revents) < 0)
+        revents = POLLERR;
+    return ((AsoundMixerFunc) callback)(revents, user_data);
+}
+
+static void asound_source_finalize(GSource * source)
+{
+    AsoundMixerSource * ms = (AsoundMixerSource *) source;
+
+    g_free(ms->fds);
+    g_free(ms->pfds);
+}
+
+static GSourceFuncs asound_source_funcs = {
+    asound_source_prepare,
+    asound_source_check,
+    asound_source_dispatch,
+    asound_source_finalize
+};
+
+static void asound_schedule_restart(VolumeALSAPlugin * vol)
+{
+    if (vol->restart_idle == 0)
+        vol->restart_idle = g_timeout_add(ASOUND_RESTART_DELAY, asound_restart, vol);
+}
+
+/* Handler for events on ALSA mixer descriptors. */
+static gboolean asound_mixer_event(unsigned short revents, gpointer vol_gpointer)
 {
     VolumeALSAPlugin * vol = (VolumeALSAPlugin *) vol_gpointer;
     int res = 0;
@@ -224,31 +269,25 @@ static gboolean asound_mixer_event(GIOChannel * channel, GIOCondition cond, gpoi
     if (g_source_is_destroyed(g_main_current_source()))
         return FALSE;
 
-    if (vol->mixer_evt_idle == 0)
+    if (revents & POLLIN)
     {
-        vol->mixer_evt_idle = g_idle_add_full(G_PRIORITY_DEFAULT, (GSourceFunc) asound_reset_mixer_evt_idle, vol, NULL);
         res = snd_mixer_handle_events(vol->mixer);
-    }
-
-    if (cond & G_IO_IN)
-    {
         /* the status of mixer is changed. update of display is needed. */
-        volumealsa_update_display(vol);
+        if (res >= 0)
+            volumealsa_update_display(vol);
     }
 
-    if ((cond & G_IO_HUP) || (res < 0))
+    if ((revents & (POLLERR | POLLHUP | POLLNVAL)) || (res < 0))
     {
         /* This means there're some problems with alsa. */
         g_warning("volumealsa: ALSA (or pulseaudio) had a problem: "
                 "volumealsa: snd_mixer_handle_events() = %d,"
-                " cond 0x%x (IN: 0x%x, HUP: 0x%x).", res, cond,
-                G_IO_IN, G_IO_HUP);
+                " revents 0x%x.", res, revents);
         gtk_widget_set_tooltip_text(vol->plugin, _("ALSA (or pulseaudio) had a problem."
                 " Please check the lxpanel logs."));
+        vol->tooltip_level = -1;
 
-        if (vol->restart_idle == 0)
-            vol->restart_idle = g_timeout_add_seconds(1, asound_restart, vol);
-
+        asound_schedule_restart(vol);
         return FALSE;
     }
 
@@ -266,14 +305,36 @@ static gboolean asound_restart(gpointer vol_gpointer)
 
     if (!asound_initialize(vol)) {
         g_warning("volumealsa: Re-initialization failed.");
-        return TRUE; // try again in a second
+        /* without hotplug notifications the only way is to try again */
+        if (vol->hotplug_monitor == NULL)
+            return TRUE; // try again in a bit
+        /* otherwise wait until some card is plugged in */
+        vol->restart_idle = 0;
+        return FALSE;
     }
 
     g_warning("volumealsa: Restarted ALSA interface...");
 
     vol->restart_idle = 0;
+    volumealsa_update_display(vol);
+    volumealsa_update_current_icon(vol, asound_is_muted(vol), asound_get_volume(vol));
     return FALSE;
 }
+
+/* Handler for changes in /dev/snd: rebind when a card is plugged or removed. */
+static void asound_hotplug_event(GFileMonitor * monitor, GFile * file, GFile * other,
+                                 GFileMonitorEvent evt, VolumeALSAPlugin * vol)
+{
+    char * name;
+
+    if (evt != G_FILE_MONITOR_EVENT_CREATED && evt != G_FILE_MONITOR_EVENT_DELETED)
+        return;
+    name = g_file_get_basename(file);
+    /* every card has exactly one control device, ignore the rest */
+    if (g_str_has_prefix(name, "controlC"))
+        asound_schedule_restart(vol);
+    g_free(name);
+}
 #endif
 
 /* Initialize the ALSA interface. */
@@ -338,21 +399,24 @@ static gboolean asound_initialize(VolumeALSAPlugin * vol)
 
     /* Listen to events from ALSA. */
     int n_fds = snd_mixer_poll_descriptors_count(vol->mixer);
-    struct pollfd * fds = g_new0(struct pollfd, n_fds);
-
-    vol->channels = g_new0(GIOChannel *, n_fds);
-    vol->watches = g_new0(guint, n_fds);
-    vol->num_channels = n_fds;
-
-    snd_mixer_poll_descriptors(vol->mixer, fds, n_fds);
+    AsoundMixerSource * ms;
     int i;
+
+    vol->mixer_source = g_source_new(&asound_source_funcs, sizeof(AsoundMixerSource));
+    ms = (AsoundMixerSource *) vol->mixer_source;
+    ms->mixer = vol->mixer;
+    ms->n_fds = n_fds;
+    ms->fds = g_new0(struct pollfd, n_fds);
+    ms->pfds = g_new0(GPollFD, n_fds);
+    snd_mixer_poll_descriptors(vol->mixer, ms->fds, n_fds);
     for (i = 0; i < n_fds; ++i)
     {
-        GIOChannel* channel = g_io_channel_unix_new(fds[i].fd);
-        vol->watches[i] = g_io_add_watch(channel, G_IO_IN | G_IO_HUP, asound_mixer_event, vol);
-        vol->channels[i] = channel;
+        ms->pfds[i].fd = ms->fds[i].fd;
+        ms->pfds[i].events = ms->fds[i].events | G_IO_HUP | G_IO_ERR;
+        g_source_add_poll(vol->mixer_source, &ms->pfds[i]);
     }
-    g_free(fds);
+    g_source_set_callback(vol->mixer_source, (GSourceFunc) asound_mixer_event, vol, NULL);
+    g_source_attach(vol->mixer_source, NULL);
 #endif
     return TRUE;
 }
@@ -364,23 +428,11 @@ static void asound_deinitialize(VolumeALSAPlugin * vol)
         close(vol->mixer_fd);
     vol->mixer_fd = -1;
 #else
-    guint i;
-
-    if (vol->mixer_evt_idle != 0) {
-        g_source_remove(vol->mixer_evt_idle);
-        vol->mixer_evt_idle = 0;
-    }
-
-    for (i = 0; i < vol->num_channels; i++) {
-        g_source_remove(vol->watches[i]);
-        g_io_channel_shutdown(vol->channels[i], FALSE, NULL);
-        g_io_channel_unref(vol->channels[i]);
+    if (vol->mixer_source != NULL) {
+        g_source_destroy(vol->mixer_source);
+        g_source_unref(vol->mixer_source);
+        vol->mixer_source = NULL;
     }
-    g_free(vol->channels);
-    g_free(vol->watches);
-    vol->channels = NULL;
-    vol->watches = NULL;
-    vol->num_channels = 0;
 
     if (vol->mixer)
         snd_mixer_close(vol->mixer);
@@ -604,16 +656,25 @@ static void volumealsa_lookup_current_icon(VolumeALSAPlugin * vol, gboolean mute
 
 static void volumealsa_update_current_icon(VolumeALSAPlugin * vol, gboolean mute, int level)
 {
+    const char * old_icon = vol->icon_panel;
+
     /* Find suitable icon */
     volumealsa_lookup_current_icon(vol, mute, level);
 
-    /* Change icon, fallback to default icon if theme doesn't exsit */
-    lxpanel_image_change_icon(vol->tray_icon, vol->icon_panel, vol->icon_fallback);
+    /* Change icon, fallback to default icon if theme doesn't exsit.
+     * The image follows theme changes itself so reload it only when the
+     * state is changed; pixbufs for every state stay in the icons cache. */
+    if (g_strcmp0(vol->icon_panel, old_icon) != 0)
+        lxpanel_image_change_icon(vol->tray_icon, vol->icon_panel, vol->icon_fallback);
 
     /* Display current level in tooltip. */
-    char * tooltip = g_strdup_printf("%s %d", _("Volume control"), level);
-    gtk_widget_set_tooltip_text(vol->plugin, tooltip);
-    g_free(tooltip);
+    if (level != vol->tooltip_level)
+    {
+        char * tooltip = g_strdup_printf("%s %d", _("Volume control"), level);
+        gtk_widget_set_tooltip_text(vol->plugin, tooltip);
+        g_free(tooltip);
+        vol->tooltip_level = level;
+    }
 }
 
 /*
@@ -626,8 +687,8 @@ static void volumealsa_update_display(VolumeALSAPlugin * vol)
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(vol->mute_check), asound_is_muted(vol));
     gtk_widget_set_sensitive(vol->mute_check, (asound_has_mute(vol)));
 
-    /* Volume. */
-    if (vol->volume_scale != NULL)
+    /* Volume. Don't let mixer events revert change which is not written yet. */
+    if (vol->volume_scale != NULL && vol->set_volume_timer == 0)
     {
         gtk_range_set_value(GTK_RANGE(vol->volume_scale), asound_get_volume(vol));
     }
@@ -770,21 +831,40 @@ static void volumealsa_popup_map(GtkWidget * widget, VolumeALSAPlugin * vol)
     lxpanel_plugin_adjust_popup_position(widget, vol->plugin);
 }
 
-/* Handler for "value_changed" signal on popup window vertical scale. */
-static void volumealsa_popup_scale_changed(GtkRange * range, VolumeALSAPlugin * vol)
+/* Write the last requested volume to the sound system. */
+static gboolean volumealsa_flush_volume(gpointer user_data)
 {
-    int level = gtk_range_get_value(GTK_RANGE(vol->volume_scale));
-    gboolean mute = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(vol->mute_check));
+    VolumeALSAPlugin * vol = (VolumeALSAPlugin *) user_data;
+    gboolean mute;
+
+    if (g_source_is_destroyed(g_main_current_source()))
+        return FALSE;
+    vol->set_volume_timer = 0;
+    if (vol->pending_volume < 0)
+        return FALSE;
 
     /* Reflect the value of the control to the sound system. */
-    asound_set_volume(vol, level);
+    asound_set_volume(vol, vol->pending_volume);
 
     /*
      * Redraw the controls.
      * Scale and check button do not need to be updated, as these are always
      * in sync with user's actions.
      */
-    volumealsa_update_current_icon(vol, mute, level);
+    mute = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(vol->mute_check));
+    volumealsa_update_current_icon(vol, mute, vol->pending_volume);
+    vol->pending_volume = -1;
+    return FALSE;
+}
+
+/* Handler for "value_changed" signal on popup window vertical scale. */
+static void volumealsa_popup_scale_changed(GtkRange * range, VolumeALSAPlugin * vol)
+{
+    /* Fast scrolling or key repeat changes value many times per frame,
+     * so remember the value and write only the last one. */
+    vol->pending_volume = gtk_range_get_value(GTK_RANGE(vol->volume_scale));
+    if (vol->set_volume_timer == 0)
+        vol->set_volume_timer = g_timeout_add(VOLUME_WRITE_INTERVAL, volumealsa_flush_volume, vol);
 }
 
 /* Handler for "scroll-event" signal on popup window vertical scale. */
@@ -935,6 +1015,12 @@ static GtkWidget *volumealsa_constructor(LXPanel *panel, config_setting_t *setti
     VolumeALSAPlugin * vol = g_new0(VolumeALSAPlugin, 1);
     GtkWidget *p;
     const char *tmp_str;
+#ifndef DISABLE_ALSA
+    GFile *dev_snd;
+#endif
+
+    vol->pending_volume = -1;
+    vol->tooltip_level = -1;
 
 #ifndef DISABLE_ALSA
     /* Read config necessary for proper initialization of ALSA. */
@@ -977,6 +1063,15 @@ static GtkWidget *volumealsa_constructor(LXPanel *panel, config_setting_t *setti
         return NULL;
     }
 
+#ifndef DISABLE_ALSA
+    /* Rebind when sound cards are plugged in or removed. */
+    dev_snd = g_file_new_for_path("/dev/snd");
+    vol->hotplug_monitor = g_file_monitor_directory(dev_snd, G_FILE_MONITOR_NONE, NULL, NULL);
+    g_object_unref(dev_snd);
+    if (vol->hotplug_monitor != NULL)
+        g_signal_connect(vol->hotplug_monitor, "changed", G_CALLBACK(asound_hotplug_event), vol);
+#endif
+
     /* Allocate top level widget and set into Plugin widget pointer. */
     vol->panel = panel;
     vol->plugin = p = gtk_event_box_new();
@@ -1012,6 +1107,23 @@ static void volumealsa_destructor(gpointer user_data)
     lxpanel_apply_hotkey(&vol->hotkey_down, NULL, NULL, NULL, FALSE);
     lxpanel_apply_hotkey(&vol->hotkey_mute, NULL, NULL, NULL, FALSE);
 
+    /* Don't lose the last change. */
+    if (vol->set_volume_timer)
+    {
+        g_source_remove(vol->set_volume_timer);
+        if (vol->pending_volume >= 0)
+            asound_set_volume(vol, vol->pending_volume);
+    }
+
+#ifndef DISABLE_ALSA
+    if (vol->hotplug_monitor)
+    {
+        g_signal_handlers_disconnect_by_func(vol->hotplug_monitor, asound_hotplug_event, vol);
+        g_file_monitor_cancel(vol->hotplug_monitor);
+        g_object_unref(vol->hotplug_monitor);
+    }
+#endif
+
     asound_deinitialize(vol);
 
     /* If the dialog box is open, dismiss it. */
@@ -1084,8 +1196,7 @@ static void card_selector_changed(GtkComboBox *card_selector, VolumeALSAPlugin *
             vol->used_device = old_card;
             //FIXME: reset the selector back
             /* schedule to restart with old settings */
-            if (vol->restart_idle == 0)
-                vol->restart_idle = g_timeout_add_seconds(1, asound_restart, vol);
+            asound_schedule_restart(vol);
             return;
         }
         g_free(old_channel);
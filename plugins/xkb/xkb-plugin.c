@@ -110,6 +110,53 @@ static int xkb_get_flag_size(XkbPlugin *p_xkb)
     return size;
 }
 
+/* Build path to the flag image of the layout in the flags directory in use. */
+static gchar *xkb_get_flag_filepath(XkbPlugin *p_xkb, const gchar *layout)
+{
+    const gchar *flags_dir = (p_xkb->cust_dir_exists && (p_xkb->display_type == DISP_TYPE_IMAGE_CUST)) ? FLAGSCUSTDIR : FLAGSDIR;
+    gchar *layout_mod = g_strdelimit(g_strdup(layout), "/", '-');
+    gchar *flag_filepath = g_strdup_printf(flag_filepath_generator, flags_dir, layout_mod);
+    g_free(layout_mod);
+    return flag_filepath;
+}
+
+/* Forget flags loaded for the groups, they will be reloaded on next redraw. */
+void xkb_flags_invalidate(XkbPlugin *p_xkb)
+{
+    int i;
+    for (i = 0; i < XkbNumKbdGroups; i++)
+    {
+        if (p_xkb->flags[i] != NULL)
+        {
+            g_object_unref(p_xkb->flags[i]);
+            p_xkb->flags[i] = NULL;
+        }
+    }
+    p_xkb->flags_size = 0;
+}
+
+/* Load flags for all groups scaled to the size so switching the layout
+ * doesn't require any disk access. */
+static void xkb_flags_load(XkbPlugin *p_xkb, int size)
+{
+    int i;
+    xkb_flags_invalidate(p_xkb);
+    for (i = 0; i < xkb_get_group_count(p_xkb) && i < XkbNumKbdGroups; i++)
+    {
+        const char *symbol_name = xkb_get_symbol_name_by_res_no(p_xkb, i);
+        if (symbol_name == NULL)
+            continue;
+        gchar *symbol_name_lowercase = g_utf8_strdown(symbol_name, -1);
+        gchar *flag_filepath = xkb_get_flag_filepath(p_xkb, symbol_name_lowercase);
+        /* flag is scaled to the height keeping aspect ratio */
+        p_xkb->flags[i] = lxpanel_icon_cache_get_for_name(flag_filepath, size, 1, NULL);
+        g_free(flag_filepath);
+        g_free(symbol_name_lowercase);
+    }
+    p_xkb->flags_size = size;
+    p_xkb->flags_display_type = p_xkb->display_type;
+}
+
 /* Redraw the graphics. */
 void xkb_redraw(XkbPlugin *p_xkb)
 {
@@ -118,44 +165,17 @@ void xkb_redraw(XkbPlugin *p_xkb)
     int  size = xkb_get_flag_size(p_xkb);
     if( (p_xkb->display_type == DISP_TYPE_IMAGE) || (p_xkb->display_type == DISP_TYPE_IMAGE_CUST) )
     {
-        char * group_name = (char *)xkb_get_current_symbol_name_lowercase(p_xkb);
-        if(group_name != NULL)
+        int group = xkb_get_current_group_xkb_no(p_xkb);
+        if ((p_xkb->flags_size != size) || (p_xkb->flags_display_type != p_xkb->display_type))
+            xkb_flags_load(p_xkb, size);
+        if ((group >= 0) && (group < XkbNumKbdGroups) && (p_xkb->flags[group] != NULL))
         {
-            gchar *flag_filepath = NULL;
-            gchar *flags_dir = (p_xkb->cust_dir_exists && (p_xkb->display_type == DISP_TYPE_IMAGE_CUST)) ? g_strdup(FLAGSCUSTDIR):g_strdup(FLAGSDIR);
-            if(strchr(group_name, '/') != NULL)
-            {
-                gchar *layout_mod = g_strdup(group_name);
-                layout_mod = g_strdelimit(layout_mod, "/", '-');
-                flag_filepath = g_strdup_printf(flag_filepath_generator, flags_dir, layout_mod);
-                g_free(layout_mod);
-            }
-            else
-            {
-                flag_filepath = g_strdup_printf(flag_filepath_generator, flags_dir, group_name);
-            }
-            GdkPixbuf * unscaled_pixbuf = gdk_pixbuf_new_from_file(flag_filepath, NULL);
-            g_free(flag_filepath);
-            g_free(flags_dir);
-            g_free(group_name);
-
-            if(unscaled_pixbuf != NULL)
-            {
-                /* Loaded successfully. */
-                int width = gdk_pixbuf_get_width(unscaled_pixbuf);
-                int height = gdk_pixbuf_get_height(unscaled_pixbuf);
-                GdkPixbuf * pixbuf = gdk_pixbuf_scale_simple(unscaled_pixbuf, size * width / height, size, GDK_INTERP_BILINEAR);
-                if(pixbuf != NULL)
-                {
-                    gtk_image_set_from_pixbuf(GTK_IMAGE(p_xkb->p_image), pixbuf);
-                    g_object_unref(G_OBJECT(pixbuf));
-                    gtk_widget_hide(p_xkb->p_label);
-                    gtk_widget_show(p_xkb->p_image);
-                    gtk_widget_set_tooltip_text(p_xkb->p_plugin, xkb_get_current_group_name(p_xkb));
-                    valid_image = TRUE;
-                }
-                g_object_unref(unscaled_pixbuf);
-            }
+            /* Loaded successfully. */
+            gtk_image_set_from_pixbuf(GTK_IMAGE(p_xkb->p_image), p_xkb->flags[group]);
+            gtk_widget_hide(p_xkb->p_label);
+            gtk_widget_show(p_xkb->p_image);
+            gtk_widget_set_tooltip_text(p_xkb->p_plugin, xkb_get_current_group_name(p_xkb));
+            valid_image = TRUE;
         }
     }
 
@@ -322,6 +342,7 @@ static GtkWidget *xkb_constructor(LXPanel *panel, config_setting_t *settings)
     /* Connect signals. */
     g_signal_connect(p, "scroll-event", G_CALLBACK(on_xkb_button_scroll_event), p_xkb);
     g_signal_connect(G_OBJECT(fbev), "active-window", G_CALLBACK(on_xkb_fbev_active_window_event), p_xkb);
+    g_signal_connect_swapped(gtk_icon_theme_get_default(), "changed", G_CALLBACK(xkb_flags_invalidate), p_xkb);
 
     /* Show the widget and return. */
     xkb_redraw(p_xkb);
@@ -335,6 +356,7 @@ static void xkb_destructor(gpointer user_data)
 
     /* Disconnect root window event handler. */
     g_signal_handlers_disconnect_by_func(G_OBJECT(fbev), on_xkb_fbev_active_window_event, p_xkb);
+    g_signal_handlers_disconnect_by_func(gtk_icon_theme_get_default(), xkb_flags_invalidate, p_xkb);
 
     /* Disconnect from the XKB mechanism. */
     xkb_mechanism_destructor(p_xkb);
@@ -345,6 +367,7 @@ static void xkb_destructor(gpointer user_data)
     g_free(p_xkb->kbd_variants);
     g_free(p_xkb->kbd_change_option);
     g_free(p_xkb->kbd_advanced_options);
+    xkb_flags_invalidate(p_xkb);
     g_free(p_xkb);
 }
 
@@ -978,19 +1001,7 @@ static void on_button_add_layout_clicked(GtkButton *p_button, gpointer *p_data)
             p_layout_desc = g_key_file_get_string(p_keyfile, "LAYOUTS", keys_layouts[layout_idx], NULL);
             if(strchr(keys_layouts[layout_idx], '(') == NULL)
             {
-                gchar *flag_filepath = NULL;
-                gchar *flags_dir = (p_xkb->cust_dir_exists && (p_xkb->display_type == DISP_TYPE_IMAGE_CUST)) ? g_strdup(FLAGSCUSTDIR):g_strdup(FLAGSDIR);
-                if(strchr(keys_layouts[layout_idx], '/') != NULL)
-                {
-                    gchar *layout_mod = g_strdup(keys_layouts[layout_idx]);
-                    layout_mod = g_strdelimit(layout_mod, "/", '-');
-                    flag_filepath = g_strdup_printf(flag_filepath_generator, flags_dir, layout_mod);
-                    g_free(layout_mod);
-                }
-                else
-                {
-                    flag_filepath = g_strdup_printf(flag_filepath_generator, flags_dir, keys_layouts[layout_idx]);
-                }
+                gchar *flag_filepath = xkb_get_flag_filepath(p_xkb, keys_layouts[layout_idx]);
                 GdkPixbuf *p_pixbuf = gdk_pixbuf_new_from_file_at_size(flag_filepath, -1, 16, NULL);
                 gtk_tree_store_append(p_treestore_add_layout, &tree_top, NULL);
                 if(p_pixbuf != NULL)
@@ -1010,7 +1021,6 @@ static void on_button_add_layout_clicked(GtkButton *p_button, gpointer *p_data)
                                         -1);
                 }
                 g_free(flag_filepath);
-                g_free(flags_dir);
             }
             else
             {
@@ -1185,19 +1195,7 @@ static void xkb_add_layout(XkbPlugin *p_xkb, gchar *layout, gchar*variant)
 {
     GtkTreeIter  tree_iter;
     gtk_list_store_append(p_xkb->p_liststore_layout, &tree_iter);
-    gchar *flag_filepath = NULL;
-    gchar *flags_dir = (p_xkb->cust_dir_exists && (p_xkb->display_type == DISP_TYPE_IMAGE_CUST)) ? g_strdup(FLAGSCUSTDIR):g_strdup(FLAGSDIR);
-    if(strchr(layout, '/') != NULL)
-    {
-        gchar *layout_mod = g_strdup(layout);
-        layout_mod = g_strdelimit(layout_mod, "/", '-');
-        flag_filepath = g_strdup_printf(flag_filepath_generator, flags_dir, layout_mod);
-        g_free(layout_mod);
-    }
-    else
-    {
-        flag_filepath = g_strdup_printf(flag_filepath_generator, flags_dir, layout);
-    }
+    gchar *flag_filepath = xkb_get_flag_filepath(p_xkb, layout);
     GdkPixbuf *p_pixbuf = gdk_pixbuf_new_from_file_at_size(flag_filepath, -1, 20, NULL);
     if(p_pixbuf != NULL)
     {
@@ -1216,7 +1214,6 @@ static void xkb_add_layout(XkbPlugin *p_xkb, gchar *layout, gchar*variant)
                            -1);
     }
     g_free(flag_filepath);
-    g_free(flags_dir);
 }
 
 static void xkb_settings_fill_layout_tree_model_with_config(XkbPlugin *p_xkb)
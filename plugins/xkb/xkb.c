@@ -52,7 +52,7 @@ typedef enum
 static void             xkb_enter_locale_by_process(XkbPlugin * xkb);
 static void             refresh_group_xkb(XkbPlugin * xkb);
 static int              initialize_keyboard_description(XkbPlugin * xkb);
-static GdkFilterReturn  xkb_event_filter(GdkXEvent * xevent, GdkEvent * event, XkbPlugin * xkb);
+static GdkFilterReturn  xkb_event_filter(XEvent * ev, gpointer user_data);
 
 static t_new_kbd_notify_ignore  xkb_new_kbd_notify_ignore = NEW_KBD_STATE_NOTIFY_IGNORE_NO;
 
@@ -254,6 +254,9 @@ static int initialize_keyboard_description(XkbPlugin * xkb)
             xkb->symbol_names[i] = g_strdup("None");
     }
 
+    /* Flags loaded for previous groups are no longer valid */
+    xkb_flags_invalidate(xkb);
+
     /* Create or recreate hash table */
     if (xkb->p_hash_table_group != NULL)
         g_hash_table_destroy(xkb->p_hash_table_group);
@@ -262,10 +265,10 @@ static int initialize_keyboard_description(XkbPlugin * xkb)
     return TRUE;
 }
 
-/* GDK event filter that receives events from all windows and the Xkb extension. */
-static GdkFilterReturn xkb_event_filter(GdkXEvent * xevent, GdkEvent * event, XkbPlugin * xkb)
+/* Handler that receives events from the Xkb extension. */
+static GdkFilterReturn xkb_event_filter(XEvent * ev, gpointer user_data)
 {
-    XEvent * ev = (XEvent *) xevent;
+    XkbPlugin * xkb = user_data;
 
     if (ev->xany.type == xkb->base_event_code + XkbEventCode)
     {
@@ -322,8 +325,9 @@ void xkb_mechanism_constructor(XkbPlugin * xkb)
         /* Read the keyboard description. */
         initialize_keyboard_description(xkb);
 
-        /* Establish GDK event filter. */
-        gdk_window_add_filter(NULL, (GdkFilterFunc) xkb_event_filter, (gpointer) xkb);
+        /* Subscribe to Xkb events. */
+        xkb->xkb_event_handler = lxpanel_x_event_connect(xkb->base_event_code + XkbEventCode,
+                                                         None, None, xkb_event_filter, xkb);
 
         /* Specify events we will receive. */
         XkbSelectEvents(xdisplay, XkbUseCoreKbd, XkbNewKeyboardNotifyMask, XkbNewKeyboardNotifyMask);
@@ -337,8 +341,9 @@ void xkb_mechanism_constructor(XkbPlugin * xkb)
 /* Deallocate resources associated with Xkb interface. */
 void xkb_mechanism_destructor(XkbPlugin * xkb)
 {
-    /* Remove event filter. */
-    gdk_window_remove_filter(NULL, (GdkFilterFunc) xkb_event_filter, xkb);
+    /* Remove events subscription. */
+    lxpanel_x_event_disconnect(xkb->xkb_event_handler);
+    xkb->xkb_event_handler = 0;
 
     /* Free group and symbol name memory. */
     int i;
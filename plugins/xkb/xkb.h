@@ -58,6 +58,7 @@ typedef struct {
     /* Mechanism. */
     int       base_event_code;                /* Result of initializing Xkb extension */
     int       base_error_code;
+    guint     xkb_event_handler;              /* Subscription to Xkb events */
     int       current_group_xkb_no;           /* Current layout */
     int       group_count;                    /* Count of groups as returned by Xkb */
     char     *group_names[XkbNumKbdGroups];   /* Group names as returned by Xkb */
@@ -75,6 +76,9 @@ typedef struct {
     gint      flag_size;
     int       num_layouts;
     gboolean  cust_dir_exists;
+    GdkPixbuf *flags[XkbNumKbdGroups];        /* Flags scaled for every group */
+    int       flags_size;                     /* Size flags were loaded for, 0 if not loaded */
+    int       flags_display_type;             /* Display type flags were loaded for */
 
 } XkbPlugin;
 
@@ -83,6 +87,7 @@ typedef struct {
 
 extern void xkb_redraw(XkbPlugin * xkb);
 extern void xkb_setxkbmap(XkbPlugin *p_xkb);
+extern void xkb_flags_invalidate(XkbPlugin *p_xkb);
 
 extern int xkb_get_current_group_xkb_no(XkbPlugin * xkb);
 extern int xkb_get_group_count(XkbPlugin * xkb);
@@ -827,6 +827,7 @@ static void on_add_plugin( GtkButton* btn, GtkTreeView* _view )
     LXPanel* p = (LXPanel*) g_object_get_data( G_OBJECT(_view), "panel" );
 #endif
 
+    _lxpanel_load_all_modules();
     classes = lxpanel_get_all_types();
 
     parent_win = gtk_widget_get_toplevel( GTK_WIDGET(_view) );
@@ -1899,6 +1900,7 @@ GtkWidget* create_generic_config_dlg( const char* title, GtkWidget* parent,
 }
 
 #define COMMAND_GROUP "Command"
+#define PANEL_GROUP "Panel"
 
 void load_global_config()
 {
@@ -1936,6 +1938,9 @@ void load_global_config()
         GList *apps, *l;
 
         logout_cmd = g_key_file_get_string( kf, COMMAND_GROUP, "Logout", NULL );
+        if (g_key_file_has_key(kf, PANEL_GROUP, "ParkMemoryLimit", NULL))
+            panel_park_memory_limit = g_key_file_get_integer(kf, PANEL_GROUP,
+                                                             "ParkMemoryLimit", NULL);
         /* check for terminal setting on upgrade */
         if (fm_config->terminal == NULL)
         {
@@ -1986,6 +1991,8 @@ static void save_global_config()
         fprintf( f, "[" COMMAND_GROUP "]\n");
         if( logout_cmd )
             fprintf( f, "Logout=%s\n", logout_cmd );
+        if (panel_park_memory_limit != PANEL_PARK_MEMORY_DEFAULT)
+            fprintf(f, "\n[" PANEL_GROUP "]\nParkMemoryLimit=%d\n", panel_park_memory_limit);
         fclose( f );
     }
     g_free(file);
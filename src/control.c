@@ -0,0 +1,518 @@
+/*
+ * Control socket for lxpanelctl.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* The protocol is described in lxpanelctl.h. All I/O is done asynchronously
+   from the main loop, so a slow client never blocks the panel. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+
+#include "private.h"
+
+/* Pending output above this size means the client does not read events. */
+#define CONTROL_MAX_PENDING     (4 * LXPANEL_CTL_MAX_FRAME)
+/* Seconds to wait for a client on exit before dropping it. */
+#define CONTROL_FLUSH_TIMEOUT   1
+
+typedef struct {
+    int ref;
+    GSocketConnection * conn;
+    GCancellable * cancellable;         /* Cancels I/O when client is dropped */
+    GByteArray * input;                 /* Received data not parsed yet */
+    GByteArray * output;                /* Frames waiting to be written */
+    GByteArray * sending;               /* Data being written now, or NULL */
+    gboolean subscribed;                /* Client receives events */
+    gboolean eof;                       /* Client will send nothing more */
+    gboolean closed;
+    guchar buffer[16384];               /* Read buffer */
+} ControlClient;
+
+static GSocketService *service = NULL;
+static char *socket_path = NULL;
+static GSList *clients = NULL;
+static LXPanelControlFunc control_func = NULL;
+
+static const struct {
+    const char *name;
+    int cmd;
+} control_commands[] = {
+    { "menu", LXPANEL_CMD_SYS_MENU },
+    { "run", LXPANEL_CMD_RUN },
+    { "config", LXPANEL_CMD_CONFIG },
+    { "restart", LXPANEL_CMD_RESTART },
+    { "exit", LXPANEL_CMD_EXIT },
+    { "command", LXPANEL_CMD_COMMAND },
+    { "refresh", LXPANEL_CMD_REFRESH },
+    { "move", LXPANEL_CMD_MOVE },
+    { "notify", LXPANEL_CMD_NOTIFY }
+};
+
+static ControlClient *client_ref(ControlClient *cl)
+{
+    cl->ref++;
+    return cl;
+}
+
+static void client_unref(ControlClient *cl)
+{
+    if (--cl->ref > 0)
+        return;
+    g_io_stream_close(G_IO_STREAM(cl->conn), NULL, NULL);
+    g_object_unref(cl->conn);
+    g_object_unref(cl->cancellable);
+    g_byte_array_free(cl->input, TRUE);
+    g_byte_array_free(cl->output, TRUE);
+    if (cl->sending)
+        g_byte_array_free(cl->sending, TRUE);
+    g_slice_free(ControlClient, cl);
+}
+
+/* Drop the client; it is freed after pending operations are finished. */
+static void client_close(ControlClient *cl)
+{
+    if (cl->closed)
+        return;
+    cl->closed = TRUE;
+    clients = g_slist_remove(clients, cl);
+    g_cancellable_cancel(cl->cancellable);
+    client_unref(cl);
+}
+
+/* Client which closed its side is dropped after it got all replies. */
+static void client_close_if_done(ControlClient *cl)
+{
+    if (cl->eof && cl->sending == NULL && cl->output->len == 0)
+        client_close(cl);
+}
+
+static void client_write_ready(GObject *source, GAsyncResult *res, gpointer user_data);
+
+static void client_write_sending(ControlClient *cl)
+{
+    g_output_stream_write_async(g_io_stream_get_output_stream(G_IO_STREAM(cl->conn)),
+                                cl->sending->data, cl->sending->len,
+                                G_PRIORITY_DEFAULT, cl->cancellable,
+                                client_write_ready, client_ref(cl));
+}
+
+static void client_start_write(ControlClient *cl)
+{
+    /* if a write is in progress then its callback will continue */
+    if (cl->closed || cl->sending != NULL || cl->output->len == 0)
+        return;
+    /* take all queued data, new frames are queued while it is written */
+    cl->sending = cl->output;
+    cl->output = g_byte_array_new();
+    client_write_sending(cl);
+}
+
+static void client_write_ready(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    ControlClient *cl = user_data;
+    GError *err = NULL;
+    gssize n = g_output_stream_write_finish(G_OUTPUT_STREAM(source), res, &err);
+
+    if (n < 0)
+    {
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_debug("control: write failed: %s", err->message);
+        g_error_free(err);
+        client_close(cl);
+    }
+    else if (!cl->closed)
+    {
+        g_byte_array_remove_range(cl->sending, 0, n);
+        if (cl->sending->len > 0)
+            client_write_sending(cl);
+        else
+        {
+            g_byte_array_free(cl->sending, TRUE);
+            cl->sending = NULL;
+            client_start_write(cl);
+            client_close_if_done(cl);
+        }
+    }
+    client_unref(cl);
+}
+
+/* Queue a frame made of n fields. */
+static void client_send_fields(ControlClient *cl, const char * const *fields, guint n)
+{
+    guint start = cl->output->len;
+    guint32 len;
+    guint i;
+
+    if (cl->closed)
+        return;
+    g_byte_array_set_size(cl->output, start + 4);
+    for (i = 0; i < n; i++)
+        g_byte_array_append(cl->output, (const guint8 *)fields[i], strlen(fields[i]) + 1);
+    len = GUINT32_TO_BE(cl->output->len - start - 4);
+    memcpy(&cl->output->data[start], &len, 4);
+    if (cl->output->len > CONTROL_MAX_PENDING)
+    {
+        g_warning("control: client does not read replies, dropping it");
+        client_close(cl);
+        return;
+    }
+    client_start_write(cl);
+}
+
+static void client_reply(ControlClient *cl, const char *error)
+{
+    const char *fields[2] = { "error", error };
+
+    if (error == NULL)
+        fields[0] = "ok";
+    client_send_fields(cl, fields, error ? 2 : 1);
+}
+
+/* Send event to all subscribers, fields[0] should be "event". */
+static void control_emit_fields(const char * const *fields, guint n)
+{
+    GSList *l, *next;
+
+    for (l = clients; l; l = next)
+    {
+        ControlClient *cl = l->data;
+
+        /* client may be dropped on overflow */
+        next = l->next;
+        if (cl->subscribed)
+            client_send_fields(cl, fields, n);
+    }
+}
+
+/* format: either "<edge>" or "<num>:<edge>", the same as for lxpanelctl */
+static int parse_panel_id(const char *arg, int *monitor)
+{
+    char *end;
+    long mon = strtol(arg, &end, 10);
+
+    if (*end == ':')
+        arg = end + 1;
+    else
+        mon = 0;
+    *monitor = mon - 1;
+    if (strcmp(arg, "top") == 0)
+        return EDGE_TOP;
+    if (strcmp(arg, "bottom") == 0)
+        return EDGE_BOTTOM;
+    if (strcmp(arg, "left") == 0)
+        return EDGE_LEFT;
+    if (strcmp(arg, "right") == 0)
+        return EDGE_RIGHT;
+    return EDGE_NONE;
+}
+
+static void client_process_request(ControlClient *cl, char **fields, guint n)
+{
+    const char *error = NULL;
+    int monitor = -1, edge = EDGE_NONE;
+    guint i, arg = 1;
+
+    if (n == 0)
+    {
+        client_reply(cl, "empty request");
+        return;
+    }
+    if (strcmp(fields[0], "subscribe") == 0)
+    {
+        cl->subscribed = TRUE;
+        client_reply(cl, NULL);
+        return;
+    }
+    for (i = 0; i < G_N_ELEMENTS(control_commands); i++)
+        if (strcmp(fields[0], control_commands[i].name) == 0)
+            break;
+    if (i == G_N_ELEMENTS(control_commands))
+    {
+        client_reply(cl, "unknown command");
+        return;
+    }
+    if (n > arg && strncmp(fields[arg], "--panel=", 8) == 0)
+        edge = parse_panel_id(fields[arg++] + 8, &monitor);
+    error = control_func(control_commands[i].cmd, monitor, edge,
+                         n > arg ? fields[arg] : NULL,
+                         n > arg + 1 ? fields[arg + 1] : NULL);
+    client_reply(cl, error);
+    if (error == NULL)
+    {
+        /* let subscribers know what was done: "event" <command> <args> */
+        const char **event = g_new(const char *, n + 1);
+
+        event[0] = "event";
+        memcpy(&event[1], fields, n * sizeof(char *));
+        control_emit_fields((const char * const *)event, n + 1);
+        g_free(event);
+    }
+}
+
+/* Handle all complete frames received so far. Returns FALSE on error. */
+static gboolean client_process_input(ControlClient *cl)
+{
+    GPtrArray *fields = g_ptr_array_new();
+    gboolean ok = TRUE;
+
+    while (!cl->closed && cl->input->len >= 4)
+    {
+        guint32 len;
+        char *payload, *p, *end;
+
+        memcpy(&len, cl->input->data, 4);
+        len = GUINT32_FROM_BE(len);
+        if (len > LXPANEL_CTL_MAX_FRAME)
+        {
+            ok = FALSE;
+            break;
+        }
+        if (cl->input->len < len + 4)
+            break;
+        /* keep the last field terminated even if the client did not */
+        payload = g_malloc(len + 1);
+        memcpy(payload, &cl->input->data[4], len);
+        payload[len] = '\0';
+        g_byte_array_remove_range(cl->input, 0, len + 4);
+        g_ptr_array_set_size(fields, 0);
+        for (p = payload, end = payload + len; p < end; p += strlen(p) + 1)
+            g_ptr_array_add(fields, p);
+        client_process_request(cl, (char **)fields->pdata, fields->len);
+        g_free(payload);
+    }
+    g_ptr_array_free(fields, TRUE);
+    return ok;
+}
+
+static void client_read_ready(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    ControlClient *cl = user_data;
+    GError *err = NULL;
+    gssize n = g_input_stream_read_finish(G_INPUT_STREAM(source), res, &err);
+
+    if (n < 0)
+    {
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_debug("control: read failed: %s", err->message);
+        g_error_free(err);
+        client_close(cl);
+    }
+    else if (n == 0)
+    {
+        /* client may still wait for replies after shutting its side down */
+        cl->eof = TRUE;
+        client_close_if_done(cl);
+    }
+    else if (!cl->closed)
+    {
+        g_byte_array_append(cl->input, cl->buffer, n);
+        if (!client_process_input(cl))
+        {
+            g_warning("control: invalid frame received, dropping client");
+            client_close(cl);
+        }
+        else if (!cl->closed)
+            g_input_stream_read_async(G_INPUT_STREAM(source), cl->buffer,
+                                      sizeof(cl->buffer), G_PRIORITY_DEFAULT,
+                                      cl->cancellable, client_read_ready,
+                                      client_ref(cl));
+    }
+    client_unref(cl);
+}
+
+/* Only the user running the panel may control it. */
+static gboolean peer_is_allowed(GSocketConnection *conn)
+{
+    GCredentials *cred;
+    GError *err = NULL;
+    uid_t uid;
+
+    cred = g_socket_get_credentials(g_socket_connection_get_socket(conn), &err);
+    if (cred == NULL)
+    {
+        g_warning("control: cannot get peer credentials: %s", err->message);
+        g_error_free(err);
+        return FALSE;
+    }
+    uid = g_credentials_get_unix_user(cred, NULL);
+    g_object_unref(cred);
+    return uid == getuid();
+}
+
+static gboolean on_incoming(GSocketService *srv, GSocketConnection *conn,
+                            GObject *source, gpointer user_data)
+{
+    ControlClient *cl;
+
+    if (!peer_is_allowed(conn))
+    {
+        g_warning("control: connection from other user rejected");
+        g_io_stream_close(G_IO_STREAM(conn), NULL, NULL);
+        return TRUE;
+    }
+    cl = g_slice_new0(ControlClient);
+    cl->ref = 1; /* owned by the clients list */
+    cl->conn = g_object_ref(conn);
+    cl->cancellable = g_cancellable_new();
+    cl->input = g_byte_array_new();
+    cl->output = g_byte_array_new();
+    clients = g_slist_prepend(clients, cl);
+    g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(conn)),
+                              cl->buffer, sizeof(cl->buffer), G_PRIORITY_DEFAULT,
+                              cl->cancellable, client_read_ready, client_ref(cl));
+    return TRUE;
+}
+
+/* Returns TRUE if nobody listens on the socket so it can be replaced. */
+static gboolean socket_is_stale(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd, res;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return FALSE;
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return FALSE;
+    do
+        res = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    while (res < 0 && errno == EINTR);
+    if (res < 0)
+        res = errno;
+    close(fd);
+    return (res == ECONNREFUSED);
+}
+
+void _lxpanel_control_init(const char *display, LXPanelControlFunc func)
+{
+    char path[512];
+    char *dir;
+    GSocketAddress *address;
+    GError *err = NULL;
+    mode_t old_umask;
+    gboolean ok;
+
+    if (!lxpanel_ctl_socket_path(path, sizeof(path), display))
+    {
+        g_warning("control: cannot find a place for socket");
+        return;
+    }
+    dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    g_free(dir);
+    /* never take over the socket of another running panel */
+    if (g_file_test(path, G_FILE_TEST_EXISTS))
+    {
+        if (!socket_is_stale(path))
+        {
+            g_warning("control: %s is in use, lxpanelctl is disabled", path);
+            return;
+        }
+        if (g_unlink(path) < 0 && errno != ENOENT)
+            g_warning("control: cannot remove %s: %s", path, g_strerror(errno));
+    }
+
+    service = g_socket_service_new();
+    address = g_unix_socket_address_new(path);
+    /* create the socket private, nobody may connect before chmod() */
+    old_umask = umask(077);
+    ok = g_socket_listener_add_address(G_SOCKET_LISTENER(service), address,
+                                       G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT,
+                                       NULL, NULL, &err);
+    umask(old_umask);
+    if (!ok)
+    {
+        g_warning("control: cannot listen on %s: %s", path, err->message);
+        g_error_free(err);
+        g_object_unref(address);
+        g_object_unref(service);
+        service = NULL;
+        return;
+    }
+    g_object_unref(address);
+    socket_path = g_strdup(path);
+    control_func = func;
+    g_signal_connect(service, "incoming", G_CALLBACK(on_incoming), NULL);
+    g_socket_service_start(service);
+}
+
+void _lxpanel_control_finish(void)
+{
+    if (service == NULL)
+        return;
+    g_socket_service_stop(service);
+    g_socket_listener_close(G_SOCKET_LISTENER(service));
+    g_object_unref(service);
+    service = NULL;
+    g_unlink(socket_path);
+    g_free(socket_path);
+    socket_path = NULL;
+    /* flush replies to the last commands such as exit, but don't wait
+       forever for a client which does not read */
+    while (clients != NULL)
+    {
+        ControlClient *cl = clients->data;
+        GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(cl->conn));
+
+        g_socket_set_timeout(g_socket_connection_get_socket(cl->conn),
+                             CONTROL_FLUSH_TIMEOUT);
+        if (!g_output_stream_has_pending(out) &&
+            (cl->sending == NULL ||
+             g_output_stream_write_all(out, cl->sending->data, cl->sending->len,
+                                       NULL, NULL, NULL)))
+            g_output_stream_write_all(out, cl->output->data, cl->output->len,
+                                      NULL, NULL, NULL);
+        client_close(cl);
+    }
+}
+
+void _lxpanel_control_emit(const char *event, ...)
+{
+    GPtrArray *fields;
+    const char *arg;
+    va_list ap;
+
+    if (clients == NULL)
+        return;
+    fields = g_ptr_array_new();
+    g_ptr_array_add(fields, "event");
+    g_ptr_array_add(fields, (gpointer)event);
+    va_start(ap, event);
+    while ((arg = va_arg(ap, const char *)) != NULL)
+        g_ptr_array_add(fields, (gpointer)arg);
+    va_end(ap);
+    control_emit_fields((const char * const *)fields->pdata, fields->len);
+    g_ptr_array_free(fields, TRUE);
+}
@@ -55,9 +55,14 @@ struct _FbEv {
     int current_desktop;
     int number_of_desktops;
     char **desktop_names;
+    int desktop_names_count;
     Window active_window;
     Window *client_list;
+    int client_list_count;
     Window *client_list_stacking;
+    int client_list_stacking_count;
+    guint valid;                /* bit (1 << signal) is set if data is fetched */
+    guint generation;           /* incremented on every root property change */
 
     Window   xroot;
     Atom     id;
@@ -189,6 +194,8 @@ fb_ev_init (FbEv *ev)
     ev->active_window = None;
     ev->client_list_stacking = NULL;
     ev->client_list = NULL;
+    ev->valid = 0;
+    ev->generation = 0;
 }
 
 
@@ -213,6 +220,9 @@ fb_ev_emit(FbEv *ev, int signal)
     DBG("signal=%d\n", signal);
     g_assert(signal >=0 && signal < LAST_SIGNAL);
     DBG("\n");
+    /* class handlers drop cached data before any other handler is called,
+       then data is fetched once on the first request */
+    ev->generation++;
     if( signal == EV_ACTIVE_WINDOW )
     {
         Window* win = None;
@@ -264,6 +274,8 @@ ev_desktop_names(FbEv *ev, gpointer p)
         g_strfreev (ev->desktop_names);
         ev->desktop_names = NULL;
     }
+    ev->desktop_names_count = 0;
+    ev->valid &= ~(1U << EV_DESKTOP_NAMES);
     RET();
 }
 static void
@@ -274,6 +286,8 @@ ev_client_list(FbEv *ev, gpointer p)
         XFree(ev->client_list);
         ev->client_list = NULL;
     }
+    ev->client_list_count = 0;
+    ev->valid &= ~(1U << EV_CLIENT_LIST);
     RET();
 }
 
@@ -285,6 +299,8 @@ ev_client_list_stacking(FbEv *ev, gpointer p)
         XFree(ev->client_list_stacking);
         ev->client_list_stacking = NULL;
     }
+    ev->client_list_stacking_count = 0;
+    ev->valid &= ~(1U << EV_CLIENT_LIST_STACKING);
     RET();
 }
 
@@ -328,13 +344,48 @@ Window *fb_ev_active_window(FbEv *ev)
     return &ev->active_window;
 }
 
-Window *fb_ev_client_list(FbEv *ev)
+char **fb_ev_desktop_names(FbEv *ev, int *count)
 {
+    if (!(ev->valid & (1U << EV_DESKTOP_NAMES))) {
+        ev->desktop_names = get_utf8_property_list(GDK_ROOT_WINDOW(), a_NET_DESKTOP_NAMES,
+                                                   &ev->desktop_names_count);
+        ev->valid |= (1U << EV_DESKTOP_NAMES);
+    }
+    if (count)
+        *count = ev->desktop_names_count;
+    return ev->desktop_names;
+}
+
+Window *fb_ev_client_list(FbEv *ev, int *count)
+{
+    if (!(ev->valid & (1U << EV_CLIENT_LIST))) {
+        ev->client_list = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_CLIENT_LIST,
+                                         XA_WINDOW, &ev->client_list_count);
+        if (ev->client_list == NULL)
+            ev->client_list_count = 0;
+        ev->valid |= (1U << EV_CLIENT_LIST);
+    }
+    if (count)
+        *count = ev->client_list_count;
     return ev->client_list;
 }
 
-Window *fb_ev_client_list_stacking(FbEv *ev)
+Window *fb_ev_client_list_stacking(FbEv *ev, int *count)
 {
+    if (!(ev->valid & (1U << EV_CLIENT_LIST_STACKING))) {
+        ev->client_list_stacking = get_xaproperty(GDK_ROOT_WINDOW(), a_NET_CLIENT_LIST_STACKING,
+                                                  XA_WINDOW, &ev->client_list_stacking_count);
+        if (ev->client_list_stacking == NULL)
+            ev->client_list_stacking_count = 0;
+        ev->valid |= (1U << EV_CLIENT_LIST_STACKING);
+    }
+    if (count)
+        *count = ev->client_list_stacking_count;
     return ev->client_list_stacking;
 }
 
+guint fb_ev_generation(FbEv *ev)
+{
+    return ev->generation;
+}
+
@@ -74,8 +74,12 @@ void fb_ev_emit_destroy(FbEv *ev, Window win);
 extern int fb_ev_current_desktop(FbEv *ev);
 extern int fb_ev_number_of_desktops(FbEv *ev);
 extern Window *fb_ev_active_window(FbEv *ev);
-extern Window *fb_ev_client_list(FbEv *ev);
-extern Window *fb_ev_client_list_stacking(FbEv *ev);
+/* data below is owned by FbEv and valid until the next change signal */
+extern char **fb_ev_desktop_names(FbEv *ev, int *count);
+extern Window *fb_ev_client_list(FbEv *ev, int *count);
+extern Window *fb_ev_client_list_stacking(FbEv *ev, int *count);
+/* changes every time any root window property is changed */
+extern guint fb_ev_generation(FbEv *ev);
 
 /* it is created in the main.c */
 extern FbEv *fbev;
@@ -437,7 +437,9 @@ void gtk_run()
 #define MENU_CACHE_CHECK_VERSION(a,b,c) 0
 #endif
 #if MENU_CACHE_CHECK_VERSION(0, 6, 1)
+        LXPANEL_TRACE_BEGIN("menu-cache-lookup", NULL);
         menu_cache = menu_cache_lookup_sync(g_getenv("XDG_MENU_PREFIX") ? "applications.menu" : "lxde-applications.menu" );
+        LXPANEL_TRACE_END("menu-cache-lookup", NULL);
         if( menu_cache )
         {
 #else
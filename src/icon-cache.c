@@ -0,0 +1,216 @@
+/*
+ * Shared icons cache for LXPanel.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <libfm/fm-gtk.h>
+
+#include "private.h"
+
+#include "dbg.h"
+
+/* Decoded pixbufs are kept in the process-wide table keyed by the icon
+   description, size, scale and fallback. Least recently used entries are
+   dropped when the total size of pixels exceeds the budget. All the cache
+   is dropped when the icon theme is changed. */
+
+#define ICON_CACHE_BUDGET (4 * 1024 * 1024) /* bytes of pixel data */
+
+typedef struct {
+    char *key;                  /* "size:scale:icon|fallback" */
+    GdkPixbuf *pixbuf;          /* decoded icon */
+    gsize bytes;                /* size of pixel data */
+    GList link;                 /* position in LRU queue, data is entry */
+} IconCacheEntry;
+
+static GHashTable *icon_cache = NULL; /* key -> IconCacheEntry */
+static GQueue icon_cache_lru = G_QUEUE_INIT; /* head is most recently used */
+static gsize icon_cache_bytes = 0;
+
+static void icon_cache_entry_free(gpointer data)
+{
+    IconCacheEntry *entry = data;
+
+    g_queue_unlink(&icon_cache_lru, &entry->link);
+    icon_cache_bytes -= entry->bytes;
+    g_object_unref(entry->pixbuf);
+    g_free(entry->key);
+    g_slice_free(IconCacheEntry, entry);
+}
+
+static void on_icon_theme_changed(GtkIconTheme *theme, gpointer unused)
+{
+    lxpanel_icon_cache_invalidate();
+}
+
+/* should be called before any image is created so our handler on "changed"
+   signal is called before any handler that reloads images from the cache */
+void _lxpanel_icon_cache_init(void)
+{
+    if (icon_cache != NULL)
+        return;
+    icon_cache = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                       icon_cache_entry_free);
+    g_signal_connect(gtk_icon_theme_get_default(), "changed",
+                     G_CALLBACK(on_icon_theme_changed), NULL);
+}
+
+void lxpanel_icon_cache_invalidate(void)
+{
+    if (icon_cache == NULL)
+        return;
+    g_debug("icon cache: dropping %u icons (%" G_GSIZE_FORMAT " bytes)",
+            g_hash_table_size(icon_cache), icon_cache_bytes);
+    g_hash_table_remove_all(icon_cache);
+}
+
+/* the same rules as images in misc.c use: themed icons are looked up in the
+   theme, other icons are files which are scaled to the height */
+static GdkPixbuf *icon_cache_load(FmIcon *icon, gint size, const char *fallback)
+{
+    GdkPixbuf *pixbuf;
+
+    if (G_LIKELY(G_IS_THEMED_ICON(icon)))
+        pixbuf = fm_pixbuf_from_icon_with_fallback(icon, size,
+                        (fallback && fallback[0] != '/') ? fallback : NULL);
+    else
+    {
+        char *file = g_icon_to_string(fm_icon_get_gicon(icon));
+        pixbuf = gdk_pixbuf_new_from_file_at_scale(file, -1, size, TRUE, NULL);
+        g_free(file);
+    }
+
+    if (pixbuf == NULL && fallback != NULL && fallback[0] == '/')
+        /* if fallback was provided as a file path */
+        pixbuf = gdk_pixbuf_new_from_file_at_scale(fallback, -1, size, TRUE, NULL);
+    return pixbuf;
+}
+
+static char *icon_cache_make_key(FmIcon *icon, gint size, gint scale,
+                                 const char *fallback)
+{
+    char *name = g_icon_to_string(fm_icon_get_gicon(icon));
+    char *key = g_strdup_printf("%d:%d:%s|%s", size, MAX(scale, 1),
+                                name ? name : "", fallback ? fallback : "");
+
+    g_free(name);
+    return key;
+}
+
+static GdkPixbuf *icon_cache_find(const char *key)
+{
+    IconCacheEntry *entry;
+
+    if (G_UNLIKELY(icon_cache == NULL))
+        _lxpanel_icon_cache_init();
+    entry = g_hash_table_lookup(icon_cache, key);
+    if (entry == NULL)
+        return NULL;
+    /* move it to the head of LRU queue */
+    g_queue_unlink(&icon_cache_lru, &entry->link);
+    g_queue_push_head_link(&icon_cache_lru, &entry->link);
+    return g_object_ref(entry->pixbuf);
+}
+
+/* consumes key, takes a reference on pixbuf */
+static void icon_cache_insert(char *key, GdkPixbuf *pixbuf)
+{
+    IconCacheEntry *entry = g_slice_new(IconCacheEntry);
+
+    g_hash_table_remove(icon_cache, key);
+    entry->key = key;
+    entry->pixbuf = g_object_ref(pixbuf);
+    entry->bytes = (gsize)gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+    entry->link.data = entry;
+    entry->link.prev = entry->link.next = NULL;
+    g_queue_push_head_link(&icon_cache_lru, &entry->link);
+    icon_cache_bytes += entry->bytes;
+    g_hash_table_insert(icon_cache, key, entry);
+
+    /* drop least recently used icons if over budget, but keep the new one */
+    while (icon_cache_bytes > ICON_CACHE_BUDGET && icon_cache_lru.tail != &entry->link)
+    {
+        IconCacheEntry *old = icon_cache_lru.tail->data;
+        g_hash_table_remove(icon_cache, old->key);
+    }
+}
+
+GdkPixbuf *lxpanel_icon_cache_lookup(FmIcon *icon, gint size, gint scale,
+                                     const char *fallback)
+{
+    GdkPixbuf *pixbuf;
+    char *key;
+
+    g_return_val_if_fail(icon != NULL, NULL);
+    key = icon_cache_make_key(icon, size, scale, fallback);
+    pixbuf = icon_cache_find(key);
+    g_free(key);
+    return pixbuf;
+}
+
+void lxpanel_icon_cache_add(FmIcon *icon, gint size, gint scale,
+                            const char *fallback, GdkPixbuf *pixbuf)
+{
+    g_return_if_fail(icon != NULL && GDK_IS_PIXBUF(pixbuf));
+    if (G_UNLIKELY(icon_cache == NULL))
+        _lxpanel_icon_cache_init();
+    icon_cache_insert(icon_cache_make_key(icon, size, scale, fallback), pixbuf);
+}
+
+GdkPixbuf *lxpanel_icon_cache_get(FmIcon *icon, gint size, gint scale,
+                                  const char *fallback)
+{
+    GdkPixbuf *pixbuf;
+    char *key;
+
+    g_return_val_if_fail(icon != NULL, NULL);
+    if (size <= 0)
+        return NULL;
+    key = icon_cache_make_key(icon, size, scale, fallback);
+    pixbuf = icon_cache_find(key);
+    if (pixbuf != NULL)
+    {
+        g_free(key);
+        return pixbuf;
+    }
+    LXPANEL_TRACE_BEGIN("icon-load", key);
+    pixbuf = icon_cache_load(icon, size * MAX(scale, 1), fallback);
+    LXPANEL_TRACE_END("icon-load", key);
+    if (pixbuf == NULL) /* don't cache failures, files may appear later */
+        g_free(key);
+    else
+        icon_cache_insert(key, pixbuf);
+    return pixbuf;
+}
+
+GdkPixbuf *lxpanel_icon_cache_get_for_name(const char *name, gint size, gint scale,
+                                           const char *fallback)
+{
+    FmIcon *icon;
+    GdkPixbuf *pixbuf;
+
+    g_return_val_if_fail(name != NULL, NULL);
+    icon = fm_icon_from_name(name);
+    pixbuf = lxpanel_icon_cache_get(icon, size, scale, fallback);
+    g_object_unref(icon);
+    return pixbuf;
+}
@@ -33,7 +33,9 @@ enum {
   PROP_ORIENTATION,
   PROP_SPACING,
   PROP_CONSTRAIN_WIDTH,
-  PROP_ASPECT_WIDTH
+  PROP_ASPECT_WIDTH,
+  PROP_OVERFLOW,
+  PROP_N_OVERFLOW
   //PROP_FILL_WIDTH
 };
 
@@ -43,6 +45,31 @@ enum {
   CHILD_PROP_POSITION
 };
 
+/* Parameters of the grid allocation, children keep their allocation while
+   these are the same. Filled with memset() since it is compared by memcmp(). */
+typedef struct {
+    GtkAllocation allocation;
+    gint child_width;
+    gint child_height;
+    guint spacing;
+    guint border;
+    GtkOrientation orientation;
+    GtkTextDirection direction;
+    gboolean hide_children;
+} IconGridLayout;
+
+/* Cached data of each child. Allocations are reused for children from start
+   up to the first one which was changed, added, removed, moved, or hidden. */
+typedef struct {
+    GtkRequisition laid_req;			/* Requisition used for alloc */
+    GtkAllocation alloc;			/* Last allocation */
+    gint index;					/* Index among visible children or -1 */
+    guint x, y, next_coord;			/* Layout state after this child */
+    int x_delta;
+} IconGridChild;
+
+static GQuark icon_grid_child_quark = 0;
+
 /* Representative of an icon grid.  This is a manager that packs widgets into a rectangular grid whose size adapts to conditions. */
 struct _PanelIconGrid
 {
@@ -56,12 +83,16 @@ struct _PanelIconGrid
     gboolean constrain_width : 1;		/* True if width should be constrained by allocated space */
     gboolean aspect_width : 1;			/* True if children should maintain aspect */
     gboolean fill_width : 1;			/* True if children should fill unused width */
+    gboolean overflow : 1;			/* True if children which don't fit are not shown */
+    gint n_overflow;				/* Number of visible children not shown */
     int rows;					/* Computed layout rows */
     int columns;				/* Computed layout columns */
     GdkWindow *event_window;			/* Event window if NO_WINDOW is set */
     GtkWidget *dest_item;			/* Drag destination to draw focus */
     PanelIconGridDropPosition dest_pos;		/* Position to draw focus */
     gboolean hide_children;         /* Flag to force a full redraw of all children while keeping overall allocation the same */
+    IconGridLayout layout;			/* Parameters of last allocation */
+    gboolean layout_valid;			/* True if layout contains valid data */
 };
 
 struct _PanelIconGridClass
@@ -89,6 +120,29 @@ static void icon_grid_element_check_requisition(PanelIconGrid *ig,
 static void panel_icon_grid_size_request(GtkWidget *widget,
                                          GtkRequisition *requisition);
 
+static inline IconGridChild *icon_grid_get_child(GtkWidget *child)
+{
+    return g_object_get_qdata(G_OBJECT(child), icon_grid_child_quark);
+}
+
+static void icon_grid_child_free(gpointer data)
+{
+    g_slice_free(IconGridChild, data);
+}
+
+/* Retrieves checked requisition of the child. GTK+ keeps it cached until
+   the child queues resize, so this is cheap for unchanged children. */
+static void icon_grid_child_request(PanelIconGrid *ig, GtkWidget *child,
+                                    GtkRequisition *requisition)
+{
+#if GTK_CHECK_VERSION(3, 0, 0)
+    gtk_widget_get_preferred_size(child, NULL, requisition);
+#else
+    gtk_widget_size_request(child, requisition);
+#endif
+    icon_grid_element_check_requisition(ig, requisition);
+}
+
 static gboolean check_for_recalc(PanelIconGrid *ig)
 {
     GtkWidget *toplevel = gtk_widget_get_toplevel((GtkWidget *)ig);
@@ -123,6 +177,10 @@ static void panel_icon_grid_size_allocate(GtkWidget *widget,
     guint x, y;
     GList *ige;
     GtkWidget *child;
+    IconGridLayout layout;
+    gboolean reuse;
+    gint i;
+    gint columns, n_shown, n_overflow;
 
     /* Apply given allocation */
     gtk_widget_set_allocation(widget, allocation);
@@ -183,10 +241,30 @@ static void panel_icon_grid_size_allocate(GtkWidget *widget,
 
     /* Get the constrained child geometry if the allocated geometry is insufficient.
      * All children are still the same size and share equally in the deficit. */
+    columns = ig->columns;
+    n_shown = -1;
     if ((ig->columns != 0) && (ig->rows != 0) && (child_allocation.width > 0))
     {
+        /* In overflow mode children aren't squeezed below a square icon,
+         * the ones which don't fit after that aren't shown at all. */
+        if (ig->overflow && ig->orientation == GTK_ORIENTATION_HORIZONTAL)
+        {
+            x_delta = MIN(child_width, child_height) + (int)ig->spacing;
+            x_delta = MAX(1, (child_allocation.width + (int)ig->spacing) / x_delta);
+            if (columns > x_delta)
+            {
+                columns = x_delta;
+                n_shown = columns * ig->rows;
+            }
+        }
+        else if (ig->overflow)
+        {
+            x_delta = MAX(1, (child_allocation.height + (int)ig->spacing) / (child_height + (int)ig->spacing));
+            if (ig->rows > x_delta)
+                n_shown = x_delta * ig->columns;
+        }
         if (ig->constrain_width &&
-            (x_delta = (child_allocation.width + ig->spacing) / ig->columns - ig->spacing) < child_width)
+            (x_delta = (child_allocation.width + ig->spacing) / columns - ig->spacing) < child_width)
             child_width = MAX(2, x_delta);
         /* fill vertical space evenly in horisontal orientation */
         if (ig->orientation == GTK_ORIENTATION_HORIZONTAL &&
@@ -201,19 +279,60 @@ static void panel_icon_grid_size_allocate(GtkWidget *widget,
     x_delta = 0;
     next_coord = border;
 
+    /* Check if allocations of children may be reused. */
+    memset(&layout, 0, sizeof(layout));
+    layout.allocation = *allocation;
+    layout.child_width = child_width;
+    layout.child_height = child_height;
+    layout.spacing = ig->spacing;
+    layout.border = border;
+    layout.orientation = ig->orientation;
+    layout.direction = direction;
+    layout.hide_children = ig->hide_children;
+    reuse = ig->layout_valid && memcmp(&layout, &ig->layout, sizeof(layout)) == 0;
+    ig->layout = layout;
+    ig->layout_valid = TRUE;
+    i = 0;
+    n_overflow = 0;
+
     /* Reposition each visible child. */
     for (ige = ig->children; ige != NULL; ige = ige->next)
     {
         child = ige->data;
         if (gtk_widget_get_visible(child))
         {
+            IconGridChild *c = icon_grid_get_child(child);
+
+            if (n_shown >= 0 && i >= n_shown)
+            {
+                /* No room for the child, keep it unmapped until there is. */
+                if (gtk_widget_get_child_visible(child))
+                    gtk_widget_set_child_visible(child, FALSE);
+                if (c != NULL)
+                    c->index = -1;
+                n_overflow++;
+                continue;
+            }
+
             /* Do necessary operations on the child. */
-#if GTK_CHECK_VERSION(3, 0, 0)
-            gtk_widget_get_preferred_size (child, NULL, &req);
-#else
-            gtk_widget_get_child_requisition(child, &req);
-#endif
-            icon_grid_element_check_requisition(ig, &req);
+            icon_grid_child_request(ig, child, &req);
+            if (reuse && c != NULL && c->index == i &&
+                c->laid_req.width == req.width && c->laid_req.height == req.height)
+            {
+                /* Nothing changed before and including this child. The child
+                   still has to be allocated since it may be queued for that. */
+                x = c->x;
+                y = c->y;
+                x_delta = c->x_delta;
+                next_coord = c->next_coord;
+                child_allocation = c->alloc;
+                gtk_widget_size_allocate(child, &child_allocation);
+                if (!gtk_widget_get_child_visible(child))
+                    gtk_widget_set_child_visible(child, TRUE);
+                i++;
+                continue;
+            }
+            reuse = FALSE;
             child_allocation.width = MIN(req.width, child_width);
             child_allocation.height = MIN(req.height, child_height);
             if (ig->hide_children)
@@ -277,7 +396,34 @@ static void panel_icon_grid_size_allocate(GtkWidget *widget,
             }
             // FIXME: if fill_width and rows > 1 then delay allocation
             gtk_widget_size_allocate(child, &child_allocation);
+            if (!gtk_widget_get_child_visible(child))
+                gtk_widget_set_child_visible(child, TRUE);
+            if (c != NULL)
+            {
+                c->laid_req = req;
+                c->alloc = child_allocation;
+                c->index = i;
+                c->x = x;
+                c->y = y;
+                c->x_delta = x_delta;
+                c->next_coord = next_coord;
+            }
+            i++;
         }
+        else
+        {
+            IconGridChild *c = icon_grid_get_child(child);
+
+            /* position will be recalculated when it is shown again */
+            if (c != NULL)
+                c->index = -1;
+        }
+    }
+
+    if (n_overflow != ig->n_overflow)
+    {
+        ig->n_overflow = n_overflow;
+        g_object_notify(G_OBJECT(ig), "n-overflow");
     }
 }
 
@@ -308,12 +454,12 @@ static void panel_icon_grid_calculate_size(PanelIconGrid *ig,
         for (ige = ig->children; ige != NULL; ige = ige->next)
             if (gtk_widget_get_visible(ige->data))
             {
-#if GTK_CHECK_VERSION(3, 0, 0)
-                gtk_widget_get_preferred_size(ige->data, NULL, &child_requisition);
-#else
-                gtk_widget_size_request(ige->data, &child_requisition);
-#endif
-                icon_grid_element_check_requisition(ig, &child_requisition);
+                /* In overflow mode the width isn't requested, so children
+                   are requested on allocation only if they are shown. */
+                if (ig->overflow)
+                    child_requisition.width = 0;
+                else
+                    icon_grid_child_request(ig, ige->data, &child_requisition);
                 if (row == 0)
                     ig->columns++;
                 w = MAX(w, child_requisition.width);
@@ -359,12 +505,7 @@ static void panel_icon_grid_calculate_size(PanelIconGrid *ig,
         for (ige = ig->children; ige != NULL; ige = ige->next)
             if (gtk_widget_get_visible(ige->data))
             {
-#if GTK_CHECK_VERSION(3, 0, 0)
-                gtk_widget_get_preferred_size(ige->data, NULL, &child_requisition);
-#else
-                gtk_widget_size_request(ige->data, &child_requisition);
-#endif
-                icon_grid_element_check_requisition(ig, &child_requisition);
+                icon_grid_child_request(ig, ige->data, &child_requisition);
                 if (w > 0)
                 {
                     w += ig->spacing;
@@ -439,11 +580,16 @@ static void panel_icon_grid_get_preferred_height(GtkWidget *widget,
 static void panel_icon_grid_add(GtkContainer *container, GtkWidget *widget)
 {
     PanelIconGrid *ig = PANEL_ICON_GRID(container);
+    IconGridChild *c;
 
     /* Insert at the tail of the child list.  This keeps the graphics in the order they were added. */
     ig->children = g_list_append(ig->children, widget);
 
     /* Add the widget to the layout container. */
+    c = g_slice_new0(IconGridChild);
+    c->index = -1;
+    g_object_set_qdata_full(G_OBJECT(widget), icon_grid_child_quark, c,
+                            icon_grid_child_free);
     gtk_widget_set_parent(widget, GTK_WIDGET(container));
 //    gtk_widget_queue_resize(GTK_WIDGET(container));
 }
@@ -471,6 +617,24 @@ void panel_icon_grid_set_aspect_width(PanelIconGrid * ig, gboolean aspect_width)
     gtk_widget_queue_resize(GTK_WIDGET(ig));
 }
 
+void panel_icon_grid_set_overflow(PanelIconGrid * ig, gboolean overflow)
+{
+    g_return_if_fail(PANEL_IS_ICON_GRID(ig));
+
+    if ((!ig->overflow && !overflow) || (ig->overflow && overflow))
+        return;
+
+    ig->overflow = !!overflow;
+    gtk_widget_queue_resize(GTK_WIDGET(ig));
+}
+
+gint panel_icon_grid_get_n_overflow(PanelIconGrid * ig)
+{
+    g_return_val_if_fail(PANEL_IS_ICON_GRID(ig), 0);
+
+    return ig->n_overflow;
+}
+
 /* void panel_icon_grid_set_fill_width(PanelIconGrid * ig, gboolean fill_width)
 {
     g_return_if_fail(PANEL_IS_ICON_GRID(ig));
@@ -497,7 +661,9 @@ static void panel_icon_grid_remove(GtkContainer *container, GtkWidget *widget)
             gboolean was_visible = gtk_widget_get_visible(widget);
 
             /* The child is found.  Remove from child list and layout container. */
+            g_object_set_qdata(G_OBJECT(widget), icon_grid_child_quark, NULL);
             gtk_widget_unparent (widget);
+            gtk_widget_set_child_visible(widget, TRUE);
             ig->children = g_list_remove_link(ig->children, children);
             g_list_free(children);
 
@@ -635,6 +801,8 @@ gboolean panel_icon_grid_get_dest_at_pos(PanelIconGrid * ig, gint x, gint y,
     {
         for (ige = ig->children; ige != NULL; ige = ige->next)
         {
+            if (!gtk_widget_get_child_visible(ige->data))
+                continue;
             gtk_widget_get_allocation(ige->data, &allocation);
             if (x < allocation.x)
             {
@@ -677,6 +845,8 @@ gboolean panel_icon_grid_get_dest_at_pos(PanelIconGrid * ig, gint x, gint y,
     {
         for (ige = ig->children; ige != NULL; ige = ige->next)
         {
+            if (!gtk_widget_get_child_visible(ige->data))
+                continue;
             gtk_widget_get_allocation(ige->data, &allocation);
             if (y < allocation.y)
             {
@@ -870,6 +1040,9 @@ static void panel_icon_grid_set_property(GObject *object, guint prop_id,
     case PROP_ASPECT_WIDTH:
         panel_icon_grid_set_aspect_width(ig, g_value_get_boolean(value));
         break;
+    case PROP_OVERFLOW:
+        panel_icon_grid_set_overflow(ig, g_value_get_boolean(value));
+        break;
     /* case PROP_FILL_WIDTH:
         panel_icon_grid_set_fill_width(ig, g_value_get_boolean(value));
         break; */
@@ -898,6 +1071,12 @@ static void panel_icon_grid_get_property(GObject *object, guint prop_id,
     case PROP_ASPECT_WIDTH:
         g_value_set_boolean(value, ig->aspect_width);
         break;
+    case PROP_OVERFLOW:
+        g_value_set_boolean(value, ig->overflow);
+        break;
+    case PROP_N_OVERFLOW:
+        g_value_set_int(value, ig->n_overflow);
+        break;
     /* case PROP_FILL_WIDTH:
         g_value_set_boolean(value, ig->fill_width);
         break; */
@@ -1181,6 +1360,8 @@ static void panel_icon_grid_class_init(PanelIconGridClass *klass)
     object_class->set_property = panel_icon_grid_set_property;
     object_class->get_property = panel_icon_grid_get_property;
 
+    icon_grid_child_quark = g_quark_from_static_string("PanelIconGrid::child");
+
 #if GTK_CHECK_VERSION(3, 0, 0)
     widget_class->get_preferred_width = panel_icon_grid_get_preferred_width;
     widget_class->get_preferred_height = panel_icon_grid_get_preferred_height;
@@ -1230,6 +1411,18 @@ static void panel_icon_grid_class_init(PanelIconGridClass *klass)
                                                          "Maintain children aspect",
                                                          "Whether to set children width to maintain their aspect",
                                                          FALSE, G_PARAM_READWRITE));
+    g_object_class_install_property(object_class,
+                                    PROP_OVERFLOW,
+                                    g_param_spec_boolean("overflow",
+                                                         "Overflow",
+                                                         "Whether to not show children which don't fit",
+                                                         FALSE, G_PARAM_READWRITE));
+    g_object_class_install_property(object_class,
+                                    PROP_N_OVERFLOW,
+                                    g_param_spec_int("n-overflow",
+                                                     "Number of overflow children",
+                                                     "Number of visible children which are not shown",
+                                                     0, G_MAXINT, 0, G_PARAM_READABLE));
 
     gtk_container_class_install_child_property(container_class,
                                                CHILD_PROP_POSITION,
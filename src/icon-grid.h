@@ -76,6 +76,36 @@ extern void panel_icon_grid_set_constrain_width(PanelIconGrid * ig, gboolean con
  */
 extern void panel_icon_grid_set_aspect_width(PanelIconGrid * ig, gboolean aspect_width);
 
+/**
+ * panel_icon_grid_set_overflow
+ * @ig: a widget
+ * @overflow: value to set
+ *
+ * Changes #PanelIconGrid::overflow property on the @ig. If enabled then
+ * children are not made narrower than their height and those which do
+ * not fit into allocated space after that are left unmapped and are not
+ * allocated. Their number is available as #PanelIconGrid::n-overflow
+ * property so the owner may present them some other way.
+ *
+ * Since: 0.10.2
+ */
+extern void panel_icon_grid_set_overflow(PanelIconGrid * ig, gboolean overflow);
+
+/**
+ * panel_icon_grid_get_n_overflow
+ * @ig: a widget
+ *
+ * Retrieves number of visible children of @ig which were not shown on
+ * last allocation because of #PanelIconGrid::overflow property. These
+ * are last visible children and they have gtk_widget_get_child_visible()
+ * returning %FALSE.
+ *
+ * Returns: number of children not shown.
+ *
+ * Since: 0.10.2
+ */
+extern gint panel_icon_grid_get_n_overflow(PanelIconGrid * ig);
+
 /* extern void panel_icon_grid_set_fill_width(PanelIconGrid * ig, gboolean fill_width);
 						 Set the fill-width property */
 extern void panel_icon_grid_set_geometry(PanelIconGrid * ig,
@@ -32,12 +32,16 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
 
 static Display* dpy;
 
 static const char usage[] =
         "\nlxpanelctl - LXPanel Controller\n"
-        "Usage: lxpanelctl <command>\n\n"
+        "Usage: lxpanelctl <command>\n"
+        "       lxpanelctl --batch\n\n"
         "Available commands:\n"
         "menu\t\t\tshow system menu\n"
         "run\t\t\tshow run dialog\n"
@@ -47,7 +51,11 @@ static const char usage[] =
         "move\t\tmove panel to new monitor\n"
         "exit\t\t\texit lxpanel\n"
         "command <plugin> <cmd>\tsend a command to a plugin\n"
-        "notify <message>\tshow a notification message\n\n";
+        "notify <message>\tshow a notification message\n"
+        "subscribe\t\tprint panel events until lxpanel exits\n\n"
+        "With --batch commands are read from standard input, one per line,\n"
+        "with arguments separated by tabs. Both --batch and subscribe require\n"
+        "the control socket, other commands fall back to X client message.\n\n";
 
 static int get_cmd( const char* cmd )
 {
@@ -94,6 +102,174 @@ static int parse_id(const char *arg, int *mon)
     return EDGE_NONE;
 }
 
+/* Control socket client, see lxpanelctl.h for the protocol */
+static int ctl_connect(const char *display_name)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (!lxpanel_ctl_socket_path(addr.sun_path, sizeof(addr.sun_path), display_name))
+        return -1;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof addr) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0)
+            return 0;
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len > 0)
+    {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0)
+            return 0;
+        p += n;
+        len -= n;
+    }
+    return 1;
+}
+
+static int send_request(int fd, char **fields, int n)
+{
+    uint32_t len = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        len += strlen(fields[i]) + 1;
+    if (len > LXPANEL_CTL_MAX_FRAME)
+    {
+        fprintf(stderr, "lxpanelctl: request is too long\n");
+        return 0;
+    }
+    len = htonl(len);
+    if (!write_all(fd, &len, 4))
+        return 0;
+    for (i = 0; i < n; i++)
+        if (!write_all(fd, fields[i], strlen(fields[i]) + 1))
+            return 0;
+    return 1;
+}
+
+/* returns allocated payload terminated by extra NUL, or NULL on EOF */
+static char *read_frame(int fd, uint32_t *len)
+{
+    char *payload;
+
+    if (!read_all(fd, len, 4))
+        return NULL;
+    *len = ntohl(*len);
+    if (*len > LXPANEL_CTL_MAX_FRAME || (payload = malloc(*len + 1)) == NULL)
+        return NULL;
+    if (!read_all(fd, payload, *len))
+    {
+        free(payload);
+        return NULL;
+    }
+    payload[*len] = '\0';
+    return payload;
+}
+
+/* read the reply and report error if any; returns 1 if command succeeded */
+static int read_reply(int fd)
+{
+    uint32_t len;
+    char *reply = read_frame(fd, &len);
+    int ok;
+
+    if (reply == NULL)
+    {
+        fprintf(stderr, "lxpanelctl: connection to lxpanel lost\n");
+        return 0;
+    }
+    ok = (strcmp(reply, "ok") == 0);
+    if (!ok)
+        fprintf(stderr, "lxpanelctl: %s\n",
+                (strcmp(reply, "error") == 0 && len > 6) ? &reply[6] : "invalid reply");
+    free(reply);
+    return ok;
+}
+
+/* send all commands from stdin at once, then collect replies */
+static int run_batch(int fd)
+{
+    char *line = NULL, *fields[64];
+    size_t size = 0;
+    ssize_t n;
+    int sent = 0, failed = 0, nf;
+
+    while ((n = getline(&line, &size, stdin)) >= 0)
+    {
+        char *p = line;
+
+        if (n > 0 && line[n - 1] == '\n')
+            line[--n] = '\0';
+        if (n == 0)
+            continue;
+        for (nf = 0; p != NULL && nf < (int)(sizeof(fields) / sizeof(fields[0])); nf++)
+        {
+            fields[nf] = p;
+            p = strchr(p, '\t');
+            if (p)
+                *p++ = '\0';
+        }
+        if (!send_request(fd, fields, nf))
+            break;
+        sent++;
+    }
+    free(line);
+    shutdown(fd, SHUT_WR);
+    while (sent-- > 0)
+        if (!read_reply(fd))
+            failed++;
+    return failed ? 1 : 0;
+}
+
+/* print events one per line, fields separated by tabs */
+static int run_subscribe(int fd)
+{
+    char *sub = "subscribe", *frame, *p;
+    uint32_t len;
+
+    if (!send_request(fd, &sub, 1) || !read_reply(fd))
+        return 1;
+    while ((frame = read_frame(fd, &len)) != NULL)
+    {
+        if (strcmp(frame, "event") == 0)
+        {
+            for (p = &frame[6]; p < &frame[len]; p += strlen(p) + 1)
+                printf(p == &frame[6] ? "%s" : "\t%s", p);
+            printf("\n");
+            fflush(stdout);
+        }
+        free(frame);
+    }
+    return 0;
+}
+
 int main( int argc, char** argv )
 {
     char *display_name = (char *)getenv("DISPLAY");
@@ -106,12 +282,29 @@ int main( int argc, char** argv )
      * valid only if XClientMessageEvent::b[0] == LXPANEL_CMD_COMMAND */
     uint8_t target;
 
+    int fd;
+
     if( argc < 2 )
     {
         printf( usage );
         return 1;
     }
 
+    if (strcmp(argv[1], "--batch") == 0 || strcmp(argv[1], "subscribe") == 0)
+    {
+        int ret;
+
+        fd = ctl_connect(display_name);
+        if (fd < 0)
+        {
+            fprintf(stderr, "lxpanelctl: cannot connect to lxpanel control socket\n");
+            return 1;
+        }
+        ret = (argv[1][0] == '-') ? run_batch(fd) : run_subscribe(fd);
+        close(fd);
+        return ret;
+    }
+
     /*
     if( restart = !strcmp( argv[1], "restart" ) )
         argv[1] = "exit";
@@ -126,6 +319,15 @@ int main( int argc, char** argv )
         return 1;
     }
 
+    /* prefer the control socket, it has no limits on arguments length */
+    fd = ctl_connect(display_name);
+    if (fd >= 0)
+    {
+        int ok = send_request(fd, &argv[1], argc - 1) && read_reply(fd);
+        close(fd);
+        return ok ? 0 : 1;
+    }
+
     dpy = XOpenDisplay(display_name);
     if (dpy == NULL) {
         printf("Cant connect to display: %s\n", display_name);
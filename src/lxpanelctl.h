@@ -23,6 +23,10 @@
 #ifndef _LXPANELCTL_H
 #define _LXPANELCTL_H
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 /* Commands controlling lxpanel.
  * These are the parameter of a _LXPANEL_CMD ClientMessage to the root window.
  * Endianness alert:  Note that the parameter is in b[0], not l[0]. */
@@ -42,4 +46,49 @@ typedef enum {
 /* this enum was in private.h but it is used by LXPANEL_CMD_COMMAND now */
 enum { EDGE_NONE=0, EDGE_LEFT, EDGE_RIGHT, EDGE_TOP, EDGE_BOTTOM };
 
+/* Control socket.
+ * Besides the ClientMessage above lxpanel listens on a Unix domain socket,
+ * one per display. Data in both directions are split into frames: 32-bit
+ * length in network byte order followed by that many bytes of payload.
+ * Payload of a request is a list of NUL-terminated fields: the command name
+ * as accepted by lxpanelctl followed by its arguments, for example
+ * "command\0--panel=1:top\0launchbar\0add lxterminal.desktop\0".
+ * Each request gets one reply in the same order, so many requests may be
+ * sent at once and replies read afterwards. Reply is "ok\0" or
+ * "error\0<reason>\0". After "subscribe" is replied the connection also
+ * receives event frames "event\0<name>\0<arguments>..." until closed. */
+#define LXPANEL_CTL_MAX_FRAME   (16 * 1024 * 1024)
+
+/* Fill buf with the socket path for display; returns FALSE if it does not fit.
+ * Screen number is ignored since all screens are served by one process. */
+static inline int lxpanel_ctl_socket_path(char *buf, size_t size, const char *display)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    const char *sub = "";
+    const char *colon;
+    char name[64];
+    size_t i;
+    int len;
+
+    if (dir == NULL || dir[0] == '\0')
+    {
+        dir = getenv("HOME");
+        sub = "/.cache";
+        if (dir == NULL)
+            return 0;
+    }
+    if (display == NULL)
+        display = "";
+    colon = strrchr(display, ':');
+    for (i = 0; display[i] != '\0' && i < sizeof(name) - 1; i++)
+    {
+        if (display[i] == '.' && colon != NULL && &display[i] > colon)
+            break;
+        name[i] = (display[i] == '/') ? '_' : display[i];
+    }
+    name[i] = '\0';
+    len = snprintf(buf, size, "%s%s/lxpanel-%s.sock", dir, sub, name);
+    return (len > 0 && (size_t)len < size);
+}
+
 #endif
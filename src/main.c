@@ -92,13 +92,31 @@ void restart(void)
                                               name,PANEL_CONF_TYPE_INT);\
     if (_s) config_setting_set_int(_s,val); } while(0)
 
-static void process_client_msg ( XClientMessageEvent* ev )
+/* find the panel by monitor and edge, -1 and EDGE_NONE match any */
+static LXPanel *find_panel(int monitor, int edge)
+{
+    GSList *l;
+
+    for (l = all_panels; l; l = l->next)
+    {
+        LXPanel *p = (LXPanel*)l->data;
+        if (p->priv->box == NULL) /* inactive panel */
+            continue;
+        if (monitor >= 0 && p->priv->monitor != monitor)
+            continue;
+        if (edge == EDGE_NONE || p->priv->edge == edge)
+            return p;
+    }
+    return NULL;
+}
+
+/* Run a command from lxpanelctl, received either as X client message or
+ * from the control socket. For LXPANEL_CMD_COMMAND arg1 is plugin type and
+ * arg2 is command, for LXPANEL_CMD_NOTIFY arg1 is message text.
+ * Returns NULL on success or the reason of failure. */
+static const char *panel_control(int cmd, int monitor, int edge,
+                                 const char *arg1, const char *arg2)
 {
-    int cmd = ev->data.b[0];
-    int monitor;
-    int edge;
-    char *plugin_type;
-    char *command;
     switch( cmd )
     {
 #ifndef DISABLE_MENU
@@ -240,7 +258,7 @@ static void process_client_msg ( XClientMessageEvent* ev )
                                     const LXPanelPluginInit *init;
                                     char buf[10];
 
-                                    init = g_hash_table_lookup (lxpanel_get_all_types (), "taskbar");
+                                    init = _lxpanel_find_plugin_type ("taskbar");
                                     if (init && init->control)
                                     {
                                         plugins = gtk_container_get_children (GTK_CONTAINER(p->priv->box));
@@ -291,17 +309,11 @@ static void process_client_msg ( XClientMessageEvent* ev )
             }
             break;
         case LXPANEL_CMD_COMMAND:
-            monitor = (ev->data.b[1] & 0xf) - 1; /* 0 for no monitor */
-            edge = (ev->data.b[1] >> 4) & 0x7;
-            if ((ev->data.b[1] & 0x80) != 0)
-                /* some extension, not supported yet */
-                break;
-            plugin_type = g_strndup(&ev->data.b[2], 18);
-            command = strchr(plugin_type, '\t');
-            if (!strncmp (plugin_type, "volumealsabt", 12))
+            if (arg1 == NULL || arg2 == NULL)
+                return "plugin type and command are required";
+            if (!strncmp (arg1, "volumealsabt", 12))
             {
                 /* special case - message volume plugin on all panels, not just the first one found */
-                *command++ = '\0';
                 GSList *l;
                 for (l = all_panels; l; l = l->next)
                 {
@@ -312,7 +324,7 @@ static void process_client_msg ( XClientMessageEvent* ev )
                         const LXPanelPluginInit *init;
                         GtkWidget *plugin = NULL;
 
-                        init = g_hash_table_lookup (lxpanel_get_all_types (), plugin_type);
+                        init = _lxpanel_find_plugin_type (arg1);
                         if (init)
                         {
                             plugins = gtk_container_get_children (GTK_CONTAINER (p->priv->box));
@@ -326,37 +338,25 @@ static void process_client_msg ( XClientMessageEvent* ev )
                             }
                             g_list_free (plugins);
 
-                            if (plugin && init->control) init->control (plugin, command);
+                            if (plugin && init->control) init->control (plugin, arg2);
                         }
                     }
                 }
             }
-            else if (command) do /* use do{}while(0) to enable break */
+            else
             {
                 LXPanel *p;
-                GSList *l;
                 GList *plugins, *pl;
                 const LXPanelPluginInit *init;
                 GtkWidget *plugin = NULL;
 
-                *command++ = '\0';
-                /* find the panel by monitor and edge */
-                for (l = all_panels; l; l = l->next)
-                {
-                    p = (LXPanel*)l->data;
-                    if (p->priv->box == NULL) /* inactive panel */
-                        continue;
-                    if (monitor >= 0 && p->priv->monitor != monitor)
-                        continue;
-                    if (edge == EDGE_NONE || p->priv->edge == edge)
-                        break;
-                }
-                if (l == NULL) /* match not found */
-                    break;
+                p = find_panel(monitor, edge);
+                if (p == NULL) /* match not found */
+                    return "no such panel";
                 /* find the plugin */
-                init = g_hash_table_lookup(lxpanel_get_all_types(), plugin_type);
+                init = _lxpanel_find_plugin_type(arg1);
                 if (init == NULL) /* no such plugin known */
-                    break;
+                    return "unknown plugin type";
                 plugins = gtk_container_get_children(GTK_CONTAINER(p->priv->box));
                 for (pl = plugins; pl; pl = pl->next)
                 {
@@ -368,7 +368,7 @@ static void process_client_msg ( XClientMessageEvent* ev )
                 }
                 g_list_free(plugins);
                 /* test for built-in commands ADD and DEL */
-                if (strcmp(command, "ADD") == 0)
+                if (strcmp(arg2, "ADD") == 0)
                 {
                     if (plugin == NULL)
                     {
@@ -376,136 +376,158 @@ static void process_client_msg ( XClientMessageEvent* ev )
 
                         cfg = config_group_add_subgroup(config_root_setting(p->priv->config),
                                                         "Plugin");
-                        config_group_set_string(cfg, "type", plugin_type);
-                        plugin = lxpanel_add_plugin(p, plugin_type, cfg, -1);
+                        config_group_set_string(cfg, "type", arg1);
+                        plugin = lxpanel_add_plugin(p, arg1, cfg, -1);
                         if (plugin == NULL) /* failed to create */
+                        {
                             config_setting_destroy(cfg);
+                            return "cannot create plugin";
+                        }
                     }
                 }
-                else if (strcmp(command, "DEL") == 0)
-                {
-                    if (plugin != NULL)
-                        lxpanel_remove_plugin(p, plugin);
-                }
+                else if (plugin == NULL)
+                    return "plugin not found";
+                else if (strcmp(arg2, "DEL") == 0)
+                    lxpanel_remove_plugin(p, plugin);
                 /* send the command */
-                else if (plugin && init->control)
-                    init->control(plugin, command);
-            } while(0);
-            g_free(plugin_type);
+                else if (init->control == NULL || !init->control(plugin, arg2))
+                    return "command failed";
+            }
             break;
         case LXPANEL_CMD_NOTIFY:
-            monitor = (ev->data.b[1] & 0xf) - 1; /* 0 for no monitor */
-            edge = (ev->data.b[1] >> 4) & 0x7;
-            if ((ev->data.b[1] & 0x80) != 0)
-                /* some extension, not supported yet */
-                break;
-            do /* use do{}while(0) to enable break */
             {
                 LXPanel *p;
-                GSList *l;
+
+                if (arg1 == NULL)
+                    return "message is required";
+                p = find_panel(monitor, edge);
+                if (p == NULL) /* match not found */
+                    return "no such panel";
+                /* lxpanel_notify() does not modify message */
+                lxpanel_notify (p, (char *)arg1);
+            }
+            break;
+        default:
+            return "unknown command";
+    }
+    return NULL;
+}
+
+static void process_client_msg ( XClientMessageEvent* ev )
+{
+    int cmd = ev->data.b[0];
+    int monitor = -1;
+    int edge = EDGE_NONE;
+    char *plugin_type;
+    char *command;
+
+    if (cmd == LXPANEL_CMD_COMMAND || cmd == LXPANEL_CMD_NOTIFY)
+    {
+        monitor = (ev->data.b[1] & 0xf) - 1; /* 0 for no monitor */
+        edge = (ev->data.b[1] >> 4) & 0x7;
+        if ((ev->data.b[1] & 0x80) != 0)
+            /* some extension, not supported yet */
+            return;
+    }
+    switch( cmd )
+    {
+        case LXPANEL_CMD_COMMAND:
+            plugin_type = g_strndup(&ev->data.b[2], 18);
+            command = strchr(plugin_type, '\t');
+            if (command)
+            {
+                *command++ = '\0';
+                panel_control(cmd, monitor, edge, plugin_type, command);
+            }
+            g_free(plugin_type);
+            break;
+        case LXPANEL_CMD_NOTIFY:
+            {
                 size_t siz;
                 FILE *fp;
-                char *buf;
-
-                /* find the panel by monitor and edge */
-                for (l = all_panels; l; l = l->next)
-                {
-                    p = (LXPanel*)l->data;
-                    if (p->priv->box == NULL) /* inactive panel */
-                        continue;
-                    if (monitor >= 0 && p->priv->monitor != monitor)
-                        continue;
-                    if (edge == EDGE_NONE || p->priv->edge == edge)
-                        break;
-                }
-                if (l == NULL) /* match not found */
-                    break;
+                char *buf = NULL;
+                char *path = g_strndup(&ev->data.b[2], 18);
 
-                buf = NULL;
-                fp = fopen (&ev->data.b[2], "rb");
+                fp = fopen (path, "rb");
                 if (fp)
                 {
                     if (getdelim (&buf, &siz, 0, fp) > 0)
-                    {
-                        lxpanel_notify (p, buf);
-                        free (buf);
-                    }
+                        panel_control(cmd, monitor, edge, buf, NULL);
+                    free (buf);
                     fclose (fp);
                 }
-                remove (&ev->data.b[2]);
-            } while(0);
+                remove (path);
+                g_free (path);
+            }
             break;
+        default:
+            panel_control(cmd, monitor, edge, NULL, NULL);
     }
 }
 
+/* private client message from lxpanelctl */
+static GdkFilterReturn
+panel_client_message(XEvent *ev, gpointer not_used)
+{
+    process_client_msg( (XClientMessageEvent*)ev );
+    return GDK_FILTER_CONTINUE;
+}
+
+/* only top level windows, reported on the root window, are of interest */
+static GdkFilterReturn
+panel_destroy_notify(XEvent *ev, gpointer not_used)
+{
+    if (((XDestroyWindowEvent*)ev)->event == GDK_ROOT_WINDOW())
+        fb_ev_emit_destroy( fbev, ((XDestroyWindowEvent*)ev)->window );
+    return GDK_FILTER_CONTINUE;
+}
+
 static GdkFilterReturn
-panel_event_filter(GdkXEvent *xevent, GdkEvent *event, gpointer not_used)
+panel_root_property_notify(XEvent *ev, gpointer not_used)
 {
     Atom at;
-    Window win;
-    XEvent *ev = (XEvent *) xevent;
 
     ENTER;
     DBG("win = 0x%x\n", ev->xproperty.window);
-    if (ev->type != PropertyNotify )
+    at = ev->xproperty.atom;
+    if (at == a_NET_CLIENT_LIST)
     {
-        /* private client message from lxpanelctl */
-        if( ev->type == ClientMessage && ev->xproperty.atom == a_LXPANEL_CMD )
-        {
-            process_client_msg( (XClientMessageEvent*)ev );
-        }
-        else if( ev->type == DestroyNotify )
-        {
-            fb_ev_emit_destroy( fbev, ((XDestroyWindowEvent*)ev)->window );
-        }
-        RET(GDK_FILTER_CONTINUE);
+        fb_ev_emit(fbev, EV_CLIENT_LIST);
     }
-
-    at = ev->xproperty.atom;
-    win = ev->xproperty.window;
-    if (win == GDK_ROOT_WINDOW())
+    else if (at == a_NET_CURRENT_DESKTOP)
     {
-        if (at == a_NET_CLIENT_LIST)
-        {
-            fb_ev_emit(fbev, EV_CLIENT_LIST);
-        }
-        else if (at == a_NET_CURRENT_DESKTOP)
-        {
-            GSList* l;
-            for( l = all_panels; l; l = l->next )
-                ((LXPanel*)l->data)->priv->curdesk = get_net_current_desktop();
-            fb_ev_emit(fbev, EV_CURRENT_DESKTOP);
-        }
-        else if (at == a_NET_NUMBER_OF_DESKTOPS)
-        {
-            GSList* l;
-            for( l = all_panels; l; l = l->next )
-                ((LXPanel*)l->data)->priv->desknum = get_net_number_of_desktops();
-            fb_ev_emit(fbev, EV_NUMBER_OF_DESKTOPS);
-        }
-        else if (at == a_NET_DESKTOP_NAMES)
-        {
-            fb_ev_emit(fbev, EV_DESKTOP_NAMES);
-        }
-        else if (at == a_NET_ACTIVE_WINDOW)
-        {
-            fb_ev_emit(fbev, EV_ACTIVE_WINDOW );
-        }
-        else if (at == a_NET_CLIENT_LIST_STACKING)
-        {
-            fb_ev_emit(fbev, EV_CLIENT_LIST_STACKING);
-        }
-        else if (at == a_XROOTPMAP_ID)
-        {
-            GSList* l;
-            for( l = all_panels; l; l = l->next )
-                _panel_queue_update_background((LXPanel*)l->data);
-        }
-        else
-            return GDK_FILTER_CONTINUE;
-
-        return GDK_FILTER_REMOVE;
+        GSList* l;
+        fb_ev_emit(fbev, EV_CURRENT_DESKTOP);
+        for( l = all_panels; l; l = l->next )
+            ((LXPanel*)l->data)->priv->curdesk = fb_ev_current_desktop(fbev);
+    }
+    else if (at == a_NET_NUMBER_OF_DESKTOPS)
+    {
+        GSList* l;
+        fb_ev_emit(fbev, EV_NUMBER_OF_DESKTOPS);
+        for( l = all_panels; l; l = l->next )
+            ((LXPanel*)l->data)->priv->desknum = fb_ev_number_of_desktops(fbev);
+    }
+    else if (at == a_NET_DESKTOP_NAMES)
+    {
+        fb_ev_emit(fbev, EV_DESKTOP_NAMES);
+    }
+    else if (at == a_NET_ACTIVE_WINDOW)
+    {
+        fb_ev_emit(fbev, EV_ACTIVE_WINDOW );
     }
+    else if (at == a_NET_CLIENT_LIST_STACKING)
+    {
+        fb_ev_emit(fbev, EV_CLIENT_LIST_STACKING);
+    }
+    else if (at == a_XROOTPMAP_ID)
+    {
+        GSList* l;
+        for( l = all_panels; l; l = l->next )
+            _panel_queue_update_background((LXPanel*)l->data);
+    }
+
+    /* GDK and other subscribers need root events too */
     return GDK_FILTER_CONTINUE;
 }
 
@@ -562,6 +584,7 @@ usage()
 //    g_print(_(" --log <number> -- set log level 0-5. 0 - none 5 - chatty\n"));
 //    g_print(_(" --configure -- launch configuration utility\n"));
     g_print(_(" --profile name -- use specified profile\n"));
+    g_print(_(" --trace file   -- write trace of startup and drawing into file\n"));
     g_print("\n");
     g_print(_(" -h  -- same as --help\n"));
     g_print(_(" -p  -- same as --profile\n"));
@@ -656,6 +679,64 @@ static gboolean check_user_warnings (gpointer data)
     return FALSE;
 }
 
+/* Collects plugin types referenced by panels in the directory. */
+static gboolean _collect_plugin_types(const char *panel_dir, GHashTable *types)
+{
+    GDir* dir = g_dir_open( panel_dir, 0, NULL );
+    const gchar* name;
+    gboolean found = FALSE;
+
+    if( ! dir )
+    {
+        return FALSE;
+    }
+
+    while((name = g_dir_read_name(dir)) != NULL)
+    {
+        char* panel_config = g_build_filename( panel_dir, name, NULL );
+        char *contents, **lines, **line, type[64];
+
+        if (strchr(panel_config, '~') == NULL && name[0] != '.' &&
+            g_file_get_contents(panel_config, &contents, NULL, NULL))
+        {
+            found = TRUE;
+            lines = g_strsplit(contents, "\n", -1);
+            for (line = lines; *line; line++)
+                if (sscanf(*line, " type = %63s", type) == 1)
+                    g_hash_table_insert(types, g_strdup(type), NULL);
+            g_strfreev(lines);
+            g_free(contents);
+        }
+        g_free( panel_config );
+    }
+    g_dir_close( dir );
+    return found;
+}
+
+/* Starts loading plugin modules which panels will need, the same order of
+   lookup as start_all_panels() uses. */
+static void preload_plugins(void)
+{
+    GHashTable *types = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    char *panel_dir;
+    const gchar * const * dir;
+    gboolean found;
+
+    panel_dir = _user_config_file_name(is_wizard () ? "wizard" : "panels", NULL);
+    found = _collect_plugin_types(panel_dir, types);
+    g_free(panel_dir);
+    dir = g_get_system_config_dirs();
+    if (dir) while (!found && dir[0])
+    {
+        panel_dir = _system_config_file_name(dir[0], is_wizard () ? "wizard" : "panels");
+        found = _collect_plugin_types(panel_dir, types);
+        g_free(panel_dir);
+        dir++;
+    }
+    _lxpanel_preload_modules(types);
+    g_hash_table_destroy(types);
+}
+
 static void _start_panels_from_dir(const char *panel_dir, int fallback)
 {
     GDir* dir = g_dir_open( panel_dir, 0, NULL );
@@ -734,6 +815,9 @@ int main(int argc, char *argv[], char *env[])
 {
     int i;
     const char* desktop_name;
+    const char* trace_file = NULL;
+    guint root_events[3];
+    gboolean is_main;
 #if !GTK_CHECK_VERSION(3, 0, 0)
     char *file;
 #endif
@@ -790,6 +874,15 @@ int main(int argc, char *argv[], char *env[])
             } else {
                 cprofile = g_strdup(argv[i]);
             }
+        } else if (!strcmp(argv[i], "--trace")) {
+            i++;
+            if (i == argc) {
+                g_critical( "lxpanel: missing trace file name");
+                usage();
+                exit(1);
+            } else {
+                trace_file = argv[i];
+            }
         } else {
             printf("lxpanel: unknown option - %s\n", argv[i]);
             usage();
@@ -797,6 +890,12 @@ int main(int argc, char *argv[], char *env[])
         }
     }
 
+    /* Start tracing if requested, see trace.c */
+    if (trace_file == NULL)
+        trace_file = g_getenv("LXPANEL_TRACE");
+    _lxpanel_trace_init(trace_file);
+    LXPANEL_TRACE_BEGIN("startup", NULL);
+
     /* Add a gtkrc file to be parsed too. */
 #if !GTK_CHECK_VERSION(3, 0, 0)
     file = _user_config_file_name("gtkrc", NULL);
@@ -805,7 +904,8 @@ int main(int argc, char *argv[], char *env[])
 #endif
 
     /* Check for duplicated lxpanel instances */
-    if (!check_main_lock() && !config) {
+    is_main = check_main_lock();
+    if (!is_main && !config) {
         printf("There is already an instance of LXPanel.  Now to exit\n");
         exit(1);
     }
@@ -814,6 +914,7 @@ int main(int argc, char *argv[], char *env[])
 
     /* Add our own icons to the search path of icon theme */
     gtk_icon_theme_append_search_path( gtk_icon_theme_get_default(), PACKAGE_DATA_DIR "/images" );
+    _lxpanel_icon_cache_init();
 
     fbev = fb_ev_new();
 
@@ -826,6 +927,7 @@ int main(int argc, char *argv[], char *env[])
     lxpanel_prepare_modules();
     lxpanel_register_plugin_type("space", &_lxpanel_static_plugin_space);
     init_static_plugins();
+    preload_plugins();
 
     load_global_config();
 
@@ -834,13 +936,23 @@ int main(int argc, char *argv[], char *env[])
      */
     gdk_window_set_events(gdk_get_default_root_window(), GDK_STRUCTURE_MASK |
             GDK_SUBSTRUCTURE_MASK | GDK_PROPERTY_CHANGE_MASK);
-    gdk_window_add_filter(gdk_get_default_root_window (), (GdkFilterFunc)panel_event_filter, NULL);
+    root_events[0] = lxpanel_x_event_connect(PropertyNotify, GDK_ROOT_WINDOW(), None,
+                                             panel_root_property_notify, NULL);
+    root_events[1] = lxpanel_x_event_connect(ClientMessage, None, a_LXPANEL_CMD,
+                                             panel_client_message, NULL);
+    root_events[2] = lxpanel_x_event_connect(DestroyNotify, None, None,
+                                             panel_destroy_notify, NULL);
 
     if( G_UNLIKELY( ! start_all_panels() ) )
         g_warning( "Config files are not found.\n" );
 
+    /* the control socket belongs to the running panel, not to configurator */
+    if (is_main)
+        _lxpanel_control_init(gdk_display_get_name(gdk_display_get_default()), panel_control);
+
     lxpanel_notify_init (first_panel);
     g_idle_add (check_user_warnings, first_panel);
+    LXPANEL_TRACE_END("startup", NULL);
 /*
  * FIXME: configure??
     if (config)
@@ -848,8 +960,10 @@ int main(int argc, char *argv[], char *env[])
 */
     gtk_main();
 
+    _lxpanel_control_finish();
     XSelectInput (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), GDK_ROOT_WINDOW(), NoEventMask);
-    gdk_window_remove_filter(gdk_get_default_root_window (), (GdkFilterFunc)panel_event_filter, NULL);
+    for (i = 0; i < (int)G_N_ELEMENTS(root_events); i++)
+        lxpanel_x_event_disconnect(root_events[i]);
 
     /* destroy all panels */
     g_slist_foreach( all_panels, (GFunc) gtk_widget_destroy, NULL );
@@ -861,6 +975,7 @@ int main(int argc, char *argv[], char *env[])
 
     lxpanel_unload_modules();
     fm_gtk_finalize();
+    _lxpanel_trace_finish();
 
     /* gdk_threads_leave(); */
 
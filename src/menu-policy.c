@@ -44,12 +44,14 @@ MenuCache * panel_menu_cache_new(guint32* visibility_flags)
     MenuCache* cache;
     gboolean need_prefix = (g_getenv("XDG_MENU_PREFIX") == NULL);
 
+    LXPANEL_TRACE_BEGIN("menu-cache-lookup", NULL);
 #if MENU_CACHE_CHECK_VERSION(0, 5, 0)
     /* do it the same way menu:// VFS plugin in libfm does */
     cache = menu_cache_lookup(need_prefix ? "lxde-applications.menu+hidden" : "applications.menu+hidden");
 #else
     cache = menu_cache_lookup(need_prefix ? "lxde-applications.menu" : "applications.menu");
 #endif
+    LXPANEL_TRACE_END("menu-cache-lookup", NULL);
     if(visibility_flags)
     {
         if(is_in_lxde)
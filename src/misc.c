@@ -1081,26 +1081,9 @@ static void _gtk_image_set_from_file_scaled(GtkWidget * img, ImgData * data)
         data->hilight = NULL;
     }
 
-    if (G_LIKELY(G_IS_THEMED_ICON(data->icon)))
-    {
-        const char *fallback = data->fallback;
-
-        if (fallback == NULL)
-            fallback = "application-x-executable";
-        data->pixbuf = fm_pixbuf_from_icon_with_fallback(data->icon, size, fallback);
-    }
-    else
-    {
-        char *file = g_icon_to_string(fm_icon_get_gicon(data->icon));
-        data->pixbuf = gdk_pixbuf_new_from_file_at_scale(file, -1, size, TRUE, NULL);
-        g_free(file);
-    }
-
-    if (data->pixbuf == NULL && data->fallback != NULL && data->fallback[0] == '/')
-    {
-        /* if fallback was provided as a file path */
-        data->pixbuf = gdk_pixbuf_new_from_file_at_scale(data->fallback, -1, size, TRUE, NULL);
-    }
+    /* images of the same icon are usually used on every panel, so share them */
+    data->pixbuf = lxpanel_icon_cache_get(data->icon, size, 1,
+                            data->fallback ? data->fallback : "application-x-executable");
 
     if (data->pixbuf != NULL)
     {
@@ -25,6 +25,9 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <string.h>
+#include <glib/gi18n.h>
+
 #include "private.h"
 #include "panel.h"
 #include "plugin.h"
@@ -37,15 +40,28 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SPACING 5
 
 #define INIT_MUTE 2500
-#define INTERVAL_MS 500
 
+#define POOL_SIZE 6                 /* Maximum number of popups on screen */
+#define QUEUE_MAX 32                /* Maximum number of messages waiting */
+#define RATE_BURST 4                /* Messages which can be shown at once */
+#define RATE_MS 500                 /* Time to earn one more message */
+
+/* Popup window, reused for many messages */
 typedef struct {
-    GtkWidget *popup;               /* Popup message window*/
+    GtkWidget *popup;
+    GtkWidget *label;
+    struct _NotifyWindow *nw;       /* Message shown in it, or NULL */
+} NotifyPopup;
+
+typedef struct _NotifyWindow {
+    LXPanel *panel;                 /* Panel to show message next to */
+    NotifyPopup *pp;                /* Popup showing message, NULL while queued */
     guint hide_timer;               /* Timer to hide message window */
     int seq;                        /* Sequence number */
-    guint hash;                     /* Hash of message string */
-    char *message;
-    gboolean shown;
+    guint hash;                     /* Hash of key */
+    char *key;                      /* Message with numbers replaced by '#' */
+    int count;                      /* Number of similar messages coalesced */
+    char *message;                  /* Latest of the coalesced messages */
 } NotifyWindow;
 
 
@@ -53,18 +69,23 @@ typedef struct {
 /* Global data */
 /*----------------------------------------------------------------------------*/
 
-static GList *nwins = NULL;         /* List of current notifications */
+static GList *nwins = NULL;         /* List of current notifications, newest first */
 static int nseq = 0;                /* Sequence number for notifications */
-static gint interval_timer = 0;     /* Used to show windows one at a time */
+static guint interval_timer = 0;    /* Used to show queued windows when allowed */
+static gboolean muted = TRUE;       /* Don't show anything until started */
+static NotifyPopup pool[POOL_SIZE]; /* Popup windows, created on demand */
+static guint layout_idle = 0;       /* Pending reposition of popups */
+static double tokens = RATE_BURST;  /* Messages which can be shown right now */
+static gint64 tokens_time = 0;      /* Time tokens were last updated */
 
 /*----------------------------------------------------------------------------*/
 /* Function prototypes */
 /*----------------------------------------------------------------------------*/
 
-static void show_message (LXPanel *panel, NotifyWindow *nw, char *str);
-static gboolean hide_message (NotifyWindow *nw);
-static void update_positions (GList *item, int offset);
-static gboolean window_click (GtkWidget *widget, GdkEventButton *event, NotifyWindow *nw);
+static void hide_message (NotifyWindow *nw);
+static gboolean hide_timeout (gpointer data);
+static gboolean show_next (gpointer data);
+static gboolean window_click (GtkWidget *widget, GdkEventButton *event, NotifyPopup *pp);
 
 /*----------------------------------------------------------------------------*/
 /* Private functions */
@@ -72,10 +93,10 @@ static gboolean window_click (GtkWidget *widget, GdkEventButton *event, NotifyWi
 
 /* Calculate position; based on lxpanel_plugin_popup_set_position_helper */
 
-static void notify_position_helper (LXPanel *p, GtkWidget *popup, gint *px, gint *py)
+static void notify_position_helper (LXPanel *p, gint width, gint *px, gint *py)
 {
     GdkMonitor *monitor;
-    GdkRectangle pop_geom, mon_geom, pan_geom;
+    GdkRectangle mon_geom, pan_geom;
 
     /* Get the geometry of the monitor on which the panel is displayed */
     monitor = gdk_display_get_monitor_at_window (gtk_widget_get_display (p->priv->box), gtk_widget_get_window (p->priv->box));
@@ -84,12 +105,8 @@ static void notify_position_helper (LXPanel *p, GtkWidget *popup, gint *px, gint
     /* Get the geometry of the panel */
     gdk_window_get_frame_extents (gtk_widget_get_window (p->priv->box), &pan_geom);
 
-    /* Get the geometry of the popup menu */
-    gtk_widget_realize (popup);
-    gdk_window_get_frame_extents (gtk_widget_get_window (popup), &pop_geom);
-
     /* By default, notifications go in the top right corner of the monitor with the panel */
-    *px = mon_geom.x + mon_geom.width - pop_geom.width;
+    *px = mon_geom.x + mon_geom.width - width;
     *py = mon_geom.y;
 
     /* Shift if panel is in the way...*/
@@ -97,13 +114,63 @@ static void notify_position_helper (LXPanel *p, GtkWidget *popup, gint *px, gint
     if (p->priv->edge == EDGE_RIGHT) *px -= pan_geom.width;
 }
 
-/* Create a notification window and position appropriately */
+/* Make the message key ignoring numbers, so "CPU at 81C" and "CPU at 82C" are similar */
+
+static char *message_key (const char *message)
+{
+    GString *key = g_string_sized_new (strlen (message));
+    const char *cptr;
+
+    for (cptr = message; *cptr; cptr++)
+    {
+        if (g_ascii_isdigit (*cptr))
+        {
+            while (g_ascii_isdigit (cptr[1])) cptr++;
+            g_string_append_c (key, '#');
+        }
+        else g_string_append_c (key, *cptr);
+    }
+    return g_string_free (key, FALSE);
+}
+
+/* Stack all shown popups from the panel corner, newest on top; done once per frame */
+
+static gboolean layout_popups (gpointer data)
+{
+    GHashTable *offsets = g_hash_table_new (NULL, NULL);
+    GtkRequisition req;
+    NotifyWindow *nw;
+    GList *item;
+    gint x, y, offset;
+
+    layout_idle = 0;
+    for (item = nwins; item != NULL; item = item->next)
+    {
+        nw = (NotifyWindow *) item->data;
+        if (!nw->pp) continue;
+
+        gtk_widget_get_preferred_size (nw->pp->popup, NULL, &req);
+        notify_position_helper (nw->panel, req.width, &x, &y);
+        offset = GPOINTER_TO_INT (g_hash_table_lookup (offsets, nw->panel));
+        gtk_window_move (GTK_WINDOW (nw->pp->popup), x, y + offset);
+        g_hash_table_insert (offsets, nw->panel, GINT_TO_POINTER (offset + req.height + SPACING));
+        if (!gtk_widget_get_visible (nw->pp->popup)) gtk_widget_show (nw->pp->popup);
+    }
+    g_hash_table_destroy (offsets);
+    return FALSE;
+}
+
+static void queue_layout (void)
+{
+    // run before the next redraw so all changes in this frame are moved together
+    if (!layout_idle) layout_idle = g_idle_add_full (GDK_PRIORITY_REDRAW - 1, layout_popups, NULL, NULL);
+}
+
+/* Create popup window for the pool */
 
-static void show_message (LXPanel *panel, NotifyWindow *nw, char *str)
+static void popup_init (NotifyPopup *pp)
 {
-    GtkWidget *box, *item;
-    gint x, y;
-    char *fmt, *cptr;
+    GtkWidget *box;
 
     /*
      * In order to get a window which looks exactly like a system tooltip, client-side decoration
@@ -112,18 +179,34 @@ static void show_message (LXPanel *panel, NotifyWindow *nw, char *str)
      * The code below is compatible with a hacked GTK+3 library which uses GTK_WINDOW_POPUP + 1 as the type
      * for a window with CSD requested. It should also not fall over with the standard library...
      */
-    nw->popup = gtk_window_new (GTK_WINDOW_POPUP + 1);
-    if (!nw->popup) nw->popup = gtk_window_new (GTK_WINDOW_POPUP);
-    gtk_window_set_type_hint (GTK_WINDOW (nw->popup), GDK_WINDOW_TYPE_HINT_TOOLTIP);
-    gtk_window_set_resizable (GTK_WINDOW (nw->popup), FALSE);
+    pp->popup = gtk_window_new (GTK_WINDOW_POPUP + 1);
+    if (!pp->popup) pp->popup = gtk_window_new (GTK_WINDOW_POPUP);
+    gtk_window_set_type_hint (GTK_WINDOW (pp->popup), GDK_WINDOW_TYPE_HINT_TOOLTIP);
+    gtk_window_set_resizable (GTK_WINDOW (pp->popup), FALSE);
 
-    GtkStyleContext *context = gtk_widget_get_style_context (nw->popup);
+    GtkStyleContext *context = gtk_widget_get_style_context (pp->popup);
     gtk_style_context_add_class (context, GTK_STYLE_CLASS_TOOLTIP);
 
     box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 5);
-    gtk_container_add (GTK_CONTAINER (nw->popup), box);
+    gtk_container_add (GTK_CONTAINER (pp->popup), box);
+
+    pp->label = gtk_label_new (NULL);
+    gtk_label_set_justify (GTK_LABEL (pp->label), GTK_JUSTIFY_CENTER);
+    gtk_box_pack_start (GTK_BOX (box), pp->label, FALSE, FALSE, 0);
+    gtk_widget_show_all (box);
+
+    gtk_widget_add_events (pp->popup, GDK_BUTTON_PRESS_MASK);
+    g_signal_connect (G_OBJECT (pp->popup), "button-press-event", G_CALLBACK (window_click), pp);
+}
 
-    fmt = g_strcompress (str);
+/* Set the text of the message into its popup */
+
+static void update_label (NotifyWindow *nw)
+{
+    char *fmt, *cptr, *text;
+    int x;
+
+    fmt = g_strcompress (nw->message);
 
     // setting gtk_label_set_max_width_chars looks awful, so we have to do this...
     cptr = fmt;
@@ -136,104 +219,128 @@ static void show_message (LXPanel *panel, NotifyWindow *nw, char *str)
         x++;
     }
 
-    item = gtk_label_new (fmt);
-    gtk_label_set_justify (GTK_LABEL (item), GTK_JUSTIFY_CENTER);
-    gtk_box_pack_start (GTK_BOX (box), item, FALSE, FALSE, 0);
+    if (nw->count > 1)
+    {
+        text = g_strdup_printf (ngettext ("%s\n(%d time)", "%s\n(%d times)", nw->count),
+                                fmt, nw->count);
+        gtk_label_set_text (GTK_LABEL (nw->pp->label), text);
+        g_free (text);
+    }
+    else gtk_label_set_text (GTK_LABEL (nw->pp->label), fmt);
     g_free (fmt);
+}
 
-    gtk_widget_show_all (nw->popup);
-    gtk_widget_hide (nw->popup);
-
-    notify_position_helper (panel, nw->popup, &x, &y);
-    gdk_window_move (gtk_widget_get_window (nw->popup), x, y);
-
-    gdk_window_set_events (gtk_widget_get_window (nw->popup), gdk_window_get_events (gtk_widget_get_window (nw->popup)) | GDK_BUTTON_PRESS_MASK);
-    g_signal_connect (G_OBJECT (nw->popup), "button-press-event", G_CALLBACK (window_click), nw);
-    gtk_widget_show (nw->popup);
-    if (panel->priv->notify_timeout > 0) nw->hide_timer = g_timeout_add (panel->priv->notify_timeout * 1000, (GSourceFunc) hide_message, nw);
+static void restart_hide_timer (NotifyWindow *nw)
+{
+    if (nw->hide_timer) g_source_remove (nw->hide_timer);
+    nw->hide_timer = 0;
+    if (nw->panel->priv->notify_timeout > 0)
+        nw->hide_timer = g_timeout_add (nw->panel->priv->notify_timeout * 1000, hide_timeout, nw);
 }
 
-/* Destroy a notification window and remove from list */
+/* Attach a free popup from the pool to a queued message */
 
-static gboolean hide_message (NotifyWindow *nw)
+static void show_message (NotifyWindow *nw)
 {
+    NotifyWindow *oldest = NULL;
     GList *item;
-    int w, h;
+    int i;
 
-    // shuffle notifications below up
-    if (nw->popup)
+    for (i = 0; i < POOL_SIZE; i++)
+        if (pool[i].nw == NULL) break;
+
+    // no free popup - the oldest shown message gives way
+    if (i == POOL_SIZE)
+    {
+        for (item = nwins; item != NULL; item = item->next)
+            if (((NotifyWindow *) item->data)->pp) oldest = (NotifyWindow *) item->data;
+        i = oldest->pp - pool;
+        hide_message (oldest);
+    }
+
+    if (pool[i].popup == NULL) popup_init (&pool[i]);
+    pool[i].nw = nw;
+    nw->pp = &pool[i];
+    update_label (nw);
+    restart_hide_timer (nw);
+    queue_layout ();
+}
+
+/* Remove a notification, returning its popup to the pool */
+
+static void hide_message (NotifyWindow *nw)
+{
+    if (nw->pp)
     {
-        item = g_list_find (nwins, nw);
-        gtk_window_get_size (GTK_WINDOW (nw->popup), &w, &h);
-        update_positions (item->next, - (h + SPACING));
-        gtk_widget_destroy (nw->popup);
+        gtk_widget_hide (nw->pp->popup);
+        nw->pp->nw = NULL;
+        queue_layout ();
     }
 
     if (nw->hide_timer) g_source_remove (nw->hide_timer);
 
     nwins = g_list_remove (nwins, nw);
+    g_free (nw->key);
     g_free (nw->message);
     g_free (nw);
-    return FALSE;
 }
 
-/* Relocate notifications below the supplied item by the supplied vertical offset */
-
-static void update_positions (GList *item, int offset)
+static gboolean hide_timeout (gpointer data)
 {
-    NotifyWindow *nw;
-    int x, y;
+    NotifyWindow *nw = (NotifyWindow *) data;
 
-    for (; item != NULL; item = item->next)
-    {
-        nw = (NotifyWindow *) item->data;
-        gdk_window_get_position (gtk_widget_get_window (nw->popup), &x, &y);
-        gdk_window_move (gtk_widget_get_window (nw->popup), x, y + offset);
-    }
+    nw->hide_timer = 0;
+    hide_message (nw);
+    return FALSE;
 }
 
 /* Handler for mouse click in notification window - closes window */
 
-static gboolean window_click (GtkWidget *widget, GdkEventButton *event, NotifyWindow *nw)
+static gboolean window_click (GtkWidget *widget, GdkEventButton *event, NotifyPopup *pp)
 {
-    hide_message (nw);
+    if (pp->nw) hide_message (pp->nw);
     return FALSE;
 }
 
-/* Timer handler to show next window */
+/* Token bucket - refill according to elapsed time, returns TRUE if a message may be shown */
 
-static gboolean show_next (LXPanel *panel)
+static gboolean take_token (void)
 {
-    NotifyWindow *nw;
-    GList *item;
-    int w, h;
+    gint64 now = g_get_monotonic_time ();
+
+    tokens += (double) (now - tokens_time) / (RATE_MS * 1000);
+    if (tokens > RATE_BURST) tokens = RATE_BURST;
+    tokens_time = now;
+    if (tokens < 1.0) return FALSE;
+    tokens -= 1.0;
+    return TRUE;
+}
 
-    if (nwins)
-    {
-        // loop through notifications in the list, finding the oldest which is unshown
-        for (item = g_list_last (nwins); item != NULL; item = item->prev)
-        {
-            nw = (NotifyWindow *) item->data;
+/* Show queued notifications, oldest first, as fast as the rate limit allows */
 
-            // is this one shown?
-            if (nw->shown) continue;
-            nw->shown = TRUE;
+static gboolean show_next (gpointer data)
+{
+    NotifyWindow *nw;
+    GList *item, *prev;
 
-            // if not, show the window
-            show_message (panel, nw, nw->message);
+    interval_timer = 0;
+    muted = FALSE;
 
-            // shuffle existing notifications down
-            gtk_window_get_size (GTK_WINDOW (nw->popup), &w, &h);
-            update_positions (item->next, h + SPACING);
+    // showing may hide the oldest shown message, which is always past this one
+    for (item = g_list_last (nwins); item != NULL; item = prev)
+    {
+        prev = item->prev;
+        nw = (NotifyWindow *) item->data;
+        if (nw->pp) continue;
 
-            // if there is a newer notification, re-call the timer else stop
-            if (item->prev) interval_timer = g_timeout_add (INTERVAL_MS, (GSourceFunc) show_next, panel);
-            else interval_timer = 0;
-            return FALSE;
+        if (!take_token ())
+        {
+            // wait until the next token is earned
+            interval_timer = g_timeout_add ((1.0 - tokens) * RATE_MS + 1, show_next, NULL);
+            break;
         }
+        show_message (nw);
     }
-
-    interval_timer = 0;
     return FALSE;
 }
 
@@ -244,30 +351,53 @@ static gboolean show_next (LXPanel *panel)
 void lxpanel_notify_init (LXPanel *panel)
 {
     // set timer for initial display of notifications
-    interval_timer = g_timeout_add (INIT_MUTE, (GSourceFunc) show_next, panel);
+    tokens_time = g_get_monotonic_time ();
+    interval_timer = g_timeout_add (INIT_MUTE, show_next, NULL);
 }
 
 int lxpanel_notify (LXPanel *panel, char *message)
 {
     NotifyWindow *nw;
     GList *item;
+    int queued = 0;
 
     // check for notifications being disabled
     if (!panel->priv->notifications) return 0;
 
-    // check to see if this notification is already in the list - just bump it to the top if so...
-    guint hash = g_str_hash (message);
+    // check to see if a similar notification is already in the list - count it there if so...
+    char *key = message_key (message);
+    guint hash = g_str_hash (key);
 
-    // loop through windows in the list, looking for the hash
     for (item = nwins; item != NULL; item = item->next)
     {
-        // if hash matches, hide the window
         nw = (NotifyWindow *) item->data;
-        if (nw->hash == hash) hide_message (nw);
+        if (nw->hash == hash && nw->panel == panel && strcmp (nw->key, key) == 0)
+        {
+            g_free (key);
+            nw->count++;
+            g_free (nw->message);
+            nw->message = g_strdup (message);
+            if (nw->pp)
+            {
+                update_label (nw);
+                restart_hide_timer (nw);
+                queue_layout ();
+            }
+            return nw->seq;
+        }
+        if (!nw->pp) queued++;
     }
 
-    // create a new notification window and add it to the front of the list
-    nw = g_new (NotifyWindow, 1);
+    // drop the oldest waiting message if too many are queued
+    if (queued >= QUEUE_MAX)
+    {
+        for (item = g_list_last (nwins); item != NULL; item = item->prev)
+            if (!((NotifyWindow *) item->data)->pp) break;
+        hide_message ((NotifyWindow *) item->data);
+    }
+
+    // create a new notification and add it to the front of the list
+    nw = g_new0 (NotifyWindow, 1);
     nwins = g_list_prepend (nwins, nw);
 
     // set the sequence number for this notification
@@ -275,18 +405,15 @@ int lxpanel_notify (LXPanel *panel, char *message)
     if (nseq == -1) nseq++;     // use -1 for invalid sequence code
     nw->seq = nseq;
     nw->hash = hash;
-    nw->popup = NULL;
+    nw->key = key;
+    nw->count = 1;
+    nw->panel = panel;
     nw->message = g_strdup (message);
-    nw->shown = FALSE;
 
-    // if the timer isn't running, show the notification immediately and start the timer
-    if (interval_timer == 0)
-    {
-        show_next (panel);
-        interval_timer = g_timeout_add (INTERVAL_MS, (GSourceFunc) show_next, panel);
-    }
+    // show it now if allowed, else it waits for the timer
+    if (!muted && interval_timer == 0) show_next (NULL);
 
-    return nseq;
+    return nw->seq;
 }
 
 void lxpanel_notify_clear (int seq)
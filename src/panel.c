@@ -72,6 +72,14 @@ static GtkWindowGroup* win_grp = NULL; /* window group used to limit the scope o
 
 static gulong monitors_handler = 0;
 
+/* Panels which lost their monitor are kept unmapped with all plugins alive,
+   so reconnecting the monitor costs only a map and relayout. If the process
+   grows above the limit then the panel which was parked first is destroyed
+   to be recreated from config later. */
+int panel_park_memory_limit = PANEL_PARK_MEMORY_DEFAULT;
+static GList *parked_panels = NULL; /* most recently parked first */
+static guint parked_check_timer = 0;
+
 static void panel_start_gui(LXPanel *p, config_setting_t *list);
 static void ah_start(LXPanel *p);
 static void ah_stop(LXPanel *p);
@@ -81,6 +89,7 @@ enum
 {
     ICON_SIZE_CHANGED,
     PANEL_FONT_CHANGED,
+    PARKED_CHANGED,
     N_SIGNALS
 };
 
@@ -239,6 +248,11 @@ static void panel_stop_gui(LXPanel *self)
     g_debug("panel_stop_gui on '%s'", p->name);
     if (p->autohide)
         ah_stop(self);
+    if (p->parked)
+    {
+        parked_panels = g_list_remove(parked_panels, self);
+        p->parked = FALSE;
+    }
 
     if (p->pref_dialog != NULL)
         gtk_widget_destroy(p->pref_dialog);
@@ -328,7 +342,8 @@ static gboolean idle_update_background(gpointer p)
 
 void _panel_queue_update_background(LXPanel *panel)
 {
-    if (panel->priv->background_update_queued)
+    /* it is updated when panel is unparked */
+    if (panel->priv->background_update_queued || panel->priv->parked)
         return;
     panel->priv->background_update_queued = g_idle_add_full(G_PRIORITY_HIGH,
                                                             idle_update_background,
@@ -579,6 +594,15 @@ static void lxpanel_class_init(PanelToplevelClass *klass)
                      NULL, NULL,
                      g_cclosure_marshal_VOID__VOID,
                      G_TYPE_NONE, 0, G_TYPE_NONE);
+
+    signals[PARKED_CHANGED] =
+        g_signal_new("parked-changed",
+                     G_TYPE_FROM_CLASS(klass),
+                     G_SIGNAL_RUN_LAST,
+                     G_STRUCT_OFFSET(PanelToplevelClass, parked_changed),
+                     NULL, NULL,
+                     g_cclosure_marshal_VOID__VOID,
+                     G_TYPE_NONE, 0, G_TYPE_NONE);
 }
 
 static void lxpanel_init(PanelToplevel *self)
@@ -1257,7 +1281,7 @@ static void ah_state_set(LXPanel *panel, PanelAHState ah_state)
 static void ah_start(LXPanel *p)
 {
     ENTER;
-    if (!p->priv->mouse_timeout)
+    if (!p->priv->mouse_timeout && !p->priv->parked)
         p->priv->mouse_timeout = g_timeout_add(PERIOD, (GSourceFunc) mouse_watch, p);
     RET();
 }
@@ -1394,6 +1418,7 @@ void _lxpanel_remove_plugin(LXPanel *p, GtkWidget *plugin)
     g_list_free(children);
 
     lxpanel_config_save(p);
+    _lxpanel_control_emit("plugin-removed", panel->name, gtk_widget_get_name(plugin), NULL);
     gtk_widget_destroy(plugin);
 }
 
@@ -1847,10 +1872,32 @@ error:
     RET(0);
 }
 
+/* Desktop and state hints, WM drops them when window is withdrawn. */
+static void panel_set_wm_state(LXPanel *panel)
+{
+    Atom state[3];
+    gulong val;
+    Screen *xscreen = GDK_SCREEN_XSCREEN(gtk_widget_get_screen(GTK_WIDGET(panel)));
+    Display *xdisplay = DisplayOfScreen(xscreen);
+    Panel *p = panel->priv;
+
+    /* send it to running wm */
+    Xclimsgx(xscreen, p->topxwin, a_NET_WM_DESKTOP, G_MAXULONG, 0, 0, 0, 0);
+    /* and assign it ourself just for case when wm is not running */
+    val = G_MAXULONG;
+    XChangeProperty(xdisplay, p->topxwin, a_NET_WM_DESKTOP, XA_CARDINAL, 32,
+          PropModeReplace, (unsigned char *) &val, 1);
+
+    state[0] = a_NET_WM_STATE_SKIP_PAGER;
+    state[1] = a_NET_WM_STATE_SKIP_TASKBAR;
+    state[2] = a_NET_WM_STATE_STICKY;
+    XChangeProperty(xdisplay, p->topxwin, a_NET_WM_STATE, XA_ATOM,
+          32, PropModeReplace, (unsigned char *) state, 3);
+}
+
 static void
 panel_start_gui(LXPanel *panel, config_setting_t *list)
 {
-    Atom state[3];
     XWMHints wmhints;
     gulong val;
     Screen *xscreen = GDK_SCREEN_XSCREEN(gtk_widget_get_screen(GTK_WIDGET(panel)));
@@ -1864,8 +1911,9 @@ panel_start_gui(LXPanel *panel, config_setting_t *list)
     ENTER;
 
     g_debug("panel_start_gui on '%s'", p->name);
-    p->curdesk = get_net_current_desktop();
-    p->desknum = get_net_number_of_desktops();
+    LXPANEL_TRACE_BEGIN("panel-start-gui", p->name);
+    p->curdesk = fb_ev_current_desktop(fbev);
+    p->desknum = fb_ev_number_of_desktops(fbev);
     //p->workarea = get_xaproperty (GDK_ROOT_WINDOW(), a_NET_WORKAREA, XA_CARDINAL, &p->wa_len);
     p->ax = p->ay = p->aw = p->ah = 0;
 
@@ -1919,19 +1967,7 @@ panel_start_gui(LXPanel *panel, config_setting_t *list)
     gtk_window_present(GTK_WINDOW(panel));
 
     /* the settings that should be done after window is mapped */
-
-    /* send it to running wm */
-    Xclimsgx(xscreen, p->topxwin, a_NET_WM_DESKTOP, G_MAXULONG, 0, 0, 0, 0);
-    /* and assign it ourself just for case when wm is not running */
-    val = G_MAXULONG;
-    XChangeProperty(xdisplay, p->topxwin, a_NET_WM_DESKTOP, XA_CARDINAL, 32,
-          PropModeReplace, (unsigned char *) &val, 1);
-
-    state[0] = a_NET_WM_STATE_SKIP_PAGER;
-    state[1] = a_NET_WM_STATE_SKIP_TASKBAR;
-    state[2] = a_NET_WM_STATE_STICKY;
-    XChangeProperty(xdisplay, p->topxwin, a_NET_WM_STATE, XA_ATOM,
-          32, PropModeReplace, (unsigned char *) state, 3);
+    panel_set_wm_state(panel);
 
     p->initialized = TRUE;
 
@@ -1944,6 +1980,7 @@ panel_start_gui(LXPanel *panel, config_setting_t *list)
             config_setting_remove_elem(list, i);
     }
 
+    LXPANEL_TRACE_END("panel-start-gui", p->name);
     RET();
 }
 
@@ -2156,6 +2193,7 @@ static gboolean _panel_idle_reconfigure(gpointer widget)
     _panel_queue_update_background(panel);
 
     p->reconfigure_queued = 0;
+    _lxpanel_control_emit("reconfigured", p->name, NULL);
 
     warp_pointer (p);
 
@@ -2262,6 +2300,93 @@ panel_parse_global(Panel *p, config_setting_t *cfg)
     return 1;
 }
 
+/* Returns resident size of the process in KiB, or 0 if unknown. */
+static gulong panel_get_rss(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long size, rss = 0;
+
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%lu %lu", &size, &rss) != 2)
+        rss = 0;
+    fclose(f);
+    return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Destroys the oldest parked panel if process is above the limit. Only one
+   panel at a time, freed memory is not always returned to the system. */
+static gboolean panel_check_parked(gpointer unused)
+{
+    LXPanel *panel;
+
+    if (parked_panels != NULL && panel_get_rss() > (gulong)panel_park_memory_limit)
+    {
+        panel = g_list_last(parked_panels)->data;
+        g_debug("parked panel '%s' exceeds memory limit, destroying it", panel->priv->name);
+        panel_stop_gui(panel);
+    }
+    if (parked_panels != NULL)
+        return TRUE;
+    parked_check_timer = 0;
+    return FALSE;
+}
+
+/* Unmaps the panel keeping all plugins, the same cleanup as panel_stop_gui()
+   does except the box destruction. */
+static void panel_park(LXPanel *panel)
+{
+    Panel *p = panel->priv;
+
+    g_debug("parking panel '%s'", p->name);
+    ah_stop(panel);
+    if (p->pref_dialog != NULL)
+        gtk_widget_destroy(p->pref_dialog);
+    p->pref_dialog = NULL;
+    if (p->plugin_pref_dialog != NULL)
+        gtk_dialog_response(GTK_DIALOG(p->plugin_pref_dialog), GTK_RESPONSE_CLOSE);
+    if (p->strut_update_queued)
+    {
+        g_source_remove(p->strut_update_queued);
+        p->strut_update_queued = 0;
+    }
+    if (p->background_update_queued)
+    {
+        g_source_remove(p->background_update_queued);
+        p->background_update_queued = 0;
+    }
+    p->ah_state = AH_STATE_VISIBLE;
+    gtk_widget_show(p->box);
+    gtk_widget_hide(GTK_WIDGET(panel));
+    p->parked = TRUE;
+    parked_panels = g_list_prepend(parked_panels, panel);
+    if (parked_check_timer == 0)
+        parked_check_timer = g_timeout_add_seconds(30, panel_check_parked, NULL);
+    /* let plugins stop their timers */
+    g_signal_emit(panel, signals[PARKED_CHANGED], 0);
+}
+
+static void panel_unpark(LXPanel *panel)
+{
+    Panel *p = panel->priv;
+    GdkRectangle rect;
+
+    g_debug("unparking panel '%s'", p->name);
+    parked_panels = g_list_remove(parked_panels, panel);
+    p->parked = FALSE;
+    p->curdesk = fb_ev_current_desktop(fbev);
+    p->desknum = fb_ev_number_of_desktops(fbev);
+    p->visible = TRUE;
+    panel_set_dock_type(p);
+    panel_set_wm_state(panel);
+    _calculate_position(panel, &rect);
+    gtk_window_move(GTK_WINDOW(panel), rect.x, rect.y);
+    gtk_window_present(GTK_WINDOW(panel));
+    gtk_widget_queue_resize(GTK_WIDGET(panel));
+    _panel_queue_update_background(panel);
+    g_signal_emit(panel, signals[PARKED_CHANGED], 0);
+}
+
 static void on_monitors_changed(GdkScreen* screen, gpointer unused)
 {
     GSList *pl;
@@ -2276,10 +2401,19 @@ static void on_monitors_changed(GdkScreen* screen, gpointer unused)
         LXPanel *p = pl->data;
 
         /* handle connecting and disconnecting monitors now */
-        if (p->priv->monitor < monitors && !p->priv->initialized)
+        if (p->priv->monitor < monitors && p->priv->parked)
+            panel_unpark(p);
+        else if (p->priv->monitor < monitors && !p->priv->initialized)
             panel_start_gui(p, config_setting_get_member(config_root_setting(p->priv->config), ""));
+        else if (p->priv->monitor >= monitors && p->priv->parked)
+            continue;
         else if (p->priv->monitor >= monitors && p->priv->initialized)
-            panel_stop_gui(p);
+        {
+            if (panel_park_memory_limit > 0)
+                panel_park(p);
+            else
+                panel_stop_gui(p);
+        }
         /* resize panel if appropriate monitor changed its size or position */
         else
         {
@@ -2329,8 +2463,16 @@ LXPanel* panel_new( const char* config_file, const char* config_name )
         panel = panel_allocate(gdk_screen_get_default());
         panel->priv->name = g_strdup(config_name);
         g_debug("starting panel from file %s",config_file);
-        if (!config_read_file(panel->priv->config, config_file) ||
-            !panel_start(panel))
+        LXPANEL_TRACE_BEGIN("config-read", config_file);
+        if (!config_read_file(panel->priv->config, config_file))
+        {
+            LXPANEL_TRACE_END("config-read", config_file);
+            g_warning( "lxpanel: can't start panel");
+            gtk_widget_destroy(GTK_WIDGET(panel));
+            return NULL;
+        }
+        LXPANEL_TRACE_END("config-read", config_file);
+        if (!panel_start(panel))
         {
             g_warning( "lxpanel: can't start panel");
             gtk_widget_destroy(GTK_WIDGET(panel));
@@ -2353,12 +2495,15 @@ LXPanel* panel_new_mon_fb (const char* config_file, const char* config_name)
         panel = panel_allocate (gdk_screen_get_default ());
         panel->priv->name = g_strdup (config_name);
         g_debug ("starting panel from file %s", config_file);
+        LXPANEL_TRACE_BEGIN ("config-read", config_file);
         if (!config_read_file (panel->priv->config, config_file))
         {
+            LXPANEL_TRACE_END ("config-read", config_file);
             g_warning ( "lxpanel: can't start panel");
             gtk_widget_destroy (GTK_WIDGET(panel));
             return NULL;
         }
+        LXPANEL_TRACE_END ("config-read", config_file);
 
         GdkScreen *screen = gtk_widget_get_screen (GTK_WIDGET (panel));
 
@@ -2447,6 +2592,11 @@ gboolean panel_is_dynamic(LXPanel *panel)
     return panel->priv->widthtype == WIDTH_REQUEST;
 }
 
+gboolean panel_is_parked(LXPanel *panel)
+{
+    return panel->priv->parked;
+}
+
 GtkWidget *panel_box_new(LXPanel *panel, gboolean homogeneous, gint spacing)
 {
 #if GTK_CHECK_VERSION(3, 0, 0)
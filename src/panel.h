@@ -79,12 +79,16 @@ struct _LXPanel
  * @panel_font_changed: callback for "panel-font-changed" signal, emitted when
  *              custom font enabled, disabled or its metrics or color changed
  *              in the panel configuration dialog.
+ * @parked_changed: callback for "parked-changed" signal, emitted when panel
+ *              is unmapped because its monitor is gone, or mapped back. The
+ *              plugins may stop their periodic work while panel is parked.
  */
 struct _LXPanelClass
 {
     GtkWindowClass parent_class;
     void (*icon_size_changed)(LXPanel *panel);
     void (*panel_font_changed)(LXPanel *panel);
+    void (*parked_changed)(LXPanel *panel);
 };
 
 /**
@@ -154,6 +158,7 @@ extern GtkStyle *panel_get_defstyle(LXPanel *panel);
 extern GtkIconTheme *panel_get_icon_theme(LXPanel *panel);
 extern gboolean panel_is_at_bottom(LXPanel *panel);
 extern gboolean panel_is_dynamic(LXPanel *panel);
+extern gboolean panel_is_parked(LXPanel *panel);
 extern GtkWidget *panel_box_new(LXPanel *panel, gboolean homogeneous, gint spacing);
 extern GtkWidget *panel_separator_new(LXPanel *panel);
 
@@ -54,6 +54,20 @@ GQuark lxpanel_plugin_qdata;
 GQuark lxpanel_plugin_qsize;
 static GHashTable *_all_types = NULL;
 
+#define PLUGINS_DIR PACKAGE_LIB_DIR "/lxpanel/plugins"
+
+/* Plugin modules are opened on demand: at startup only types referenced by
+   panel configs are opened, in a separate thread, and the rest of them only
+   when the full list of types is requested. */
+typedef struct {
+    char *type;                 /* NULL marks end of queue */
+    GModule *module;            /* NULL if failed to open */
+} PreloadedModule;
+
+static GAsyncQueue *_preload_queue = NULL;
+static GSList *_loaded_modules = NULL; /* new style modules which are opened */
+static gboolean _all_modules_loaded = FALSE;
+
 /* Dynamic parameter for static (built-in) plugins must be FALSE so we will not try to unload them */
 #define REGISTER_STATIC_PLUGIN_CLASS(pc) \
 do {\
@@ -111,37 +125,53 @@ static void register_plugin_class(PluginClass * pc, gboolean dynamic)
     g_hash_table_insert(_all_types, g_strdup(pc->type), init);
 }
 
-/* Load a dynamic plugin. */
-static void plugin_load_dynamic(const char * type, const gchar * path)
+/* Register a dynamic plugin from already opened module, consumes the module. */
+static void plugin_load_dynamic(const char * type, GModule * m)
 {
     PluginClass * pc = NULL;
+    gpointer tmpsym;
 
-    /* Load the external module. */
-    GModule * m = g_module_open(path, G_MODULE_BIND_LAZY);
-    if (m != NULL)
+    /* New style module, do the same checks as FmModule loader does. */
+    if (g_module_symbol(m, "fm_module_init_lxpanel_gtk", &tmpsym))
     {
-        /* Formulate the name of the expected external variable of type PluginClass. */
-        char class_name[128];
-        g_snprintf(class_name, sizeof(class_name), "%s_plugin_class", type);
-
-        /* Validate that the external variable is of type PluginClass. */
-        gpointer tmpsym;
-        if (( ! g_module_symbol(m, class_name, &tmpsym))	/* Ensure symbol is present */
-        || ((pc = tmpsym) == NULL)
-        || (pc->structure_size != sizeof(PluginClass))		/* Then check versioning information */
-        || (pc->structure_version != PLUGINCLASS_VERSION)
-        || (strcmp(type, pc->type) != 0))			/* Then and only then access other fields; check name */
+        gpointer ver, name;
+
+        if (g_module_symbol(m, "module_lxpanel_gtk_version", &ver)
+            && *(int *)ver != FM_MODULE_lxpanel_gtk_VERSION)
         {
             g_module_close(m);
-            g_warning("%s.so is not a lxpanel plugin", type);
+            g_warning("%s.so has unsupported module version", type);
             return;
         }
+        if (g_module_symbol(m, "module_name", &name))
+            type = name;
+        if (lxpanel_register_plugin_type(type, tmpsym))
+            _loaded_modules = g_slist_prepend(_loaded_modules, m);
+        else
+            g_module_close(m);
+        return;
+    }
 
-        /* Register the newly loaded and valid plugin. */
-        pc->gmodule = m;
-        register_plugin_class(pc, TRUE);
-        pc->count = 1;
+    /* Formulate the name of the expected external variable of type PluginClass. */
+    char class_name[128];
+    g_snprintf(class_name, sizeof(class_name), "%s_plugin_class", type);
+
+    /* Validate that the external variable is of type PluginClass. */
+    if (( ! g_module_symbol(m, class_name, &tmpsym))	/* Ensure symbol is present */
+    || ((pc = tmpsym) == NULL)
+    || (pc->structure_size != sizeof(PluginClass))		/* Then check versioning information */
+    || (pc->structure_version != PLUGINCLASS_VERSION)
+    || (strcmp(type, pc->type) != 0))			/* Then and only then access other fields; check name */
+    {
+        g_module_close(m);
+        g_warning("%s.so is not a lxpanel plugin", type);
+        return;
     }
+
+    /* Register the newly loaded and valid plugin. */
+    pc->gmodule = m;
+    register_plugin_class(pc, TRUE);
+    pc->count = 1;
 }
 
 /* Unreference a dynamic plugin. */
@@ -158,11 +188,11 @@ static void plugin_class_unref(PluginClass * pc)
     }
 }
 
-/* Loads all available old type plugins. Should be removed in future releases. */
+/* Loads all available plugins which aren't loaded yet. */
 static void plugin_get_available_classes(void)
 {
 #ifndef DISABLE_PLUGINS_LOADING
-    GDir * dir = g_dir_open(PACKAGE_LIB_DIR "/lxpanel/plugins", 0, NULL);
+    GDir * dir = g_dir_open(PLUGINS_DIR, 0, NULL);
     if (dir != NULL)
     {
         const char * file;
@@ -174,8 +204,10 @@ static void plugin_get_available_classes(void)
                 if (_find_plugin(type) == NULL)
                 {
                     /* If it has not been loaded, do it.  If successful, add it to the result. */
-                    char * path = g_build_filename(PACKAGE_LIB_DIR "/lxpanel/plugins", file, NULL );
-                    plugin_load_dynamic(type, path);
+                    char * path = g_build_filename(PLUGINS_DIR, file, NULL );
+                    GModule * m = g_module_open(path, G_MODULE_BIND_LAZY);
+                    if (m != NULL)
+                        plugin_load_dynamic(type, m);
                     g_free(path);
                 }
                 g_free(type);
@@ -413,9 +445,132 @@ static gboolean fm_module_callback_lxpanel_gtk(const char *name, gpointer init,
     /* ignore ver for now, only 1 exists */
     return lxpanel_register_plugin_type(name, init);
 }
+
+/* Runs in separate thread: does the file reading and relocation work of
+   dlopen() while main thread continues with startup. */
+static gpointer _preload_thread(gpointer data)
+{
+    char **types = data;
+    PreloadedModule *pm;
+    guint i;
+
+    for (i = 0; types[i] != NULL; i++)
+    {
+        char *path = g_strdup_printf(PLUGINS_DIR "/%s.so", types[i]);
+
+        pm = g_slice_new(PreloadedModule);
+        pm->type = types[i];
+        pm->module = g_module_open(path, G_MODULE_BIND_LAZY);
+        g_free(path);
+        g_async_queue_push(_preload_queue, pm);
+    }
+    g_free(types); /* strings are passed to the main thread */
+    g_async_queue_push(_preload_queue, g_slice_new0(PreloadedModule));
+    return NULL;
+}
+
+/* Registers modules opened by the thread, until type is met or all is done */
+static void _preload_wait(const char *type)
+{
+    PreloadedModule *pm;
+    gboolean found;
+
+    while (_preload_queue != NULL)
+    {
+        pm = g_async_queue_pop(_preload_queue);
+        if (pm->type == NULL)
+        {
+            g_slice_free(PreloadedModule, pm);
+            g_async_queue_unref(_preload_queue);
+            _preload_queue = NULL;
+            break;
+        }
+        found = (type != NULL && strcmp(pm->type, type) == 0);
+        if (pm->module != NULL && _find_plugin(pm->type) == NULL)
+            plugin_load_dynamic(pm->type, pm->module);
+        else if (pm->module != NULL)
+            g_module_close(pm->module);
+        g_free(pm->type);
+        g_slice_free(PreloadedModule, pm);
+        if (found)
+            break;
+    }
+}
+#endif
+
+void _lxpanel_preload_modules(GHashTable *types)
+{
+#ifndef DISABLE_PLUGINS_LOADING
+    GHashTableIter iter;
+    gpointer key;
+    char **list;
+    guint n = 0;
+
+    if (_preload_queue != NULL || _all_modules_loaded)
+        return;
+    list = g_new(char *, g_hash_table_size(types) + 1);
+    g_hash_table_iter_init(&iter, types);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        if (_find_plugin(key) == NULL) /* skip built-in ones */
+            list[n++] = g_strdup(key);
+    list[n] = NULL;
+    if (n == 0)
+    {
+        g_free(list);
+        return;
+    }
+    _preload_queue = g_async_queue_new();
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_thread_unref(g_thread_new("lxpanel-preload", _preload_thread, list));
+#else
+    g_thread_create(_preload_thread, list, FALSE, NULL);
+#endif
+#endif
+}
+
+void _lxpanel_load_all_modules(void)
+{
+    if (_all_modules_loaded)
+        return;
+#ifndef DISABLE_PLUGINS_LOADING
+    _preload_wait(NULL);
+    /* modules installed into libfm modules directory */
+    CHECK_MODULES();
 #endif
+    plugin_get_available_classes();
+    _all_modules_loaded = TRUE;
+}
+
+const LXPanelPluginInit *_lxpanel_find_plugin_type(const char *name)
+{
+    const LXPanelPluginInit *init = _find_plugin(name);
 
-static gboolean old_plugins_loaded = FALSE;
+#ifndef DISABLE_PLUGINS_LOADING
+    if (init != NULL || _all_modules_loaded)
+        return init;
+    /* try the modules opened by the preload thread */
+    _preload_wait(name);
+    init = _find_plugin(name);
+    if (init == NULL)
+    {
+        /* try the module named after type */
+        char *path = g_strdup_printf(PLUGINS_DIR "/%s.so", name);
+        GModule *m = g_module_open(path, G_MODULE_BIND_LAZY);
+
+        g_free(path);
+        if (m != NULL)
+            plugin_load_dynamic(name, m);
+        init = _find_plugin(name);
+    }
+    if (init == NULL)
+    {
+        /* module might be named differently, have to check all of them */
+        _lxpanel_load_all_modules();
+        init = _find_plugin(name);
+    }
+#endif
+    return init;
+}
 
 void lxpanel_prepare_modules(void)
 {
@@ -425,7 +580,8 @@ void lxpanel_prepare_modules(void)
     lxpanel_plugin_qconf = g_quark_from_static_string("LXPanel::plugin-conf");
     lxpanel_plugin_qsize = g_quark_from_static_string("LXPanel::plugin-size");
 #ifndef DISABLE_PLUGINS_LOADING
-    fm_modules_add_directory(PACKAGE_LIB_DIR "/lxpanel/plugins");
+    /* our own directory is not added to libfm, its modules are loaded on
+       demand by _lxpanel_find_plugin_type() */
     fm_module_register_lxpanel_gtk();
 #endif
 }
@@ -435,6 +591,9 @@ void lxpanel_unload_modules(void)
     GHashTableIter iter;
     gpointer key, val;
 
+#ifndef DISABLE_PLUGINS_LOADING
+    _preload_wait(NULL);
+#endif
     g_hash_table_iter_init(&iter, _all_types);
     while(g_hash_table_iter_next(&iter, &key, &val))
     {
@@ -449,7 +608,9 @@ void lxpanel_unload_modules(void)
 #ifndef DISABLE_PLUGINS_LOADING
     fm_module_unregister_type("lxpanel_gtk");
 #endif
-    old_plugins_loaded = FALSE;
+    g_slist_free_full(_loaded_modules, (GDestroyNotify)g_module_close);
+    _loaded_modules = NULL;
+    _all_modules_loaded = FALSE;
 }
 
 gboolean lxpanel_register_plugin_type(const char *name, const LXPanelPluginInit *init)
@@ -530,11 +691,7 @@ GtkWidget *lxpanel_add_plugin(LXPanel *p, const char *name, config_setting_t *cf
     config_setting_t *s, *pconf;
     gint expand, padding = 0, border = 0, i;
 
-    CHECK_MODULES();
-    if (!old_plugins_loaded)
-        plugin_get_available_classes();
-    old_plugins_loaded = TRUE;
-    init = _find_plugin(name);
+    init = _lxpanel_find_plugin_type(name);
     if (init == NULL)
         return NULL;
     /* prepare widget settings */
@@ -560,9 +717,11 @@ GtkWidget *lxpanel_add_plugin(LXPanel *p, const char *name, config_setting_t *cf
         pconf = config_setting_add(s, "Config", PANEL_CONF_TYPE_GROUP);
     /* If this plugin can only be instantiated once, count the instantiation.
      * This causes the configuration system to avoid displaying the plugin as one that can be added. */
+    LXPANEL_TRACE_BEGIN("plugin-new", name);
     if (init->new_instance) /* new style of plugin */
     {
         widget = init->new_instance(p, pconf);
+        LXPANEL_TRACE_END("plugin-new", name);
         if (widget == NULL)
             return widget;
         /* always connect lxpanel_plugin_button_press_event() */
@@ -588,6 +747,7 @@ GtkWidget *lxpanel_add_plugin(LXPanel *p, const char *name, config_setting_t *cf
         if (pc->constructor(pl, &fp))
             widget = pl->pwid;
         g_free(conf);
+        LXPANEL_TRACE_END("plugin-new", name);
 
         if (widget == NULL) /* failed */
         {
@@ -612,6 +772,9 @@ GtkWidget *lxpanel_add_plugin(LXPanel *p, const char *name, config_setting_t *cf
     g_object_set_qdata(G_OBJECT(widget), lxpanel_plugin_qinit, (gpointer)init);
     g_object_set_qdata_full(G_OBJECT(widget), lxpanel_plugin_qsize,
                             g_new0(GdkRectangle, 1), g_free);
+    if (G_UNLIKELY(_lxpanel_trace_enabled))
+        _lxpanel_trace_plugin(widget, name);
+    _lxpanel_control_emit("plugin-added", p->priv->name, name, NULL);
     return widget;
 }
 
@@ -626,8 +789,7 @@ void lxpanel_plugin_set_taskbar_icon (LXPanel *p, GtkWidget *image, const char *
 {
     GdkPixbuf *pixbuf;
 
-    pixbuf = gtk_icon_theme_load_icon (panel_get_icon_theme (p), icon,
-        panel_get_safe_icon_size (p), GTK_ICON_LOOKUP_FORCE_SIZE, NULL);
+    pixbuf = lxpanel_icon_cache_get_for_name (icon, panel_get_safe_icon_size (p), 1, NULL);
     if (pixbuf)
     {
         gtk_image_set_from_pixbuf (GTK_IMAGE (image), pixbuf);
@@ -640,8 +802,8 @@ void lxpanel_plugin_set_menu_icon (LXPanel *p, GtkWidget *image, const char *ico
     GdkPixbuf *pixbuf = NULL;
 
     if (icon)
-        pixbuf = gtk_icon_theme_load_icon (panel_get_icon_theme (p), icon,
-            panel_get_safe_icon_size (p) > 32 ? 24 : 16, GTK_ICON_LOOKUP_FORCE_SIZE, NULL);
+        pixbuf = lxpanel_icon_cache_get_for_name (icon,
+            panel_get_safe_icon_size (p) > 32 ? 24 : 16, 1, NULL);
     if (!pixbuf)
     {
         pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, panel_get_safe_icon_size (p) > 32 ? 24 : 16, 
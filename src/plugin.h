@@ -26,6 +26,7 @@
 #define __PLUGIN_H__ 1
 
 #include <libfm/fm.h>
+#include <X11/Xlib.h>
 
 #include "panel.h"
 #include "conf.h"
@@ -98,9 +99,10 @@ G_BEGIN_DECLS
  * Callback @control is called when command was sent via the lxpanelctl.
  * The message will be sent to only one instance of plugin. Some messages
  * are handled by lxpanel: "DEL" will remove plugin from panel, "ADD"
- * will create new instance if there is no instance yet. Due to design
- * limitations of XClientMessageEvent the size of plugin type and command
- * cannot exceed 18 characters in total.
+ * will create new instance if there is no instance yet. Commands sent via
+ * the control socket have no length limit but due to design limitations of
+ * XClientMessageEvent, which is used if socket is not available, the size
+ * of plugin type and command cannot exceed 18 characters in total.
  *
  * If @gettext_package is not %NULL then it will be used for translation
  * of @name and @description. (Since: 0.9.0)
@@ -392,6 +394,141 @@ extern void lxpanel_plugin_update_menu_icon (GtkWidget *item, GtkWidget *image);
 extern void lxpanel_plugin_append_menu_icon (GtkWidget *item, GtkWidget *image);
 extern const char *lxpanel_plugin_get_menu_label (GtkWidget *item);
 
+/**
+ * lxpanel_icon_cache_get
+ * @icon: icon to load
+ * @size: size in pixels
+ * @scale: scale factor, the pixbuf is created for @size * @scale pixels
+ * @fallback: (allow-none): icon name or file path to use if @icon not found
+ *
+ * Retrieves pixbuf for @icon from process-wide icons cache or loads it
+ * and adds into the cache. Themed icons are looked up in the current icon
+ * theme, other icons are considered files and are scaled to fit @size in
+ * height. The cache has limited size and least recently used icons are
+ * dropped from it when the limit is reached. The cache is cleared every
+ * time the icon theme is changed, therefore callers should connect to the
+ * #GtkIconTheme::changed signal and retrieve icons again if they want to
+ * follow icon theme changes. Returned pixbuf is shared and should not be
+ * modified.
+ *
+ * Returns: (transfer full): pixbuf or %NULL if icon cannot be loaded.
+ *
+ * Since: 0.10.2
+ */
+extern GdkPixbuf *lxpanel_icon_cache_get(FmIcon *icon, gint size, gint scale,
+                                         const char *fallback);
+
+/**
+ * lxpanel_icon_cache_get_for_name
+ * @name: icon name or file path
+ * @size: size in pixels
+ * @scale: scale factor
+ * @fallback: (allow-none): icon name or file path to use if @name not found
+ *
+ * Same as lxpanel_icon_cache_get() but takes name of icon instead.
+ *
+ * Returns: (transfer full): pixbuf or %NULL if icon cannot be loaded.
+ *
+ * Since: 0.10.2
+ */
+extern GdkPixbuf *lxpanel_icon_cache_get_for_name(const char *name, gint size,
+                                                  gint scale, const char *fallback);
+
+/**
+ * lxpanel_icon_cache_lookup
+ * @icon: icon to find
+ * @size: size in pixels
+ * @scale: scale factor
+ * @fallback: (allow-none): fallback as it would be passed to lxpanel_icon_cache_get()
+ *
+ * Checks if pixbuf for @icon is in the icons cache but never loads it.
+ *
+ * Returns: (transfer full): pixbuf or %NULL if icon is not in cache.
+ *
+ * Since: 0.10.2
+ */
+extern GdkPixbuf *lxpanel_icon_cache_lookup(FmIcon *icon, gint size, gint scale,
+                                            const char *fallback);
+
+/**
+ * lxpanel_icon_cache_add
+ * @icon: icon to add
+ * @size: size in pixels
+ * @scale: scale factor
+ * @fallback: (allow-none): fallback as it would be passed to lxpanel_icon_cache_get()
+ * @pixbuf: pixbuf that was loaded for @icon
+ *
+ * Adds pixbuf loaded by the caller (for example, in a worker thread) into
+ * the icons cache so following lxpanel_icon_cache_get() calls can use it.
+ * This function should be called from the main thread only.
+ *
+ * Since: 0.10.2
+ */
+extern void lxpanel_icon_cache_add(FmIcon *icon, gint size, gint scale,
+                                   const char *fallback, GdkPixbuf *pixbuf);
+
+/**
+ * lxpanel_icon_cache_invalidate
+ *
+ * Drops all pixbufs from the icons cache. It is done automatically when the
+ * icon theme is changed.
+ *
+ * Since: 0.10.2
+ */
+extern void lxpanel_icon_cache_invalidate(void);
+
+/**
+ * LXPanelXEventFunc
+ * @xev: the X event
+ * @user_data: data passed to lxpanel_x_event_connect()
+ *
+ * Callback for X events. It is called from GDK event filter therefore it
+ * should return %GDK_FILTER_CONTINUE unless it wants to stop further
+ * processing of the event, including other subscribers.
+ *
+ * Returns: result of filtering.
+ *
+ * Since: 0.10.2
+ */
+typedef GdkFilterReturn (*LXPanelXEventFunc)(XEvent *xev, gpointer user_data);
+
+/**
+ * lxpanel_x_event_connect
+ * @type: X event type, for example %PropertyNotify
+ * @window: window to receive events about, or %None for any window
+ * @atom: atom to receive events for, or %None for any atom
+ * @func: callback
+ * @user_data: data to pass to @func
+ *
+ * Subscribes @func to X events. The panel decodes each event only once and
+ * dispatches it only to callbacks subscribed to it so plugins should use
+ * this API instead of own GDK event filters. The @window is the window
+ * event is about: the destroyed one for %DestroyNotify, the reconfigured
+ * one for %ConfigureNotify, the event window for other core events. The
+ * @atom is the property for %PropertyNotify, message type for
+ * %ClientMessage, selection for %SelectionClear, and should be %None for
+ * other events. Extension events (such as XKB ones) can be subscribed
+ * only with both @window and @atom set to %None. The caller is responsible
+ * for selecting events on the window with XSelectInput().
+ *
+ * Returns: subscription id to use with lxpanel_x_event_disconnect().
+ *
+ * Since: 0.10.2
+ */
+extern guint lxpanel_x_event_connect(int type, Window window, Atom atom,
+                                     LXPanelXEventFunc func, gpointer user_data);
+
+/**
+ * lxpanel_x_event_disconnect
+ * @id: subscription id
+ *
+ * Removes subscription made by lxpanel_x_event_connect(). It is safe to
+ * call it from any #LXPanelXEventFunc callback.
+ *
+ * Since: 0.10.2
+ */
+extern void lxpanel_x_event_disconnect(guint id);
+
 extern void lxpanel_notify_init (LXPanel *panel);
 extern int lxpanel_notify (LXPanel *panel, char *message);
 extern void lxpanel_notify_clear (int seq);
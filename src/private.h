@@ -75,6 +75,11 @@ extern gchar *cprofile;
 
 extern GSList* all_panels;
 
+/* RSS of process in KiB above which parked panels are destroyed, 0 disables
+   parking; set by [Panel] ParkMemoryLimit in global config */
+#define PANEL_PARK_MEMORY_DEFAULT (128 * 1024)
+extern int panel_park_memory_limit;
+
 /* Context of a panel on a given edge. */
 struct _Panel {
     char* name;
@@ -166,6 +171,7 @@ struct _Panel {
     guint initialized : 1;              /* Should be grouped better later, */
     guint ah_far : 1;                   /* placed here for binary compatibility */
     guint ah_state : 3;
+    guint parked : 1;                   /* unmapped since monitor is gone */
     guint background_update_queued;
     guint strut_update_queued;
     guint mouse_timeout;
@@ -245,6 +251,30 @@ void free_global_config(void);
 /* Plugins management - new style */
 void lxpanel_prepare_modules(void);
 void lxpanel_unload_modules(void);
+void _lxpanel_preload_modules(GHashTable *types); /* keys are type names */
+void _lxpanel_load_all_modules(void);
+const LXPanelPluginInit *_lxpanel_find_plugin_type(const char *name);
+
+/* Icons cache */
+void _lxpanel_icon_cache_init(void);
+
+/* Control socket, see lxpanelctl.h; func returns NULL or reason of failure */
+typedef const char *(*LXPanelControlFunc)(int cmd, int monitor, int edge,
+                                          const char *arg1, const char *arg2);
+void _lxpanel_control_init(const char *display, LXPanelControlFunc func);
+void _lxpanel_control_finish(void);
+void _lxpanel_control_emit(const char *event, ...) G_GNUC_NULL_TERMINATED;
+
+/* Tracing into Chrome trace-event file, see trace.c; name should be static */
+extern gboolean _lxpanel_trace_enabled;
+void _lxpanel_trace_init(const char *file);
+void _lxpanel_trace_finish(void);
+void _lxpanel_trace_event(char phase, const char *name, const char *arg);
+void _lxpanel_trace_plugin(GtkWidget *plugin, const char *type);
+#define LXPANEL_TRACE_BEGIN(name, arg) G_STMT_START { \
+    if (G_UNLIKELY(_lxpanel_trace_enabled)) _lxpanel_trace_event('B', name, arg); } G_STMT_END
+#define LXPANEL_TRACE_END(name, arg) G_STMT_START { \
+    if (G_UNLIKELY(_lxpanel_trace_enabled)) _lxpanel_trace_event('E', name, arg); } G_STMT_END
 
 GHashTable *lxpanel_get_all_types(void); /* transfer none */
 void _lxpanel_remove_plugin(LXPanel *p, GtkWidget *plugin); /* no destroy dialog */
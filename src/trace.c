@@ -0,0 +1,332 @@
+/*
+ * Startup and frame tracing for LXPanel.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Events are appended to per-thread buffers without any locking: each thread
+   only writes into its own buffer and publishes the count of events after
+   the event is filled. Buffers are linked into single list with an atomic
+   push and are never freed since other threads may still use them. All the
+   events are written as Chrome trace-event JSON on exit, the file may be
+   opened by chrome://tracing or Perfetto UI. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "private.h"
+
+#define TRACE_BUFFER_SIZE   4096 /* events per buffer */
+#define TRACE_MAX_BUFFERS   512  /* about 64 MiB of events */
+
+typedef struct {
+    gint64 ts;                  /* monotonic time, microseconds */
+    gint64 dur;                 /* duration of 'X' event, microseconds */
+    const char *name;           /* static string */
+    char *arg;                  /* copy of argument or NULL */
+    char phase;                 /* 'B', 'E', or 'X' */
+} TraceEvent;
+
+/* Data attached to each traced plugin widget. */
+typedef struct {
+    const char *name;           /* interned plugin type */
+    gint64 draw_start;          /* start time of current draw, or 0 */
+} TracePlugin;
+
+typedef struct _TraceBuffer TraceBuffer;
+struct _TraceBuffer {
+    TraceBuffer *next;          /* in list of all buffers */
+    gint tid;                   /* sequential thread number */
+    gint n;                     /* number of filled events */
+    TraceEvent events[TRACE_BUFFER_SIZE];
+};
+
+gboolean _lxpanel_trace_enabled = FALSE;
+
+static char *trace_file = NULL;
+static TraceBuffer *trace_buffers = NULL;
+static gint trace_n_buffers = 0;
+static gint trace_n_threads = 0;
+static gint trace_dropped = 0;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static GPrivate trace_current = G_PRIVATE_INIT(NULL);
+#define trace_get_current() g_private_get(&trace_current)
+#define trace_set_current(_b) g_private_set(&trace_current, _b)
+#else
+static GPrivate *trace_current = NULL;
+#define trace_get_current() g_private_get(trace_current)
+#define trace_set_current(_b) g_private_set(trace_current, _b)
+#endif
+
+static GPollFunc trace_poll_func = NULL;
+static gboolean trace_in_dispatch = FALSE;
+static guint trace_draw_id = 0;
+static gulong trace_draw_hook = 0;
+static GQuark trace_qplugin = 0;
+static GHashTable *trace_wrapped_types = NULL; /* types with size-allocate wrapped */
+static GtkWidget *trace_allocating = NULL;
+
+static TraceBuffer *trace_buffer_new(TraceBuffer *prev)
+{
+    TraceBuffer *buf;
+
+    if (g_atomic_int_get(&trace_n_buffers) >= TRACE_MAX_BUFFERS ||
+        g_atomic_int_add(&trace_n_buffers, 1) >= TRACE_MAX_BUFFERS)
+        return NULL;
+    buf = g_malloc(sizeof(TraceBuffer));
+    buf->tid = prev ? prev->tid : g_atomic_int_add(&trace_n_threads, 1) + 1;
+    buf->n = 0;
+    do
+        buf->next = g_atomic_pointer_get(&trace_buffers);
+    while (!g_atomic_pointer_compare_and_exchange(&trace_buffers, buf->next, buf));
+    return buf;
+}
+
+static void trace_add_event(char phase, const char *name, const char *arg,
+                            gint64 ts, gint64 dur)
+{
+    TraceBuffer *buf = trace_get_current();
+    TraceEvent *ev;
+
+    if (buf == NULL || buf->n == TRACE_BUFFER_SIZE)
+    {
+        TraceBuffer *next = trace_buffer_new(buf);
+
+        if (next == NULL)
+        {
+            g_atomic_int_inc(&trace_dropped);
+            return;
+        }
+        trace_set_current(next);
+        buf = next;
+    }
+    ev = &buf->events[buf->n];
+    ev->ts = ts;
+    ev->dur = dur;
+    ev->name = name;
+    ev->arg = g_strdup(arg);
+    ev->phase = phase;
+    /* publish it for the writer */
+    g_atomic_int_set(&buf->n, buf->n + 1);
+}
+
+void _lxpanel_trace_event(char phase, const char *name, const char *arg)
+{
+    trace_add_event(phase, name, arg, g_get_monotonic_time(), 0);
+}
+
+/* Adds span which started at start and ends now. */
+static void trace_complete_event(const char *name, const char *arg, gint64 start)
+{
+    trace_add_event('X', name, arg, start, g_get_monotonic_time() - start);
+}
+
+/* Everything between two polls of the main loop is dispatching. */
+static gint trace_poll(GPollFD *ufds, guint nfds, gint timeout)
+{
+    gint ret;
+
+    if (trace_in_dispatch)
+        _lxpanel_trace_event('E', "main-loop-dispatch", NULL);
+    ret = trace_poll_func(ufds, nfds, timeout);
+    _lxpanel_trace_event('B', "main-loop-dispatch", NULL);
+    trace_in_dispatch = TRUE;
+    return ret;
+}
+
+/* "size-allocate" is a RUN_FIRST signal, the allocation is done by the class
+   handler before anything connected to the signal is called. So the class
+   handler of each plugin widget type is wrapped instead. The wrapper stays
+   after tracing is finished since it cannot be removed. */
+static void trace_size_allocate(GtkWidget *widget, GtkAllocation *alloc)
+{
+    TracePlugin *tp = NULL;
+    GtkWidget *prev = trace_allocating;
+    gint64 start;
+
+    /* the handler may be chained from a wrapper of a subclass */
+    if (_lxpanel_trace_enabled && widget != trace_allocating)
+        tp = g_object_get_qdata(G_OBJECT(widget), trace_qplugin);
+    if (tp == NULL)
+    {
+        g_signal_chain_from_overridden_handler(widget, alloc);
+        return;
+    }
+    trace_allocating = widget;
+    start = g_get_monotonic_time();
+    g_signal_chain_from_overridden_handler(widget, alloc);
+    trace_allocating = prev;
+    trace_complete_event("size-allocate", tp->name, start);
+}
+
+/* "draw" is a RUN_LAST signal so the emission hook is called before any
+   drawing. The span is written by a handler connected after as complete
+   event, so nothing is left open if some handler stops the emission. */
+static gboolean trace_emission_hook(GSignalInvocationHint *ihint,
+                                    guint n_param_values,
+                                    const GValue *param_values,
+                                    gpointer data)
+{
+    GObject *obj = g_value_get_object(&param_values[0]);
+    TracePlugin *tp = g_object_get_qdata(obj, trace_qplugin);
+
+    if (tp != NULL)
+        tp->draw_start = g_get_monotonic_time();
+    return TRUE;
+}
+
+#if GTK_CHECK_VERSION(3, 0, 0)
+static gboolean trace_draw_after(GtkWidget *widget, cairo_t *cr, TracePlugin *tp)
+#else
+static gboolean trace_draw_after(GtkWidget *widget, GdkEventExpose *event, TracePlugin *tp)
+#endif
+{
+    if (tp->draw_start != 0 && _lxpanel_trace_enabled)
+        trace_complete_event("draw", tp->name, tp->draw_start);
+    tp->draw_start = 0;
+    return FALSE;
+}
+
+void _lxpanel_trace_plugin(GtkWidget *plugin, const char *type)
+{
+    TracePlugin *tp = g_new0(TracePlugin, 1);
+    GType gtype = G_OBJECT_TYPE(plugin);
+
+    tp->name = g_intern_string(type);
+    g_object_set_qdata_full(G_OBJECT(plugin), trace_qplugin, tp, g_free);
+    if (!g_hash_table_lookup(trace_wrapped_types, GSIZE_TO_POINTER(gtype)))
+    {
+        g_signal_override_class_handler("size-allocate", gtype,
+                                        G_CALLBACK(trace_size_allocate));
+        g_hash_table_insert(trace_wrapped_types, GSIZE_TO_POINTER(gtype),
+                            GINT_TO_POINTER(1));
+    }
+#if GTK_CHECK_VERSION(3, 0, 0)
+    g_signal_connect_after(plugin, "draw",
+#else
+    g_signal_connect_after(plugin, "expose-event",
+#endif
+                           G_CALLBACK(trace_draw_after), tp);
+}
+
+void _lxpanel_trace_init(const char *file)
+{
+    gpointer klass;
+
+    if (_lxpanel_trace_enabled || file == NULL || file[0] == '\0')
+        return;
+    trace_file = g_strdup(file);
+#if !GLIB_CHECK_VERSION(2, 32, 0)
+    trace_current = g_private_new(NULL);
+#endif
+    trace_qplugin = g_quark_from_static_string("LXPanel::trace-plugin");
+    trace_poll_func = g_main_context_get_poll_func(NULL);
+    g_main_context_set_poll_func(NULL, trace_poll);
+    trace_wrapped_types = g_hash_table_new(g_direct_hash, g_direct_equal);
+    /* signals are not known until the class is created */
+    klass = g_type_class_ref(GTK_TYPE_WIDGET);
+#if GTK_CHECK_VERSION(3, 0, 0)
+    trace_draw_id = g_signal_lookup("draw", GTK_TYPE_WIDGET);
+#else
+    trace_draw_id = g_signal_lookup("expose-event", GTK_TYPE_WIDGET);
+#endif
+    trace_draw_hook = g_signal_add_emission_hook(trace_draw_id, 0,
+                                                 trace_emission_hook, NULL, NULL);
+    g_type_class_unref(klass);
+    _lxpanel_trace_enabled = TRUE;
+    /* exit() may be called from anywhere */
+    atexit(_lxpanel_trace_finish);
+}
+
+static void trace_write_string(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(f, "\\%c", *str);
+        else if ((guchar)*str < 0x20)
+            fprintf(f, "\\u%04x", (guchar)*str);
+        else
+            fputc(*str, f);
+    }
+    fputc('"', f);
+}
+
+void _lxpanel_trace_finish(void)
+{
+    TraceBuffer *buf;
+    FILE *f;
+    int pid = getpid();
+    gint i, n;
+    gboolean first = TRUE;
+
+    if (!_lxpanel_trace_enabled)
+        return;
+    _lxpanel_trace_enabled = FALSE;
+    if (trace_in_dispatch)
+        _lxpanel_trace_event('E', "main-loop-dispatch", NULL);
+    g_main_context_set_poll_func(NULL, trace_poll_func);
+    g_signal_remove_emission_hook(trace_draw_id, trace_draw_hook);
+
+    f = fopen(trace_file, "w");
+    if (f == NULL)
+    {
+        g_warning("lxpanel: cannot write trace into %s", trace_file);
+        return;
+    }
+    fputs("{\"traceEvents\":[\n", f);
+    for (buf = g_atomic_pointer_get(&trace_buffers); buf; buf = buf->next)
+    {
+        n = g_atomic_int_get(&buf->n);
+        for (i = 0; i < n; i++)
+        {
+            TraceEvent *ev = &buf->events[i];
+
+            if (!first)
+                fputs(",\n", f);
+            first = FALSE;
+            fprintf(f, "{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%" G_GINT64_FORMAT ",",
+                    ev->phase, pid, buf->tid, ev->ts);
+            if (ev->phase == 'X')
+                fprintf(f, "\"dur\":%" G_GINT64_FORMAT ",", ev->dur);
+            fputs("\"name\":", f);
+            trace_write_string(f, ev->name);
+            if (ev->arg)
+            {
+                fputs(",\"args\":{\"arg\":", f);
+                trace_write_string(f, ev->arg);
+                fputc('}', f);
+            }
+            fputc('}', f);
+        }
+    }
+    if (!first)
+        fputs(",\n", f);
+    /* thread which started tracing is the main one */
+    fprintf(f, "{\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"name\":\"thread_name\","
+               "\"args\":{\"name\":\"main\"}}\n", pid);
+    fprintf(f, "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%d}}\n",
+            g_atomic_int_get(&trace_dropped));
+    fclose(f);
+}
@@ -0,0 +1,229 @@
+/*
+ * X events router for LXPanel.
+ *
+ * This file is a part of LXPanel project.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gdk/gdkx.h>
+
+#include "private.h"
+
+#include "dbg.h"
+
+/* Single GDK filter is installed for the whole process. Each event is decoded
+   once into (type, window, atom) and subscribers are found in the table by
+   exact key and by keys with window and/or atom set to None, so the cost of
+   an event doesn't depend on how many plugins are interested in other ones. */
+
+typedef struct {
+    int type;
+    Window window;
+    Atom atom;
+} XEventKey;
+
+typedef struct {
+    XEventKey key;
+    LXPanelXEventFunc func;     /* NULL if disconnected during dispatch */
+    gpointer user_data;
+    guint id;
+} XEventSubscriber;
+
+static GHashTable *x_event_table = NULL; /* XEventKey -> GList of XEventSubscriber */
+static GHashTable *x_event_ids = NULL; /* id -> XEventSubscriber */
+static guint x_event_last_id = 0;
+static guint x_event_dispatching = 0;
+static GSList *x_event_dead = NULL; /* disconnected while dispatching */
+static gboolean x_event_filter_installed = FALSE;
+
+static guint x_event_key_hash(gconstpointer p)
+{
+    const XEventKey *key = p;
+
+    return (guint)key->type ^ (guint)(key->window * 31) ^ (guint)(key->atom << 8);
+}
+
+static gboolean x_event_key_equal(gconstpointer a, gconstpointer b)
+{
+    const XEventKey *ka = a, *kb = b;
+
+    return ka->type == kb->type && ka->window == kb->window && ka->atom == kb->atom;
+}
+
+/* the window is the one event is about, not the one it was selected on */
+static void x_event_decode(XEvent *xev, XEventKey *key)
+{
+    key->type = xev->type;
+    key->window = None;
+    key->atom = None;
+    switch (xev->type)
+    {
+    case PropertyNotify:
+        key->window = xev->xproperty.window;
+        key->atom = xev->xproperty.atom;
+        break;
+    case ClientMessage:
+        key->window = xev->xclient.window;
+        key->atom = xev->xclient.message_type;
+        break;
+    case SelectionClear:
+        key->window = xev->xselectionclear.window;
+        key->atom = xev->xselectionclear.selection;
+        break;
+    case DestroyNotify:
+        key->window = xev->xdestroywindow.window;
+        break;
+    case ConfigureNotify:
+        key->window = xev->xconfigure.window;
+        break;
+    default:
+        /* extension events may have no window field at all */
+        if (xev->type < LASTEvent)
+            key->window = xev->xany.window;
+    }
+}
+
+static GdkFilterReturn x_event_filter(GdkXEvent *xevent, GdkEvent *event, gpointer unused)
+{
+    XEvent *xev = (XEvent *)xevent;
+    XEventKey keys[4];
+    GPtrArray *matched = NULL;
+    GdkFilterReturn ret = GDK_FILTER_CONTINUE;
+    guint i, n_keys;
+    GList *l;
+
+    x_event_decode(xev, &keys[0]);
+    n_keys = 1;
+    if (keys[0].atom != None)
+    {
+        keys[n_keys] = keys[0];
+        keys[n_keys++].atom = None;
+    }
+    if (keys[0].window != None)
+    {
+        keys[n_keys] = keys[0];
+        keys[n_keys++].window = None;
+        if (keys[0].atom != None)
+        {
+            keys[n_keys] = keys[n_keys - 1];
+            keys[n_keys++].atom = None;
+        }
+    }
+
+    /* collect first since callbacks may change subscriptions */
+    for (i = 0; i < n_keys; i++)
+        for (l = g_hash_table_lookup(x_event_table, &keys[i]); l; l = l->next)
+        {
+            if (matched == NULL)
+                matched = g_ptr_array_sized_new(4);
+            g_ptr_array_add(matched, l->data);
+        }
+    if (matched == NULL)
+        return GDK_FILTER_CONTINUE;
+
+    x_event_dispatching++;
+    for (i = 0; i < matched->len && ret == GDK_FILTER_CONTINUE; i++)
+    {
+        XEventSubscriber *sub = g_ptr_array_index(matched, i);
+
+        if (sub->func != NULL)
+            ret = sub->func(xev, sub->user_data);
+    }
+    x_event_dispatching--;
+    g_ptr_array_free(matched, TRUE);
+
+    if (x_event_dispatching == 0)
+    {
+        g_slist_free_full(x_event_dead, g_free);
+        x_event_dead = NULL;
+    }
+    return ret;
+}
+
+guint lxpanel_x_event_connect(int type, Window window, Atom atom,
+                              LXPanelXEventFunc func, gpointer user_data)
+{
+    XEventSubscriber *sub;
+    GList *list;
+
+    g_return_val_if_fail(func != NULL, 0);
+
+    if (x_event_table == NULL)
+    {
+        x_event_table = g_hash_table_new(x_event_key_hash, x_event_key_equal);
+        x_event_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+    if (!x_event_filter_installed)
+    {
+        gdk_window_add_filter(NULL, x_event_filter, NULL);
+        x_event_filter_installed = TRUE;
+    }
+
+    sub = g_new(XEventSubscriber, 1);
+    sub->key.type = type;
+    sub->key.window = window;
+    sub->key.atom = atom;
+    sub->func = func;
+    sub->user_data = user_data;
+    if (++x_event_last_id == 0) /* wrapped around */
+        ++x_event_last_id;
+    sub->id = x_event_last_id;
+
+    /* keys are owned by subscribers, replace key with one from the list head */
+    list = g_hash_table_lookup(x_event_table, &sub->key);
+    list = g_list_append(list, sub);
+    g_hash_table_replace(x_event_table, &((XEventSubscriber *)list->data)->key, list);
+    g_hash_table_insert(x_event_ids, GUINT_TO_POINTER(sub->id), sub);
+    return sub->id;
+}
+
+void lxpanel_x_event_disconnect(guint id)
+{
+    XEventSubscriber *sub;
+    GList *list;
+
+    if (x_event_ids == NULL || id == 0)
+        return;
+    sub = g_hash_table_lookup(x_event_ids, GUINT_TO_POINTER(id));
+    g_return_if_fail(sub != NULL);
+
+    g_hash_table_remove(x_event_ids, GUINT_TO_POINTER(id));
+    list = g_hash_table_lookup(x_event_table, &sub->key);
+    list = g_list_remove(list, sub);
+    /* the key in the table may belong to this subscriber, replace it */
+    g_hash_table_remove(x_event_table, &sub->key);
+    if (list != NULL)
+        g_hash_table_insert(x_event_table, &((XEventSubscriber *)list->data)->key, list);
+
+    if (x_event_dispatching > 0)
+    {
+        sub->func = NULL;
+        x_event_dead = g_slist_prepend(x_event_dead, sub);
+    }
+    else
+        g_free(sub);
+
+    /* GDK may be iterating over filters now so keep it until next time */
+    if (g_hash_table_size(x_event_ids) == 0 && x_event_dispatching == 0)
+    {
+        gdk_window_remove_filter(NULL, x_event_filter, NULL);
+        x_event_filter_installed = FALSE;
+    }
+}